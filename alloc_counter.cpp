@@ -0,0 +1,84 @@
+// --- START OF FILE alloc_counter.cpp ---
+
+#include "alloc_counter.h"
+
+#if ALLOC_COUNT_ENABLED
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t t_allocation_count = 0;
+
+uint64_t thread_allocation_count()
+{
+    return t_allocation_count;
+}
+
+static void* counted_alloc(std::size_t size)
+{
+    t_allocation_count++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    t_allocation_count++;
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    t_allocation_count++;
+    return std::malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+AllocationProbe::AllocationProbe(const char* name)
+    : m_name(name)
+{
+}
+
+void AllocationProbe::frame_done()
+{
+    m_frames++;
+    if (m_frames == ALLOC_COUNT_WARMUP_FRAMES) {
+        m_baseline = thread_allocation_count();
+        return;
+    }
+    if (m_frames < ALLOC_COUNT_WARMUP_FRAMES ||
+        (m_frames - ALLOC_COUNT_WARMUP_FRAMES) % ALLOC_COUNT_REPORT_FRAMES != 0) {
+        return;
+    }
+
+    const uint64_t now = thread_allocation_count();
+    const uint64_t allocs = now - m_baseline;
+    m_baseline = now;
+    if (allocs == 0) {
+        if (!m_alloc_free) {
+            fprintf(stderr, "[分配计数] %s: 已恢复为每帧零分配\n", m_name);
+        } else if (m_frames == ALLOC_COUNT_WARMUP_FRAMES + ALLOC_COUNT_REPORT_FRAMES) {
+            fprintf(stderr, "[分配计数] %s: 预热后 %d 帧内零分配\n", m_name, ALLOC_COUNT_REPORT_FRAMES);
+        }
+        m_alloc_free = true;
+    } else {
+        const double per_frame = (double)allocs / ALLOC_COUNT_REPORT_FRAMES;
+        if (ALLOC_COUNT_ENFORCE && per_frame > ALLOC_COUNT_MAX_PER_FRAME) {
+            fprintf(stderr, "[分配计数] 错误: %s 在 %d 帧内分配了 %llu 次 (%.2f 次/帧)，超过上限 %.2f 次/帧\n",
+                    m_name, ALLOC_COUNT_REPORT_FRAMES, (unsigned long long)allocs, per_frame,
+                    (double)ALLOC_COUNT_MAX_PER_FRAME);
+            abort();
+        }
+        fprintf(stderr, "[分配计数] 警告: %s 在 %d 帧内分配了 %llu 次 (%.2f 次/帧)\n", m_name,
+                ALLOC_COUNT_REPORT_FRAMES, (unsigned long long)allocs, per_frame);
+        m_alloc_free = false;
+    }
+}
+
+#endif // ALLOC_COUNT_ENABLED
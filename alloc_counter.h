@@ -0,0 +1,55 @@
+// --- START OF FILE alloc_counter.h ---
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+#include "app_config.h"
+
+/**
+ * @file alloc_counter.h
+ * @brief 分配计数模式 (make ALLOC_COUNT=1)：验证流水线线程在预热后每帧没有堆分配。
+ *
+ * 开启后替换全局 operator new/delete，按线程统计分配次数。每个流水线线程在循环中
+ * 每处理一帧 (或一个数据包) 调用一次 AllocationProbe::frame_done()：前
+ * ALLOC_COUNT_WARMUP_FRAMES 帧为预热，之后每 ALLOC_COUNT_REPORT_FRAMES 帧打印一次
+ * 平均每帧的分配次数，非零时给出警告。ALLOC_COUNT_ENFORCE 开启时 (make alloc_check)，
+ * 窗口内平均每帧超过 ALLOC_COUNT_MAX_PER_FRAME 次即打印线程名并 abort，用于在设备上做回归检查。
+ * 只统计 C++ 堆分配；FFmpeg 内部的 av_malloc (编码器、AVBufferRef 等) 不在统计范围内。
+ * 分段切换、遥测样本等低频事件的分配会计入所在的统计窗口。
+ *
+ * 未开启时 AllocationProbe 为空操作，不影响正常构建。
+ */
+
+#if ALLOC_COUNT_ENABLED
+
+// 当前线程累计的 operator new 次数
+uint64_t thread_allocation_count();
+
+class AllocationProbe
+{
+public:
+    explicit AllocationProbe(const char* name);
+
+    void frame_done();
+
+private:
+    const char* m_name;
+    uint64_t m_frames = 0;
+    uint64_t m_baseline = 0;
+    bool m_alloc_free = true;
+};
+
+#else
+
+class AllocationProbe
+{
+public:
+    explicit AllocationProbe(const char*) {}
+    void frame_done() {}
+};
+
+#endif // ALLOC_COUNT_ENABLED
+
+#endif // ALLOC_COUNTER_H
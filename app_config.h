@@ -13,8 +13,28 @@
 // ======================================================================
 // 视频和照片的临时存储路径 (建议使用 /tmp，通常是内存文件系统，速度快)
 #define TEMP_STORAGE_PATH   "/tmp/"
+// 录像分段的临时目录，只存放 Recorder 写出的分段和索引；启动时的录像恢复只扫描这个目录。
+// 默认在 /tmp (tmpfs) 下，重启或断电后内容丢失，只能恢复进程崩溃时中断的录像；
+// 需要在断电后恢复时，改为存储卡等持久存储上的目录
+#define RECORDING_TEMP_PATH TEMP_STORAGE_PATH "recording/"
 // 视频和照片的最终存储路径 (例如 SD 卡挂载点)
 #define FINAL_STORAGE_PATH  "/mnt/sdcard/"
+// 录像占用的空间上限 (字节)，0 表示使用整张存储卡 (扣除 STORAGE_RESERVED_BYTES)
+#define STORAGE_QUOTA_BYTES             0ULL
+// 存储卡上始终保留的剩余空间，留给照片和文件系统
+#define STORAGE_RESERVED_BYTES          (64ULL * 1024 * 1024)
+// 淘汰时额外腾出的余量 (应大于一个分段的大小)，新分段写入时无需等待淘汰
+#define STORAGE_EVICTION_HEADROOM_BYTES (512ULL * 1024 * 1024)
+// 后台检查存储空间的间隔 (毫秒)
+#define STORAGE_CHECK_INTERVAL_MS       5000
+// 锁定文件 (事件片段) 的标记文件后缀，例如 20240101120000.mp4.lock
+#define STORAGE_LOCK_SUFFIX             ".lock"
+// 片段导出线程的 nice 值 (19 为最低 CPU 优先级)；I/O 优先级固定为 idle
+#define CLIP_EXPORT_NICE                19
+// 启动时是否恢复 RECORDING_TEMP_PATH 中未正常结束的录像 (1 开启, 0 关闭)；恢复线程同样以最低优先级运行
+#define RECOVERY_ENABLED                1
+// 无法恢复的录像改名追加的后缀，保留在临时目录中，下次启动不再重试
+#define RECOVERY_DAMAGED_SUFFIX         ".damaged"
 
 
 // ======================================================================
@@ -23,37 +43,167 @@
 // V4L2 摄像头设备期望的原始输入分辨率
 #define V4L2_INPUT_WIDTH    2112
 #define V4L2_INPUT_HEIGHT   1568
-// FFmpeg H.264 硬件编码器名称 (用于录制和推流)
-#define H264_ENCODER_NAME "h264_rkmpp"
+// V4L2 摄像头的采集帧率
+#define V4L2_INPUT_FPS      30
+// FFmpeg H.264 编码器候选列表 (用于录制和推流)，逗号分隔，按顺序尝试:
+// 硬件编码器不存在或被占用时回退到软件编码器
+#define H264_ENCODER_NAME "h264_rkmpp,libx264,libopenh264"
+// FFmpeg HEVC (H.265) 编码器候选列表，硬件不可用时回退到 libx265
+#define HEVC_ENCODER_NAME "hevc_rkmpp,libx265"
+// 设置这些环境变量可在运行时覆盖编码器候选列表 (例如在 x86 构建服务器上: CAMERA_SDK_H264_ENCODER=libx264)
+#define H264_ENCODER_OVERRIDE_ENV "CAMERA_SDK_H264_ENCODER"
+#define HEVC_ENCODER_OVERRIDE_ENV "CAMERA_SDK_HEVC_ENCODER"
+// 软件编码器线程数 (0 表示按 CPU 核数自动选择)
+#define SW_ENCODER_THREADS 0
+// 软件编码器 (libx264) 录制用参数：画质优先
+#define SW_ENCODER_PRESET_RECORDING   "faster"
+#define SW_ENCODER_TUNE_RECORDING     "film"
+// 软件编码器 (libx264) 推流用参数：低延迟
+#define SW_ENCODER_PRESET_LOW_LATENCY "veryfast"
+#define SW_ENCODER_TUNE_LOW_LATENCY   "zerolatency"
+// 每次 放大/缩小 步进的平滑过渡时长 (毫秒)
+#define ZOOM_STEP_DURATION_MS 100
 
 
 // ======================================================================
 // =                         视频录制 (Recording) 配置                  =
 // ======================================================================
-// 录制视频文件时使用的编码器
-#define RECORDER_ENCODER_NAME H264_ENCODER_NAME
+// 录制视频文件时默认的编码格式 ("h264" 或 "hevc")，可通过 camera_sdk_set_recording_codec 修改
+#define RECORDER_DEFAULT_CODEC "h264"
 // 录制高分辨率视频 (>=720p) 的比特率
 #define RECORDER_BITRATE_HIGH 8000000 // 8 Mbps
 // 录制低分辨率视频 (<720p) 的比特率
 #define RECORDER_BITRATE_LOW  4000000 // 4 Mbps
+// HEVC 录制的比特率 (同等画质约为 H.264 的一半)
+#define RECORDER_HEVC_BITRATE_HIGH 4000000 // 4 Mbps
+#define RECORDER_HEVC_BITRATE_LOW  2000000 // 2 Mbps
 // 录制视频的GOP (Group of Pictures) 大小
 #define RECORDER_GOP_SIZE 50
+// 延时摄影的播放帧率 (抽取的帧以该帧率连续排列)
+#define TIMELAPSE_OUTPUT_FPS 30
+// 延时摄影开启运动模糊时，每个输出帧最多平均的采集帧数 (取抽帧点之前的连续帧)
+#define TIMELAPSE_BLEND_FRAMES 8
+// 循环录制的分段时长 (秒)，到时后在下一个关键帧切换到新文件；0 表示不分段
+#define RECORDER_SEGMENT_SECONDS 60
 
 
 // ======================================================================
 // =                         RTSP 推流 (Streaming) 配置                 =
 // ======================================================================
-// RTSP推流时使用的编码器
-#define RTSP_ENCODER_NAME   H264_ENCODER_NAME
+// RTSP推流时默认的编码格式 ("h264" 或 "hevc")，可通过 camera_sdk_set_streaming_codec 修改
+#define RTSP_DEFAULT_CODEC  "h264"
 // RTSP推流的目标分辨率
 #define RTSP_OUTPUT_WIDTH   1920
 #define RTSP_OUTPUT_HEIGHT  1080
 // RTSP推流的比特率
 #define RTSP_BITRATE        4000000 // 4 Mbps
+// HEVC 推流的比特率
+#define RTSP_HEVC_BITRATE   2000000 // 2 Mbps
 // RTSP推流的GOP大小
 #define RTSP_GOP_SIZE       30
 // RTSP推流使用的传输协议 ("udp" 或 "tcp")
 #define RTSP_TRANSPORT      "udp"
+// 子码流 (例如电视墙宫格) 的默认分辨率与帧率；与主码流同时启动时共用采集和裁剪
+#define RTSP_SUBSTREAM_WIDTH    640
+#define RTSP_SUBSTREAM_HEIGHT   360
+#define RTSP_SUBSTREAM_FPS      10
+// 按面积/帧率缩放默认码率时的下限
+#define RTSP_MIN_BITRATE        200000 // 200 kbps
+// 推流连接中断后自动重连 (1 开启, 0 关闭)；重连期间编码链保持运行
+#define RTSP_RECONNECT_ENABLED      1
+// 重连的初始等待和最长等待 (毫秒)，每次失败翻倍
+#define RTSP_RECONNECT_INITIAL_MS   500
+#define RTSP_RECONNECT_MAX_MS       10000
+// RTSP 推流套接字的读写超时 (微秒)，超时视为连接中断
+#define RTSP_SOCKET_TIMEOUT_US      5000000
+// 同一路推流推送到多个目的地址 (主/备服务器) 时，每个目的地址发送队列的上限 (数据包数)；
+// 超过时丢弃该目的地址的积压并从下一个关键帧继续，不影响其他目的地址
+#define RTSP_DESTINATION_MAX_QUEUED 60
+// RTSP 输出默认使用帧内刷新代替周期 IDR (1 开启, 0 关闭)，可通过 set_streaming_intra_refresh 修改
+#define RTSP_INTRA_REFRESH          0
+// 内置 RTSP 服务器为新客户端 (或丢帧后恢复的客户端) 请求 IDR 的最小间隔 (毫秒)，避免频繁加入时连续出现大帧
+#define RTSP_KEYFRAME_REQUEST_MIN_MS 1000
+// 录制/推流默认每帧插入时延测量 SEI (1 开启, 0 关闭)，可通过 camera_sdk_set_latency_sei 修改；
+// 接收端用 tools/latency_meter 统计端到端时延
+#define LATENCY_SEI_ENABLED     0
+// 推流拥塞自适应 (1 开启, 0 关闭)：按发送耗时和发送队列积压逐级降低码率、帧率、分辨率，恢复后逐级升回
+#define RTSP_ADAPTIVE_ENABLED   1
+// 拥塞判断的统计窗口 (毫秒)
+#define RTSP_ADAPT_WINDOW_MS    1000
+// 窗口内发送耗时占比超过 BUSY_HIGH，或队列积压超过 BACKLOG_HIGH 个数据包视为拥塞
+#define RTSP_ADAPT_BUSY_HIGH    0.7
+#define RTSP_ADAPT_BACKLOG_HIGH 15
+// 发送耗时占比低于 BUSY_LOW 且积压不超过 BACKLOG_LOW 视为空闲
+#define RTSP_ADAPT_BUSY_LOW     0.3
+#define RTSP_ADAPT_BACKLOG_LOW  2
+// 切换档位后等待新参数生效的时间 (毫秒)，期间不再切换
+#define RTSP_ADAPT_SETTLE_MS    2000
+// 连续空闲这么久才升一档 (毫秒)
+#define RTSP_ADAPT_UP_HOLD_MS   10000
+// 降帧率、降分辨率的下限
+#define RTSP_ADAPT_MIN_FPS      10
+#define RTSP_ADAPT_MIN_WIDTH    320
+
+// 内置 RTSP 服务器 (客户端直接拉流 rtsp://<设备IP>:端口/live) 的默认端口
+#define RTSP_SERVER_PORT            8554
+// 内置 RTSP 服务器同时连接的客户端上限
+#define RTSP_SERVER_MAX_CLIENTS     16
+// 会话超时 (秒)：期间没有收到 RTSP 请求或 RTCP 报告的客户端被断开
+#define RTSP_SERVER_SESSION_TIMEOUT 60
+// RTP over UDP 共用发送套接字的发送缓冲区大小 (字节)
+#define RTSP_SERVER_UDP_SNDBUF      (1024 * 1024)
+// RTP 包负载的最大字节数，超过的 NAL 分片发送 (保持在常见 MTU 1500 以内)
+#define RTP_MAX_PAYLOAD             1400
+// RTP 打包缓冲区池中保留的帧数
+#define RTP_FRAME_POOL_SIZE         8
+// RTP over UDP 的发送方式：0 逐包 sendto，1 每帧一次 sendmmsg，2 sendmmsg + UDP GSO
+// (内核或网卡不支持 GSO 时自动退回 1)；用 tools/rtp_send_bench 对比各方式的开销
+#define RTP_UDP_SEND_MODE           2
+// 一个 UDP GSO 报文最多合并的 RTP 包个数 (内核上限为 64)
+#define RTP_UDP_GSO_MAX_SEGMENTS    64
+
+// LL-HLS (CMAF) 输出的默认目录，由任意静态 HTTP 服务器提供给浏览器；建议放在 tmpfs 上，避免存储卡磨损
+#define HLS_OUTPUT_DIR              "/tmp/hls"
+// 默认部分分段 (EXT-X-PART) 时长 (毫秒)，按帧数取整
+#define HLS_PART_DURATION_MS        200
+// 分段目标时长 (毫秒)，到时后在下一个关键帧切分
+#define HLS_SEGMENT_DURATION_MS     2000
+// 播放列表中的分段个数，更早的分段从磁盘删除
+#define HLS_PLAYLIST_SEGMENTS       6
+// 列出部分分段的最近分段个数 (含正在写的分段)
+#define HLS_PART_SEGMENTS           3
+// 写入队列积压超过这么多数据包时丢弃积压，从下一个关键帧继续
+#define HLS_MAX_QUEUED_PACKETS      90
+
+
+// ======================================================================
+// =                         共享编码 (Encode-once) 配置                =
+// ======================================================================
+// 录制与推流分辨率、编码器相同时，是否共用一条 裁剪+OSD+编码 链 (1 开启, 0 关闭)
+// 共用时码率与 GOP 沿用先启动的一方
+#define ENCODE_SHARING_ENABLED 1
+// 多路输出时，RGA 缩放的输出是否保持为 DRM_PRIME 硬件帧直接送给硬件编码器 (1 开启, 0 关闭)。
+// 省去每帧一次的 hwdownload 整帧拷贝；编码器不接受硬件帧时自动回退到下载为 NV12
+#define HW_FRAMES_PATH_ENABLED 1
+// 设置为 "0" 时在运行时关闭硬件帧直通，与下载路径对比测试
+#define HW_FRAMES_OVERRIDE_ENV "CAMERA_SDK_HW_FRAMES"
+// 帧/数据包空壳池中最多缓存的空闲对象数 (见 media_pool.h)，超出时直接释放
+#define MEDIA_POOL_MAX_FREE 32
+// 分配计数模式：统计各流水线线程每帧的堆分配次数 (见 alloc_counter.h)，用 make ALLOC_COUNT=1 开启
+#ifndef ALLOC_COUNT_ENABLED
+#define ALLOC_COUNT_ENABLED 0
+#endif
+// 分配计数模式下，前若干帧视为预热 (池、队列扩容)，之后每隔若干帧报告一次
+#define ALLOC_COUNT_WARMUP_FRAMES 300
+#define ALLOC_COUNT_REPORT_FRAMES 300
+// 强制检查 (make ALLOC_COUNT=2 或 make alloc_check)：预热后某个统计窗口内平均每帧的分配次数
+// 超过上限时 abort。按窗口平均，分段切换等低频事件的少量分配不会触发；逐帧分配至少为 1 次/帧
+#ifndef ALLOC_COUNT_ENFORCE
+#define ALLOC_COUNT_ENFORCE 0
+#endif
+#ifndef ALLOC_COUNT_MAX_PER_FRAME
+#define ALLOC_COUNT_MAX_PER_FRAME 0.1
+#endif
 
 
 // ======================================================================
@@ -66,6 +216,8 @@
 #define OSD_FONT_SIZE       36
 // OSD 字体文件的绝对路径 (请确保此路径在目标系统上有效)
 #define OSD_FONT_PATH       "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+// 遥测 (GPS/速度) 元数据的间隔 (毫秒)：录像中字幕轨的样本间隔、推流中 SEI 的插入间隔
+#define TELEMETRY_INTERVAL_MS 1000
 
 
 // ======================================================================
@@ -75,5 +227,18 @@
 #define JPEG_OUTPUT_WIDTH   1920
 #define JPEG_OUTPUT_HEIGHT  1080
 
+// 内置 MJPEG over HTTP 预览 (浏览器打开 http://<设备IP>:端口/) 的默认端口
+#define MJPEG_PREVIEW_PORT          8080
+// 预览画面的分辨率和帧率 (采集线程按 V4L2_INPUT_FPS / MJPEG_PREVIEW_FPS 抽帧)
+#define MJPEG_PREVIEW_WIDTH         640
+#define MJPEG_PREVIEW_HEIGHT        360
+#define MJPEG_PREVIEW_FPS           5
+// 预览 JPEG 的量化参数 (2~31，越小质量越高、图片越大)
+#define MJPEG_PREVIEW_QSCALE        8
+// 同时观看预览的客户端上限
+#define MJPEG_PREVIEW_MAX_CLIENTS   4
+// 客户端连续这么久收不下数据就断开 (毫秒)
+#define MJPEG_PREVIEW_STALL_TIMEOUT_MS 5000
+
 #endif // APP_CONFIG_H
 
@@ -3,9 +3,12 @@
 #include "camera_capture.h"
 #include "app_config.h"
 #include "zoom_manager.h"
+#include "media_pool.h"
+#include "alloc_counter.h"
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 extern "C" {
 #include <libavutil/avutil.h>
@@ -67,8 +70,8 @@ void CameraCapture::stop() {
 
     {
         std::lock_guard<std::mutex> lock(m_consumer_mutex);
-        for (auto* q : m_consumers) {
-            q->stop();
+        for (auto& c : m_consumers) {
+            c.queue->stop();
         }
     }
 
@@ -99,7 +102,7 @@ bool CameraCapture::initialize_ffmpeg() {
     snprintf(video_size_str, sizeof(video_size_str), "%dx%d", V4L2_INPUT_WIDTH, V4L2_INPUT_HEIGHT);
     
     av_dict_set(&opts, "input_format", "nv12", 0); 
-    av_dict_set(&opts, "framerate", "30", 0);
+    av_dict_set_int(&opts, "framerate", V4L2_INPUT_FPS, 0);
     av_dict_set(&opts, "video_size", video_size_str, 0);
 
     const AVInputFormat* iformat = av_find_input_format("v4l2");
@@ -155,21 +158,17 @@ void CameraCapture::cleanup_ffmpeg() {
 void CameraCapture::capture_loop() {
     fprintf(stderr, "[CaptureLoop] 采集线程启动。\n");
     AVPacket* pkt = av_packet_alloc();
-    AVFrame* raw_frame = av_frame_alloc();
+    AllocationProbe alloc_probe("CaptureLoop");
     int ret = 0;
 
-    if (!pkt || !raw_frame) {
-        fprintf(stderr, "[CaptureLoop] 错误: 无法分配 pkt 或 frame\n");
+    if (!pkt) {
+        fprintf(stderr, "[CaptureLoop] 错误: 无法分配 pkt\n");
         m_stop_flag = true;
     }
 
-    raw_frame->width = m_input_codec_ctx->width;
-    raw_frame->height = m_input_codec_ctx->height;
-    raw_frame->format = m_input_codec_ctx->pix_fmt;
-    if (av_frame_get_buffer(raw_frame, 0) < 0) {
-        fprintf(stderr, "[CaptureLoop] 错误: 无法为原始帧分配缓冲区\n");
-        m_stop_flag = true;
-    }
+    // 每帧从帧池取一块独立的缓冲区：下游仍持有的帧不会被下一帧覆盖，
+    // 缓冲区在所有消费者释放后自动回到池中
+    FramePool frame_pool(m_input_codec_ctx->pix_fmt, m_input_codec_ctx->width, m_input_codec_ctx->height);
 
     while (!m_stop_flag) {
         ret = av_read_frame(m_ifmt_ctx, pkt);
@@ -178,6 +177,13 @@ void CameraCapture::capture_loop() {
             break;
         }
 
+        AVFramePtr raw_frame = frame_pool.acquire();
+        if (!raw_frame) {
+            fprintf(stderr, "[CaptureLoop] 错误: 无法为原始帧分配缓冲区\n");
+            av_packet_unref(pkt);
+            break;
+        }
+
         uint8_t *src_data[4] = { nullptr };
         int src_linesize[4] = { 0 };
 
@@ -195,19 +201,16 @@ void CameraCapture::capture_loop() {
 
         if (m_first_pts == AV_NOPTS_VALUE) {
             m_first_pts = pkt->pts;
+            m_clock_origin_us = ZoomManager::now_us();
         }
         raw_frame->pts = (pkt->pts != AV_NOPTS_VALUE) ? (pkt->pts - m_first_pts) : 0;
         if (raw_frame->pts < 0) raw_frame->pts = 0;
         
         {
+            // 拍照与流水线共享同一帧 (只读)
             std::lock_guard<std::mutex> lock(m_request_mutex);
             if (!m_single_frame_requests.empty()) {
-                AVFrame* frame_for_request = av_frame_clone(raw_frame);
-                if (frame_for_request) {
-                    m_single_frame_requests.front().set_value(make_avframe_ptr(frame_for_request));
-                } else {
-                    m_single_frame_requests.front().set_value(nullptr);
-                }
+                m_single_frame_requests.front().set_value(raw_frame);
                 m_single_frame_requests.pop_front();
             }
         }
@@ -215,15 +218,15 @@ void CameraCapture::capture_loop() {
         fan_out_frame(raw_frame);
         
         av_packet_unref(pkt);
+        alloc_probe.frame_done();
     }
 
     av_packet_free(&pkt);
-    av_frame_free(&raw_frame);
     
     {
         std::lock_guard<std::mutex> lock(m_consumer_mutex);
-        for (auto* q : m_consumers) {
-            q->stop();
+        for (auto& c : m_consumers) {
+            c.queue->stop();
         }
     }
     
@@ -238,23 +241,16 @@ void CameraCapture::capture_loop() {
     fprintf(stderr, "[CaptureLoop] 采集线程退出。\n");
 }
 
-void CameraCapture::fan_out_frame(AVFrame* frame) {
+void CameraCapture::fan_out_frame(const AVFramePtr& frame) {
     std::lock_guard<std::mutex> lock(m_consumer_mutex);
 
-    if (m_consumers.empty()) {
-        return;
-    }
-
-    AVFrame* frame_to_distribute = av_frame_clone(frame);
-    if (!frame_to_distribute) {
-        fprintf(stderr, "[CameraCapture] 错误: av_frame_clone 失败，无法分发帧。\n");
-        return;
-    }
-    
-    AVFramePtr frame_ptr = make_avframe_ptr(frame_to_distribute);
-
-    for (auto* consumer_queue : m_consumers) {
-        consumer_queue->push(frame_ptr);
+    // 延时摄影的消费者只在每组的最后 window 帧收到数据，被跳过的帧不做任何处理
+    for (auto& c : m_consumers) {
+        const int64_t phase = c.counter++ % c.interval;
+        if (phase < c.interval - c.window) {
+            continue;
+        }
+        c.queue->push(frame);
     }
 }
 
@@ -268,18 +264,20 @@ std::future<AVFramePtr> CameraCapture::request_single_frame() {
     return future;
 }
 
-void CameraCapture::register_consumer(ThreadSafeFrameQueue* consumer_queue) {
+void CameraCapture::register_consumer(ThreadSafeFrameQueue* consumer_queue, int interval, int window) {
     if (!consumer_queue) return;
+    interval = std::max(interval, 1);
+    window = std::max(1, std::min(window, interval));
     
     std::lock_guard<std::mutex> lock(m_consumer_mutex);
-    m_consumers.push_back(consumer_queue);
-    fprintf(stderr, "[CameraCapture] 注册了一个新消费者。当前总数: %zu\n", m_consumers.size());
+    m_consumers.push_back({consumer_queue, interval, window, 0});
+    fprintf(stderr, "[CameraCapture] 注册了一个新消费者 (每 %d 帧取 %d 帧)。当前总数: %zu\n", interval, window, m_consumers.size());
 }
 
 void CameraCapture::unregister_consumer(ThreadSafeFrameQueue* consumer_queue) {
     if (!consumer_queue) return;
 
     std::lock_guard<std::mutex> lock(m_consumer_mutex);
-    m_consumers.remove(consumer_queue);
+    m_consumers.remove_if([consumer_queue](const Consumer& c) { return c.queue == consumer_queue; });
     fprintf(stderr, "[CameraCapture] 注销了一个消费者。剩余总数: %zu\n", m_consumers.size());
 }
\ No newline at end of file
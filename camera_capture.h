@@ -32,7 +32,13 @@ public:
     bool start();
     void stop();
 
-    void register_consumer(ThreadSafeFrameQueue* consumer_queue);
+    /**
+     * @brief 注册一个原始帧消费者。
+     * @param interval 抽帧间隔：每 interval 帧为一组 (延时摄影)，1 表示每帧都要。
+     * @param window 每组中交付的帧数 (取组内最后 window 帧，用于多帧平均的运动模糊)，
+     *               其余帧在采集线程中直接跳过，不进入下游队列。
+     */
+    void register_consumer(ThreadSafeFrameQueue* consumer_queue, int interval = 1, int window = 1);
     void unregister_consumer(ThreadSafeFrameQueue* consumer_queue);
 
     AVBufferRef* get_hw_device_context() const { return m_hw_device_ctx; }
@@ -40,11 +46,17 @@ public:
 
     std::future<AVFramePtr> request_single_frame();
 
+    /**
+     * @brief 帧时间戳 pts=0 对应的 steady_clock 微秒时间 (与 ZoomManager::now_us() 同一时钟)。
+     * 帧的采集时刻 = 该值 + pts (微秒)，用于按帧时间戳插值变焦区域。
+     */
+    int64_t get_clock_origin_us() const { return m_clock_origin_us; }
+
 private:
     void capture_loop();
     bool initialize_ffmpeg();
     void cleanup_ffmpeg();
-    void fan_out_frame(AVFrame* frame);
+    void fan_out_frame(const AVFramePtr& frame);
 
     std::string m_device_path;
 
@@ -57,8 +69,15 @@ private:
     AVBufferRef* m_hw_device_ctx = nullptr;
 
     int64_t m_first_pts = AV_NOPTS_VALUE;
-
-    std::list<ThreadSafeFrameQueue*> m_consumers;
+    std::atomic<int64_t> m_clock_origin_us{0};
+
+    struct Consumer {
+        ThreadSafeFrameQueue* queue;
+        int interval;
+        int window;
+        int64_t counter;
+    };
+    std::list<Consumer> m_consumers;
     std::mutex m_consumer_mutex;
 
     std::list<std::promise<AVFramePtr>> m_single_frame_requests;
@@ -7,6 +7,7 @@
 #include "camera_capture.h"
 
 #include <iostream>
+#include <algorithm>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -25,7 +26,11 @@ extern "C"
 std::mutex g_camera_device_mutex;
 
 CameraController::CameraController(std::string device_path)
-    : m_device_path(std::move(device_path)) {}
+    : m_device_path(std::move(device_path))
+{
+    parse_video_codec(RECORDER_DEFAULT_CODEC, m_recording_codec);
+    parse_video_codec(RTSP_DEFAULT_CODEC, m_streaming_codec);
+}
 
 CameraController::~CameraController()
 {
@@ -37,14 +42,41 @@ CameraController::~CameraController()
     {
         stop_rtsp_stream();
     }
+    if (m_is_serving)
+    {
+        stop_rtsp_server();
+    }
+    if (m_is_hls)
+    {
+        stop_hls();
+    }
+    if (m_is_previewing)
+    {
+        stop_preview_server();
+    }
 
     if (m_recorder_thread.joinable())
     {
         m_recorder_thread.join();
     }
-    if (m_streamer_thread.joinable())
+    for (auto &t : m_streamer_threads)
     {
-        m_streamer_thread.join();
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    if (m_rtsp_server_thread.joinable())
+    {
+        m_rtsp_server_thread.join();
+    }
+    if (m_hls_thread.joinable())
+    {
+        m_hls_thread.join();
+    }
+    if (m_preview_thread.joinable())
+    {
+        m_preview_thread.join();
     }
 
     if (m_camera_capture)
@@ -52,11 +84,22 @@ CameraController::~CameraController()
         m_camera_capture->stop();
     }
 
+    // 恢复线程向 FileManager 提交任务，先停止它
+    if (m_recording_recovery)
+    {
+        m_recording_recovery->stop();
+    }
+
     if (m_file_manager)
     {
         m_file_manager->stop();
     }
 
+    if (m_storage_manager)
+    {
+        m_storage_manager->stop();
+    }
+
     if (m_osd_manager)
     {
         m_osd_manager->shutdown();
@@ -83,8 +126,26 @@ bool CameraController::initialize()
     m_exposure_manager->start();
 
     m_file_manager = std::make_unique<FileManager>();
+
+    m_storage_manager = std::make_shared<StorageManager>();
+    m_storage_manager->set_evict_callback([this](const std::string& filename) {
+        m_file_manager->getCatalog().remove(filename);
+    });
+    m_storage_manager->start();
+
+    m_file_manager->setMoveCompleteCallback([this](const std::string& dst_path) {
+        m_storage_manager->add_file(dst_path);
+    });
     m_file_manager->start();
 
+#if RECOVERY_ENABLED
+    // 上次断电/崩溃时留在临时目录中的录像，在后台恢复后交给 FileManager 移动
+    m_recording_recovery = std::make_unique<RecordingRecovery>([this](const std::string& path) {
+        m_file_manager->scheduleMove(path);
+    });
+    m_recording_recovery->start();
+#endif
+
     avdevice_register_all();
     avformat_network_init();
 
@@ -96,8 +157,6 @@ bool CameraController::initialize()
         return false;
     }
 
-    m_zoom_manager->check_and_reset_change_flag();
-
     std::cout << "[CameraController] 初始化成功, 核心采集已启动。" << std::endl;
     return true;
 }
@@ -115,22 +174,32 @@ int CameraController::start_recording(const std::string &resolution)
         m_recorder_thread.join();
     }
 
-    m_zoom_manager->check_and_reset_change_flag();
-
     auto on_media_finished_callback = [this](const std::string& temp_filepath) {
         if (m_file_manager) {
             m_file_manager->scheduleMove(temp_filepath);
         }
     };
 
-    m_recorder = std::make_unique<Recorder>(m_camera_capture.get(), m_osd_manager, m_zoom_manager, on_media_finished_callback);
+    m_recorder = std::make_unique<Recorder>(on_media_finished_callback);
+    m_recorder->set_position_source(m_osd_manager);
+    m_recorder->set_timelapse(m_timelapse_interval, m_timelapse_blend);
+    m_recorder->set_osd_burn_in(m_recording_burn_in);
+    m_recorder->set_latency_stamping(m_latency_stamping);
 
-    if (!m_recorder->prepare(resolution))
+    if (!m_recorder->prepare(resolution, m_recording_codec))
     {
         m_recorder.reset();
         return -1;
     }
 
+    auto pipeline = acquire_encode_pipeline(m_recorder->get_encode_profiles());
+    if (!pipeline || !m_recorder->attach_pipeline(pipeline))
+    {
+        std::cerr << "错误: 无法为录制启动编码链。" << std::endl;
+        m_recorder.reset();
+        return -1;
+    }
+
     m_is_recording = true;
     m_recorder_thread = std::thread([this]()
                                     { 
@@ -200,69 +269,367 @@ void CameraController::set_osd_enabled(bool enabled)
 }
 
 int CameraController::start_rtsp_stream(const std::string &url)
+{
+    RtspStreamConfig config;
+    config.url = url;
+    return start_rtsp_streams({config});
+}
+
+int CameraController::start_rtsp_stream(const std::vector<std::string> &urls)
+{
+    if (urls.empty())
+    {
+        return -1;
+    }
+    RtspStreamConfig config;
+    config.url = urls[0];
+    config.mirror_urls.assign(urls.begin() + 1, urls.end());
+    return start_rtsp_streams({config});
+}
+
+int CameraController::start_rtsp_streams(const std::vector<RtspStreamConfig> &configs)
 {
     if (m_is_streaming)
     {
         std::cerr << "错误: RTSP推流已在进行中。" << std::endl;
         return -1;
     }
-
-    if (m_streamer_thread.joinable())
+    if (configs.empty())
     {
-        m_streamer_thread.join();
+        return -1;
     }
 
-    m_zoom_manager->check_and_reset_change_flag();
+    for (auto &t : m_streamer_threads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    m_streamer_threads.clear();
+    m_streamers.clear();
 
-    m_streamer = std::make_unique<RtspStreamer>(m_camera_capture.get(), m_osd_manager, m_zoom_manager);
+    std::vector<EncodeProfile> profiles;
+    for (const auto &config : configs)
+    {
+        std::unique_ptr<RtspStreamer> streamer(new RtspStreamer());
+        streamer->set_position_source(m_osd_manager);
+        streamer->set_osd_burn_in(m_streaming_burn_in);
+        streamer->set_intra_refresh(m_streaming_intra_refresh);
+        streamer->set_latency_stamping(m_latency_stamping);
+        if (!streamer->prepare(config, m_streaming_codec))
+        {
+            m_streamers.clear();
+            return -1;
+        }
+        profiles.push_back(streamer->get_encode_profile());
+        m_streamers.push_back(std::move(streamer));
+    }
 
-    if (!m_streamer->prepare(url))
+    // 多路推流一起启动时建一条多输出编码链：采集和裁剪只做一次，每路只增加缩放和编码
+    auto pipeline = acquire_encode_pipeline(profiles);
+    bool attached = pipeline != nullptr;
+    for (size_t i = 0; attached && i < m_streamers.size(); ++i)
+    {
+        attached = m_streamers[i]->attach_pipeline(pipeline);
+    }
+    if (!attached)
     {
-        m_streamer.reset();
+        std::cerr << "错误: 无法为推流启动编码链。" << std::endl;
+        // 已绑定的推流器在析构时注销自己的队列，最后一个注销时编码链随之停止
+        m_streamers.clear();
         return -1;
     }
 
     m_is_streaming = true;
-    m_streamer_thread = std::thread([this]()
-                                    {
-        if (m_streamer) m_streamer->run();
-        m_is_streaming = false; });
+    m_active_streamers = static_cast<int>(m_streamers.size());
+    for (size_t i = 0; i < m_streamers.size(); ++i)
+    {
+        RtspStreamer *streamer = m_streamers[i].get();
+        m_streamer_threads.emplace_back([this, streamer]()
+                                        {
+            streamer->run();
+            if (--m_active_streamers == 0) m_is_streaming = false; });
+    }
+    if (m_streamers.size() > 1)
+    {
+        std::cout << "[CameraController] 已启动 " << m_streamers.size() << " 路推流，共用一条编码链。" << std::endl;
+    }
     return 0;
 }
 
 int CameraController::stop_rtsp_stream()
 {
-    if (!m_is_streaming)
+    const bool was_streaming = m_is_streaming;
+
+    // 即使状态标志为 false，也检查一下线程是否还在运行
+    for (auto &streamer : m_streamers)
     {
-        // 即使状态标志为 false，也检查一下线程是否还在运行
-        if (m_streamer_thread.joinable())
+        streamer->stop();
+    }
+    for (auto &t : m_streamer_threads)
+    {
+        if (t.joinable())
         {
-            if (m_streamer)
-                m_streamer->stop();
-            m_streamer_thread.join();
+            t.join();
         }
+    }
+    m_streamer_threads.clear();
+    m_streamers.clear();
+    m_is_streaming = false;
+
+    if (!was_streaming)
+    {
         std::cerr << "错误: 当前没有在推流。" << std::endl;
         return -1;
     }
+    std::cout << "RTSP推流已停止。" << std::endl;
 
-    if (m_streamer)
+    // [核心修复] 在停止一个重量级硬件用户后，短暂等待，给驱动清理时间
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    return 0;
+}
+
+int CameraController::start_rtsp_server(int port)
+{
+    if (m_is_serving)
     {
-        m_streamer->stop();
+        std::cerr << "错误: RTSP服务器已在运行中。" << std::endl;
+        return -1;
     }
-    if (m_streamer_thread.joinable())
+
+    if (m_rtsp_server_thread.joinable())
     {
-        m_streamer_thread.join();
+        m_rtsp_server_thread.join();
     }
-    m_streamer.reset();
-    m_is_streaming = false;
-    std::cout << "RTSP推流已停止。" << std::endl;
 
-    // [核心修复] 在停止一个重量级硬件用户后，短暂等待，给驱动清理时间
+    if (port <= 0)
+    {
+        port = RTSP_SERVER_PORT;
+    }
+
+    m_rtsp_server = std::make_unique<RtspServer>();
+    m_rtsp_server->set_position_source(m_osd_manager);
+    m_rtsp_server->set_osd_burn_in(m_streaming_burn_in);
+    m_rtsp_server->set_intra_refresh(m_streaming_intra_refresh);
+    m_rtsp_server->set_latency_stamping(m_latency_stamping);
+
+    if (!m_rtsp_server->prepare(port, m_streaming_codec))
+    {
+        m_rtsp_server.reset();
+        return -1;
+    }
+
+    auto pipeline = acquire_encode_pipeline({m_rtsp_server->get_encode_profile()});
+    if (!pipeline || !m_rtsp_server->attach_pipeline(pipeline))
+    {
+        std::cerr << "错误: 无法为RTSP服务器启动编码链。" << std::endl;
+        m_rtsp_server.reset();
+        return -1;
+    }
+
+    m_is_serving = true;
+    m_rtsp_server_thread = std::thread([this]()
+                                       {
+        if (m_rtsp_server) m_rtsp_server->run();
+        m_is_serving = false; });
+    return 0;
+}
+
+int CameraController::stop_rtsp_server()
+{
+    if (!m_is_serving)
+    {
+        if (m_rtsp_server_thread.joinable())
+        {
+            if (m_rtsp_server)
+                m_rtsp_server->stop();
+            m_rtsp_server_thread.join();
+        }
+        std::cerr << "错误: RTSP服务器未在运行。" << std::endl;
+        return -1;
+    }
+
+    if (m_rtsp_server)
+    {
+        m_rtsp_server->stop();
+    }
+    if (m_rtsp_server_thread.joinable())
+    {
+        m_rtsp_server_thread.join();
+    }
+    m_rtsp_server.reset();
+    m_is_serving = false;
+    std::cout << "RTSP服务器已停止。" << std::endl;
+
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return 0;
+}
+
+int CameraController::start_hls(const std::string& dir, int part_ms)
+{
+    if (m_is_hls)
+    {
+        std::cerr << "错误: HLS输出已在运行中。" << std::endl;
+        return -1;
+    }
 
+    if (m_hls_thread.joinable())
+    {
+        m_hls_thread.join();
+    }
+
+    m_hls_writer = std::make_unique<HlsWriter>();
+    m_hls_writer->set_osd_burn_in(m_streaming_burn_in);
+
+    if (!m_hls_writer->prepare(dir.empty() ? std::string(HLS_OUTPUT_DIR) : dir, part_ms, m_streaming_codec))
+    {
+        m_hls_writer.reset();
+        return -1;
+    }
+
+    auto pipeline = acquire_encode_pipeline({m_hls_writer->get_encode_profile()});
+    if (!pipeline || !m_hls_writer->attach_pipeline(pipeline))
+    {
+        std::cerr << "错误: 无法为HLS输出启动编码链。" << std::endl;
+        m_hls_writer.reset();
+        return -1;
+    }
+
+    m_is_hls = true;
+    m_hls_thread = std::thread([this]()
+                               {
+        if (m_hls_writer) m_hls_writer->run();
+        m_is_hls = false; });
     return 0;
 }
 
+int CameraController::stop_hls()
+{
+    if (!m_is_hls)
+    {
+        if (m_hls_thread.joinable())
+        {
+            if (m_hls_writer)
+                m_hls_writer->stop();
+            m_hls_thread.join();
+        }
+        std::cerr << "错误: HLS输出未在运行。" << std::endl;
+        return -1;
+    }
+
+    if (m_hls_writer)
+    {
+        m_hls_writer->stop();
+    }
+    if (m_hls_thread.joinable())
+    {
+        m_hls_thread.join();
+    }
+    m_hls_writer.reset();
+    m_is_hls = false;
+    std::cout << "HLS输出已停止。" << std::endl;
+    return 0;
+}
+
+int CameraController::start_preview_server(int port)
+{
+    if (m_is_previewing)
+    {
+        std::cerr << "错误: MJPEG预览已在运行中。" << std::endl;
+        return -1;
+    }
+
+    if (m_preview_thread.joinable())
+    {
+        m_preview_thread.join();
+    }
+
+    if (port <= 0)
+    {
+        port = MJPEG_PREVIEW_PORT;
+    }
+
+    m_preview_server = std::make_unique<MjpegServer>(m_camera_capture.get(), m_osd_manager, m_zoom_manager);
+    m_preview_server->set_osd_burn_in(m_streaming_burn_in);
+
+    if (!m_preview_server->prepare(port))
+    {
+        m_preview_server.reset();
+        return -1;
+    }
+
+    m_is_previewing = true;
+    m_preview_thread = std::thread([this]()
+                                   {
+        if (m_preview_server) m_preview_server->run();
+        m_is_previewing = false; });
+    return 0;
+}
+
+int CameraController::stop_preview_server()
+{
+    if (!m_is_previewing)
+    {
+        if (m_preview_thread.joinable())
+        {
+            if (m_preview_server)
+                m_preview_server->stop();
+            m_preview_thread.join();
+        }
+        std::cerr << "错误: MJPEG预览未在运行。" << std::endl;
+        return -1;
+    }
+
+    if (m_preview_server)
+    {
+        m_preview_server->stop();
+    }
+    if (m_preview_thread.joinable())
+    {
+        m_preview_thread.join();
+    }
+    m_preview_server.reset();
+    m_is_previewing = false;
+    std::cout << "MJPEG预览已停止。" << std::endl;
+    return 0;
+}
+
+std::shared_ptr<EncodePipeline> CameraController::acquire_encode_pipeline(const std::vector<EncodeProfile>& profiles)
+{
+#if ENCODE_SHARING_ENABLED
+    // 多分辨率录制需要专属的多输出编码链，只有单一输出才尝试复用
+    if (profiles.size() == 1)
+    {
+        const EncodeProfile& profile = profiles.front();
+        std::shared_ptr<EncodePipeline> running[] = {
+            (m_is_recording && m_recorder) ? m_recorder->get_pipeline() : nullptr,
+            (m_is_streaming && !m_streamers.empty()) ? m_streamers.front()->get_pipeline() : nullptr,
+            (m_is_serving && m_rtsp_server) ? m_rtsp_server->get_pipeline() : nullptr,
+            (m_is_hls && m_hls_writer) ? m_hls_writer->get_pipeline() : nullptr,
+        };
+        for (auto& pipeline : running)
+        {
+            if (pipeline && pipeline->isRunning() && !pipeline->hasError() &&
+                pipeline->find_compatible_output(profile) >= 0)
+            {
+                std::cout << "[CameraController] 复用正在运行的编码链 (" << profile.width << "x" << profile.height
+                          << ", " << profile.encoder_name << ")。" << std::endl;
+                return pipeline;
+            }
+        }
+    }
+#endif
+
+    auto pipeline = std::make_shared<EncodePipeline>(m_camera_capture.get(), m_osd_manager, m_zoom_manager, profiles);
+    if (!pipeline->start())
+    {
+        return nullptr;
+    }
+    return pipeline;
+}
+
 void CameraController::zoom_in()
 {
     if (m_zoom_manager)
@@ -279,6 +646,206 @@ void CameraController::zoom_out()
     }
 }
 
+void CameraController::zoom_to(float level, int duration_ms)
+{
+    if (m_zoom_manager)
+    {
+        m_zoom_manager->zoom_to(level, duration_ms);
+    }
+}
+
+void CameraController::set_zoom_velocity(float levels_per_sec)
+{
+    if (m_zoom_manager)
+    {
+        m_zoom_manager->set_zoom_velocity(levels_per_sec);
+    }
+}
+
+int CameraController::set_recording_codec(const std::string& codec)
+{
+    if (!parse_video_codec(codec, m_recording_codec))
+    {
+        std::cerr << "错误: 不支持的编码格式 '" << codec << "'." << std::endl;
+        return -1;
+    }
+    std::cout << "[CameraController] 录制编码格式: " << video_codec_name(m_recording_codec) << std::endl;
+    return 0;
+}
+
+int CameraController::set_streaming_codec(const std::string& codec)
+{
+    if (!parse_video_codec(codec, m_streaming_codec))
+    {
+        std::cerr << "错误: 不支持的编码格式 '" << codec << "'." << std::endl;
+        return -1;
+    }
+    std::cout << "[CameraController] 推流编码格式: " << video_codec_name(m_streaming_codec) << std::endl;
+    return 0;
+}
+
+int CameraController::set_timelapse(double interval_sec, bool motion_blur)
+{
+    if (interval_sec < 0)
+    {
+        std::cerr << "错误: 无效的延时摄影间隔。" << std::endl;
+        return -1;
+    }
+    m_timelapse_interval = std::max(1, static_cast<int>(interval_sec * V4L2_INPUT_FPS + 0.5));
+    m_timelapse_blend = motion_blur ? std::min(TIMELAPSE_BLEND_FRAMES, m_timelapse_interval) : 1;
+    if (m_timelapse_interval > 1)
+    {
+        std::cout << "[CameraController] 延时摄影: 每 " << m_timelapse_interval << " 帧取 1 帧"
+                  << (m_timelapse_blend > 1 ? " (运动模糊)" : "") << std::endl;
+    }
+    else
+    {
+        std::cout << "[CameraController] 延时摄影已关闭" << std::endl;
+    }
+    return 0;
+}
+
+void CameraController::set_osd_burn_in(bool recording, bool streaming)
+{
+    m_recording_burn_in = recording;
+    m_streaming_burn_in = streaming;
+    std::cout << "[CameraController] OSD 烧录: 录制 " << (recording ? "开" : "关")
+              << ", 推流 " << (streaming ? "开" : "关") << std::endl;
+}
+
+int CameraController::set_recording_rate_control(const RateControl& rc)
+{
+    if (!m_is_recording || !m_recorder)
+    {
+        std::cerr << "错误: 当前没有在录制。" << std::endl;
+        return -1;
+    }
+    return m_recorder->set_rate_control(rc) ? 0 : -1;
+}
+
+int CameraController::set_streaming_rate_control(const RateControl& rc, size_t stream_index)
+{
+    if (!m_is_streaming || stream_index >= m_streamers.size())
+    {
+        std::cerr << "错误: 当前没有在推流。" << std::endl;
+        return -1;
+    }
+    return m_streamers[stream_index]->set_rate_control(rc) ? 0 : -1;
+}
+
+int CameraController::request_keyframe()
+{
+    if (!m_is_streaming && !m_is_serving)
+    {
+        std::cerr << "错误: 当前没有在推流。" << std::endl;
+        return -1;
+    }
+    // 推流与服务器共享编码链时同一输出会被请求两次，编码线程只会强制一帧
+    for (auto& streamer : m_streamers)
+    {
+        streamer->request_keyframe();
+    }
+    if (m_is_serving && m_rtsp_server)
+    {
+        m_rtsp_server->request_keyframe();
+    }
+    return 0;
+}
+
+void CameraController::set_streaming_intra_refresh(bool enabled)
+{
+    m_streaming_intra_refresh = enabled;
+    std::cout << "[CameraController] 推流帧内刷新: " << (enabled ? "开" : "关") << std::endl;
+}
+
+void CameraController::set_latency_stamping(bool enabled)
+{
+    m_latency_stamping = enabled;
+    std::cout << "[CameraController] 时延测量 SEI: " << (enabled ? "开" : "关") << std::endl;
+}
+
+int CameraController::lock_current_recording()
+{
+    if (!m_is_recording || !m_recorder || !m_storage_manager)
+    {
+        std::cerr << "错误: 当前没有在录制。" << std::endl;
+        return -1;
+    }
+    // 分段尚在临时目录时也可以锁定，移动到存储卡后自动生效
+    int ret = 0;
+    for (const auto& name : m_recorder->get_recent_segment_names())
+    {
+        if (!m_storage_manager->lock_file(name))
+        {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int CameraController::lock_file(const std::string& filename)
+{
+    return (m_storage_manager && m_storage_manager->lock_file(filename)) ? 0 : -1;
+}
+
+int CameraController::unlock_file(const std::string& filename)
+{
+    return (m_storage_manager && m_storage_manager->unlock_file(filename)) ? 0 : -1;
+}
+
+void CameraController::get_storage_info(uint64_t& used_bytes, uint64_t& quota_bytes) const
+{
+    used_bytes = m_storage_manager ? m_storage_manager->get_used_bytes() : 0;
+    quota_bytes = m_storage_manager ? m_storage_manager->get_quota_bytes() : 0;
+}
+
+std::vector<RecordingCatalogHit> CameraController::query_recordings(int64_t start_us, int64_t end_us)
+{
+    if (!m_file_manager)
+    {
+        return {};
+    }
+    return m_file_manager->getCatalog().query(start_us, end_us);
+}
+
+int CameraController::export_clip(int64_t start_us, int64_t end_us, const std::string& output_path, ClipExportCallback cb)
+{
+    if (output_path.empty() || end_us <= start_us)
+    {
+        std::cerr << "错误: 无效的导出参数。" << std::endl;
+        return -1;
+    }
+    auto hits = query_recordings(start_us, end_us);
+    if (hits.empty())
+    {
+        std::cerr << "错误: 该时间范围内没有已保存的录像。" << std::endl;
+        return -1;
+    }
+
+    // 导出期间源分段不能被循环录制淘汰
+    std::vector<std::string> sources;
+    for (const auto& hit : hits)
+    {
+        const char* slash = strrchr(hit.media_path.c_str(), '/');
+        sources.push_back(slash ? slash + 1 : hit.media_path);
+    }
+    std::weak_ptr<StorageManager> storage = m_storage_manager;
+    if (m_storage_manager)
+    {
+        m_storage_manager->pin_files(sources);
+    }
+
+    auto exporter = std::make_shared<ClipExporter>(std::move(hits), start_us, end_us, output_path, std::move(cb));
+    std::thread([exporter, storage, sources]() {
+        exporter->run();
+        if (auto manager = storage.lock())
+        {
+            manager->unpin_files(sources);
+        }
+    }).detach();
+    return 0;
+}
+
 void CameraController::set_iso(int iso)
 {
     if (m_exposure_manager)
@@ -8,10 +8,19 @@
 #include "osd_manager.h"
 #include "zoom_manager.h"
 #include "rtsp_streamer.h"
+#include "rtsp_server.h"
+#include "hls_writer.h"
+#include "mjpeg_server.h"
 #include "exposure_manager.h"
+#include "encode_pipeline.h"
+#include "storage_manager.h"
+#include "recording_catalog.h"
+#include "clip_exporter.h"
+#include "recording_recovery.h"
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <thread>
 #include <atomic>
 
@@ -35,14 +44,59 @@ public:
     void set_osd_enabled(bool enabled);
     void zoom_in();
     void zoom_out();
+    void zoom_to(float level, int duration_ms);
+    void set_zoom_velocity(float levels_per_sec);
     int start_rtsp_stream(const std::string& url);
+    // 同一路码流推送到多个目的地址 (第一个为主服务器，其余为备份)，只编码一次，各目的地址互不阻塞
+    int start_rtsp_stream(const std::vector<std::string>& urls);
+    // 同时启动多路推流 (主码流 + 子码流)，各路分辨率/帧率/码率独立，共用一条编码链
+    int start_rtsp_streams(const std::vector<RtspStreamConfig>& configs);
+    // 停止所有推流
     int stop_rtsp_stream();
+    // 内置 RTSP 服务器：客户端直接拉流，编码格式与 OSD 烧录设置与推流相同，可与推流共享编码链
+    int start_rtsp_server(int port);
+    int stop_rtsp_server();
+    // LL-HLS 输出：在 dir 中写 CMAF 分段和滚动播放列表 (dir 为空时用 HLS_OUTPUT_DIR)，可与推流共享编码链
+    int start_hls(const std::string& dir, int part_ms);
+    int stop_hls();
+    // MJPEG over HTTP 预览 (http://<设备IP>:port/)，不占用编码链，只在有客户端观看时编码
+    int start_preview_server(int port);
+    int stop_preview_server();
+    // 设置之后开始的录制/推流使用的编码格式 ("h264" / "hevc")，正在进行的不受影响
+    int set_recording_codec(const std::string& codec);
+    int set_streaming_codec(const std::string& codec);
+    // 设置之后开始的录制为延时摄影 (每 interval_sec 秒一帧)，0 表示普通录制
+    int set_timelapse(double interval_sec, bool motion_blur);
+    // 设置之后开始的录制/推流是否把 OSD 烧录到画面中；遥测数据始终以元数据 (字幕轨 / SEI) 输出
+    void set_osd_burn_in(bool recording, bool streaming);
+    // 修改正在进行的录制/推流的码率控制，下一个关键帧生效；共享同一编码链的另一方也会受影响
+    int set_recording_rate_control(const RateControl& rc);
+    // stream_index: 推流序号 (与 start_rtsp_streams 的顺序一致，0 为主码流)
+    int set_streaming_rate_control(const RateControl& rc, size_t stream_index = 0);
+    // 让所有推流和内置服务器的编码输出在下一帧强制编码为 IDR
+    int request_keyframe();
+    // 设置之后开始的推流/内置服务器是否使用帧内刷新代替周期 IDR (仅软件编码器支持)
+    void set_streaming_intra_refresh(bool enabled);
+    // 设置之后开始的录制/推流是否每帧插入时延测量 SEI (见 latency_stamp.h)
+    void set_latency_stamping(bool enabled);
+    // 锁定当前录制的分段 (以及上一个分段)，防止被循环录制淘汰
+    int lock_current_recording();
+    int lock_file(const std::string& filename);
+    int unlock_file(const std::string& filename);
+    void get_storage_info(uint64_t& used_bytes, uint64_t& quota_bytes) const;
+    // 查询覆盖 [start_us, end_us] (系统时间, 微秒) 的录像，只读取索引不打开媒体文件
+    std::vector<RecordingCatalogHit> query_recordings(int64_t start_us, int64_t end_us);
+    // 在后台以最低优先级按流复制导出片段，立即返回；完成后调用 cb
+    int export_clip(int64_t start_us, int64_t end_us, const std::string& output_path, ClipExportCallback cb);
     void set_iso(int iso);
     void set_ev(double ev);
 
     std::shared_ptr<OsdManager> get_osd_manager();
 
 private:
+    // 查找可共享的正在运行的编码链，找不到时按给定的输出列表新建并启动一条
+    std::shared_ptr<EncodePipeline> acquire_encode_pipeline(const std::vector<EncodeProfile>& profiles);
+
     std::string m_device_path;
 
     std::shared_ptr<OsdManager> m_osd_manager;
@@ -51,17 +105,45 @@ private:
     
     // [重构] 新增 FileManager 成员，用于管理文件移动
     std::unique_ptr<FileManager> m_file_manager;
+    // 存储卡配额与循环录制淘汰
+    // 片段导出线程持有 weak_ptr，导出结束时解除对源分段的淘汰保护
+    std::shared_ptr<StorageManager> m_storage_manager;
+    // 启动时恢复未正常结束的录像
+    std::unique_ptr<RecordingRecovery> m_recording_recovery;
 
     std::unique_ptr<CameraCapture> m_camera_capture;
 
     std::unique_ptr<Recorder> m_recorder;
     std::thread m_recorder_thread;
 
-    std::unique_ptr<RtspStreamer> m_streamer;
-    std::thread m_streamer_thread;
+    // 同时运行的各路推流 (第一路为主码流)，共用一条编码链
+    std::vector<std::unique_ptr<RtspStreamer>> m_streamers;
+    std::vector<std::thread> m_streamer_threads;
+    std::atomic<int> m_active_streamers{0};
+
+    std::unique_ptr<RtspServer> m_rtsp_server;
+    std::thread m_rtsp_server_thread;
+
+    std::unique_ptr<HlsWriter> m_hls_writer;
+    std::thread m_hls_thread;
+
+    std::unique_ptr<MjpegServer> m_preview_server;
+    std::thread m_preview_thread;
 
     std::atomic<bool> m_is_recording{false};
     std::atomic<bool> m_is_streaming{false};
+    std::atomic<bool> m_is_serving{false};
+    std::atomic<bool> m_is_hls{false};
+    std::atomic<bool> m_is_previewing{false};
+
+    VideoCodec m_recording_codec = VideoCodec::H264;
+    VideoCodec m_streaming_codec = VideoCodec::H264;
+    int m_timelapse_interval = 1;
+    int m_timelapse_blend = 1;
+    bool m_recording_burn_in = true;
+    bool m_streaming_burn_in = true;
+    bool m_streaming_intra_refresh = RTSP_INTRA_REFRESH;
+    bool m_latency_stamping = LATENCY_SEI_ENABLED;
 };
 
 #endif // CAMERA_CONTROLLER_H
\ No newline at end of file
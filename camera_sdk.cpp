@@ -2,6 +2,8 @@
 #include "camera_controller.h"
 #include <iostream>
 #include <new> // For std::bad_alloc
+#include <cstdio>
+#include <vector>
 
 /**
  * @file camera_sdk.cpp
@@ -80,6 +82,42 @@ extern "C"
         return -1;
     }
 
+    int camera_sdk_start_rtsp_stream_multi(void* handle, const char* const* urls, int count) {
+        if (!handle || !urls || count <= 0) {
+            return -1;
+        }
+        std::vector<std::string> url_list;
+        for (int i = 0; i < count; ++i) {
+            if (!urls[i]) {
+                return -1;
+            }
+            url_list.push_back(urls[i]);
+        }
+        return static_cast<CameraController*>(handle)->start_rtsp_stream(url_list);
+    }
+
+    int camera_sdk_start_rtsp_streams(void* handle, const camera_sdk_stream_profile_t* profiles, int count) {
+        if (!handle || !profiles || count <= 0) {
+            return -1;
+        }
+        std::vector<RtspStreamConfig> configs;
+        for (int i = 0; i < count; ++i) {
+            if (!profiles[i].url) {
+                return -1;
+            }
+            RtspStreamConfig config;
+            config.url = profiles[i].url;
+            if (profiles[i].width > 0 && profiles[i].height > 0) {
+                config.width = profiles[i].width;
+                config.height = profiles[i].height;
+            }
+            config.fps = profiles[i].fps;
+            config.bit_rate = static_cast<int64_t>(profiles[i].bitrate_kbps) * 1000;
+            configs.push_back(config);
+        }
+        return static_cast<CameraController*>(handle)->start_rtsp_streams(configs);
+    }
+
     int camera_sdk_stop_rtsp_stream(void* handle) {
         if (handle) {
             return static_cast<CameraController*>(handle)->stop_rtsp_stream();
@@ -87,6 +125,48 @@ extern "C"
         return -1;
     }
 
+    int camera_sdk_start_rtsp_server(void* handle, int port) {
+        if (handle) {
+            return static_cast<CameraController*>(handle)->start_rtsp_server(port);
+        }
+        return -1;
+    }
+
+    int camera_sdk_stop_rtsp_server(void* handle) {
+        if (handle) {
+            return static_cast<CameraController*>(handle)->stop_rtsp_server();
+        }
+        return -1;
+    }
+
+    int camera_sdk_start_hls(void* handle, const char* dir, int part_ms) {
+        if (handle) {
+            return static_cast<CameraController*>(handle)->start_hls(dir ? dir : "", part_ms);
+        }
+        return -1;
+    }
+
+    int camera_sdk_stop_hls(void* handle) {
+        if (handle) {
+            return static_cast<CameraController*>(handle)->stop_hls();
+        }
+        return -1;
+    }
+
+    int camera_sdk_start_preview_server(void* handle, int port) {
+        if (handle) {
+            return static_cast<CameraController*>(handle)->start_preview_server(port);
+        }
+        return -1;
+    }
+
+    int camera_sdk_stop_preview_server(void* handle) {
+        if (handle) {
+            return static_cast<CameraController*>(handle)->stop_preview_server();
+        }
+        return -1;
+    }
+
     int camera_sdk_take_snapshot(void *handle)
     {
         if (handle)
@@ -139,6 +219,208 @@ extern "C"
         }
     }
 
+    void camera_sdk_zoom_to(void *handle, float level, int duration_ms)
+    {
+        if (handle)
+        {
+            static_cast<CameraController *>(handle)->zoom_to(level, duration_ms);
+        }
+    }
+
+    void camera_sdk_set_zoom_velocity(void *handle, float levels_per_sec)
+    {
+        if (handle)
+        {
+            static_cast<CameraController *>(handle)->set_zoom_velocity(levels_per_sec);
+        }
+    }
+
+    int camera_sdk_set_recording_codec(void *handle, const char *codec)
+    {
+        if (handle && codec)
+        {
+            return static_cast<CameraController *>(handle)->set_recording_codec(codec);
+        }
+        return -1;
+    }
+
+    int camera_sdk_set_streaming_codec(void *handle, const char *codec)
+    {
+        if (handle && codec)
+        {
+            return static_cast<CameraController *>(handle)->set_streaming_codec(codec);
+        }
+        return -1;
+    }
+
+    static RateControl to_rate_control(const camera_sdk_rate_control_t *rc)
+    {
+        static const RateControlMode modes[] = {RateControlMode::Auto, RateControlMode::CBR,
+                                                RateControlMode::VBR, RateControlMode::CQP};
+        RateControl out;
+        out.mode = (rc->mode >= CAMERA_SDK_RC_AUTO && rc->mode <= CAMERA_SDK_RC_CQP) ? modes[rc->mode] : RateControlMode::Auto;
+        out.bit_rate = static_cast<int64_t>(rc->bitrate_kbps) * 1000;
+        out.max_bit_rate = static_cast<int64_t>(rc->max_bitrate_kbps) * 1000;
+        out.qp = rc->qp;
+        out.gop_size = rc->gop_size;
+        return out;
+    }
+
+    int camera_sdk_set_timelapse(void *handle, double interval_sec, bool motion_blur)
+    {
+        if (handle)
+        {
+            return static_cast<CameraController *>(handle)->set_timelapse(interval_sec, motion_blur);
+        }
+        return -1;
+    }
+
+    void camera_sdk_set_osd_burn_in(void *handle, bool recording, bool streaming)
+    {
+        if (handle)
+        {
+            static_cast<CameraController *>(handle)->set_osd_burn_in(recording, streaming);
+        }
+    }
+
+    int camera_sdk_set_recording_rate_control(void *handle, const camera_sdk_rate_control_t *rc)
+    {
+        if (handle && rc)
+        {
+            return static_cast<CameraController *>(handle)->set_recording_rate_control(to_rate_control(rc));
+        }
+        return -1;
+    }
+
+    int camera_sdk_set_streaming_rate_control(void *handle, const camera_sdk_rate_control_t *rc)
+    {
+        if (handle && rc)
+        {
+            return static_cast<CameraController *>(handle)->set_streaming_rate_control(to_rate_control(rc));
+        }
+        return -1;
+    }
+
+    int camera_sdk_set_stream_rate_control(void *handle, int stream_index, const camera_sdk_rate_control_t *rc)
+    {
+        if (handle && rc && stream_index >= 0)
+        {
+            return static_cast<CameraController *>(handle)->set_streaming_rate_control(to_rate_control(rc),
+                                                                                        static_cast<size_t>(stream_index));
+        }
+        return -1;
+    }
+
+    int camera_sdk_request_keyframe(void *handle)
+    {
+        if (handle)
+        {
+            return static_cast<CameraController *>(handle)->request_keyframe();
+        }
+        return -1;
+    }
+
+    void camera_sdk_set_streaming_intra_refresh(void *handle, bool enabled)
+    {
+        if (handle)
+        {
+            static_cast<CameraController *>(handle)->set_streaming_intra_refresh(enabled);
+        }
+    }
+
+    void camera_sdk_set_latency_sei(void *handle, bool enabled)
+    {
+        if (handle)
+        {
+            static_cast<CameraController *>(handle)->set_latency_stamping(enabled);
+        }
+    }
+
+    int camera_sdk_lock_current_recording(void *handle)
+    {
+        if (handle)
+        {
+            return static_cast<CameraController *>(handle)->lock_current_recording();
+        }
+        return -1;
+    }
+
+    int camera_sdk_lock_file(void *handle, const char *filename)
+    {
+        if (handle && filename)
+        {
+            return static_cast<CameraController *>(handle)->lock_file(filename);
+        }
+        return -1;
+    }
+
+    int camera_sdk_unlock_file(void *handle, const char *filename)
+    {
+        if (handle && filename)
+        {
+            return static_cast<CameraController *>(handle)->unlock_file(filename);
+        }
+        return -1;
+    }
+
+    void camera_sdk_get_storage_info(void *handle, unsigned long long *used_bytes, unsigned long long *quota_bytes)
+    {
+        uint64_t used = 0, quota = 0;
+        if (handle)
+        {
+            static_cast<CameraController *>(handle)->get_storage_info(used, quota);
+        }
+        if (used_bytes)
+            *used_bytes = used;
+        if (quota_bytes)
+            *quota_bytes = quota;
+    }
+
+    int camera_sdk_query_recordings(void *handle, long long start_ms, long long end_ms,
+                                    camera_sdk_recording_range_t *results, int max_results)
+    {
+        if (!handle || end_ms < start_ms)
+        {
+            return -1;
+        }
+        auto hits = static_cast<CameraController *>(handle)->query_recordings(start_ms * 1000, end_ms * 1000);
+        for (int i = 0; results && i < max_results && i < static_cast<int>(hits.size()); ++i)
+        {
+            const RecordingCatalogHit &hit = hits[i];
+            camera_sdk_recording_range_t &out = results[i];
+            snprintf(out.path, sizeof(out.path), "%s", hit.media_path.c_str());
+            out.start_ms = hit.header.start_us / 1000;
+            out.end_ms = hit.header.end_us / 1000;
+            out.keyframe_ms = hit.start_keyframe_us / 1000;
+            out.start_offset = hit.start_offset;
+            out.end_offset = hit.end_offset;
+            out.width = hit.header.width;
+            out.height = hit.header.height;
+            out.min_lat = hit.header.min_lat;
+            out.max_lat = hit.header.max_lat;
+            out.min_lon = hit.header.min_lon;
+            out.max_lon = hit.header.max_lon;
+        }
+        return static_cast<int>(hits.size());
+    }
+
+    int camera_sdk_export_clip(void *handle, long long start_ms, long long end_ms, const char *output_path,
+                               camera_sdk_export_callback_t callback, void *user_data)
+    {
+        if (!handle || !output_path)
+        {
+            return -1;
+        }
+        ClipExportCallback cb;
+        if (callback)
+        {
+            cb = [callback, user_data](const std::string &path, int result) {
+                callback(path.c_str(), result, user_data);
+            };
+        }
+        return static_cast<CameraController *>(handle)->export_clip(start_ms * 1000, end_ms * 1000, output_path, std::move(cb));
+    }
+
     void camera_sdk_set_iso(void* handle, int iso)
     {
         if (handle)
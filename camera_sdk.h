@@ -22,6 +22,50 @@ extern "C"
         const char *timestamp; // 使用 const char* 以便 C 语言调用
     } camera_sdk_pos_data_t;
 
+    // 码率控制模式
+    typedef enum
+    {
+        CAMERA_SDK_RC_AUTO = 0, // 编码器默认模式，只设置目标码率
+        CAMERA_SDK_RC_CBR,      // 恒定码率
+        CAMERA_SDK_RC_VBR,      // 可变码率，峰值为 max_bitrate_kbps
+        CAMERA_SDK_RC_CQP,      // 恒定量化参数，忽略码率
+    } camera_sdk_rc_mode_t;
+
+    // 与 RateControl 对应的 C 结构体
+    typedef struct
+    {
+        camera_sdk_rc_mode_t mode;
+        int bitrate_kbps;     // 目标码率，CQP 模式忽略
+        int max_bitrate_kbps; // VBR 峰值码率，0 表示目标码率的 1.5 倍
+        int qp;               // CQP 模式的量化参数 (0-51)
+        int gop_size;         // 关键帧间隔 (帧数)
+    } camera_sdk_rate_control_t;
+
+    // 一路 RTSP 推流的参数 (见 camera_sdk_start_rtsp_streams)
+    typedef struct
+    {
+        const char *url;  // 推送到的 RTSP 地址
+        int width;        // 输出分辨率，0 表示主码流默认分辨率
+        int height;
+        int fps;          // 输出帧率，0 表示采集帧率
+        int bitrate_kbps; // 目标码率，0 表示按分辨率和帧率取默认值
+    } camera_sdk_stream_profile_t;
+
+    // 时间范围查询的一条结果
+    typedef struct
+    {
+        char path[256];           // 录像文件的完整路径
+        long long start_ms;       // 文件第一帧的系统时间 (毫秒, UNIX 纪元)
+        long long end_ms;         // 文件最后一帧的系统时间
+        long long keyframe_ms;    // 不晚于查询起点的最近关键帧时间
+        long long start_offset;   // 该关键帧在文件中的字节偏移
+        long long end_offset;     // 查询终点之后第一个关键帧的偏移，-1 表示到文件末尾
+        int width;
+        int height;
+        double min_lat, max_lat;  // 文件覆盖的 GPS 范围，没有定位数据时为 0
+        double min_lon, max_lon;
+    } camera_sdk_recording_range_t;
+
     /**
      * @brief 初始化摄像头 SDK 控制器。
      *
@@ -49,6 +93,9 @@ extern "C"
      *
      * @param handle camera_sdk_create 返回的有效句柄。
      * @param resolution 要录制的分辨率，可以是 "1080p", "720p", 或 "360p"。
+     *                   也可以用逗号分隔多个分辨率同时录制，例如 "1080p,360p"：
+     *                   第一个为主文件，其余生成带分辨率后缀的代理文件 (xxx_360p.mp4)，
+     *                   各文件共用一次裁剪和 OSD 叠加，并在同一帧开始和结束。
      * @return 成功启动返回 0，如果已在录制中或参数错误则返回 -1。
      */
     int camera_sdk_start_recording(void *handle, const char *resolution);
@@ -76,7 +123,33 @@ extern "C"
     int camera_sdk_start_rtsp_stream(void *handle, const char *url);
 
     /**
-     * @brief 停止当前正在进行的RTSP推流。
+     * @brief 把同一路码流同时推送到多个服务器 (例如主服务器和备份服务器)，支持 rtsp:// 和 rtmp://。
+     *
+     * 只编码一次；每个目的地址有独立的发送队列和发送线程，各自断线重连。某个服务器不可用或链路阻塞时
+     * 只丢弃发往它的数据，不会阻塞其他服务器或让其丢帧。非阻塞函数，立即返回。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param urls 目的地址数组，第一个为主服务器 (拥塞控制跟随它)。
+     * @param count urls 的个数。
+     * @return 成功启动返回 0，如果已在推流中或参数错误则返回 -1。
+     */
+    int camera_sdk_start_rtsp_stream_multi(void *handle, const char *const *urls, int count);
+
+    /**
+     * @brief 同时开始多路RTSP推流 (例如 1080p 主码流 + 360p/10fps 子码流)。
+     *
+     * 各路分辨率、帧率、码率独立，但共用同一条编码链：采集和裁剪只做一次，
+     * 每增加一路只增加一次缩放和编码。非阻塞函数，立即返回。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param profiles 各路推流参数，第一路为主码流。
+     * @param count profiles 的个数。
+     * @return 成功启动返回 0，如果已在推流中或参数错误则返回 -1。
+     */
+    int camera_sdk_start_rtsp_streams(void *handle, const camera_sdk_stream_profile_t *profiles, int count);
+
+    /**
+     * @brief 停止当前正在进行的RTSP推流 (多路推流时全部停止)。
      *
      * 这是一个阻塞函数。它会向推流线程发送停止信号，并等待线程完全结束后才返回。
      *
@@ -85,6 +158,70 @@ extern "C"
      */
     int camera_sdk_stop_rtsp_stream(void *handle);
 
+    /**
+     * @brief 启动内置RTSP服务器，客户端直接从相机拉流 (rtsp://<设备IP>:<port>/live)。
+     *
+     * 这是一个非阻塞函数。所有客户端共享同一路编码；编码格式和 OSD 烧录设置与推流相同，
+     * 同时推流时两者共用一条编码链。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param port 监听端口，小于等于 0 时使用默认端口 8554。
+     * @return 成功启动返回 0，如果已在运行或端口无法监听则返回 -1。
+     */
+    int camera_sdk_start_rtsp_server(void *handle, int port);
+
+    /**
+     * @brief 停止内置RTSP服务器并断开所有客户端。
+     *
+     * 这是一个阻塞函数，等待服务线程完全结束后才返回。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @return 成功停止返回 0，如果服务器未在运行则返回 -1。
+     */
+    int camera_sdk_stop_rtsp_server(void *handle);
+
+    /**
+     * @brief 启动低延迟 HLS (LL-HLS) 输出，供浏览器直接播放。
+     *
+     * 在 dir 中写入 CMAF fMP4 分段、部分分段和滚动播放列表 index.m3u8，用任意静态 HTTP 服务器
+     * 提供该目录即可 (例如 http://<设备IP>/hls/index.m3u8，浏览器端使用 hls.js 或 Safari)。
+     * 编码参数与推流相同，同时推流时共享同一路编码。磁盘占用以分段个数为上限 (HLS_PLAYLIST_SEGMENTS)。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param dir 输出目录，NULL 或空字符串时使用 HLS_OUTPUT_DIR；建议位于 tmpfs。
+     * @param part_ms 部分分段时长 (毫秒)，小于等于 0 时使用 HLS_PART_DURATION_MS。
+     * @return 成功启动返回 0，如果已在运行或目录无法创建则返回 -1。
+     */
+    int camera_sdk_start_hls(void *handle, const char *dir, int part_ms);
+
+    /**
+     * @brief 停止 HLS 输出。播放列表标记为结束 (EXT-X-ENDLIST)，已写出的分段保留在目录中。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @return 成功停止返回 0，如果未在运行则返回 -1。
+     */
+    int camera_sdk_stop_hls(void *handle);
+
+    /**
+     * @brief 启动内置 MJPEG over HTTP 预览，浏览器直接打开 http://<设备IP>:<port>/ 即可取景。
+     *
+     * 这是一个非阻塞函数。预览为低分辨率、低帧率的 JPEG 流 (MJPEG_PREVIEW_WIDTH/HEIGHT/FPS)，
+     * 不占用录制/推流的编码链，且只在有客户端观看时才编码。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param port 监听端口，小于等于 0 时使用默认端口 8080。
+     * @return 成功启动返回 0，如果已在运行则返回 -1。
+     */
+    int camera_sdk_start_preview_server(void *handle, int port);
+
+    /**
+     * @brief 停止 MJPEG 预览并断开所有客户端。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @return 成功停止返回 0，如果未在运行则返回 -1。
+     */
+    int camera_sdk_stop_preview_server(void *handle);
+
     /**
      * @brief 拍摄一张快照 (JPEG 图片)。
      *
@@ -130,6 +267,211 @@ extern "C"
      */
     void camera_sdk_zoom_out(void *handle);
 
+    /**
+     * @brief 在指定时长内平滑变焦到目标级别 (数字变焦)。
+     *
+     * 这是一个非阻塞函数，会立即返回。裁剪区域按每帧的采集时间插值，录制和推流画面都平滑过渡。
+     * 变焦进行中再次调用会从当前画面位置开始新的过渡。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param level 目标变焦级别，范围 1.0 ~ 8.0，超出范围会被限制。
+     * @param duration_ms 过渡时长 (毫秒)，<= 0 表示立即切换。
+     */
+    void camera_sdk_zoom_to(void *handle, float level, int duration_ms);
+
+    /**
+     * @brief 以恒定速度连续变焦 (数字变焦)。
+     *
+     * 这是一个非阻塞函数，会立即返回。变焦会持续进行，直到达到级别边界或再次调用本函数。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param levels_per_sec 每秒变化的级别数，正数放大、负数缩小，0 表示停止在当前级别。
+     */
+    void camera_sdk_set_zoom_velocity(void *handle, float levels_per_sec);
+
+    /**
+     * @brief 设置录制使用的视频编码格式。
+     *
+     * 对之后开始的录制生效，正在进行的录制不受影响。HEVC 在同等画质下约节省一半存储空间，
+     * 优先使用硬件编码器 (hevc_rkmpp)，不可用时回退到软件编码器 (libx265)。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param codec "h264" 或 "hevc" (也接受 "h265")。
+     * @return 成功返回 0，编码格式无效返回 -1。
+     */
+    int camera_sdk_set_recording_codec(void *handle, const char *codec);
+
+    /**
+     * @brief 设置 RTSP 推流使用的视频编码格式。
+     *
+     * 对之后开始的推流生效，正在进行的推流不受影响。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param codec "h264" 或 "hevc" (也接受 "h265")。
+     * @return 成功返回 0，编码格式无效返回 -1。
+     */
+    int camera_sdk_set_streaming_codec(void *handle, const char *codec);
+
+    /**
+     * @brief 设置延时摄影模式。
+     *
+     * 对之后开始的录制生效：每 interval_sec 秒保留一帧，以 30 fps 播放。
+     * 被跳过的帧在采集阶段直接丢弃，不做裁剪、OSD 和编码，CPU 与存储开销按比例下降。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param interval_sec 抽帧间隔 (秒)，例如 1.0 - 10.0；0 表示恢复普通录制。
+     * @param motion_blur 为 true 时把抽帧点之前的若干帧平均成一帧，画面中的运动更平滑。
+     * @return 成功返回 0，参数无效返回 -1。
+     */
+    int camera_sdk_set_timelapse(void *handle, double interval_sec, bool motion_blur);
+
+    /**
+     * @brief 设置录制/推流是否把 OSD 烧录到画面中。
+     *
+     * 对之后开始的录制/推流生效。POS 数据始终作为元数据输出：录像文件中为一条字幕轨
+     * (mov_text)，RTSP 码流中为 user data unregistered SEI。由播放器渲染叠加时可以关闭烧录，
+     * 省去该路输出每帧一次的 RGA 混合。OSD 总开关 (camera_sdk_set_osd_enabled) 关闭时两者都不烧录。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param recording 录制是否烧录。
+     * @param streaming 推流是否烧录。
+     */
+    void camera_sdk_set_osd_burn_in(void *handle, bool recording, bool streaming);
+
+    /**
+     * @brief 修改正在进行的录制的码率控制 (模式、码率、GOP)。
+     *
+     * 无需停止录制，新参数在下一个关键帧生效。多分辨率录制时参数针对主分辨率，
+     * 其余分辨率按面积比例缩放码率。如果推流与录制共享同一编码链，推流也会受影响。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param rc 码率控制参数。
+     * @return 成功返回 0，没有在录制或参数无效返回 -1。
+     */
+    int camera_sdk_set_recording_rate_control(void *handle, const camera_sdk_rate_control_t *rc);
+
+    /**
+     * @brief 修改正在进行的 RTSP 推流的码率控制 (模式、码率、GOP)。
+     *
+     * 无需停止推流，新参数在下一个关键帧生效，可用于根据网络状况调整码率。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param rc 码率控制参数。
+     * @return 成功返回 0，没有在推流或参数无效返回 -1。
+     */
+    int camera_sdk_set_streaming_rate_control(void *handle, const camera_sdk_rate_control_t *rc);
+
+    /**
+     * @brief 修改多路推流中某一路的码率控制，用法同 camera_sdk_set_streaming_rate_control。
+     *
+     * @param stream_index 推流序号 (与 camera_sdk_start_rtsp_streams 的顺序一致，0 为主码流)。
+     * @return 成功返回 0，该路不存在或参数无效返回 -1。
+     */
+    int camera_sdk_set_stream_rate_control(void *handle, int stream_index, const camera_sdk_rate_control_t *rc);
+
+    /**
+     * @brief 请求所有推流和内置 RTSP 服务器的编码输出在下一帧编码为 IDR。
+     *
+     * 用于播放端加入或解码出错后立即恢复画面，不必等到下一个 GOP。内置服务器在客户端开始播放
+     * 或丢帧时会自动请求 (限频，见 RTSP_KEYFRAME_REQUEST_MIN_MS)。与录制共享编码链时录像中也会多一个 IDR。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @return 成功返回 0，没有在推流返回 -1。
+     */
+    int camera_sdk_request_keyframe(void *handle);
+
+    /**
+     * @brief 设置推流/内置服务器是否使用周期帧内刷新代替周期 IDR。
+     *
+     * 帧内刷新把 I 宏块分散到一个 GOP 的各帧中，码率平滑、没有关键帧带来的延迟尖峰，适合低带宽链路；
+     * 新客户端靠按需 IDR 快速起播。仅 libx264/libx265 支持，硬件编码器保持周期 IDR。
+     * 对之后开始的推流生效。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param enabled true 开启帧内刷新。
+     */
+    void camera_sdk_set_streaming_intra_refresh(void *handle, bool enabled);
+
+    /**
+     * @brief 设置录制/推流是否每帧插入时延测量 SEI。
+     *
+     * SEI 中记录该帧的采集时刻和发出时刻 (单调时钟)，在同一设备上运行 tools/latency_meter 拉流
+     * 即可统计 采集->发送、发送->接收、接收->解码 各阶段和端到端时延的分位数；
+     * 对录像文件运行可统计 采集->写入 的时延。对之后开始的录制/推流生效。
+     * 开启后每帧多一次数据包复制 (约 50 字节的 SEI)，只建议在测量时使用。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param enabled true 开启。
+     */
+    void camera_sdk_set_latency_sei(void *handle, bool enabled);
+
+    /**
+     * @brief 锁定正在录制的分段 (以及上一个分段)，使其不会被循环录制淘汰。
+     *
+     * 用于保存事件片段 (例如碰撞)。锁定以存储目录中的 "<文件名>.lock" 标记文件持久化，
+     * 重启后仍然有效。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @return 成功返回 0，没有在录制或创建标记文件失败返回 -1。
+     */
+    int camera_sdk_lock_current_recording(void *handle);
+
+    /**
+     * @brief 锁定/解锁存储目录中的一个录像文件。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param filename 文件名 (不含目录)，例如 "20240101120000.mp4"。
+     * @return 成功返回 0，失败返回 -1。
+     */
+    int camera_sdk_lock_file(void *handle, const char *filename);
+    int camera_sdk_unlock_file(void *handle, const char *filename);
+
+    /**
+     * @brief 查询录像占用的空间和生效的配额。
+     *
+     * 空间超过 (配额 - 预留余量) 时，后台会提前删除最旧的未锁定录像。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param used_bytes 接收录像已用空间 (字节)，可为 NULL。
+     * @param quota_bytes 接收配额 (字节)，可为 NULL。
+     */
+    void camera_sdk_get_storage_info(void *handle, unsigned long long *used_bytes, unsigned long long *quota_bytes);
+
+    /**
+     * @brief 查询哪些录像文件 (及文件内的字节范围) 覆盖时间范围 [start_ms, end_ms]。
+     *
+     * 只查询内存中的录像目录和命中文件的关键帧索引 (.idx)，不打开媒体文件，通常在几毫秒内返回。
+     * 结果按开始时间排序；多分辨率录制时每种分辨率各有一条结果。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param start_ms, end_ms 系统时间 (毫秒, UNIX 纪元)。
+     * @param results 接收结果的数组，可为 NULL (只返回数量)。
+     * @param max_results results 数组的容量。
+     * @return 命中的文件总数 (可能大于 max_results)，失败返回 -1。
+     */
+    int camera_sdk_query_recordings(void *handle, long long start_ms, long long end_ms,
+                                    camera_sdk_recording_range_t *results, int max_results);
+
+    // 片段导出完成回调：result 为 0 表示成功，-1 表示失败
+    typedef void (*camera_sdk_export_callback_t)(const char *output_path, int result, void *user_data);
+
+    /**
+     * @brief 从已保存的录像中导出时间范围 [start_ms, end_ms] 的片段。
+     *
+     * 只做流复制 (不解码、不重新编码)：从起点之前最近的关键帧开始，到终点之后的关键帧为止，
+     * 跨分段拼接为一个 MP4。导出在后台线程中以最低的 CPU/I/O 优先级运行，不影响正在进行的录制和推流。
+     * 这是一个非阻塞函数，会立即返回。
+     *
+     * @param handle camera_sdk_create 返回的有效句柄。
+     * @param start_ms, end_ms 系统时间 (毫秒, UNIX 纪元)。
+     * @param output_path 输出 MP4 文件路径。
+     * @param callback 完成回调 (在后台线程中调用)，可为 NULL。
+     * @param user_data 传给回调的用户指针。
+     * @return 成功开始导出返回 0，参数无效或范围内没有录像返回 -1。
+     */
+    int camera_sdk_export_clip(void *handle, long long start_ms, long long end_ms, const char *output_path,
+                               camera_sdk_export_callback_t callback, void *user_data);
+
     /**
      * @brief 设置相机传感器的ISO值（感光度）。
      *
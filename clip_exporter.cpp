@@ -0,0 +1,230 @@
+// --- START OF FILE clip_exporter.cpp ---
+
+#include "clip_exporter.h"
+#include "app_config.h"
+#include "file_utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+static const AVRational kMicroseconds = {1, 1000000};
+
+static void print_err_clip(int ret, const char* context) {
+    char buf[256];
+    av_strerror(ret, buf, sizeof(buf));
+    fprintf(stderr, "[片段导出] FFmpeg 错误 in %s: %s (ret=%d)\n", context, buf, ret);
+}
+
+ClipExporter::ClipExporter(std::vector<RecordingCatalogHit> hits, int64_t start_us, int64_t end_us,
+                           std::string output_path, ClipExportCallback cb)
+    : m_hits(std::move(hits)),
+      m_start_us(start_us),
+      m_end_us(end_us),
+      m_output_path(std::move(output_path)),
+      m_on_complete_cb(std::move(cb)) {}
+
+ClipExporter::~ClipExporter() {
+    cleanup();
+}
+
+void ClipExporter::cleanup() {
+    if (m_ofmt_ctx && !(m_ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&m_ofmt_ctx->pb);
+    if (m_ofmt_ctx) avformat_free_context(m_ofmt_ctx);
+    av_packet_free(&m_pkt);
+    m_ofmt_ctx = nullptr;
+    m_out_stream = nullptr;
+    m_header_written = false;
+}
+
+bool ClipExporter::open_output(const AVStream* in_stream) {
+    int ret = avformat_alloc_output_context2(&m_ofmt_ctx, nullptr, nullptr, m_output_path.c_str());
+    if (!m_ofmt_ctx) {
+        print_err_clip(ret, "avformat_alloc_output_context2");
+        return false;
+    }
+    m_out_stream = avformat_new_stream(m_ofmt_ctx, nullptr);
+    if (!m_out_stream) {
+        return false;
+    }
+    avcodec_parameters_copy(m_out_stream->codecpar, in_stream->codecpar);
+    m_out_stream->time_base = in_stream->time_base;
+
+    if (!(m_ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        if ((ret = avio_open(&m_ofmt_ctx->pb, m_output_path.c_str(), AVIO_FLAG_WRITE)) < 0) {
+            print_err_clip(ret, "avio_open");
+            return false;
+        }
+    }
+    if ((ret = avformat_write_header(m_ofmt_ctx, nullptr)) < 0) {
+        print_err_clip(ret, "avformat_write_header");
+        return false;
+    }
+    m_header_written = true;
+    m_pkt = av_packet_alloc();
+    return m_pkt != nullptr;
+}
+
+// 文件内时间戳换算为系统时间 (见 RecordingIndexHeader::time_scale)
+static int64_t to_wall_us(int64_t start_us, double time_scale, int64_t ts, AVRational time_base) {
+    return start_us + static_cast<int64_t>(av_rescale_q(ts, time_base, kMicroseconds) * time_scale);
+}
+
+int64_t ClipExporter::to_output_ts(int64_t wall_us) const {
+    const int64_t media_us = static_cast<int64_t>((wall_us - m_clip_start_us) / m_time_scale);
+    return av_rescale_q(media_us, kMicroseconds, m_out_stream->time_base);
+}
+
+bool ClipExporter::copy_file(const RecordingCatalogHit& hit) {
+    AVFormatContext* ifmt_ctx = nullptr;
+    int ret = avformat_open_input(&ifmt_ctx, hit.media_path.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        print_err_clip(ret, hit.media_path.c_str());
+        return false;
+    }
+    // 只解析 moov 中的样本表，不读取媒体数据
+    if ((ret = avformat_find_stream_info(ifmt_ctx, nullptr)) < 0) {
+        print_err_clip(ret, "avformat_find_stream_info");
+        avformat_close_input(&ifmt_ctx);
+        return false;
+    }
+    int vidx = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (vidx < 0) {
+        avformat_close_input(&ifmt_ctx);
+        return false;
+    }
+    AVStream* in_stream = ifmt_ctx->streams[vidx];
+    const double time_scale = recording_index_time_scale(hit.header);
+
+    if (!m_ofmt_ctx) {
+        m_time_scale = time_scale;
+        if (!open_output(in_stream)) {
+            avformat_close_input(&ifmt_ctx);
+            return false;
+        }
+    } else {
+        const AVCodecParameters* a = m_out_stream->codecpar;
+        const AVCodecParameters* b = in_stream->codecpar;
+        if (a->codec_id != b->codec_id || a->width != b->width || a->height != b->height ||
+            time_scale != m_time_scale) {
+            // 中途切换了编码格式、分辨率或延时摄影的比例，无法拼接，片段在此结束
+            fprintf(stderr, "[片段导出] 警告: %s 的编码参数不同，片段在此截止。\n", hit.media_path.c_str());
+            m_finished = true;
+            avformat_close_input(&ifmt_ctx);
+            return true;
+        }
+    }
+
+    // 直接跳到索引中的起始关键帧 (文件内时间 0 对应 header.start_us，文件内 1 秒对应 time_scale 秒系统时间)
+    const int64_t seek_us = static_cast<int64_t>((hit.start_keyframe_us - hit.header.start_us) / time_scale);
+    if (seek_us > 0) {
+        int64_t ts = av_rescale_q(seek_us, kMicroseconds, in_stream->time_base);
+        if ((ret = av_seek_frame(ifmt_ctx, vidx, ts, AVSEEK_FLAG_BACKWARD)) < 0) {
+            print_err_clip(ret, "av_seek_frame");
+        }
+    }
+
+    bool ok = true;
+    AVPacket* in_pkt = av_packet_alloc();
+    while (in_pkt && (ret = av_read_frame(ifmt_ctx, in_pkt)) >= 0) {
+        if (in_pkt->stream_index != vidx) {
+            av_packet_unref(in_pkt);
+            continue;
+        }
+        const bool key = in_pkt->flags & AV_PKT_FLAG_KEY;
+        const int64_t wall_us = to_wall_us(hit.header.start_us, time_scale, in_pkt->pts, in_stream->time_base);
+
+        if (m_clip_start_us < 0) {
+            // 片段必须从关键帧开始
+            if (!key) {
+                av_packet_unref(in_pkt);
+                continue;
+            }
+            m_clip_start_us = wall_us;
+        }
+        if (key && wall_us > m_end_us) {
+            m_finished = true;
+            av_packet_unref(in_pkt);
+            break;
+        }
+
+        // 输出时间戳按系统时间对齐各分段，再按比例换回媒体时间，延时摄影导出后与原录像的播放速度相同
+        const int64_t dts_wall_us = to_wall_us(hit.header.start_us, time_scale, in_pkt->dts, in_stream->time_base);
+        int64_t dts = to_output_ts(dts_wall_us);
+        if (m_last_dts != AV_NOPTS_VALUE && dts <= m_last_dts) {
+            // 分段之间的时间戳按系统时间换算，可能有不到一帧的舍入重叠，顺延 1 个单位；
+            // 重叠一帧或更多说明是上一个文件已经写过的数据，直接丢弃
+            const int64_t frame_ticks = in_pkt->duration > 0
+                ? av_rescale_q(in_pkt->duration, in_stream->time_base, m_out_stream->time_base)
+                : av_rescale_q(1, AVRational{1, V4L2_INPUT_FPS}, m_out_stream->time_base);
+            if (m_last_dts - dts >= frame_ticks) {
+                av_packet_unref(in_pkt);
+                continue;
+            }
+            dts = m_last_dts + 1;
+        }
+        int64_t pts = to_output_ts(wall_us);
+
+        av_packet_move_ref(m_pkt, in_pkt);
+        m_pkt->pts = std::max(pts, dts);
+        m_pkt->dts = dts;
+        m_pkt->duration = av_rescale_q(m_pkt->duration, in_stream->time_base, m_out_stream->time_base);
+        m_pkt->stream_index = m_out_stream->index;
+        m_pkt->pos = -1;
+        m_last_dts = dts;
+
+        if ((ret = av_interleaved_write_frame(m_ofmt_ctx, m_pkt)) < 0) {
+            print_err_clip(ret, "av_interleaved_write_frame");
+            ok = false;
+            break;
+        }
+        m_packets_written++;
+    }
+
+    av_packet_free(&in_pkt);
+    avformat_close_input(&ifmt_ctx);
+    return ok;
+}
+
+void ClipExporter::run() {
+    lower_thread_priority(CLIP_EXPORT_NICE);
+
+    // 多分辨率录制时同一时间有多个文件，只取分辨率最高的一组
+    int64_t max_area = 0;
+    for (const auto& hit : m_hits) {
+        max_area = std::max<int64_t>(max_area, static_cast<int64_t>(hit.header.width) * hit.header.height);
+    }
+    m_hits.erase(std::remove_if(m_hits.begin(), m_hits.end(), [max_area](const RecordingCatalogHit& h) {
+                     return static_cast<int64_t>(h.header.width) * h.header.height != max_area;
+                 }),
+                 m_hits.end());
+
+    printf("[片段导出] 开始导出 %s (%.1f 秒, %zu 个分段)\n", m_output_path.c_str(),
+           (m_end_us - m_start_us) / 1e6, m_hits.size());
+
+    bool ok = !m_hits.empty();
+    if (!ok) {
+        fprintf(stderr, "[片段导出] 错误: 该时间范围内没有录像。\n");
+    }
+    for (const auto& hit : m_hits) {
+        if (!ok || m_finished) break;
+        ok = copy_file(hit);
+    }
+
+    if (m_header_written) {
+        av_write_trailer(m_ofmt_ctx);
+    }
+    cleanup();
+    ok = ok && m_packets_written > 0;
+
+    if (ok) {
+        printf("[片段导出] 导出完成: %s (%lld 帧)\n", m_output_path.c_str(), (long long)m_packets_written);
+    } else {
+        fprintf(stderr, "[片段导出] 导出失败: %s\n", m_output_path.c_str());
+        unlink(m_output_path.c_str());
+    }
+    if (m_on_complete_cb) {
+        m_on_complete_cb(m_output_path, ok ? 0 : -1);
+    }
+}
@@ -0,0 +1,63 @@
+// --- START OF FILE clip_exporter.h ---
+
+#ifndef CLIP_EXPORTER_H
+#define CLIP_EXPORTER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "recording_catalog.h"
+
+// 导出完成回调：输出路径与结果 (0 成功, -1 失败)
+using ClipExportCallback = std::function<void(const std::string&, int)>;
+
+/**
+ * @class ClipExporter
+ * @brief 按时间范围从已录制的分段中导出片段，只做流复制 (不解码、不编码)。
+ *
+ * - 用录像目录的关键帧索引找到覆盖范围的文件，从范围起点之前最近的关键帧开始，
+ *   到终点之后的第一个关键帧为止，跨分段拼接成一个 MP4。
+ * - run() 在调用线程中把自己的 CPU 和 I/O 优先级降到最低 (idle)，
+ *   不与正在进行的录制/推流争抢存储卡带宽。
+ * - 只导出已移动到存储目录的分段；多分辨率录制时取分辨率最高的一组文件。
+ */
+class ClipExporter {
+public:
+    ClipExporter(std::vector<RecordingCatalogHit> hits, int64_t start_us, int64_t end_us,
+                 std::string output_path, ClipExportCallback cb);
+    ~ClipExporter();
+
+    void run();
+
+private:
+    bool open_output(const AVStream* in_stream);
+    bool copy_file(const RecordingCatalogHit& hit);
+    // 系统时间换算为输出流时间戳 (以 m_clip_start_us 为零点，按 m_time_scale 换回媒体时间)
+    int64_t to_output_ts(int64_t wall_us) const;
+    void cleanup();
+
+    std::vector<RecordingCatalogHit> m_hits;
+    int64_t m_start_us;
+    int64_t m_end_us;
+    std::string m_output_path;
+    ClipExportCallback m_on_complete_cb;
+
+    AVFormatContext* m_ofmt_ctx = nullptr;
+    AVStream* m_out_stream = nullptr;
+    AVPacket* m_pkt = nullptr;
+    bool m_header_written = false;
+    bool m_finished = false;       // 已到达终点之后的关键帧
+    int64_t m_clip_start_us = -1;  // 输出第一帧 (关键帧) 的系统时间，输出时间戳以它为零点
+    double m_time_scale = 0;       // 第一个分段的时间比例 (延时摄影大于 1)，比例不同的分段不能拼接
+    int64_t m_last_dts = AV_NOPTS_VALUE;
+    int64_t m_packets_written = 0;
+};
+
+#endif // CLIP_EXPORTER_H
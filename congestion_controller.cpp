@@ -0,0 +1,104 @@
+// --- START OF FILE congestion_controller.cpp ---
+
+#include "congestion_controller.h"
+#include "app_config.h"
+
+#include <algorithm>
+#include <cstdio>
+
+CongestionController::CongestionController(const Level& base, bool allow_resize)
+{
+    const int64_t min_rate = RTSP_MIN_BITRATE;
+    m_levels.push_back(base);
+
+    // 先只降码率，画面不变
+    Level level = base;
+    level.bit_rate = std::max(min_rate, base.bit_rate * 7 / 10);
+    m_levels.push_back(level);
+    level.bit_rate = std::max(min_rate, base.bit_rate / 2);
+    m_levels.push_back(level);
+
+    // 再降帧率，每帧仍有足够的码率
+    const int base_fps = base.fps > 0 ? base.fps : V4L2_INPUT_FPS;
+    const int half_fps = std::max(RTSP_ADAPT_MIN_FPS, base_fps / 2);
+    if (half_fps < base_fps) {
+        level.fps = half_fps;
+        level.bit_rate = std::max(min_rate, base.bit_rate * 4 / 10);
+        m_levels.push_back(level);
+    }
+
+    // 最后降分辨率 (宽高减半，保持偶数)
+    const int half_width = (base.width / 2) & ~1;
+    const int half_height = (base.height / 2) & ~1;
+    if (allow_resize && half_width >= RTSP_ADAPT_MIN_WIDTH) {
+        level.width = half_width;
+        level.height = half_height;
+        level.bit_rate = std::max(min_rate, base.bit_rate / 4);
+        m_levels.push_back(level);
+    }
+}
+
+void CongestionController::on_packet_sent(int64_t send_us, size_t backlog)
+{
+    m_busy_us += send_us;
+    m_max_backlog = std::max(m_max_backlog, backlog);
+}
+
+void CongestionController::reset(int64_t now_us)
+{
+    m_index = 0;
+    m_window_start_us = now_us;
+    m_busy_us = 0;
+    m_max_backlog = 0;
+    m_last_change_us = now_us;
+    m_clear_since_us = -1;
+}
+
+bool CongestionController::update(int64_t now_us)
+{
+    if (m_window_start_us < 0) {
+        reset(now_us);
+        return false;
+    }
+    const int64_t window_us = now_us - m_window_start_us;
+    if (window_us < static_cast<int64_t>(RTSP_ADAPT_WINDOW_MS) * 1000) {
+        return false;
+    }
+
+    // 发送耗时占比：写入阻塞说明链路带宽不足 (TCP 发送缓冲区满或 UDP 套接字缓冲区满)
+    const double busy = static_cast<double>(m_busy_us) / window_us;
+    const size_t backlog = m_max_backlog;
+    m_window_start_us = now_us;
+    m_busy_us = 0;
+    m_max_backlog = 0;
+
+    const bool congested = busy > RTSP_ADAPT_BUSY_HIGH || backlog > RTSP_ADAPT_BACKLOG_HIGH;
+    const bool clear = busy < RTSP_ADAPT_BUSY_LOW && backlog <= RTSP_ADAPT_BACKLOG_LOW;
+    if (!clear) {
+        m_clear_since_us = -1;
+    } else if (m_clear_since_us < 0) {
+        m_clear_since_us = now_us - window_us;
+    }
+
+    // 上次切换后先等新参数生效 (码率在下一个关键帧生效)、积压排空
+    if (now_us - m_last_change_us < static_cast<int64_t>(RTSP_ADAPT_SETTLE_MS) * 1000) {
+        return false;
+    }
+
+    const int64_t hold_us = static_cast<int64_t>(RTSP_ADAPT_UP_HOLD_MS) * 1000;
+    if (congested && m_index + 1 < m_levels.size()) {
+        m_index++;
+    } else if (clear && m_index > 0 && now_us - m_clear_since_us >= hold_us && now_us - m_last_change_us >= hold_us) {
+        m_index--;
+    } else {
+        return false;
+    }
+
+    m_last_change_us = now_us;
+    m_clear_since_us = -1;
+    const Level& level = m_levels[m_index];
+    fprintf(stderr, "[拥塞控制] %s到第 %zu/%zu 档: %dx%d, %d fps, %lld kbps (发送占比 %.0f%%, 积压 %zu)\n",
+            congested ? "降" : "升", m_index, m_levels.size() - 1, level.width, level.height,
+            level.fps > 0 ? level.fps : V4L2_INPUT_FPS, (long long)(level.bit_rate / 1000), busy * 100, backlog);
+    return true;
+}
@@ -0,0 +1,67 @@
+// --- START OF FILE congestion_controller.h ---
+
+#ifndef CONGESTION_CONTROLLER_H
+#define CONGESTION_CONTROLLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class CongestionController
+ * @brief 推流拥塞控制：根据发送状况在一组由高到低的输出档位之间切换。
+ *
+ * - 输入：每个数据包的发送耗时 (写入阻塞的时间) 和发送队列的积压。按 RTSP_ADAPT_WINDOW_MS 统计，
+ *   发送耗时占窗口时间的比例或积压超过上限视为拥塞，两者都低于下限视为空闲。
+ * - 档位依次为：原始参数 -> 降码率 -> 再降码率 -> 降帧率 -> 降分辨率 (不允许修改分辨率时没有最后一档)。
+ * - 滞回：拥塞时立即降一档，之后等 RTSP_ADAPT_SETTLE_MS 让新参数生效、积压排空再判断；
+ *   连续空闲 RTSP_ADAPT_UP_HOLD_MS 才升一档。
+ *
+ * 只做判断，不修改编码链；调用者按 current() 应用档位。非线程安全，只在发送线程中使用。
+ */
+class CongestionController
+{
+public:
+    struct Level
+    {
+        int64_t bit_rate;
+        int fps;      // 0 表示采集帧率
+        int width;
+        int height;
+    };
+
+    /**
+     * @param base 最高档 (即原始推流参数)。
+     * @param allow_resize 是否允许最后一档降低分辨率。
+     */
+    CongestionController(const Level& base, bool allow_resize);
+
+    // 每发送完一个数据包调用一次
+    void on_packet_sent(int64_t send_us, size_t backlog);
+
+    /**
+     * @brief 统计窗口结束时做一次判断。
+     * @return 档位发生变化时返回 true，新档位见 current()。
+     */
+    bool update(int64_t now_us);
+
+    const Level& current() const { return m_levels[m_index]; }
+    size_t level_index() const { return m_index; }
+    size_t level_count() const { return m_levels.size(); }
+
+    // 回到最高档并清空统计
+    void reset(int64_t now_us);
+
+private:
+    std::vector<Level> m_levels;
+    size_t m_index = 0;
+
+    int64_t m_window_start_us = -1;
+    int64_t m_busy_us = 0;
+    size_t m_max_backlog = 0;
+
+    int64_t m_last_change_us = 0;
+    int64_t m_clear_since_us = -1;
+};
+
+#endif // CONGESTION_CONTROLLER_H
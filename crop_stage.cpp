@@ -0,0 +1,153 @@
+// --- START OF FILE crop_stage.cpp ---
+
+#include "crop_stage.h"
+
+#include <cstdio>
+#include <cstdint>
+
+// RGA/im2d 头文件
+#include <im2d.hpp>
+#include <RockchipRga.h>
+#include <RgaUtils.h>
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/hwcontext_drm.h>
+}
+
+CropStage::CropStage(int out_width, int out_height)
+    : m_out_width(out_width),
+      m_out_height(out_height),
+      m_frames(AV_PIX_FMT_NV12, out_width, out_height)
+{
+}
+
+CropStage::~CropStage()
+{
+    if (m_sws_ctx) sws_freeContext(m_sws_ctx);
+    m_sws_ctx = nullptr;
+}
+
+AVFramePtr CropStage::process(const AVFrame* src, int cx, int cy, int cw, int ch)
+{
+    if (!src) return nullptr;
+
+    // NV12: Y 平面 + 交错的 UV 平面，连续存放，便于 RGA 以单个虚拟地址导入
+    AVFramePtr dst = m_frames.acquire();
+    if (!dst) {
+        fprintf(stderr, "[裁剪阶段] 错误: 分配输出帧失败\n");
+        return nullptr;
+    }
+
+    bool ok = false;
+    if (m_use_rga) {
+        ok = process_rga(src, dst.get(), cx, cy, cw, ch);
+        if (!ok) {
+            fprintf(stderr, "[裁剪阶段] 警告: RGA 裁剪缩放失败，后续帧回退到软件路径。\n");
+            m_use_rga = false;
+        }
+    }
+    if (!ok) {
+        ok = process_sw(src, dst.get(), cx, cy, cw, ch);
+    }
+    if (!ok) {
+        return nullptr;
+    }
+
+    av_frame_copy_props(dst.get(), src);
+    return dst;
+}
+
+bool CropStage::process_rga(const AVFrame* src, AVFrame* dst, int cx, int cy, int cw, int ch)
+{
+    // RK_FORMAT_YCbCr_420_SP 对应 NV12
+    const int rga_format = RK_FORMAT_YCbCr_420_SP;
+    rga_buffer_handle_t src_handle = -1;
+    int src_wstride = 0, src_hstride = 0;
+
+    if (src->format == AV_PIX_FMT_DRM_PRIME) {
+        // 硬件帧: data[0] 是 DRM 帧描述符，按 fd 零拷贝导入
+        const AVDRMFrameDescriptor* desc = reinterpret_cast<const AVDRMFrameDescriptor*>(src->data[0]);
+        if (!desc || desc->nb_layers < 1 || desc->layers[0].nb_planes < 2) return false;
+        src_wstride = static_cast<int>(desc->layers[0].planes[0].pitch);
+        src_hstride = static_cast<int>(desc->layers[0].planes[1].offset / desc->layers[0].planes[0].pitch);
+        src_handle = importbuffer_fd(desc->objects[0].fd, src_wstride, src_hstride, rga_format);
+    } else if (src->format == AV_PIX_FMT_NV12) {
+        // 软件帧: 要求 Y/UV 平面连续 (采集模块用 av_frame_get_buffer 分配，满足该条件)
+        src_wstride = src->linesize[0];
+        src_hstride = static_cast<int>((src->data[1] - src->data[0]) / src->linesize[0]);
+        if (src->linesize[1] != src_wstride || src_hstride < src->height) return false;
+        src_handle = importbuffer_virtualaddr(src->data[0], src_wstride, src_hstride, rga_format);
+    } else {
+        return false;
+    }
+    if (src_handle <= 0) return false;
+
+    rga_buffer_handle_t dst_handle = importbuffer_virtualaddr(dst->data[0], m_out_width, m_out_height, rga_format);
+    if (dst_handle <= 0) {
+        releasebuffer_handle(src_handle);
+        return false;
+    }
+
+    rga_buffer_t rga_src = wrapbuffer_handle(src_handle, src->width, src->height, rga_format, src_wstride, src_hstride);
+    rga_buffer_t rga_dst = wrapbuffer_handle(dst_handle, m_out_width, m_out_height, rga_format);
+    rga_buffer_t rga_pat = {};
+    im_rect srect = {cx, cy, cw, ch};
+    im_rect drect = {0, 0, m_out_width, m_out_height};
+    im_rect prect = {};
+
+    IM_STATUS status = improcess(rga_src, rga_dst, rga_pat, srect, drect, prect, IM_SYNC);
+
+    releasebuffer_handle(dst_handle);
+    releasebuffer_handle(src_handle);
+
+    if (status != IM_STATUS_SUCCESS) {
+        fprintf(stderr, "[裁剪阶段] RGA improcess 失败: %s\n", imStrError(status));
+        return false;
+    }
+    return true;
+}
+
+bool CropStage::process_sw(const AVFrame* src, AVFrame* dst, int cx, int cy, int cw, int ch)
+{
+    if (src->format == AV_PIX_FMT_DRM_PRIME) {
+        fprintf(stderr, "[裁剪阶段] 错误: 软件路径不支持硬件帧输入\n");
+        return false;
+    }
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(src->format));
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+        fprintf(stderr, "[裁剪阶段] 错误: 软件路径不支持的像素格式 %d\n", src->format);
+        return false;
+    }
+
+    // 直接偏移各平面的数据指针完成裁剪，不拷贝像素也不复制帧；
+    // 起点对齐到色度采样网格，保证亮度和色度对应同一位置
+    cx &= ~((1 << desc->log2_chroma_w) - 1);
+    cy &= ~((1 << desc->log2_chroma_h) - 1);
+    int max_step[4];
+    av_image_fill_max_pixsteps(max_step, nullptr, desc);
+    const uint8_t* data[4] = {nullptr};
+    for (int i = 0; i < 4 && src->data[i]; i++) {
+        const bool chroma = (i == 1 || i == 2);
+        const int x = chroma ? (cx >> desc->log2_chroma_w) : cx;
+        const int y = chroma ? (cy >> desc->log2_chroma_h) : cy;
+        data[i] = src->data[i] + static_cast<ptrdiff_t>(y) * src->linesize[i] + x * max_step[i];
+    }
+
+    // 裁剪尺寸随变焦变化，sws_getCachedContext 只在参数变化时重建缩放上下文
+    m_sws_ctx = sws_getCachedContext(m_sws_ctx,
+                                     cw, ch, static_cast<AVPixelFormat>(src->format),
+                                     m_out_width, m_out_height, AV_PIX_FMT_NV12,
+                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!m_sws_ctx) {
+        fprintf(stderr, "[裁剪阶段] 错误: sws_getCachedContext 失败\n");
+        return false;
+    }
+
+    sws_scale(m_sws_ctx, data, src->linesize, 0, ch, dst->data, dst->linesize);
+    return true;
+}
@@ -0,0 +1,55 @@
+// --- START OF FILE crop_stage.h ---
+
+#ifndef CROP_STAGE_H
+#define CROP_STAGE_H
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include "media_pool.h"
+
+/**
+ * @class CropStage
+ * @brief 数字变焦的逐帧裁剪+缩放阶段。
+ *
+ * - 每帧按调用者传入的裁剪区域处理，输出尺寸固定，因此变焦不需要重建下游滤镜图。
+ * - 优先使用 RGA (improcess) 一次完成裁剪和缩放，失败时回退到 libswscale。
+ * - 输出为 NV12 软件帧，帧和缓冲区都来自内部的帧池，随引用计数自动回收。
+ *
+ * 非线程安全：每个实例只应由一个线程使用。
+ */
+class CropStage
+{
+public:
+    CropStage(int out_width, int out_height);
+    ~CropStage();
+
+    /**
+     * @brief 裁剪并缩放一帧。
+     * @param src 输入帧 (NV12 软件帧或 DRM_PRIME 硬件帧)。
+     * @param cx, cy, cw, ch 在输入帧上的裁剪区域。
+     * @return 帧池中的 NV12 帧 (已复制 pts 等属性，调用者独占、可修改)，失败时返回 nullptr。
+     */
+    AVFramePtr process(const AVFrame* src, int cx, int cy, int cw, int ch);
+
+    int get_output_width() const { return m_out_width; }
+    int get_output_height() const { return m_out_height; }
+
+private:
+    bool process_rga(const AVFrame* src, AVFrame* dst, int cx, int cy, int cw, int ch);
+    bool process_sw(const AVFrame* src, AVFrame* dst, int cx, int cy, int cw, int ch);
+
+    int m_out_width;
+    int m_out_height;
+
+    // RGA 失败一次后不再尝试，后续帧直接走软件路径
+    bool m_use_rga = true;
+
+    FramePool m_frames;
+    SwsContext* m_sws_ctx = nullptr;
+};
+
+#endif // CROP_STAGE_H
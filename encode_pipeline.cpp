@@ -0,0 +1,1096 @@
+// --- START OF FILE encode_pipeline.cpp ---
+
+#include "encode_pipeline.h"
+#include "app_config.h"
+#include "osd_manager.h"
+#include "zoom_manager.h"
+#include "camera_capture.h"
+#include "crop_stage.h"
+#include "alloc_counter.h"
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+extern "C"
+{
+#include <libavutil/avutil.h>
+#include <libavutil/opt.h>
+#include <libavutil/hwcontext.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
+#include <libavutil/frame.h>
+}
+
+static void print_err_pipe(int ret, const char *context)
+{
+    char buf[256];
+    av_strerror(ret, buf, sizeof(buf));
+    fprintf(stderr, "[编码流水线] FFmpeg 错误 in %s: %s (ret=%d)\n", context, buf, ret);
+}
+
+EncodePipeline::EncodePipeline(CameraCapture* capture_module,
+                               std::shared_ptr<OsdManager> osd_manager,
+                               std::shared_ptr<ZoomManager> zoom_manager,
+                               const std::vector<EncodeProfile>& profiles)
+    : m_capture_module(capture_module),
+      m_osd_manager(std::move(osd_manager)),
+      m_zoom_manager(std::move(zoom_manager)),
+      m_use_hw(false),
+      m_stop_flag(false),
+      m_is_running(false),
+      m_pipeline_error(false)
+{
+    for (const auto& profile : profiles) {
+        std::unique_ptr<Output> out(new Output());
+        out->profile = profile;
+        out->width = profile.width;
+        out->height = profile.height;
+        out->fps = profile.fps;
+        if (!m_outputs.empty() &&
+            profile.width * profile.height > m_outputs[m_largest_output]->profile.width * m_outputs[m_largest_output]->profile.height) {
+            m_largest_output = m_outputs.size();
+        }
+        m_outputs.push_back(std::move(out));
+    }
+}
+
+EncodePipeline::~EncodePipeline()
+{
+    stop();
+}
+
+bool EncodePipeline::is_compatible(const EncodeProfile& a, const EncodeProfile& b)
+{
+    return a.width == b.width &&
+           a.height == b.height &&
+           a.encoder_name == b.encoder_name &&
+           a.fps == b.fps &&
+           a.frame_interval == b.frame_interval &&
+           a.blend_frames == b.blend_frames &&
+           a.burn_in_osd == b.burn_in_osd &&
+           a.intra_refresh == b.intra_refresh;
+}
+
+int EncodePipeline::find_compatible_output(const EncodeProfile& profile) const
+{
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        // 被拥塞控制降级的输出不再共享，避免新加入的录制跟着降低画质
+        if (m_outputs[i]->adapted) {
+            continue;
+        }
+        if (is_compatible(m_outputs[i]->profile, profile)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool EncodePipeline::isRunning() const { return m_is_running; }
+bool EncodePipeline::hasError() const { return m_pipeline_error; }
+
+bool EncodePipeline::start()
+{
+    std::lock_guard<std::mutex> state_lock(m_state_mutex);
+    if (m_is_running) {
+        return true;
+    }
+
+    m_pipeline_error = false;
+    m_stop_flag = false;
+
+    if (m_outputs.empty()) {
+        fprintf(stderr, "[编码流水线] 错误: 没有配置任何输出\n");
+        return false;
+    }
+
+    AVBufferRef* hw_device_ctx = m_capture_module->get_hw_device_context();
+    if (hw_device_ctx != nullptr) {
+        fprintf(stderr, "[编码流水线] 从采集器获取 RKMPP 硬件设备成功。\n");
+        m_use_hw = true;
+    } else {
+        fprintf(stderr, "[编码流水线] 警告: 未获取到 RKMPP 硬件设备, 将回退到纯软件模式。\n");
+        m_use_hw = false;
+    }
+
+    // 裁剪阶段直接输出面积最大的那路尺寸，变焦只改变每帧的裁剪区域
+    const EncodeProfile& main_profile = m_outputs[m_largest_output]->profile;
+    m_crop_stage.reset(new CropStage(m_outputs[m_largest_output]->width, m_outputs[m_largest_output]->height));
+    m_last_zoom_generation = 0;
+
+    // 其余各路由 RGA 缩放；编码器能直接编码硬件帧时不再下载回内存
+    // (面积最大的那路就是裁剪输出，本来就在内存中)
+    const bool hw_frames = hw_frames_path_enabled();
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        Output& out = *m_outputs[i];
+        out.hw_frames = hw_frames && i != m_largest_output && encoder_accepts_hw_frames(out.profile.encoder_name);
+    }
+
+    // 只有一路输出时裁剪输出就是最终尺寸，不需要滤镜图。
+    // 滤镜图先于编码器配置：硬件帧直通的编码器需要 buffersink 的帧上下文
+    if (m_outputs.size() > 1 && !configure_filters()) {
+        bool retried = false;
+        for (auto& out : m_outputs) {
+            retried = retried || out->hw_frames;
+            out->hw_frames = false;
+        }
+        if (retried) {
+            fprintf(stderr, "[编码流水线] 警告: 硬件帧直通的滤镜图配置失败，回退到 hwdownload。\n");
+        }
+        if (!retried || !configure_filters()) {
+            fprintf(stderr, "[编码流水线] 错误: 配置滤镜图失败\n");
+            cleanup_ffmpeg();
+            return false;
+        }
+    }
+
+    for (auto& out : m_outputs) {
+        if (!initialize_encoder(*out)) {
+            fprintf(stderr, "[编码流水线] 错误: 初始化编码器失败 (%dx%d)\n", out->profile.width, out->profile.height);
+            cleanup_ffmpeg();
+            return false;
+        }
+        if (out->hw_frames) {
+            fprintf(stderr, "[编码流水线] %dx%d: %s\n", out->profile.width, out->profile.height,
+                    out->enc_ctx->pix_fmt == AV_PIX_FMT_DRM_PRIME ? "DRM_PRIME 硬件帧直通编码器"
+                                                                  : "编码器不接受硬件帧，编码前下载为 NV12");
+        }
+    }
+
+    for (auto& out : m_outputs) {
+        out->next_frame_us = AV_NOPTS_VALUE;
+        if (out->profile.fps > 0) {
+            fprintf(stderr, "[编码流水线] %dx%d: 输出帧率 %d fps\n", out->profile.width, out->profile.height, out->profile.fps);
+        }
+    }
+
+    m_frame_interval = std::max(main_profile.frame_interval, 1);
+    m_blend_frames = std::max(1, std::min(main_profile.blend_frames, m_frame_interval));
+    m_output_frame_count = 0;
+    m_blend_count = 0;
+    m_blend_last_pts = AV_NOPTS_VALUE;
+    m_capture_module->register_consumer(&m_queue_decoded_frames, m_frame_interval, m_blend_frames);
+    if (m_frame_interval > 1) {
+        fprintf(stderr, "[编码流水线] 延时摄影: 每 %d 帧编码 1 帧%s\n", m_frame_interval,
+                m_blend_frames > 1 ? " (多帧平均)" : "");
+    }
+
+    fprintf(stderr, "[编码流水线] 启动流水线线程 (%zu 路输出)...\n", m_outputs.size());
+    try {
+        for (size_t i = 0; i < m_outputs.size(); ++i) {
+            m_outputs[i]->thread_encode = std::thread(&EncodePipeline::thread_encode, this, i);
+        }
+        m_thread_filter = std::thread(&EncodePipeline::thread_filter_osd, this);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "[编码流水线] 启动线程失败: %s\n", e.what());
+        m_stop_flag = true;
+        m_capture_module->unregister_consumer(&m_queue_decoded_frames);
+        m_queue_decoded_frames.stop();
+        for (auto& out : m_outputs) out->queue_filtered_frames.stop();
+        if (m_thread_filter.joinable()) m_thread_filter.join();
+        for (auto& out : m_outputs) {
+            if (out->thread_encode.joinable()) out->thread_encode.join();
+        }
+        cleanup_ffmpeg();
+        return false;
+    }
+
+    m_is_running = true;
+    return true;
+}
+
+void EncodePipeline::stop()
+{
+    std::lock_guard<std::mutex> state_lock(m_state_mutex);
+    if (!m_is_running.exchange(false)) {
+        return;
+    }
+
+    fprintf(stderr, "[编码流水线] 收到停止信号...\n");
+    m_stop_flag = true;
+
+    m_capture_module->unregister_consumer(&m_queue_decoded_frames);
+    m_queue_decoded_frames.stop();
+
+    // 先等 T1 退出 (它会停止各输出的帧队列)，再让各编码线程把已滤镜的帧编完。
+    // 这样所有输出在同一帧结束，多分辨率录制的文件边界保持一致。
+    if (m_thread_filter.joinable()) m_thread_filter.join();
+    for (auto& out : m_outputs) {
+        if (out->thread_encode.joinable()) out->thread_encode.join();
+    }
+    fprintf(stderr, "[编码流水线] 流水线线程已全部退出。\n");
+
+    // 把编码器内部缓存的最后几帧交给仍在注册的消费者，然后再通知它们结束
+    if (!m_pipeline_error) {
+        for (size_t i = 0; i < m_outputs.size(); ++i) {
+            flush_encoder(i);
+        }
+    }
+    stop_all_consumers();
+
+    cleanup_ffmpeg();
+}
+
+bool EncodePipeline::register_consumer(ThreadSafePacketQueue* consumer_queue, size_t output_index)
+{
+    if (!consumer_queue || output_index >= m_outputs.size()) return false;
+    if (!m_is_running || m_pipeline_error) {
+        fprintf(stderr, "[编码流水线] 错误: 流水线未运行，无法注册消费者。\n");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_consumer_mutex);
+    m_consumers.push_back(Consumer{consumer_queue, output_index});
+    fprintf(stderr, "[编码流水线] 输出 #%zu 注册了一个数据包消费者。当前总数: %zu\n", output_index, m_consumers.size());
+    return true;
+}
+
+void EncodePipeline::stop_all_consumers()
+{
+    std::lock_guard<std::mutex> lock(m_consumer_mutex);
+    for (auto& c : m_consumers) {
+        c.queue->stop();
+    }
+}
+
+void EncodePipeline::unregister_consumer(ThreadSafePacketQueue* consumer_queue)
+{
+    if (!consumer_queue) return;
+    unregister_consumers(std::vector<ThreadSafePacketQueue*>{consumer_queue});
+}
+
+void EncodePipeline::unregister_consumers(const std::vector<ThreadSafePacketQueue*>& consumer_queues)
+{
+    auto is_leaving = [&consumer_queues](const Consumer& c) {
+        return std::find(consumer_queues.begin(), consumer_queues.end(), c.queue) != consumer_queues.end();
+    };
+
+    bool is_last = false;
+    {
+        std::lock_guard<std::mutex> lock(m_consumer_mutex);
+        size_t leaving = std::count_if(m_consumers.begin(), m_consumers.end(), is_leaving);
+        is_last = (leaving > 0 && leaving == m_consumers.size());
+    }
+
+    // 最后的消费者离开时，先停止并冲刷编码器，保证其文件完整收尾
+    if (is_last) {
+        stop();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_consumer_mutex);
+        m_consumers.remove_if(is_leaving);
+        fprintf(stderr, "[编码流水线] 注销了 %zu 个数据包消费者。剩余总数: %zu\n", consumer_queues.size(), m_consumers.size());
+    }
+    for (auto* q : consumer_queues) {
+        if (q) q->stop();
+    }
+}
+
+bool EncodePipeline::hw_frames_path_enabled() const
+{
+    if (!HW_FRAMES_PATH_ENABLED || !m_use_hw) {
+        return false;
+    }
+    const char* env = getenv(HW_FRAMES_OVERRIDE_ENV);
+    return !(env && strcmp(env, "0") == 0);
+}
+
+EncoderOpenParams EncodePipeline::encoder_params(const Output& out, const RateControl& rc) const
+{
+    EncoderOpenParams params;
+    params.width = out.profile.width;
+    params.height = out.profile.height;
+    params.rate_control = rc;
+    params.use_case = out.profile.use_case;
+    params.intra_refresh = out.profile.intra_refresh;
+    const int fps = out.fps;
+    if (fps > 0) {
+        params.framerate = AVRational{fps, 1};
+    }
+    params.hw_device_ctx = m_use_hw ? m_capture_module->get_hw_device_context() : nullptr;
+    return params;
+}
+
+bool EncodePipeline::initialize_encoder(Output& out)
+{
+    EncoderOpenParams params = encoder_params(out, out.profile.rate_control);
+    if (out.hw_frames && out.buffersink_ctx) {
+        params.hw_frames_ctx = av_buffersink_get_hw_frames_ctx(out.buffersink_ctx);
+    }
+    out.enc_ctx = open_video_encoder(out.profile.encoder_name, params);
+    if (out.enc_ctx) out.enc_time_base = out.enc_ctx->time_base;
+    out.rate_control = out.profile.rate_control;
+    out.frames_sent = 0;
+    out.prepend_extradata = false;
+    return out.enc_ctx != nullptr;
+}
+
+bool EncodePipeline::get_codec_parameters(size_t output_index, AVCodecParameters* par, AVRational* time_base) const
+{
+    if (output_index >= m_outputs.size() || !par) return false;
+    const Output& out = *m_outputs[output_index];
+    std::lock_guard<std::mutex> lock(out.enc_mutex);
+    if (!out.enc_ctx) return false;
+    if (avcodec_parameters_from_context(par, out.enc_ctx) < 0) return false;
+    if (time_base) *time_base = out.enc_ctx->time_base;
+    return true;
+}
+
+bool EncodePipeline::set_rate_control(size_t output_index, const RateControl& rc)
+{
+    if (output_index >= m_outputs.size()) return false;
+    if (rc.mode != RateControlMode::CQP && rc.bit_rate <= 0) {
+        fprintf(stderr, "[编码流水线] 错误: 无效的目标码率 %lld\n", (long long)rc.bit_rate);
+        return false;
+    }
+    if (rc.mode == RateControlMode::CQP && (rc.qp < 0 || rc.qp > 51)) {
+        fprintf(stderr, "[编码流水线] 错误: 无效的 QP %d\n", rc.qp);
+        return false;
+    }
+    if (rc.gop_size <= 0) {
+        fprintf(stderr, "[编码流水线] 错误: 无效的 GOP %d\n", rc.gop_size);
+        return false;
+    }
+
+    Output& out = *m_outputs[output_index];
+    std::lock_guard<std::mutex> lock(out.rate_control_mutex);
+    out.pending_rate_control = rc;
+    out.has_pending_rate_control = true;
+    fprintf(stderr, "[编码流水线] 输出 #%zu 码率控制将在下一个关键帧生效。\n", output_index);
+    return true;
+}
+
+RateControl EncodePipeline::get_rate_control(size_t output_index) const
+{
+    const Output& out = *m_outputs[output_index];
+    std::lock_guard<std::mutex> lock(out.enc_mutex);
+    return out.rate_control;
+}
+
+bool EncodePipeline::apply_pending_rate_control(size_t output_index)
+{
+    Output& out = *m_outputs[output_index];
+    RateControl wanted;
+    {
+        std::lock_guard<std::mutex> lock(out.rate_control_mutex);
+        if (!out.has_pending_rate_control) return true;
+        wanted = out.pending_rate_control;
+        out.has_pending_rate_control = false;
+    }
+
+    // 1. 编码器支持时原地修改，不中断码流
+    {
+        std::lock_guard<std::mutex> lock(out.enc_mutex);
+        if (try_reconfigure_encoder(out.enc_ctx, out.rate_control, wanted)) {
+            out.rate_control = wanted;
+            fprintf(stderr, "[T2:Encode-Pipe#%zu] 码率控制已原地更新: %lld bps\n", output_index, (long long)wanted.bit_rate);
+            return true;
+        }
+    }
+
+    // 2. 否则只重新打开本路编码器，失败时继续使用旧编码器
+    if (!reopen_encoder(output_index, wanted, out.enc_ctx->width, out.enc_ctx->height, out.enc_ctx->hw_frames_ctx)) {
+        fprintf(stderr, "[T2:Encode-Pipe#%zu] 警告: 按新码率控制打开编码器失败，保持原参数。\n", output_index);
+        return true;
+    }
+    fprintf(stderr, "[T2:Encode-Pipe#%zu] 编码器已按新码率控制重新打开 (%lld bps, GOP %d)%s\n", output_index,
+            (long long)wanted.bit_rate, wanted.gop_size, out.prepend_extradata ? "，参数集已变化" : "");
+    return true;
+}
+
+bool EncodePipeline::reopen_encoder(size_t output_index, const RateControl& rc, int width, int height,
+                                    AVBufferRef* hw_frames_ctx)
+{
+    Output& out = *m_outputs[output_index];
+    // 先打开新的，成功后再替换
+    EncoderOpenParams params = encoder_params(out, rc);
+    params.width = width;
+    params.height = height;
+    params.hw_frames_ctx = hw_frames_ctx;
+    AVCodecContext* new_ctx = open_video_encoder(out.enc_ctx->codec->name, params);
+    if (!new_ctx) {
+        return false;
+    }
+    // 滤镜线程按缓存的时间基换算时间戳，新编码器必须保持相同的时间基
+    if (av_cmp_q(new_ctx->time_base, out.enc_time_base) != 0) {
+        fprintf(stderr, "[T2:Encode-Pipe#%zu] 错误: 新编码器时间基 %d/%d 与原来的不一致。\n", output_index,
+                new_ctx->time_base.num, new_ctx->time_base.den);
+        avcodec_free_context(&new_ctx);
+        return false;
+    }
+
+    // 旧编码器缓存的数据包先发出去，保证时间戳连续
+    flush_encoder(output_index);
+
+    AVCodecContext* old_ctx = out.enc_ctx;
+    {
+        std::lock_guard<std::mutex> lock(out.enc_mutex);
+        out.prepend_extradata = (new_ctx->extradata_size != old_ctx->extradata_size ||
+                                 (new_ctx->extradata_size > 0 &&
+                                  memcmp(new_ctx->extradata, old_ctx->extradata, new_ctx->extradata_size) != 0));
+        out.enc_ctx = new_ctx;
+        out.rate_control = rc;
+        out.frames_sent = 0;
+    }
+    avcodec_free_context(&old_ctx);
+    return true;
+}
+
+bool EncodePipeline::set_output_adaptation(size_t output_index, int width, int height, int fps)
+{
+    if (output_index >= m_outputs.size()) return false;
+    Output& out = *m_outputs[output_index];
+    if (width <= 0 || height <= 0 || (width % 2) || (height % 2) ||
+        width > out.profile.width || height > out.profile.height || fps < 0) {
+        fprintf(stderr, "[编码流水线] 错误: 无效的输出调整 %dx%d@%d\n", width, height, fps);
+        return false;
+    }
+    if ((width != out.profile.width || height != out.profile.height) && !can_resize_output(output_index)) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(out.adaptation_mutex);
+        out.pending_width = width;
+        out.pending_height = height;
+        out.pending_fps = fps;
+        out.has_pending_adaptation = true;
+    }
+    m_adaptation_pending = true;
+    return true;
+}
+
+bool EncodePipeline::can_resize_output(size_t output_index) const
+{
+    return output_index < m_outputs.size() && (m_outputs.size() == 1 || output_index != m_largest_output);
+}
+
+size_t EncodePipeline::get_consumer_count(size_t output_index) const
+{
+    std::lock_guard<std::mutex> lock(m_consumer_mutex);
+    return static_cast<size_t>(std::count_if(m_consumers.begin(), m_consumers.end(),
+                                             [output_index](const Consumer& c) { return c.output_index == output_index; }));
+}
+
+int64_t EncodePipeline::get_capture_time_us(int64_t pts, AVRational time_base) const
+{
+    const int64_t origin = m_capture_origin_us;
+    if (origin == AV_NOPTS_VALUE || pts == AV_NOPTS_VALUE) {
+        return AV_NOPTS_VALUE;
+    }
+    return origin + av_rescale_q(pts, time_base, AVRational{1, 1000000});
+}
+
+void EncodePipeline::request_keyframe(size_t output_index)
+{
+    if (output_index < m_outputs.size()) {
+        m_outputs[output_index]->force_keyframe = true;
+    }
+}
+
+bool EncodePipeline::apply_output_adaptation()
+{
+    bool rebuild_crop = false;
+    bool rebuild_graph = false;
+    for (auto& out_ptr : m_outputs) {
+        Output& out = *out_ptr;
+        int width = 0, height = 0, fps = 0;
+        {
+            std::lock_guard<std::mutex> lock(out.adaptation_mutex);
+            if (!out.has_pending_adaptation) continue;
+            width = out.pending_width;
+            height = out.pending_height;
+            fps = out.pending_fps;
+            out.has_pending_adaptation = false;
+        }
+
+        out.fps = fps;
+        out.next_frame_us = AV_NOPTS_VALUE;
+        if (width != out.width || height != out.height) {
+            out.width = width;
+            out.height = height;
+            if (m_filter_graph) {
+                rebuild_graph = true;
+            } else {
+                rebuild_crop = true;
+            }
+        }
+        out.adapted = (width != out.profile.width || height != out.profile.height || fps != out.profile.fps);
+        fprintf(stderr, "[T1:Filter-Pipe] 输出 %dx%d 调整为 %dx%d, %d fps\n", out.profile.width, out.profile.height,
+                width, height, fps > 0 ? fps : V4L2_INPUT_FPS);
+    }
+
+    // 单路输出：裁剪阶段直接输出新尺寸；多路输出：只重建滤镜图中的缩放
+    if (rebuild_crop) {
+        const Output& main = *m_outputs[m_largest_output];
+        m_crop_stage.reset(new CropStage(main.width, main.height));
+    }
+    if (rebuild_graph && !configure_filters()) {
+        fprintf(stderr, "[T1:Filter-Pipe] 错误: 调整分辨率后重建滤镜图失败\n");
+        return false;
+    }
+    return true;
+}
+
+AVPacket* EncodePipeline::prepend_parameter_sets(const AVCodecContext* enc_ctx, const AVPacket* pkt)
+{
+    // 编码器输出 Annex B 码流，直接把 extradata (SPS/PPS[/VPS]) 拼接到关键帧前
+    AVPacket* out_pkt = av_packet_alloc();
+    if (!out_pkt) return nullptr;
+    if (av_new_packet(out_pkt, enc_ctx->extradata_size + pkt->size) < 0) {
+        av_packet_free(&out_pkt);
+        return nullptr;
+    }
+    memcpy(out_pkt->data, enc_ctx->extradata, enc_ctx->extradata_size);
+    memcpy(out_pkt->data + enc_ctx->extradata_size, pkt->data, pkt->size);
+    av_packet_copy_props(out_pkt, pkt);
+    return out_pkt;
+}
+
+std::string EncodePipeline::build_filter_descr() const
+{
+    const size_t n = m_outputs.size();
+    char part[256];
+
+    // 多路输出 (单路输出不建滤镜图)：裁剪阶段已输出面积最大那路的尺寸 (NV12)，
+    // split 后其余各路缩放到目标分辨率
+    std::string descr = "[in]";
+    snprintf(part, sizeof(part), "split=%zu", n);
+    descr += part;
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(part, sizeof(part), "[s%zu]", i);
+        descr += part;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const Output& p = *m_outputs[i];
+        if (i == m_largest_output) {
+            snprintf(part, sizeof(part), ";[s%zu]null[out%zu]", i, i);
+        } else if (m_outputs[i]->hw_frames) {
+            snprintf(part, sizeof(part), ";[s%zu]hwupload,vpp_rkrga=w=%d:h=%d[out%zu]", i, p.width, p.height, i);
+        } else if (m_use_hw) {
+            snprintf(part, sizeof(part), ";[s%zu]hwupload,vpp_rkrga=w=%d:h=%d,hwdownload,format=nv12[out%zu]",
+                     i, p.width, p.height, i);
+        } else {
+            snprintf(part, sizeof(part), ";[s%zu]scale=%d:%d,format=nv12[out%zu]", i, p.width, p.height, i);
+        }
+        descr += part;
+    }
+    return descr;
+}
+
+bool EncodePipeline::configure_filters()
+{
+    avfilter_graph_free(&m_filter_graph);
+    m_buffersrc_ctx = nullptr;
+    for (auto& out : m_outputs) out->buffersink_ctx = nullptr;
+    m_filter_graph = avfilter_graph_alloc();
+    if (!m_filter_graph) return false;
+
+    AVBufferRef* hw_device_ctx = m_capture_module->get_hw_device_context();
+
+    const AVFilter *buffersrc = avfilter_get_by_name("buffer");
+    const AVFilter *buffersink = avfilter_get_by_name("buffersink");
+    char args[512];
+
+    // 输入是裁剪阶段的输出：固定尺寸的 NV12 软件帧，滤镜图在整个录制期间只构建一次
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d",
+             m_crop_stage->get_output_width(), m_crop_stage->get_output_height(), AV_PIX_FMT_NV12, 1, 1000000);
+
+    int ret = avfilter_graph_create_filter(&m_buffersrc_ctx, buffersrc, "in", args, nullptr, m_filter_graph);
+    if (ret < 0) {
+        print_err_pipe(ret, "avfilter_graph_create_filter (buffersrc)");
+        return false;
+    }
+
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = m_buffersrc_ctx;
+
+    // 每路输出一个 buffersink，按 out0/out1/... 标签链接
+    AVFilterInOut *inputs = nullptr;
+    for (size_t i = m_outputs.size(); i-- > 0;) {
+        char sink_name[32];
+        snprintf(sink_name, sizeof(sink_name), "out%zu", i);
+        ret = avfilter_graph_create_filter(&m_outputs[i]->buffersink_ctx, buffersink, sink_name, nullptr, nullptr, m_filter_graph);
+        if (ret < 0) {
+            print_err_pipe(ret, "avfilter_graph_create_filter (buffersink)");
+            avfilter_inout_free(&inputs);
+            avfilter_inout_free(&outputs);
+            return false;
+        }
+        enum AVPixelFormat sink_fmts[] = {m_outputs[i]->hw_frames ? AV_PIX_FMT_DRM_PRIME : AV_PIX_FMT_NV12,
+                                          AV_PIX_FMT_NONE};
+        av_opt_set_int_list(m_outputs[i]->buffersink_ctx, "pix_fmts", sink_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+
+        AVFilterInOut *in = avfilter_inout_alloc();
+        in->name = av_strdup(sink_name);
+        in->filter_ctx = m_outputs[i]->buffersink_ctx;
+        in->next = inputs;
+        inputs = in;
+    }
+
+    const std::string filt_descr = build_filter_descr();
+
+    ret = avfilter_graph_parse_ptr(m_filter_graph, filt_descr.c_str(), &inputs, &outputs, nullptr);
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0) {
+        print_err_pipe(ret, "avfilter_graph_parse_ptr");
+        return false;
+    }
+
+    if (m_use_hw && hw_device_ctx) {
+        for (unsigned i = 0; i < m_filter_graph->nb_filters; i++) {
+            AVFilterContext* fctx = m_filter_graph->filters[i];
+            const char* filter_name = fctx->filter->name;
+            if (strcmp(filter_name, "hwupload") == 0 || strcmp(filter_name, "vpp_rkrga") == 0) {
+                fctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+                fprintf(stderr, "[编码流水线] 已绑定 hw_device_ctx 到 %s 滤镜\n", filter_name);
+            }
+        }
+    }
+
+    if ((ret = avfilter_graph_config(m_filter_graph, nullptr)) < 0) {
+        print_err_pipe(ret, "avfilter_graph_config");
+        return false;
+    }
+    fprintf(stderr, "[编码流水线] 滤镜图配置完成: \"%s\"\n", filt_descr.c_str());
+    return true;
+}
+
+void EncodePipeline::cleanup_ffmpeg()
+{
+    fprintf(stderr, "[编码流水线] 正在清理 FFmpeg 资源...\n");
+
+    for (auto& out : m_outputs) {
+        if (out->enc_ctx) avcodec_free_context(&out->enc_ctx);
+        out->enc_ctx = nullptr;
+        if (out->sws_ctx) sws_freeContext(out->sws_ctx);
+        out->sws_ctx = nullptr;
+        out->convert_pool.reset();
+        out->download_pool.reset();
+        out->queue_filtered_frames.clear();
+    }
+
+    avfilter_graph_free(&m_filter_graph);
+    m_filter_graph = nullptr; // 防止悬空指针
+    m_buffersrc_ctx = nullptr;
+    for (auto& out : m_outputs) out->buffersink_ctx = nullptr;
+    m_crop_stage.reset();
+    m_blend_pool.reset();
+
+    m_queue_decoded_frames.clear();
+}
+
+void EncodePipeline::fan_out_packet(size_t output_index, AVPacket* pkt)
+{
+    std::lock_guard<std::mutex> lock(m_consumer_mutex);
+
+    AVPacketPtr pkt_ptr;
+    for (auto& c : m_consumers) {
+        if (c.output_index != output_index) {
+            continue;
+        }
+        // 只有在确实有消费者时才把引用移入池中的空壳，所有消费者共享同一份引用
+        if (!pkt_ptr) {
+            pkt_ptr = m_outputs[output_index]->packet_shells.adopt(pkt);
+            if (!pkt_ptr) {
+                fprintf(stderr, "[编码流水线] 错误: 分配数据包失败，无法分发数据包。\n");
+                return;
+            }
+        }
+        c.queue->push(pkt_ptr);
+    }
+}
+
+void EncodePipeline::flush_encoder(size_t output_index)
+{
+    AVCodecContext* enc_ctx = m_outputs[output_index]->enc_ctx;
+    if (!enc_ctx) return;
+
+    AVPacket* outpkt = av_packet_alloc();
+    if (avcodec_send_frame(enc_ctx, nullptr) >= 0) {
+        while (avcodec_receive_packet(enc_ctx, outpkt) >= 0) {
+            fan_out_packet(output_index, outpkt);
+            av_packet_unref(outpkt);
+        }
+    }
+    av_packet_free(&outpkt);
+}
+
+bool EncodePipeline::keep_frame(Output& out, int64_t pts_us) const
+{
+    const int fps = out.fps;
+    if (fps <= 0 || pts_us == AV_NOPTS_VALUE) {
+        return true;
+    }
+    const int64_t interval_us = 1000000 / fps;
+    // 容忍半个采集间隔的抖动，否则 30 -> 10 fps 会因时间戳取整变成每 4 帧取 1 帧
+    const int64_t tolerance_us = 1000000 / V4L2_INPUT_FPS / 2;
+    if (out.next_frame_us != AV_NOPTS_VALUE && pts_us + tolerance_us < out.next_frame_us) {
+        return false;
+    }
+    // 按固定间隔推进；采集丢帧落后超过一个间隔时从当前帧重新对齐
+    if (out.next_frame_us == AV_NOPTS_VALUE || pts_us - out.next_frame_us >= interval_us) {
+        out.next_frame_us = pts_us + interval_us;
+    } else {
+        out.next_frame_us += interval_us;
+    }
+    return true;
+}
+
+AVFramePtr EncodePipeline::accumulate_blend(AVFramePtr frame_ptr)
+{
+    const AVFrame* f = frame_ptr.get();
+    if (f->format != AV_PIX_FMT_NV12) {
+        return frame_ptr; // 硬件帧不做平均
+    }
+
+    // 采集丢帧导致组不连续时，丢弃已累加的部分
+    const int64_t max_gap_us = 3 * 1000000 / V4L2_INPUT_FPS;
+    if (m_blend_count > 0 && f->pts - m_blend_last_pts > max_gap_us) {
+        m_blend_count = 0;
+    }
+    m_blend_last_pts = f->pts;
+
+    const int w = f->width;
+    const int h = f->height;
+    const size_t luma_size = static_cast<size_t>(w) * h;
+    if (m_blend_acc.size() != luma_size * 3 / 2) {
+        m_blend_acc.assign(luma_size * 3 / 2, 0);
+        m_blend_count = 0;
+    }
+    if (m_blend_count == 0) {
+        std::fill(m_blend_acc.begin(), m_blend_acc.end(), 0);
+    }
+
+    // Y 平面 h 行，交错的 UV 平面 h/2 行，每行 w 字节
+    for (int plane = 0; plane < 2; ++plane) {
+        uint16_t* acc = m_blend_acc.data() + (plane ? luma_size : 0);
+        const int rows = plane ? h / 2 : h;
+        for (int y = 0; y < rows; ++y) {
+            const uint8_t* src = f->data[plane] + static_cast<size_t>(y) * f->linesize[plane];
+            uint16_t* dst = acc + static_cast<size_t>(y) * w;
+            for (int x = 0; x < w; ++x) {
+                dst[x] += src[x];
+            }
+        }
+    }
+    if (++m_blend_count < m_blend_frames) {
+        return nullptr;
+    }
+
+    if (!m_blend_pool || !m_blend_pool->matches(AV_PIX_FMT_NV12, w, h)) {
+        m_blend_pool.reset(new FramePool(AV_PIX_FMT_NV12, w, h));
+    }
+    AVFramePtr out_ptr = m_blend_pool->acquire();
+    if (!out_ptr) {
+        m_blend_count = 0;
+        return frame_ptr;
+    }
+    AVFrame* out = out_ptr.get();
+    av_frame_copy_props(out, f);
+
+    const int n = m_blend_count;
+    for (int plane = 0; plane < 2; ++plane) {
+        const uint16_t* acc = m_blend_acc.data() + (plane ? luma_size : 0);
+        const int rows = plane ? h / 2 : h;
+        for (int y = 0; y < rows; ++y) {
+            const uint16_t* src = acc + static_cast<size_t>(y) * w;
+            uint8_t* dst = out->data[plane] + static_cast<size_t>(y) * out->linesize[plane];
+            for (int x = 0; x < w; ++x) {
+                dst[x] = static_cast<uint8_t>((src[x] + n / 2) / n);
+            }
+        }
+    }
+    m_blend_count = 0;
+    return out_ptr;
+}
+
+void EncodePipeline::thread_filter_osd()
+{
+    fprintf(stderr, "[T1:Filter-Pipe] 滤镜OSD线程启动。\n");
+    AllocationProbe alloc_probe("T1:Filter-Pipe");
+
+    while (!m_stop_flag && !m_pipeline_error) {
+        AVFramePtr frame_ptr = m_queue_decoded_frames.wait_and_pop();
+        if (frame_ptr == nullptr) {
+            break;
+        }
+
+        if (m_adaptation_pending.exchange(false) && !apply_output_adaptation()) {
+            m_pipeline_error = true;
+            break;
+        }
+
+        if (m_blend_frames > 1) {
+            // 组内的帧先累加，凑满一组才继续处理
+            frame_ptr = accumulate_blend(std::move(frame_ptr));
+            if (!frame_ptr) {
+                continue;
+            }
+        }
+
+        int ret = 0;
+        const AVFrame* frame = frame_ptr.get();
+        if (m_first_pts == AV_NOPTS_VALUE) {
+            m_first_pts = frame->pts;
+            if (m_frame_interval == 1) {
+                m_capture_origin_us = m_capture_module->get_clock_origin_us() + m_first_pts;
+            }
+        }
+
+        // 按帧的采集时刻插值裁剪区域 (无锁读取)：所有流水线对同一帧得到相同的区域，
+        // 变焦动画在录制和推流上同样平滑，也无需重建滤镜图
+        int cx = 0, cy = 0, cw = frame->width, ch = frame->height;
+        if (m_zoom_manager) {
+            uint32_t generation = 0;
+            int64_t frame_time_us = m_capture_module->get_clock_origin_us() + frame->pts;
+            m_zoom_manager->get_crop_params_at(frame_time_us, cx, cy, cw, ch, &generation);
+            if (generation != m_last_zoom_generation) {
+                if (m_last_zoom_generation != 0) {
+                    // 从变焦请求到第一帧开始应用新运动的耗时
+                    auto latency = std::chrono::steady_clock::now() - m_zoom_manager->get_last_change_time();
+                    fprintf(stderr, "[T1:Filter-Pipe] 变焦生效: 裁剪 %dx%d, 延迟 %.1f ms\n", cw, ch,
+                            std::chrono::duration<double, std::milli>(latency).count());
+                }
+                m_last_zoom_generation = generation;
+            }
+        }
+
+        AVFramePtr cropped = m_crop_stage->process(frame, cx, cy, cw, ch);
+        if (!cropped) {
+            fprintf(stderr, "[T1:Filter-Pipe] 错误: 裁剪缩放失败\n");
+            m_pipeline_error = true;
+            break;
+        }
+        // 采集帧不再需要，尽早把缓冲区还给采集器的帧池
+        frame_ptr.reset();
+
+        // [修复] 时间戳归一化：在裁剪输出的新帧上修改，采集帧由多个消费者共享，不能改动
+        if (m_frame_interval > 1) {
+            // 延时摄影：保留的帧按播放帧率连续排列
+            cropped->pts = av_rescale_q(m_output_frame_count++, AVRational{1, TIMELAPSE_OUTPUT_FPS}, AVRational{1, 1000000});
+        } else {
+            cropped->pts -= m_first_pts;
+        }
+
+        // 单路输出：裁剪输出已是最终尺寸，直接叠加 OSD 后交给编码线程
+        if (!m_filter_graph) {
+            Output& out = *m_outputs[0];
+            if (!keep_frame(out, cropped->pts)) {
+                alloc_probe.frame_done();
+                continue;
+            }
+            cropped->pts = av_rescale_q(cropped->pts, AVRational{1, 1000000}, out.enc_time_base);
+            if (m_osd_manager && out.profile.burn_in_osd) {
+                m_osd_manager->blend_osd_on_frame(cropped.get());
+            }
+            out.queue_filtered_frames.push(std::move(cropped));
+            alloc_probe.frame_done();
+            continue;
+        }
+
+        // 引用移交给滤镜图 (不带 KEEP_REF)，空壳随 cropped 释放回到池中
+        ret = av_buffersrc_add_frame_flags(m_buffersrc_ctx, cropped.get(), 0);
+        cropped.reset();
+        if (ret < 0) {
+            print_err_pipe(ret, "av_buffersrc_add_frame");
+            m_pipeline_error = true;
+            break;
+        }
+
+        // 每个输入帧都要从所有输出取完，保证各分辨率的帧序列一致
+        for (size_t i = 0; i < m_outputs.size() && !m_pipeline_error; ++i) {
+            Output& out = *m_outputs[i];
+            const AVRational sink_time_base = av_buffersink_get_time_base(out.buffersink_ctx);
+            while (!m_pipeline_error) {
+                // 直接取到池中的空壳里，代替 av_frame_clone + av_frame_unref
+                AVFramePtr filt_frame = m_frame_shells.acquire();
+                if (!filt_frame) {
+                    fprintf(stderr, "[T1:Filter-Pipe] 错误: 分配滤镜输出帧失败\n");
+                    m_pipeline_error = true;
+                    break;
+                }
+                ret = av_buffersink_get_frame(out.buffersink_ctx, filt_frame.get());
+
+                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                    break;
+                }
+                if (ret < 0) {
+                    print_err_pipe(ret, "av_buffersink_get_frame");
+                    m_pipeline_error = true;
+                    break;
+                }
+
+                // 抽掉的帧直接释放，不做 OSD 混合和编码
+                if (out.fps > 0 && filt_frame->pts != AV_NOPTS_VALUE &&
+                    !keep_frame(out, av_rescale_q(filt_frame->pts, sink_time_base, AVRational{1, 1000000}))) {
+                    continue;
+                }
+
+                // 在滤镜线程里换算到编码器时间基，编码线程无需访问 buffersink
+                if (filt_frame->pts != AV_NOPTS_VALUE) {
+                    filt_frame->pts = av_rescale_q(filt_frame->pts, sink_time_base, out.enc_time_base);
+                }
+
+                if (m_osd_manager && out.profile.burn_in_osd) {
+                    m_osd_manager->blend_osd_on_frame(filt_frame.get());
+                }
+
+                out.queue_filtered_frames.push(std::move(filt_frame));
+            }
+        }
+        alloc_probe.frame_done();
+    }
+
+    for (auto& out : m_outputs) {
+        out->queue_filtered_frames.stop();
+    }
+    fprintf(stderr, "[T1:Filter-Pipe] 滤镜OSD线程退出。\n");
+}
+
+AVFramePtr EncodePipeline::convert_frame(Output& out, const AVFrame* src)
+{
+    // 硬件帧直通但编码器 (例如回退后的软件编码器) 不接受：先下载为 NV12
+    AVFramePtr downloaded;
+    if (src->format == AV_PIX_FMT_DRM_PRIME) {
+        if (!out.download_pool || !out.download_pool->matches(AV_PIX_FMT_NV12, src->width, src->height)) {
+            out.download_pool.reset(new FramePool(AV_PIX_FMT_NV12, src->width, src->height));
+        }
+        downloaded = out.download_pool->acquire();
+        if (!downloaded || av_hwframe_transfer_data(downloaded.get(), src, 0) < 0) {
+            fprintf(stderr, "[编码流水线] 错误: 下载硬件帧失败\n");
+            return nullptr;
+        }
+        av_frame_copy_props(downloaded.get(), src);
+        if (out.enc_ctx->pix_fmt == AV_PIX_FMT_NV12) {
+            return downloaded;
+        }
+        src = downloaded.get();
+    }
+
+    out.sws_ctx = sws_getCachedContext(out.sws_ctx,
+                                       src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                       out.enc_ctx->width, out.enc_ctx->height, out.enc_ctx->pix_fmt,
+                                       SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!out.sws_ctx) {
+        fprintf(stderr, "[编码流水线] 错误: 无法创建像素格式转换\n");
+        return nullptr;
+    }
+    if (!out.convert_pool || !out.convert_pool->matches(out.enc_ctx->pix_fmt, out.enc_ctx->width, out.enc_ctx->height)) {
+        out.convert_pool.reset(new FramePool(out.enc_ctx->pix_fmt, out.enc_ctx->width, out.enc_ctx->height));
+    }
+    AVFramePtr dst = out.convert_pool->acquire();
+    if (!dst) {
+        fprintf(stderr, "[编码流水线] 错误: 分配转换帧失败\n");
+        return nullptr;
+    }
+    sws_scale(out.sws_ctx, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    av_frame_copy_props(dst.get(), src);
+    return dst;
+}
+
+void EncodePipeline::thread_encode(size_t output_index)
+{
+    Output& out = *m_outputs[output_index];
+    fprintf(stderr, "[T2:Encode-Pipe#%zu] 编码线程启动 (%dx%d)。\n", output_index, out.profile.width, out.profile.height);
+    AVPacket* outpkt = av_packet_alloc();
+    AllocationProbe alloc_probe("T2:Encode-Pipe");
+
+    // 不检查 m_stop_flag：停止时 T1 先退出并停止本队列，这里把已滤镜的帧全部编完，
+    // 保证各路输出结束于同一帧。
+    while (!m_pipeline_error) {
+        AVFramePtr frame_ptr = out.queue_filtered_frames.wait_and_pop();
+        if (frame_ptr == nullptr) {
+            break;
+        }
+
+        // 拥塞控制调整了分辨率：按新尺寸重新打开编码器 (新编码器从关键帧开始)
+        if (frame_ptr->width != out.enc_ctx->width || frame_ptr->height != out.enc_ctx->height) {
+            AVBufferRef* hw_frames_ctx = frame_ptr->format == AV_PIX_FMT_DRM_PRIME ? frame_ptr->hw_frames_ctx : nullptr;
+            if (!reopen_encoder(output_index, out.rate_control, frame_ptr->width, frame_ptr->height, hw_frames_ctx)) {
+                fprintf(stderr, "[T2:Encode-Pipe#%zu] 错误: 按 %dx%d 重新打开编码器失败\n", output_index,
+                        frame_ptr->width, frame_ptr->height);
+                m_pipeline_error = true;
+                break;
+            }
+            fprintf(stderr, "[T2:Encode-Pipe#%zu] 编码器已按新分辨率 %dx%d 重新打开\n", output_index,
+                    frame_ptr->width, frame_ptr->height);
+        }
+
+        if (frame_ptr->format != out.enc_ctx->pix_fmt) {
+            frame_ptr = convert_frame(out, frame_ptr.get());
+            if (!frame_ptr) {
+                m_pipeline_error = true;
+                break;
+            }
+        }
+
+        // 下一帧是 GOP 的第一帧 (关键帧) 时应用待生效的码率控制；强制 IDR 同样从这一帧重新计数
+        const bool force_keyframe = out.force_keyframe.exchange(false);
+        if (force_keyframe) {
+            out.frames_sent = 0;
+        }
+        const int gop = out.rate_control.gop_size > 0 ? out.rate_control.gop_size : 1;
+        if (out.frames_sent % gop == 0) {
+            apply_pending_rate_control(output_index);
+        }
+        out.frames_sent++;
+        // 帧来自池或本路独占的空壳，可以直接修改
+        frame_ptr->pict_type = force_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+        int ret = avcodec_send_frame(out.enc_ctx, frame_ptr.get());
+        if (ret < 0) {
+            print_err_pipe(ret, "avcodec_send_frame (encoder)");
+            m_pipeline_error = true;
+            break;
+        }
+
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(out.enc_ctx, outpkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            }
+            if (ret < 0) {
+                print_err_pipe(ret, "avcodec_receive_packet (encoder)");
+                m_pipeline_error = true;
+                break;
+            }
+
+            if (out.prepend_extradata && (outpkt->flags & AV_PKT_FLAG_KEY) && out.enc_ctx->extradata_size > 0) {
+                AVPacket* with_ps = prepend_parameter_sets(out.enc_ctx, outpkt);
+                if (with_ps) {
+                    fan_out_packet(output_index, with_ps);
+                    av_packet_free(&with_ps);
+                    out.prepend_extradata = false;
+                    av_packet_unref(outpkt);
+                    continue;
+                }
+            }
+
+            fan_out_packet(output_index, outpkt);
+            av_packet_unref(outpkt);
+        }
+        alloc_probe.frame_done();
+    }
+
+    av_packet_free(&outpkt);
+    out.queue_filtered_frames.stop();
+
+    // 非正常结束 (错误或采集中断)：通知所有消费者，避免它们无限等待
+    if (!m_stop_flag) {
+        m_pipeline_error = true;
+        m_queue_decoded_frames.stop();
+        stop_all_consumers();
+    }
+    fprintf(stderr, "[T2:Encode-Pipe#%zu] 编码线程退出。\n", output_index);
+}
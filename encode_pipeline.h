@@ -0,0 +1,317 @@
+// --- START OF FILE encode_pipeline.h ---
+
+#ifndef ENCODE_PIPELINE_H
+#define ENCODE_PIPELINE_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <list>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavfilter/avfilter.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libswscale/swscale.h>
+}
+
+#include "osd_manager.h"
+#include "zoom_manager.h"
+#include "threadsafe_queue.h"
+#include "media_pool.h"
+#include "encoder_backend.h"
+
+class CameraCapture;
+class CropStage;
+
+/**
+ * @brief 一条编码链的输出参数。
+ *
+ * 分辨率和编码器相同的两个输出 (例如 1080p 录制 + 1080p 推流) 可以共享同一条编码链。
+ */
+struct EncodeProfile
+{
+    int width = 0;
+    int height = 0;
+    // 初始码率控制参数，运行中可通过 set_rate_control 修改
+    RateControl rate_control;
+    // 逗号分隔的编码器候选列表，按顺序尝试 (见 open_video_encoder)
+    std::string encoder_name;
+    // 决定软件编码器的 preset/tune 和线程方式；共享编码链时沿用先启动的一方
+    EncodeUseCase use_case = EncodeUseCase::Recording;
+    // 延时摄影：每 frame_interval 个采集帧只编码一帧，时间戳按 TIMELAPSE_OUTPUT_FPS 连续排列。
+    // 抽帧在采集器中完成，裁剪/缩放/OSD/编码只处理保留的帧。同一编码链的所有输出必须相同。
+    int frame_interval = 1;
+    // >1 时把抽帧点之前的 blend_frames 个采集帧平均成一帧 (运动模糊)
+    int blend_frames = 1;
+    // 输出帧率，0 表示与采集 (或延时摄影) 帧率相同。低于输入帧率时在滤镜线程中按时间戳均匀抽帧，
+    // 抽掉的帧不做 OSD 混合和编码 (例如 360p/10fps 的子码流)。
+    int fps = 0;
+    // 是否把 OSD 烧录到画面中。播放器根据元数据轨 (见 telemetry_track.h) 自行渲染时可以关闭，
+    // 省去这一路每帧一次的 RGA 混合。
+    bool burn_in_osd = true;
+    // 周期帧内刷新代替周期 IDR (仅 libx264/libx265)：码率平滑，没有关键帧尖峰，新客户端按需请求 IDR
+    bool intra_refresh = false;
+};
+
+/**
+ * @class EncodePipeline
+ * @brief 采集帧 -> 裁剪/缩放 -> OSD -> 编码 的共享处理链。
+ *
+ * - 作为 CameraCapture 的一个消费者接收原始帧。
+ * - 支持多路输出 (多分辨率)：每帧只裁剪一次 (CropStage，按当前变焦区域逐帧处理)，
+ *   之后的滤镜图 split 后按输出分别缩放，每路输出一个编码器。只有一路输出时不建滤镜图，
+ *   裁剪输出直接送去编码。RGA 缩放的输出保持为 DRM_PRIME 硬件帧直到编码器 (见 Output::hw_frames)。
+ * - 热路径上的帧和数据包来自对象池 (media_pool.h)，引用在各阶段之间移动而不是克隆，
+ *   预热之后每帧没有 C++ 堆分配 (可用分配计数模式验证，见 alloc_counter.h)。
+ * - 内部线程：T1 滤镜+OSD (所有输出共用)，每路输出一个 T2 编码线程。
+ * - 编码后的数据包以引用计数的方式分发给注册到该输出的所有数据包队列 (录制器、推流器等)，
+ *   从而在参数兼容时只做一次裁剪、OSD 叠加和编码。
+ * - 最后一个消费者注销时自动停止，并把编码器中剩余的数据包冲刷给它。
+ */
+class EncodePipeline
+{
+public:
+    EncodePipeline(CameraCapture* capture_module,
+                   std::shared_ptr<OsdManager> osd_manager,
+                   std::shared_ptr<ZoomManager> zoom_manager,
+                   const std::vector<EncodeProfile>& profiles);
+
+    ~EncodePipeline();
+
+    // 打开编码器、配置滤镜图、注册到采集器并启动流水线线程
+    bool start();
+
+    // 停止流水线，冲刷编码器，并停止所有消费者队列
+    void stop();
+
+    bool isRunning() const;
+    bool hasError() const;
+
+    /**
+     * @brief 注册一个数据包消费者。
+     * @param output_index 要接收的输出序号 (与构造时 profiles 的顺序一致)。
+     * @return 流水线未运行或序号无效时返回 false。
+     */
+    bool register_consumer(ThreadSafePacketQueue* consumer_queue, size_t output_index = 0);
+
+    /**
+     * @brief 注销一个数据包消费者，并停止其队列。
+     * 如果它是最后一个消费者，流水线会先冲刷编码器再停止。
+     */
+    void unregister_consumer(ThreadSafePacketQueue* consumer_queue);
+
+    /**
+     * @brief 一次注销多个消费者 (例如同一录制器的多个分辨率)。
+     * 如果它们就是剩下的全部消费者，流水线先停止并冲刷所有编码器，
+     * 保证每一路都收到最后的数据包，在同一帧结束。
+     */
+    void unregister_consumers(const std::vector<ThreadSafePacketQueue*>& consumer_queues);
+
+    size_t get_output_count() const { return m_outputs.size(); }
+    const EncodeProfile& get_profile(size_t output_index = 0) const { return m_outputs[output_index]->profile; }
+
+    /**
+     * @brief 供复用器创建输出流：复制编码参数 (含 extradata) 和编码器时间基。
+     * 仅在 start() 成功后有效；编码器可能因码率调整被重新打开，因此不直接暴露 AVCodecContext。
+     */
+    bool get_codec_parameters(size_t output_index, AVCodecParameters* par, AVRational* time_base) const;
+
+    /**
+     * @brief 运行中修改一路输出的码率控制 (模式、码率、GOP)。
+     *
+     * 新参数在下一个关键帧生效：能原地重配置的编码器直接修改，否则只重新打开该路编码器
+     * (冲刷旧编码器的剩余数据包，新编码器从关键帧开始；参数集变化时在关键帧前带内发送)，
+     * 滤镜图和其他输出不受影响。共享该输出的所有消费者都会受影响。
+     */
+    bool set_rate_control(size_t output_index, const RateControl& rc);
+    RateControl get_rate_control(size_t output_index) const;
+
+    /**
+     * @brief 拥塞控制：运行中降低一路输出的分辨率和帧率 (传入 profile 的原值即恢复)。
+     *
+     * 滤镜线程在下一帧之前应用：帧率只改变抽帧间隔；分辨率变化时重建缩放 (单路输出时重建裁剪阶段)，
+     * 编码线程收到新尺寸的第一帧时重新打开编码器，从关键帧开始并带内发送新的参数集，不中断码流。
+     * 调整过的输出不再与新加入的消费者共享。
+     * 限制：已写出文件头的复用器 (RtspStreamer 的推流会话、正在写的录像分段) 不会更新 codecpar
+     * 和 SDP 中的宽高，接收端只能依靠带内 SPS/PPS 得知新分辨率；需要准确的容器信息时，
+     * 消费者应在重连或切换分段时重新调用 get_codec_parameters。
+     * @return 参数无效，或该路不能修改分辨率 (见 can_resize_output) 时返回 false。
+     */
+    bool set_output_adaptation(size_t output_index, int width, int height, int fps);
+
+    // 多路输出中面积最大的那一路是其余各路的缩放源，不能修改分辨率
+    bool can_resize_output(size_t output_index) const;
+
+    // 注册到该输出的消费者个数
+    size_t get_consumer_count(size_t output_index) const;
+
+    /**
+     * @brief 让一路输出的下一帧编码为 IDR (例如推流重连后)，不必等到下一个 GOP。
+     * 待生效的码率控制随之生效；共享该输出的消费者都会收到这个关键帧。
+     */
+    void request_keyframe(size_t output_index);
+
+    /**
+     * @brief 编码输出数据包对应的采集时刻 (steady_clock 微秒，见 latency_stamp.h)，用于时延测量。
+     * @param pts 数据包时间戳，time_base 为编码器时间基 (见 get_codec_parameters)。
+     * @return 延时摄影 (时间戳与采集时刻无关) 或还没有处理过帧时返回 AV_NOPTS_VALUE。
+     */
+    int64_t get_capture_time_us(int64_t pts, AVRational time_base) const;
+
+    /**
+     * @brief 查找与给定参数兼容的输出。
+     * @return 输出序号，没有兼容输出时返回 -1。
+     */
+    int find_compatible_output(const EncodeProfile& profile) const;
+
+    /**
+     * @brief 判断两个输出能否共享同一条编码链。
+     *
+     * 比较分辨率、编码器、帧率、延时摄影的抽帧/混合帧数、是否叠加 OSD 以及是否使用帧内刷新；
+     * 码率与 GOP 沿用先启动的那一方，加入者不会重启正在运行的编码器。
+     */
+    static bool is_compatible(const EncodeProfile& a, const EncodeProfile& b);
+
+private:
+    // 每路输出 (一种分辨率) 的编码状态
+    struct Output
+    {
+        EncodeProfile profile;
+        AVCodecContext *enc_ctx = nullptr;
+        // 编码器时间基，打开编码器时缓存。滤镜线程换算时间戳只读这里，不访问 enc_ctx
+        // (编码线程重新打开编码器时会替换并释放旧的 enc_ctx)
+        AVRational enc_time_base{1, 1000000};
+        AVFilterContext *buffersink_ctx = nullptr;
+        // 编码器不支持 NV12 时 (例如 libopenh264)，在编码线程里转换像素格式
+        SwsContext *sws_ctx = nullptr;
+        std::unique_ptr<FramePool> convert_pool;
+        // 该路滤镜输出为 DRM_PRIME 硬件帧 (RGA 缩放后不 hwdownload)，OSD 按 fd 导入混合，
+        // 编码器直接编码；编码器不接受硬件帧时在编码线程中下载到 download_pool
+        bool hw_frames = false;
+        std::unique_ptr<FramePool> download_pool;
+        // 编码输出的数据包移入池中的空壳后分发，代替 av_packet_clone
+        PacketShellPool packet_shells;
+
+        // 当前生效的码率控制；仅编码线程修改，读取需持有 enc_mutex
+        RateControl rate_control;
+        // 待生效的码率控制 (由 set_rate_control 写入，编码线程在下一个关键帧取走)
+        RateControl pending_rate_control;
+        bool has_pending_rate_control = false;
+        std::mutex rate_control_mutex;
+        // 保护 enc_ctx 的替换 (重新打开编码器) 与其他线程读取编码参数
+        mutable std::mutex enc_mutex;
+        // 当前编码器已送入的帧数，用于判断下一帧是否为 GOP 的关键帧
+        int64_t frames_sent = 0;
+        // 按 fps 抽帧时下一帧的目标时间 (微秒)
+        int64_t next_frame_us = AV_NOPTS_VALUE;
+
+        // 当前生效的分辨率和帧率：初始为 profile 的值，拥塞控制可在运行中降低。
+        // width/height 只由滤镜线程读写；fps 由滤镜线程修改，编码线程重新打开编码器时读取
+        int width = 0;
+        int height = 0;
+        std::atomic<int> fps{0};
+        // 分辨率或帧率低于 profile 时为 true，不再与新的消费者共享
+        std::atomic<bool> adapted{false};
+        // 待应用的调整 (由 set_output_adaptation 写入，滤镜线程在下一帧之前取走)
+        int pending_width = 0;
+        int pending_height = 0;
+        int pending_fps = 0;
+        bool has_pending_adaptation = false;
+        std::mutex adaptation_mutex;
+        // 重新打开编码器后参数集可能变化，在下一个关键帧前带内发送新的参数集
+        bool prepend_extradata = false;
+        // 下一帧强制编码为 IDR (request_keyframe)
+        std::atomic<bool> force_keyframe{false};
+
+        ThreadSafeFrameQueue queue_filtered_frames;
+        std::thread thread_encode;
+    };
+
+    struct Consumer
+    {
+        ThreadSafePacketQueue* queue;
+        size_t output_index;
+    };
+
+    void thread_filter_osd();
+    void thread_encode(size_t output_index);
+    AVFramePtr convert_frame(Output& out, const AVFrame* src);
+    // 按该路的输出帧率决定是否保留时间戳为 pts_us 的帧
+    bool keep_frame(Output& out, int64_t pts_us) const;
+    // 滤镜线程中应用待生效的分辨率/帧率调整
+    bool apply_output_adaptation();
+    // 按给定参数重新打开一路编码器：先冲刷旧编码器，新编码器从关键帧开始
+    bool reopen_encoder(size_t output_index, const RateControl& rc, int width, int height, AVBufferRef* hw_frames_ctx);
+
+    bool initialize_encoder(Output& out);
+    EncoderOpenParams encoder_params(const Output& out, const RateControl& rc) const;
+    bool hw_frames_path_enabled() const;
+    void cleanup_ffmpeg();
+    bool configure_filters();
+    std::string build_filter_descr() const;
+    void flush_encoder(size_t output_index);
+    bool apply_pending_rate_control(size_t output_index);
+    AVPacket* prepend_parameter_sets(const AVCodecContext* enc_ctx, const AVPacket* pkt);
+    // 把 pkt 的引用移交给该输出的所有消费者 (没有消费者时保持不变)，调用者随后 unref 即可
+    void fan_out_packet(size_t output_index, AVPacket* pkt);
+    void stop_all_consumers();
+
+    CameraCapture* m_capture_module;
+    std::shared_ptr<OsdManager> m_osd_manager;
+    std::shared_ptr<ZoomManager> m_zoom_manager;
+
+    std::vector<std::unique_ptr<Output>> m_outputs;
+    // 面积最大的输出：裁剪后直接缩放到该尺寸，其余输出再从它缩小
+    size_t m_largest_output = 0;
+
+    // 逐帧裁剪+缩放到面积最大的输出尺寸；滤镜图只负责 split 和其余各路的缩放，
+    // 启动时构建一次，变焦时不再重建
+    std::unique_ptr<CropStage> m_crop_stage;
+    // 最近应用的变焦运动序号，用于统计变焦生效延迟
+    uint32_t m_last_zoom_generation = 0;
+    // 有输出等待应用分辨率/帧率调整，滤镜线程每帧只检查这一个标志
+    std::atomic<bool> m_adaptation_pending{false};
+
+    // 延时摄影 (抽帧间隔和混合帧数都取自面积最大那一路输出的 EncodeProfile)
+    AVFramePtr accumulate_blend(AVFramePtr frame);
+    int m_frame_interval = 1;
+    int m_blend_frames = 1;
+    int64_t m_output_frame_count = 0;
+    std::vector<uint16_t> m_blend_acc;   // NV12 各像素的累加值
+    std::unique_ptr<FramePool> m_blend_pool;
+    int m_blend_count = 0;
+    int64_t m_blend_last_pts = AV_NOPTS_VALUE;
+
+    AVFilterGraph *m_filter_graph = nullptr;
+    AVFilterContext *m_buffersrc_ctx = nullptr;
+    // buffersink 的输出直接取到池中的空壳里
+    FrameShellPool m_frame_shells;
+
+    // 用于消费者内部的时间戳归一化
+    int64_t m_first_pts = AV_NOPTS_VALUE;
+    // 时间戳 0 对应的采集时刻，滤镜线程在第一帧时写入
+    std::atomic<int64_t> m_capture_origin_us{AV_NOPTS_VALUE};
+
+    bool m_use_hw = false;
+    std::atomic<bool> m_stop_flag{false};
+    std::atomic<bool> m_is_running{false};
+    std::atomic<bool> m_pipeline_error{false};
+
+    std::thread m_thread_filter;
+
+    // 串行化 start/stop
+    std::mutex m_state_mutex;
+
+    ThreadSafeFrameQueue m_queue_decoded_frames;
+
+    std::list<Consumer> m_consumers;
+    mutable std::mutex m_consumer_mutex;
+};
+
+#endif // ENCODE_PIPELINE_H
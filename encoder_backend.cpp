@@ -0,0 +1,272 @@
+// --- START OF FILE encoder_backend.cpp ---
+
+#include "encoder_backend.h"
+#include "app_config.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+
+extern "C"
+{
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+static void print_err_enc(int ret, const char *context)
+{
+    char buf[256];
+    av_strerror(ret, buf, sizeof(buf));
+    fprintf(stderr, "[编码器] FFmpeg 错误 in %s: %s (ret=%d)\n", context, buf, ret);
+}
+
+static bool is_hw_encoder(const AVCodec* enc)
+{
+    return strstr(enc->name, "rkmpp") != nullptr;
+}
+
+static bool accepts_drm_prime(const AVCodec* enc)
+{
+    if (!is_hw_encoder(enc) || !enc->pix_fmts) {
+        return false;
+    }
+    for (const AVPixelFormat* p = enc->pix_fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        if (*p == AV_PIX_FMT_DRM_PRIME) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 有硬件帧上下文且编码器接受时用 DRM_PRIME (零拷贝)；否则优先 NV12 (与滤镜/OSD 输出一致，
+// 无需转换)，再否则取编码器的第一个支持格式
+static AVPixelFormat choose_pix_fmt(const AVCodec* enc, bool hw_frames)
+{
+    if (hw_frames && accepts_drm_prime(enc)) {
+        return AV_PIX_FMT_DRM_PRIME;
+    }
+    if (!enc->pix_fmts) {
+        return AV_PIX_FMT_NV12;
+    }
+    for (const AVPixelFormat* p = enc->pix_fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        if (*p == AV_PIX_FMT_NV12) {
+            return AV_PIX_FMT_NV12;
+        }
+    }
+    return enc->pix_fmts[0];
+}
+
+// 软件编码器的线程与速度参数，按用途区分
+static void apply_sw_options(AVCodecContext* ctx, const AVCodec* enc, EncodeUseCase use_case, bool intra_refresh)
+{
+    const bool low_latency = (use_case == EncodeUseCase::LowLatency);
+
+    ctx->thread_count = SW_ENCODER_THREADS;
+    // 帧级多线程会让每个线程多缓存一帧，推流时改用片级多线程
+    ctx->thread_type = low_latency ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+
+    if (strcmp(enc->name, "libx264") == 0) {
+        av_opt_set(ctx->priv_data, "preset", low_latency ? SW_ENCODER_PRESET_LOW_LATENCY : SW_ENCODER_PRESET_RECORDING, 0);
+        av_opt_set(ctx->priv_data, "tune", low_latency ? SW_ENCODER_TUNE_LOW_LATENCY : SW_ENCODER_TUNE_RECORDING, 0);
+        // 强制关键帧 (pict_type = I) 输出真正的 IDR；帧内刷新模式下否则只会开始新一轮刷新
+        av_opt_set(ctx->priv_data, "forced-idr", "1", 0);
+        if (intra_refresh) {
+            av_opt_set(ctx->priv_data, "intra-refresh", "1", 0);
+        }
+    } else if (strcmp(enc->name, "libx265") == 0) {
+        // x265 没有 "film" 调优，录制时只设置 preset
+        av_opt_set(ctx->priv_data, "preset", low_latency ? SW_ENCODER_PRESET_LOW_LATENCY : SW_ENCODER_PRESET_RECORDING, 0);
+        if (low_latency) {
+            av_opt_set(ctx->priv_data, "tune", SW_ENCODER_TUNE_LOW_LATENCY, 0);
+        }
+        av_opt_set(ctx->priv_data, "forced-idr", "1", 0);
+        if (intra_refresh) {
+            av_opt_set(ctx->priv_data, "x265-params", "intra-refresh=1", 0);
+        }
+    }
+}
+
+// 按模式设置码率控制：通用字段 + 各编码器的私有选项 (不支持的选项会被忽略)
+static void apply_rate_control(AVCodecContext* ctx, const AVCodec* enc, const RateControl& rc, bool intra_refresh)
+{
+    ctx->gop_size = rc.gop_size;
+
+    const int64_t max_rate = rc.max_bit_rate > 0 ? rc.max_bit_rate : rc.bit_rate * 3 / 2;
+    switch (rc.mode) {
+    case RateControlMode::CBR:
+        ctx->bit_rate = rc.bit_rate;
+        ctx->rc_min_rate = rc.bit_rate;
+        ctx->rc_max_rate = rc.bit_rate;
+        ctx->rc_buffer_size = static_cast<int>(rc.bit_rate);
+        break;
+    case RateControlMode::VBR:
+        ctx->bit_rate = rc.bit_rate;
+        ctx->rc_max_rate = max_rate;
+        ctx->rc_buffer_size = static_cast<int>(max_rate);
+        break;
+    case RateControlMode::CQP:
+        ctx->bit_rate = 0;
+        break;
+    case RateControlMode::Auto:
+        ctx->bit_rate = rc.bit_rate;
+        return;
+    }
+
+    static const char* const rkmpp_modes[] = {"", "CBR", "VBR", "CQP"};
+    char qp_str[16];
+    snprintf(qp_str, sizeof(qp_str), "%d", rc.qp);
+
+    if (is_hw_encoder(enc)) {
+        av_opt_set(ctx->priv_data, "rc_mode", rkmpp_modes[static_cast<int>(rc.mode)], 0);
+        if (rc.mode == RateControlMode::CQP) {
+            av_opt_set(ctx->priv_data, "qp_init", qp_str, 0);
+        }
+    } else if (strcmp(enc->name, "libx264") == 0) {
+        if (rc.mode == RateControlMode::CQP) {
+            av_opt_set(ctx->priv_data, "qp", qp_str, 0);
+        } else if (rc.mode == RateControlMode::CBR) {
+            av_opt_set(ctx->priv_data, "nal-hrd", "cbr", 0);
+        }
+    } else if (strcmp(enc->name, "libx265") == 0) {
+        if (rc.mode == RateControlMode::CQP) {
+            // x265-params 整体覆盖，需要带上 apply_sw_options 设置的帧内刷新
+            char params[48];
+            snprintf(params, sizeof(params), "qp=%d%s", rc.qp, intra_refresh ? ":intra-refresh=1" : "");
+            av_opt_set(ctx->priv_data, "x265-params", params, 0);
+        }
+    } else if (strcmp(enc->name, "libopenh264") == 0) {
+        av_opt_set(ctx->priv_data, "rc_mode", rc.mode == RateControlMode::CQP ? "off" : "bitrate", 0);
+    }
+}
+
+bool try_reconfigure_encoder(AVCodecContext* ctx, const RateControl& current, const RateControl& wanted)
+{
+    if (!ctx || !ctx->codec || strcmp(ctx->codec->name, "libx264") != 0) {
+        return false;
+    }
+    if (wanted.mode != current.mode || wanted.gop_size != current.gop_size ||
+        wanted.mode == RateControlMode::CQP) {
+        return false;
+    }
+    // libx264 封装在每帧编码前比较这些字段，变化时调用 x264_encoder_reconfig
+    apply_rate_control(ctx, ctx->codec, wanted, false);
+    return true;
+}
+
+bool parse_video_codec(const std::string& name, VideoCodec& codec)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (lower == "h264" || lower == "avc") {
+        codec = VideoCodec::H264;
+        return true;
+    }
+    if (lower == "hevc" || lower == "h265") {
+        codec = VideoCodec::HEVC;
+        return true;
+    }
+    return false;
+}
+
+const char* video_codec_name(VideoCodec codec)
+{
+    return codec == VideoCodec::HEVC ? "hevc" : "h264";
+}
+
+const char* video_codec_encoder_candidates(VideoCodec codec)
+{
+    // 每种编码格式单独的环境变量，避免覆盖后 HEVC 请求悄悄变成 H.264
+    const char* env = getenv(codec == VideoCodec::HEVC ? HEVC_ENCODER_OVERRIDE_ENV : H264_ENCODER_OVERRIDE_ENV);
+    if (env && *env) {
+        return env;
+    }
+    return codec == VideoCodec::HEVC ? HEVC_ENCODER_NAME : H264_ENCODER_NAME;
+}
+
+std::vector<std::string> resolve_encoder_candidates(const std::string& candidates)
+{
+    std::stringstream ss(candidates);
+
+    std::vector<std::string> names;
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+bool encoder_accepts_hw_frames(const std::string& candidates)
+{
+    for (const auto& name : resolve_encoder_candidates(candidates)) {
+        const AVCodec* enc = avcodec_find_encoder_by_name(name.c_str());
+        if (enc) {
+            return accepts_drm_prime(enc);
+        }
+    }
+    return false;
+}
+
+AVCodecContext* open_video_encoder(const std::string& candidates, const EncoderOpenParams& params)
+{
+    for (const auto& name : resolve_encoder_candidates(candidates)) {
+        const AVCodec* enc = avcodec_find_encoder_by_name(name.c_str());
+        if (!enc) {
+            fprintf(stderr, "[编码器] 未编译编码器: %s，尝试下一个\n", name.c_str());
+            continue;
+        }
+
+        AVCodecContext* ctx = avcodec_alloc_context3(enc);
+        if (!ctx) {
+            fprintf(stderr, "[编码器] avcodec_alloc_context3 失败 (%s)\n", name.c_str());
+            continue;
+        }
+        ctx->width = params.width;
+        ctx->height = params.height;
+        ctx->pix_fmt = choose_pix_fmt(enc, params.hw_frames_ctx != nullptr);
+        ctx->time_base = params.time_base;
+        ctx->framerate = params.framerate;
+        ctx->max_b_frames = 0;
+        // MP4 和 RTSP 复用器都需要全局头 (SPS/PPS 放在 extradata 中)，
+        // 共享编码时无法按单个复用器决定，因此总是开启。
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        if (is_hw_encoder(enc)) {
+            if (params.hw_device_ctx) {
+                ctx->hw_device_ctx = av_buffer_ref(params.hw_device_ctx);
+            }
+            if (ctx->pix_fmt == AV_PIX_FMT_DRM_PRIME) {
+                ctx->hw_frames_ctx = av_buffer_ref(params.hw_frames_ctx);
+                ctx->sw_pix_fmt = AV_PIX_FMT_NV12;
+            }
+        } else {
+            apply_sw_options(ctx, enc, params.use_case, params.intra_refresh);
+        }
+        apply_rate_control(ctx, enc, params.rate_control, params.intra_refresh);
+        const bool refresh_supported = strcmp(enc->name, "libx264") == 0 || strcmp(enc->name, "libx265") == 0;
+        if (params.intra_refresh && !refresh_supported) {
+            fprintf(stderr, "[编码器] %s 不支持帧内刷新，保持周期 IDR\n", name.c_str());
+        }
+
+        int ret = avcodec_open2(ctx, enc, nullptr);
+        if (ret < 0) {
+            print_err_enc(ret, name.c_str());
+            fprintf(stderr, "[编码器] 打开 %s 失败，尝试下一个\n", name.c_str());
+            avcodec_free_context(&ctx);
+            continue;
+        }
+
+        fprintf(stderr, "[编码器] 使用 %s (%dx%d, %s, %s%s)\n", name.c_str(), params.width, params.height,
+                av_get_pix_fmt_name(ctx->pix_fmt),
+                params.use_case == EncodeUseCase::LowLatency ? "低延迟" : "录制",
+                params.intra_refresh && refresh_supported ? ", 帧内刷新" : "");
+        return ctx;
+    }
+
+    fprintf(stderr, "[编码器] 错误: 候选编码器均不可用: %s\n", candidates.c_str());
+    return nullptr;
+}
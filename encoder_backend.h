@@ -0,0 +1,124 @@
+// --- START OF FILE encoder_backend.h ---
+
+#ifndef ENCODER_BACKEND_H
+#define ENCODER_BACKEND_H
+
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+/**
+ * @brief 编码用途，决定软件编码器的 preset/tune 和线程方式。
+ */
+enum class EncodeUseCase
+{
+    Recording,  // 录制：画质优先，帧级多线程
+    LowLatency, // 推流：低延迟，片级多线程 (不引入额外帧延迟)
+};
+
+/**
+ * @brief 视频编码格式。
+ */
+enum class VideoCodec
+{
+    H264,
+    HEVC, // 同等画质下码率约为 H.264 的一半
+};
+
+/**
+ * @brief 解析编码格式名称 ("h264" / "hevc" / "h265"，不区分大小写)。
+ * @return 名称无效时返回 false。
+ */
+bool parse_video_codec(const std::string& name, VideoCodec& codec);
+
+const char* video_codec_name(VideoCodec codec);
+
+/**
+ * @brief 该编码格式的编码器候选列表 (H264_ENCODER_NAME / HEVC_ENCODER_NAME)。
+ *
+ * 如果设置了对应的环境变量 (H264_ENCODER_OVERRIDE_ENV / HEVC_ENCODER_OVERRIDE_ENV)，
+ * 则用它代替默认列表，便于在没有 MPP 的主机上运行和对比测试。
+ */
+const char* video_codec_encoder_candidates(VideoCodec codec);
+
+/**
+ * @brief 码率控制模式。
+ */
+enum class RateControlMode
+{
+    Auto, // 沿用编码器默认模式，只设置目标码率
+    CBR,  // 恒定码率
+    VBR,  // 可变码率，峰值不超过 max_bit_rate
+    CQP,  // 恒定量化参数，忽略码率
+};
+
+/**
+ * @brief 码率控制参数，可在运行中修改 (见 EncodePipeline::set_rate_control)。
+ */
+struct RateControl
+{
+    RateControlMode mode = RateControlMode::Auto;
+    int64_t bit_rate = 0;     // 目标码率 (bps)
+    int64_t max_bit_rate = 0; // VBR 峰值码率 (bps)，0 表示取目标码率的 1.5 倍
+    int qp = 26;              // CQP 模式的量化参数
+    int gop_size = 0;
+};
+
+/**
+ * @brief 打开一个视频编码器的参数。
+ */
+struct EncoderOpenParams
+{
+    int width = 0;
+    int height = 0;
+    RateControl rate_control;
+    AVRational time_base{1, 1000000};
+    AVRational framerate{30, 1};
+    EncodeUseCase use_case = EncodeUseCase::Recording;
+    // 周期帧内刷新：每个 GOP 内逐步刷新一列宏块代替周期 IDR，各帧大小平稳 (只有第一帧和强制请求时出 IDR)。
+    // 目前只有 libx264/libx265 支持，其他编码器忽略并保持周期 IDR
+    bool intra_refresh = false;
+    // 仅硬件编码器 (*_rkmpp) 使用，可为空
+    AVBufferRef* hw_device_ctx = nullptr;
+    // 滤镜图输出 DRM_PRIME 硬件帧时的帧上下文；编码器接受 DRM_PRIME 时直接编码硬件帧，
+    // 否则忽略 (调用者需要把硬件帧下载为 NV12)
+    AVBufferRef* hw_frames_ctx = nullptr;
+};
+
+// 把逗号分隔的编码器候选列表拆成数组
+std::vector<std::string> resolve_encoder_candidates(const std::string& candidates);
+
+/**
+ * @brief 候选列表中第一个可用的编码器能否直接编码 DRM_PRIME 硬件帧。
+ * 用于决定滤镜图的输出是否保持为硬件帧；该编码器之后打开失败而回退到软件编码器时，
+ * 由调用者下载硬件帧。
+ */
+bool encoder_accepts_hw_frames(const std::string& candidates);
+
+/**
+ * @brief 按候选顺序依次尝试打开编码器，直到有一个成功。
+ *
+ * 硬件编码器不存在或被占用 (avcodec_open2 失败) 时自动回退到下一个软件编码器。
+ * 编码器的输入像素格式：给出 hw_frames_ctx 且编码器接受时为 DRM_PRIME，否则优先 NV12，
+ * 都不支持时取编码器的首选格式 (调用者需要转换)。
+ *
+ * @param candidates 逗号分隔的编码器名称，例如 "h264_rkmpp,libx264,libopenh264"。
+ * @return 已打开的编码器上下文，全部失败时返回 nullptr。调用者用 avcodec_free_context 释放。
+ */
+AVCodecContext* open_video_encoder(const std::string& candidates, const EncoderOpenParams& params);
+
+/**
+ * @brief 尝试在已打开的编码器上直接修改码率 (不重新打开)。
+ *
+ * 只有支持运行中重配置的编码器 (libx264: 码率/VBV) 且模式和 GOP 不变时才可行，
+ * 新参数从下一帧开始生效。
+ * @return 无法原地修改时返回 false，调用者需要重新打开编码器。
+ */
+bool try_reconfigure_encoder(AVCodecContext* ctx, const RateControl& current, const RateControl& wanted);
+
+#endif // ENCODER_BACKEND_H
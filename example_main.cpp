@@ -1,6 +1,8 @@
 #include "camera_sdk.h" // 甲方唯一需要包含的头文件
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <vector>
 #include <thread>
 #include <chrono>
 #include <stdexcept> // For std::stoi, std::stod exceptions
@@ -55,13 +57,34 @@ void osd_update_thread_func(void *handle)
 void print_usage()
 {
     std::cout << "\n========= 摄像头 SDK 交互式示例 ==========" << std::endl;
-    std::cout << "  record <res>      - 开始录制 (1080p, 720p, 360p)." << std::endl;
+    std::cout << "  record <res>      - 开始录制 (1080p, 720p, 360p, 或多分辨率如 1080p,360p)." << std::endl;
     std::cout << "  stop              - 停止当前录制。" << std::endl;
-    std::cout << "  stream <rtsp_url> - 开始RTSP推流。" << std::endl;
+    std::cout << "  stream <rtsp_url> [backup_url ...] - 开始RTSP推流 (多个地址时同一路编码同时推送到各服务器)。" << std::endl;
+    std::cout << "  stream2 <main_url> <sub_url> - 同时推主码流 (1080p) 和子码流 (360p/10fps)，共用一条编码链。" << std::endl;
     std::cout << "  stop_stream       - 停止RTSP推流。" << std::endl;
+    std::cout << "  serve [port]      - 启动内置RTSP服务器 (默认端口 8554，拉流地址 rtsp://<设备IP>:<port>/live)。" << std::endl;
+    std::cout << "  stop_serve        - 停止内置RTSP服务器。" << std::endl;
+    std::cout << "  hls [dir] [part_ms] - 启动 LL-HLS 输出 (默认 /tmp/hls，用静态 HTTP 服务器提供该目录)。" << std::endl;
+    std::cout << "  stop_hls          - 停止 LL-HLS 输出。" << std::endl;
+    std::cout << "  preview [port]    - 启动 MJPEG 预览 (默认端口 8080，浏览器打开 http://<设备IP>:<port>/)。" << std::endl;
+    std::cout << "  stop_preview      - 停止 MJPEG 预览。" << std::endl;
+    std::cout << "  idr               - 推流/内置服务器的下一帧强制编码为 IDR。" << std::endl;
+    std::cout << "  intrarefresh on/off - 之后的推流使用帧内刷新代替周期 IDR (仅软件编码器)。" << std::endl;
+    std::cout << "  latency on/off    - 之后的录制/推流每帧插入时延测量 SEI (用 latency_meter 统计)。" << std::endl;
     std::cout << "  snapshot          - 拍摄一张照片。" << std::endl;
     std::cout << "  osd on/off        - 开启或关闭 OSD。" << std::endl;
+    std::cout << "  burnin <rec> <stream> - 录制/推流是否把 OSD 烧录到画面 (例如: burnin off on)。" << std::endl;
     std::cout << "  + / -             - 放大 / 缩小 (步长 0.1x)。" << std::endl;
+    std::cout << "  zoomto <x> <ms>   - 平滑变焦到指定级别 (例如: zoomto 4.0 500)。" << std::endl;
+    std::cout << "  zoomv <x/s>       - 连续变焦速度, 0 停止 (例如: zoomv 1.5)。" << std::endl;
+    std::cout << "  codec <rec|stream> <h264|hevc> - 设置录制/推流的编码格式。" << std::endl;
+    std::cout << "  timelapse <秒> [blur] - 之后的录制为延时摄影, 0 关闭 (例如: timelapse 2 blur)。" << std::endl;
+    std::cout << "  rc <rec|stream|sub> <cbr|vbr|cqp> <kbps|qp> <gop> - 运行中修改码率控制 (例如: rc stream cbr 1500 30)。" << std::endl;
+    std::cout << "  lock              - 锁定当前录制的分段 (不会被循环录制删除)。" << std::endl;
+    std::cout << "  lock <file> / unlock <file> - 锁定 / 解锁存储卡上的录像文件。" << std::endl;
+    std::cout << "  storage           - 查看录像占用空间和配额。" << std::endl;
+    std::cout << "  find <秒数>       - 查找最近 N 秒内的录像 (例如: find 300)。" << std::endl;
+    std::cout << "  export <秒数> <path> - 导出最近 N 秒的片段 (例如: export 30 /mnt/sdcard/clip.mp4)。" << std::endl;
     std::cout << "  iso <value>       - 设置 ISO (例如: iso 800)。" << std::endl;
     std::cout << "  ev <value>        - 设置 EV (例如: ev -1.0)。" << std::endl;
     std::cout << "  exit              - 退出程序。" << std::endl;
@@ -110,13 +133,129 @@ int main(int argc, char **argv)
         }
         else if (line.rfind("stream ", 0) == 0)
         {
-            std::string url = line.substr(7);
-            camera_sdk_start_rtsp_stream(handle, url.c_str());
+            std::istringstream iss(line.substr(7));
+            std::vector<std::string> urls;
+            std::string url;
+            while (iss >> url)
+            {
+                urls.push_back(url);
+            }
+            if (urls.size() > 1)
+            {
+                std::vector<const char *> url_ptrs;
+                for (const auto &u : urls)
+                {
+                    url_ptrs.push_back(u.c_str());
+                }
+                camera_sdk_start_rtsp_stream_multi(handle, url_ptrs.data(), static_cast<int>(url_ptrs.size()));
+            }
+            else
+            {
+                camera_sdk_start_rtsp_stream(handle, line.substr(7).c_str());
+            }
+        }
+        else if (line.rfind("stream2 ", 0) == 0)
+        {
+            std::istringstream iss(line.substr(8));
+            std::string main_url, sub_url;
+            if (!(iss >> main_url >> sub_url))
+            {
+                std::cerr << "用法: stream2 <main_url> <sub_url>" << std::endl;
+            }
+            else
+            {
+                camera_sdk_stream_profile_t profiles[2] = {};
+                profiles[0].url = main_url.c_str();
+                profiles[1].url = sub_url.c_str();
+                profiles[1].width = 640;
+                profiles[1].height = 360;
+                profiles[1].fps = 10;
+                camera_sdk_start_rtsp_streams(handle, profiles, 2);
+            }
         }
         else if (line == "stop_stream")
         {
             camera_sdk_stop_rtsp_stream(handle);
         }
+        else if (line == "serve")
+        {
+            camera_sdk_start_rtsp_server(handle, 0);
+        }
+        else if (line.rfind("serve ", 0) == 0)
+        {
+            try
+            {
+                int port = std::stoi(line.substr(6));
+                camera_sdk_start_rtsp_server(handle, port);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "无效的端口: " << line.substr(6) << std::endl;
+            }
+        }
+        else if (line == "stop_serve")
+        {
+            camera_sdk_stop_rtsp_server(handle);
+        }
+        else if (line == "hls" || line.rfind("hls ", 0) == 0)
+        {
+            std::istringstream iss(line.substr(3));
+            std::string dir, part;
+            iss >> dir >> part;
+            try
+            {
+                int part_ms = part.empty() ? 0 : std::stoi(part);
+                camera_sdk_start_hls(handle, dir.c_str(), part_ms);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "无效的部分分段时长: " << part << std::endl;
+            }
+        }
+        else if (line == "stop_hls")
+        {
+            camera_sdk_stop_hls(handle);
+        }
+        else if (line == "preview")
+        {
+            camera_sdk_start_preview_server(handle, 0);
+        }
+        else if (line.rfind("preview ", 0) == 0)
+        {
+            try
+            {
+                int port = std::stoi(line.substr(8));
+                camera_sdk_start_preview_server(handle, port);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "无效的端口: " << line.substr(8) << std::endl;
+            }
+        }
+        else if (line == "stop_preview")
+        {
+            camera_sdk_stop_preview_server(handle);
+        }
+        else if (line == "idr")
+        {
+            camera_sdk_request_keyframe(handle);
+        }
+        else if (line == "intrarefresh on")
+        {
+            camera_sdk_set_streaming_intra_refresh(handle, true);
+        }
+        else if (line == "intrarefresh off")
+        {
+            camera_sdk_set_streaming_intra_refresh(handle, false);
+        }
+        else if (line == "latency on")
+        {
+            camera_sdk_set_latency_sei(handle, true);
+        }
+        else if (line == "latency off")
+        {
+            camera_sdk_set_latency_sei(handle, false);
+        }
         else if (line == "snapshot")
         {
             camera_sdk_take_snapshot(handle);
@@ -137,6 +276,151 @@ int main(int argc, char **argv)
         {
             camera_sdk_zoom_out(handle);
         }
+        else if (line.rfind("zoomto ", 0) == 0)
+        {
+            try
+            {
+                std::string args = line.substr(7);
+                size_t pos = 0;
+                float level = std::stof(args, &pos);
+                int duration_ms = std::stoi(args.substr(pos));
+                camera_sdk_zoom_to(handle, level, duration_ms);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "无效的变焦参数: " << line.substr(7) << std::endl;
+            }
+        }
+        else if (line.rfind("zoomv ", 0) == 0)
+        {
+            try
+            {
+                float velocity = std::stof(line.substr(6));
+                camera_sdk_set_zoom_velocity(handle, velocity);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "无效的变焦速度: " << line.substr(6) << std::endl;
+            }
+        }
+        else if (line.rfind("codec rec ", 0) == 0)
+        {
+            camera_sdk_set_recording_codec(handle, line.substr(10).c_str());
+        }
+        else if (line.rfind("codec stream ", 0) == 0)
+        {
+            camera_sdk_set_streaming_codec(handle, line.substr(13).c_str());
+        }
+        else if (line.rfind("burnin ", 0) == 0)
+        {
+            std::istringstream iss(line.substr(7));
+            std::string rec, stream;
+            if (!(iss >> rec >> stream) || (rec != "on" && rec != "off") || (stream != "on" && stream != "off"))
+            {
+                std::cerr << "用法: burnin <on|off> <on|off>" << std::endl;
+            }
+            else
+            {
+                camera_sdk_set_osd_burn_in(handle, rec == "on", stream == "on");
+            }
+        }
+        else if (line.rfind("timelapse ", 0) == 0)
+        {
+            std::istringstream iss(line.substr(10));
+            double interval = 0;
+            std::string blur;
+            if (!(iss >> interval))
+            {
+                std::cerr << "用法: timelapse <秒> [blur]" << std::endl;
+            }
+            else
+            {
+                iss >> blur;
+                camera_sdk_set_timelapse(handle, interval, blur == "blur");
+            }
+        }
+        else if (line.rfind("rc ", 0) == 0)
+        {
+            std::istringstream iss(line.substr(3));
+            std::string target, mode;
+            int value = 0;
+            camera_sdk_rate_control_t rc = {};
+            if (!(iss >> target >> mode >> value >> rc.gop_size) || (target != "rec" && target != "stream" && target != "sub") ||
+                (mode != "cbr" && mode != "vbr" && mode != "cqp"))
+            {
+                std::cerr << "用法: rc <rec|stream|sub> <cbr|vbr|cqp> <kbps|qp> <gop>" << std::endl;
+            }
+            else
+            {
+                rc.mode = (mode == "cbr") ? CAMERA_SDK_RC_CBR : (mode == "vbr") ? CAMERA_SDK_RC_VBR : CAMERA_SDK_RC_CQP;
+                if (rc.mode == CAMERA_SDK_RC_CQP)
+                    rc.qp = value;
+                else
+                    rc.bitrate_kbps = value;
+
+                if (target == "rec")
+                    camera_sdk_set_recording_rate_control(handle, &rc);
+                else if (target == "sub")
+                    camera_sdk_set_stream_rate_control(handle, 1, &rc);
+                else
+                    camera_sdk_set_streaming_rate_control(handle, &rc);
+            }
+        }
+        else if (line == "lock")
+        {
+            camera_sdk_lock_current_recording(handle);
+        }
+        else if (line.rfind("lock ", 0) == 0)
+        {
+            camera_sdk_lock_file(handle, line.substr(5).c_str());
+        }
+        else if (line.rfind("unlock ", 0) == 0)
+        {
+            camera_sdk_unlock_file(handle, line.substr(7).c_str());
+        }
+        else if (line == "storage")
+        {
+            unsigned long long used = 0, quota = 0;
+            camera_sdk_get_storage_info(handle, &used, &quota);
+            std::cout << "录像已用 " << used / (1024 * 1024) << " MB / 配额 " << quota / (1024 * 1024) << " MB" << std::endl;
+        }
+        else if (line.rfind("find ", 0) == 0)
+        {
+            try
+            {
+                long long seconds = std::stoll(line.substr(5));
+                long long now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       std::chrono::system_clock::now().time_since_epoch()).count();
+                camera_sdk_recording_range_t results[16];
+                int n = camera_sdk_query_recordings(handle, now_ms - seconds * 1000, now_ms, results, 16);
+                for (int i = 0; i < n && i < 16; ++i)
+                {
+                    std::cout << results[i].path << " (" << results[i].width << "x" << results[i].height
+                              << ") 偏移 " << results[i].start_offset << " - " << results[i].end_offset << std::endl;
+                }
+                std::cout << "共 " << n << " 个文件。" << std::endl;
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "无效的秒数: " << line.substr(5) << std::endl;
+            }
+        }
+        else if (line.rfind("export ", 0) == 0)
+        {
+            std::istringstream iss(line.substr(7));
+            long long seconds = 0;
+            std::string path;
+            if (!(iss >> seconds >> path) || seconds <= 0)
+            {
+                std::cerr << "用法: export <秒数> <path>" << std::endl;
+            }
+            else
+            {
+                long long now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       std::chrono::system_clock::now().time_since_epoch()).count();
+                camera_sdk_export_clip(handle, now_ms - seconds * 1000, now_ms, path.c_str(), nullptr, nullptr);
+            }
+        }
         else if (line.rfind("iso ", 0) == 0)
         {
             try
@@ -45,6 +45,9 @@ void FileManager::scheduleMove(const std::string& source_path) {
 }
 
 void FileManager::worker_thread_func() {
+    // 在后台加载目录，不拖慢相机启动；加载期间移动的文件排在队列中，加载完成后再登记
+    m_catalog.load(FINAL_STORAGE_PATH);
+
     while (!m_stop_flag) {
         std::string src_path;
         {
@@ -74,6 +77,14 @@ void FileManager::worker_thread_func() {
             
             if (move_file_robust(src_path.c_str(), dst_path.c_str()) != 0) {
                  fprintf(stderr, "[文件管理器] 错误: 文件移动失败: %s\n", src_path.c_str());
+            } else {
+                if (dst_path.size() > strlen(RECORDING_INDEX_EXT) &&
+                    dst_path.compare(dst_path.size() - strlen(RECORDING_INDEX_EXT), std::string::npos, RECORDING_INDEX_EXT) == 0) {
+                    m_catalog.add(dst_path);
+                }
+                if (m_on_moved_cb) {
+                    m_on_moved_cb(dst_path);
+                }
             }
         }
     }
@@ -9,6 +9,9 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <functional>
+
+#include "recording_catalog.h"
 
 /**
  * @class FileManager
@@ -16,6 +19,8 @@
  *
  * 这个类将文件移动操作封装在一个独立的常驻线程中，
  * 通过一个线程安全的队列接收任务，避免阻塞核心业务逻辑。
+ * 同时维护存储目录的录像目录 (RecordingCatalog)：启动时在后台线程中加载，
+ * 每移动一个索引文件 (.idx) 登记一次。
  */
 class FileManager {
 public:
@@ -34,6 +39,15 @@ public:
      */
     void scheduleMove(const std::string& source_path);
 
+    /**
+     * @brief 设置文件移动成功后的回调 (在后台线程中调用)，参数为目标路径。
+     * 必须在 start() 之前设置。
+     */
+    void setMoveCompleteCallback(std::function<void(const std::string&)> cb) { m_on_moved_cb = std::move(cb); }
+
+    // 存储目录中全部录像的目录，用于按时间范围查询
+    RecordingCatalog& getCatalog() { return m_catalog; }
+
 private:
     // 后台工作线程的主函数
     void worker_thread_func();
@@ -43,6 +57,8 @@ private:
     std::mutex m_queue_mutex;
     std::condition_variable m_cv;
     std::atomic<bool> m_stop_flag{false};
+    std::function<void(const std::string&)> m_on_moved_cb;
+    RecordingCatalog m_catalog;
 };
 
 #endif // FILE_MANAGER_H
\ No newline at end of file
@@ -7,8 +7,15 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <iostream>
 
+// linux/ioprio.h 在部分工具链中缺失，这里只需要以下常量
+#define IOPRIO_CLASS_IDLE_VALUE  3
+#define IOPRIO_CLASS_SHIFT_VALUE 13
+#define IOPRIO_WHO_PROCESS_VALUE 1
+
 /**
  * @file file_utils.cpp
  * @brief 实现了文件操作相关的工具函数。
@@ -97,3 +104,14 @@ int move_file_robust(const char *src_path, const char *dst_path)
     std::cerr << "[文件工具] 错误: rename 操作失败: " << src_path << " -> " << dst_path << " (" << strerror(errno) << ")" << std::endl;
     return -1;
 }
+
+void lower_thread_priority(int nice_value)
+{
+    const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, nice_value) != 0) {
+        fprintf(stderr, "[文件工具] 警告: 无法降低 CPU 优先级\n");
+    }
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS_VALUE, tid, IOPRIO_CLASS_IDLE_VALUE << IOPRIO_CLASS_SHIFT_VALUE) != 0) {
+        fprintf(stderr, "[文件工具] 警告: 无法设置 idle I/O 优先级\n");
+    }
+}
@@ -18,5 +18,12 @@
  */
 int move_file_robust(const char *src_path, const char *dst_path);
 
+/**
+ * @brief 降低调用线程的 CPU 优先级并把 I/O 优先级设为 idle。
+ * 用于导出、恢复等后台任务，只在存储卡空闲时读写，不与录制/推流争抢带宽。
+ * @param nice_value 目标 nice 值 (19 为最低 CPU 优先级)。
+ */
+void lower_thread_priority(int nice_value);
+
 #endif // FILE_UTILS_H
 
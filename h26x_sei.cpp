@@ -0,0 +1,154 @@
+// --- START OF FILE h26x_sei.cpp ---
+
+#include "h26x_sei.h"
+
+#include <cstring>
+
+static const int kSeiUserDataUnregistered = 5;
+static const size_t kUuidSize = 16;
+
+// 边写 RBSP 边做防竞争：连续两个 0x00 之后的字节不大于 0x03 时插入 0x03
+struct EscapedWriter
+{
+    std::vector<uint8_t>& out;
+    int zeros;
+
+    void put(uint8_t b)
+    {
+        if (zeros >= 2 && b <= 0x03) {
+            out.push_back(0x03);
+            zeros = 0;
+        }
+        out.push_back(b);
+        zeros = (b == 0x00) ? zeros + 1 : 0;
+    }
+
+    // payloadType/payloadSize 的编码：每 255 写一个 0xFF，最后写余数
+    void put_sei_value(size_t value)
+    {
+        while (value >= 255) {
+            put(0xFF);
+            value -= 255;
+        }
+        put(static_cast<uint8_t>(value));
+    }
+};
+
+bool append_sei_user_data(AVCodecID codec_id, const uint8_t uuid[16], const uint8_t* payload, size_t size,
+                          std::vector<uint8_t>& out)
+{
+    if (codec_id != AV_CODEC_ID_H264 && codec_id != AV_CODEC_ID_HEVC) {
+        return false;
+    }
+
+    static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+    out.insert(out.end(), start_code, start_code + sizeof(start_code));
+    if (codec_id == AV_CODEC_ID_H264) {
+        out.push_back(0x06); // nal_unit_type 6
+    } else {
+        out.push_back(39 << 1); // PREFIX_SEI_NUT, nuh_layer_id 0
+        out.push_back(0x01);    // nuh_temporal_id_plus1
+    }
+
+    // 直接写入 out (不经过临时缓冲区)，复用调用者的容量
+    EscapedWriter w{out, 0};
+    w.put_sei_value(kSeiUserDataUnregistered);
+    w.put_sei_value(size + kUuidSize);
+    for (size_t i = 0; i < kUuidSize; i++) w.put(uuid[i]);
+    for (size_t i = 0; i < size; i++) w.put(payload[i]);
+    w.put(0x80); // rbsp_trailing_bits
+    return true;
+}
+
+// 去掉防竞争字节
+static void unescape_rbsp(const uint8_t* data, size_t size, std::vector<uint8_t>& rbsp)
+{
+    rbsp.clear();
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (zeros >= 2 && data[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        rbsp.push_back(data[i]);
+        zeros = (data[i] == 0x00) ? zeros + 1 : 0;
+    }
+}
+
+static bool parse_sei_rbsp(const std::vector<uint8_t>& rbsp, const uint8_t uuid[16], std::vector<uint8_t>& payload)
+{
+    size_t pos = 0;
+    // 至少还要有 1 字节 type、1 字节 size，最后一个字节是 rbsp_trailing_bits
+    while (pos + 2 < rbsp.size()) {
+        size_t type = 0, size = 0;
+        while (pos < rbsp.size() && rbsp[pos] == 0xFF) type += rbsp[pos++];
+        if (pos >= rbsp.size()) return false;
+        type += rbsp[pos++];
+        while (pos < rbsp.size() && rbsp[pos] == 0xFF) size += rbsp[pos++];
+        if (pos >= rbsp.size()) return false;
+        size += rbsp[pos++];
+        if (pos + size > rbsp.size()) return false;
+
+        if (type == kSeiUserDataUnregistered && size >= kUuidSize && memcmp(&rbsp[pos], uuid, kUuidSize) == 0) {
+            payload.assign(rbsp.begin() + pos + kUuidSize, rbsp.begin() + pos + size);
+            return true;
+        }
+        pos += size;
+    }
+    return false;
+}
+
+bool find_sei_user_data(AVCodecID codec_id, const uint8_t uuid[16], const uint8_t* data, size_t size,
+                        std::vector<uint8_t>& payload)
+{
+    const size_t header_size = (codec_id == AV_CODEC_ID_HEVC) ? 2 : 1;
+    std::vector<uint8_t> rbsp;
+
+    size_t i = 0;
+    while (i + 3 <= size) {
+        // 查找起始码 00 00 01 (4 字节的起始码同样以它结尾)
+        if (!(data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] == 0x01)) {
+            i++;
+            continue;
+        }
+        const size_t nal_start = i + 3;
+        size_t nal_end = nal_start;
+        while (nal_end + 3 <= size && !(data[nal_end] == 0x00 && data[nal_end + 1] == 0x00 &&
+                                         (data[nal_end + 2] == 0x01 || data[nal_end + 2] == 0x00))) {
+            nal_end++;
+        }
+        if (nal_end + 3 > size) nal_end = size;
+
+        if (nal_end > nal_start + header_size) {
+            bool is_sei;
+            if (codec_id == AV_CODEC_ID_HEVC) {
+                const int type = (data[nal_start] >> 1) & 0x3F;
+                is_sei = (type == 39 || type == 40);
+            } else {
+                is_sei = (data[nal_start] & 0x1F) == 6;
+            }
+            if (is_sei) {
+                unescape_rbsp(data + nal_start + header_size, nal_end - nal_start - header_size, rbsp);
+                if (parse_sei_rbsp(rbsp, uuid, payload)) {
+                    return true;
+                }
+            }
+        }
+        i = nal_end;
+    }
+    return false;
+}
+
+bool packet_with_sei(AVPacket* out, const AVPacket* pkt, const std::vector<uint8_t>& sei_nal)
+{
+    if (av_new_packet(out, static_cast<int>(sei_nal.size()) + pkt->size) < 0) {
+        return false;
+    }
+    if (av_packet_copy_props(out, pkt) < 0) {
+        av_packet_unref(out);
+        return false;
+    }
+    memcpy(out->data, sei_nal.data(), sei_nal.size());
+    memcpy(out->data + sei_nal.size(), pkt->data, pkt->size);
+    return true;
+}
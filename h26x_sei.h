@@ -0,0 +1,44 @@
+// --- START OF FILE h26x_sei.h ---
+
+#ifndef H26X_SEI_H
+#define H26X_SEI_H
+
+#include <vector>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+/**
+ * @file h26x_sei.h
+ * @brief 生成和解析 H.264/HEVC 的 "user data unregistered" SEI (payloadType 5)。
+ *
+ * 用于在码流中带内传递元数据 (定位遥测等)，RTSP/RTP 等只承载视频的通道也能原样送达。
+ * 生成的是 Annex B 格式 (带起始码) 的完整 NAL 单元，已做防竞争字节处理。
+ */
+
+/**
+ * @brief 生成一个 SEI NAL 单元并追加到 out。
+ * @param codec_id AV_CODEC_ID_H264 或 AV_CODEC_ID_HEVC。
+ * @param uuid 16 字节的 UUID，接收端据此识别数据类型。
+ * @return 不支持的编码格式返回 false。
+ */
+bool append_sei_user_data(AVCodecID codec_id, const uint8_t uuid[16], const uint8_t* payload, size_t size,
+                          std::vector<uint8_t>& out);
+
+/**
+ * @brief 在 Annex B 数据包中查找指定 UUID 的 user data unregistered SEI，返回其负载。
+ * @return 找到时返回 true。
+ */
+bool find_sei_user_data(AVCodecID codec_id, const uint8_t uuid[16], const uint8_t* data, size_t size,
+                        std::vector<uint8_t>& payload);
+
+/**
+ * @brief 把 SEI NAL 和原数据包内容依次写入 out (必须是空的数据包)，并复制时间戳等属性。
+ * 原数据包可能被多个输出共享，因此不在其上原地修改。
+ */
+bool packet_with_sei(AVPacket* out, const AVPacket* pkt, const std::vector<uint8_t>& sei_nal);
+
+#endif // H26X_SEI_H
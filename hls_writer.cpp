@@ -0,0 +1,538 @@
+// --- START OF FILE hls_writer.cpp ---
+
+#include "hls_writer.h"
+#include "alloc_counter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+}
+
+static const char kPlaylistName[] = "index.m3u8";
+static const char kInitName[] = "init.mp4";
+
+static void print_err_hls(int ret, const char* msg)
+{
+    char errbuf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(ret, errbuf, sizeof(errbuf));
+    fprintf(stderr, "[HLS输出] 错误: %s: %s\n", msg, errbuf);
+}
+
+// 逐级创建目录 (mkdir -p)
+static bool make_directories(const std::string& dir)
+{
+    for (size_t pos = 1; pos <= dir.size(); ++pos) {
+        if (pos == dir.size() || dir[pos] == '/') {
+            const std::string sub = dir.substr(0, pos);
+            if (mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 删除上次运行留下的分段和播放列表，否则分段序号从 0 重新开始后旧文件不会再被清理
+static void remove_stale_files(const std::string& dir)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    while (struct dirent* entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        const bool is_segment = name.compare(0, 3, "seg") == 0 && name.find(".m4s") != std::string::npos;
+        if (is_segment || name == kPlaylistName || name == kInitName) {
+            unlink((dir + "/" + name).c_str());
+        }
+    }
+    closedir(d);
+}
+
+HlsWriter::HlsWriter() = default;
+
+HlsWriter::~HlsWriter()
+{
+    stop();
+}
+
+bool HlsWriter::prepare(const std::string& dir, int part_ms, VideoCodec codec)
+{
+    m_dir = dir;
+    while (m_dir.size() > 1 && m_dir.back() == '/') {
+        m_dir.pop_back();
+    }
+    if (m_dir.empty() || !make_directories(m_dir)) {
+        fprintf(stderr, "[HLS输出] 错误: 无法创建目录 %s\n", dir.c_str());
+        return false;
+    }
+    if (part_ms <= 0) {
+        part_ms = HLS_PART_DURATION_MS;
+    }
+
+    // 部分分段按帧数切分，时长是帧间隔的整数倍，PART-TARGET 取这个值
+    const int fps = V4L2_INPUT_FPS;
+    m_frame_us = 1000000 / fps;
+    m_part_frames = std::max(1, (part_ms * fps + 500) / 1000);
+    m_part_target = static_cast<double>(m_part_frames) / fps;
+    // 分段在目标时长之后的第一个关键帧切分，最长为目标时长向上取整到 GOP
+    const int segment_frames = std::max(1, HLS_SEGMENT_DURATION_MS * fps / 1000);
+    const int gops = (segment_frames + RTSP_GOP_SIZE - 1) / RTSP_GOP_SIZE;
+    m_target_duration = std::max(1, static_cast<int>(std::ceil(static_cast<double>(gops * RTSP_GOP_SIZE) / fps)));
+
+    // 与 RtspStreamer 使用相同的编码参数，同时推流时共享编码链。
+    // 分段必须以 IDR 开始，因此不使用帧内刷新 (推流开启帧内刷新时会单独编码一路)。
+    m_profile.width = RTSP_OUTPUT_WIDTH;
+    m_profile.height = RTSP_OUTPUT_HEIGHT;
+    m_profile.rate_control.bit_rate = (codec == VideoCodec::HEVC) ? RTSP_HEVC_BITRATE : RTSP_BITRATE;
+    m_profile.rate_control.gop_size = RTSP_GOP_SIZE;
+    m_profile.encoder_name = video_codec_encoder_candidates(codec);
+    m_profile.use_case = EncodeUseCase::LowLatency;
+    m_profile.burn_in_osd = m_burn_in_osd;
+    return true;
+}
+
+bool HlsWriter::attach_pipeline(std::shared_ptr<EncodePipeline> pipeline)
+{
+    if (!pipeline) {
+        return false;
+    }
+    int idx = pipeline->find_compatible_output(m_profile);
+    if (idx < 0 || !pipeline->register_consumer(&m_queue_packets, static_cast<size_t>(idx))) {
+        return false;
+    }
+    m_output_index = static_cast<size_t>(idx);
+    m_pipeline = std::move(pipeline);
+    return true;
+}
+
+void HlsWriter::stop()
+{
+    m_stop_flag = true;
+    if (m_pipeline) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+    } else {
+        m_queue_packets.stop();
+    }
+}
+
+std::string HlsWriter::path_of(const std::string& name) const
+{
+    return m_dir + "/" + name;
+}
+
+std::string HlsWriter::segment_name(unsigned sequence) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "seg%u.m4s", sequence);
+    return name;
+}
+
+std::string HlsWriter::part_name(unsigned sequence, size_t part_index) const
+{
+    char name[48];
+    snprintf(name, sizeof(name), "seg%u.%zu.m4s", sequence, part_index);
+    return name;
+}
+
+bool HlsWriter::write_file(const std::string& name, const uint8_t* data, size_t size)
+{
+    const std::string path = path_of(name);
+    const std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "[HLS输出] 错误: 无法写入 %s: %s\n", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    const bool ok = fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0 || !ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "[HLS输出] 错误: 写入 %s 失败\n", path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool HlsWriter::initialize_muxer()
+{
+    AVCodecParameters* enc_par = avcodec_parameters_alloc();
+    if (!enc_par || !m_pipeline->get_codec_parameters(m_output_index, enc_par, &m_enc_time_base)) {
+        fprintf(stderr, "[HLS输出] 错误: 编码链未就绪。\n");
+        avcodec_parameters_free(&enc_par);
+        return false;
+    }
+
+    avformat_alloc_output_context2(&m_ofmt_ctx, nullptr, "mp4", nullptr);
+    if (!m_ofmt_ctx) {
+        fprintf(stderr, "[HLS输出] 错误: 无法创建 fMP4 复用器\n");
+        avcodec_parameters_free(&enc_par);
+        return false;
+    }
+    m_out_stream = avformat_new_stream(m_ofmt_ctx, nullptr);
+    if (!m_out_stream) {
+        fprintf(stderr, "[HLS输出] 创建输出流失败\n");
+        avcodec_parameters_free(&enc_par);
+        return false;
+    }
+    avcodec_parameters_copy(m_out_stream->codecpar, enc_par);
+    avcodec_parameters_free(&enc_par);
+    if (m_out_stream->codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        // Safari 只播放 hvc1 标记的 HEVC
+        m_out_stream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+    }
+    m_out_stream->time_base = AVRational{1, 90000};
+
+    // CMAF：初始化分段只含 moov，每个片段 (moof+mdat) 由 av_write_frame(NULL) 手动切出，
+    // 片段内的偏移相对 moof，片段可以单独存成文件
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "movflags", "empty_moov+default_base_moof+frag_custom", 0);
+
+    // 复用器写出的数据先进入内存缓冲区，每个片段结束时取出写成文件
+    int ret = avio_open_dyn_buf(&m_ofmt_ctx->pb);
+    if (ret < 0) {
+        print_err_hls(ret, "avio_open_dyn_buf");
+        av_dict_free(&opts);
+        return false;
+    }
+    ret = avformat_write_header(m_ofmt_ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        print_err_hls(ret, "avformat_write_header (fmp4)");
+        return false;
+    }
+    m_header_written = true;
+
+    uint8_t* buf = nullptr;
+    const int size = avio_close_dyn_buf(m_ofmt_ctx->pb, &buf);
+    m_ofmt_ctx->pb = nullptr;
+    const bool ok = size > 0 && write_file(kInitName, buf, static_cast<size_t>(size));
+    av_free(buf);
+    if (!ok) {
+        return false;
+    }
+
+    m_write_pkt = av_packet_alloc();
+    return m_write_pkt != nullptr;
+}
+
+void HlsWriter::cleanup_muxer()
+{
+    if (m_segment_file) {
+        fclose(m_segment_file);
+        m_segment_file = nullptr;
+        if (!m_segments.empty()) {
+            unlink((path_of(segment_name(m_segments.back().sequence)) + ".tmp").c_str());
+        }
+    }
+    if (m_ofmt_ctx) {
+        // 尾部数据 (mfra) 对 HLS 没有用处，写入内存后丢弃
+        if (m_header_written && (m_ofmt_ctx->pb || avio_open_dyn_buf(&m_ofmt_ctx->pb) >= 0)) {
+            av_write_trailer(m_ofmt_ctx);
+        }
+        if (m_ofmt_ctx->pb) {
+            uint8_t* buf = nullptr;
+            avio_close_dyn_buf(m_ofmt_ctx->pb, &buf);
+            av_free(buf);
+            m_ofmt_ctx->pb = nullptr;
+        }
+        avformat_free_context(m_ofmt_ctx);
+    }
+    av_packet_free(&m_write_pkt);
+    m_queue_packets.clear();
+
+    m_ofmt_ctx = nullptr;
+    m_out_stream = nullptr;
+    m_header_written = false;
+}
+
+bool HlsWriter::begin_fragment()
+{
+    int ret = avio_open_dyn_buf(&m_ofmt_ctx->pb);
+    if (ret < 0) {
+        print_err_hls(ret, "avio_open_dyn_buf");
+        return false;
+    }
+    return true;
+}
+
+bool HlsWriter::finish_part(int64_t end_pts)
+{
+    if (m_part_start_pts == AV_NOPTS_VALUE) {
+        return true;
+    }
+    int ret = av_write_frame(m_ofmt_ctx, nullptr);
+    uint8_t* buf = nullptr;
+    const int size = avio_close_dyn_buf(m_ofmt_ctx->pb, &buf);
+    m_ofmt_ctx->pb = nullptr;
+    if (ret < 0) {
+        print_err_hls(ret, "av_write_frame (flush fragment)");
+        av_free(buf);
+        return false;
+    }
+
+    Segment& seg = m_segments.back();
+    bool ok = size > 0 && write_file(part_name(seg.sequence, seg.parts.size()), buf, static_cast<size_t>(size));
+    // 分段文件就是各部分分段的拼接
+    ok = ok && fwrite(buf, 1, static_cast<size_t>(size), m_segment_file) == static_cast<size_t>(size);
+    av_free(buf);
+
+    Part part;
+    part.duration = av_rescale_q(end_pts - m_part_start_pts, m_enc_time_base, AVRational{1, 1000000}) / 1e6;
+    part.independent = m_part_independent;
+    seg.parts.push_back(part);
+    seg.duration += part.duration;
+    m_part_start_pts = AV_NOPTS_VALUE;
+    return ok;
+}
+
+bool HlsWriter::finish_segment()
+{
+    if (!m_segment_file) {
+        return true;
+    }
+    Segment& seg = m_segments.back();
+    const std::string path = path_of(segment_name(seg.sequence));
+    const bool ok = fclose(m_segment_file) == 0 && rename((path + ".tmp").c_str(), path.c_str()) == 0;
+    m_segment_file = nullptr;
+    if (!ok) {
+        fprintf(stderr, "[HLS输出] 错误: 写入 %s 失败\n", path.c_str());
+        return false;
+    }
+    seg.complete = true;
+
+    // 关键帧晚到时分段会超过目标时长；TARGETDURATION 只能增大，否则播放器会报错
+    const int rounded = static_cast<int>(seg.duration + 0.5);
+    if (rounded > m_target_duration) {
+        fprintf(stderr, "[HLS输出] 警告: 分段 %u 时长 %.2f 秒，超过目标时长 %d 秒\n", seg.sequence, seg.duration,
+                m_target_duration);
+        m_target_duration = rounded;
+    }
+    trim_segments();
+    return true;
+}
+
+void HlsWriter::trim_segments()
+{
+    // 比播放列表多保留一个分段，留给刚刚拿到上一版播放列表、还在下载的客户端
+    while (m_segments.size() > static_cast<size_t>(HLS_PLAYLIST_SEGMENTS) + 1) {
+        const Segment& seg = m_segments.front();
+        unlink(path_of(segment_name(seg.sequence)).c_str());
+        if (!seg.parts_deleted) {
+            for (size_t i = 0; i < seg.parts.size(); ++i) {
+                unlink(path_of(part_name(seg.sequence, i)).c_str());
+            }
+        }
+        m_segments.pop_front();
+    }
+    // 部分分段只在最近几个分段中列出，更早的同样多保留一个分段再删除
+    if (m_segments.size() > static_cast<size_t>(HLS_PART_SEGMENTS)) {
+        const size_t end = m_segments.size() - HLS_PART_SEGMENTS;
+        for (size_t s = 0; s < end; ++s) {
+            Segment& seg = m_segments[s];
+            if (seg.parts_deleted) continue;
+            for (size_t i = 0; i < seg.parts.size(); ++i) {
+                unlink(path_of(part_name(seg.sequence, i)).c_str());
+            }
+            seg.parts_deleted = true;
+        }
+    }
+}
+
+bool HlsWriter::write_playlist(bool ended)
+{
+    if (m_segments.empty()) {
+        return true;
+    }
+    const size_t open_count = m_segments.back().complete ? 0 : 1;
+    const size_t complete = m_segments.size() - open_count;
+    const size_t first = complete > static_cast<size_t>(HLS_PLAYLIST_SEGMENTS) ? complete - HLS_PLAYLIST_SEGMENTS : 0;
+
+    std::string out;
+    out.reserve(4096);
+    char line[160];
+    snprintf(line, sizeof(line),
+             "#EXTM3U\n"
+             "#EXT-X-VERSION:6\n"
+             "#EXT-X-TARGETDURATION:%d\n"
+             "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n"
+             "#EXT-X-PART-INF:PART-TARGET=%.5f\n"
+             "#EXT-X-MEDIA-SEQUENCE:%u\n",
+             m_target_duration, m_part_target * 3, m_part_target, m_segments[first].sequence);
+    out += line;
+    snprintf(line, sizeof(line), "#EXT-X-MAP:URI=\"%s\"\n", kInitName);
+    out += line;
+
+    for (size_t s = first; s < m_segments.size(); ++s) {
+        const Segment& seg = m_segments[s];
+        if (s + HLS_PART_SEGMENTS >= m_segments.size() && !seg.parts_deleted) {
+            for (size_t i = 0; i < seg.parts.size(); ++i) {
+                snprintf(line, sizeof(line), "#EXT-X-PART:DURATION=%.5f,URI=\"%s\"%s\n", seg.parts[i].duration,
+                         part_name(seg.sequence, i).c_str(), seg.parts[i].independent ? ",INDEPENDENT=YES" : "");
+                out += line;
+            }
+        }
+        if (seg.complete) {
+            snprintf(line, sizeof(line), "#EXTINF:%.5f,\n%s\n", seg.duration, segment_name(seg.sequence).c_str());
+            out += line;
+        }
+    }
+    if (ended) {
+        out += "#EXT-X-ENDLIST\n";
+    }
+    return write_file(kPlaylistName, reinterpret_cast<const uint8_t*>(out.data()), out.size());
+}
+
+bool HlsWriter::write_packet(const AVPacket* pkt)
+{
+    const bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+    // 分段必须从关键帧开始 (加入已在运行的编码链或丢弃积压之后)
+    if (m_wait_keyframe) {
+        if (!key) {
+            return true;
+        }
+        m_wait_keyframe = false;
+        if (m_first_pts == AV_NOPTS_VALUE) {
+            m_first_pts = pkt->pts;
+        }
+    }
+
+    const int64_t segment_us = static_cast<int64_t>(HLS_SEGMENT_DURATION_MS) * 1000;
+    const bool new_segment = !m_segment_file ||
+        (key && av_rescale_q(pkt->pts - m_segment_start_pts, m_enc_time_base, AVRational{1, 1000000}) >= segment_us);
+    if (new_segment || m_part_frame_count >= m_part_frames) {
+        if (!finish_part(pkt->pts)) {
+            return false;
+        }
+        if (new_segment) {
+            if (!finish_segment()) {
+                return false;
+            }
+            Segment seg;
+            seg.sequence = m_next_sequence++;
+            m_segments.push_back(seg);
+            const std::string tmp = path_of(segment_name(seg.sequence)) + ".tmp";
+            m_segment_file = fopen(tmp.c_str(), "wb");
+            if (!m_segment_file) {
+                fprintf(stderr, "[HLS输出] 错误: 无法创建 %s: %s\n", tmp.c_str(), strerror(errno));
+                return false;
+            }
+            m_segment_start_pts = pkt->pts;
+        }
+        if (!write_playlist(false)) {
+            return false;
+        }
+    }
+    if (m_part_start_pts == AV_NOPTS_VALUE) {
+        if (!begin_fragment()) {
+            return false;
+        }
+        m_part_start_pts = pkt->pts;
+        m_part_independent = key;
+        m_part_frame_count = 0;
+    }
+
+    // 数据包由其他消费者共享，只在自己的引用上修改时间戳
+    if (av_packet_ref(m_write_pkt, pkt) < 0) {
+        fprintf(stderr, "[HLS输出] 错误: av_packet_ref 失败\n");
+        return false;
+    }
+    m_write_pkt->pts -= m_first_pts;
+    m_write_pkt->dts -= m_first_pts;
+    // 片段在下一帧到达之前切出，最后一帧的时长取标称帧间隔
+    m_write_pkt->duration = av_rescale_q(m_frame_us, AVRational{1, 1000000}, m_enc_time_base);
+    av_packet_rescale_ts(m_write_pkt, m_enc_time_base, m_out_stream->time_base);
+    m_write_pkt->stream_index = m_out_stream->index;
+    int ret = av_write_frame(m_ofmt_ctx, m_write_pkt);
+    av_packet_unref(m_write_pkt);
+    if (ret < 0) {
+        print_err_hls(ret, "av_write_frame (fmp4)");
+        return false;
+    }
+    m_part_frame_count++;
+    m_last_pts = pkt->pts;
+    return true;
+}
+
+void HlsWriter::drop_backlog()
+{
+    fprintf(stderr, "[HLS输出] 警告: 写入积压 %zu 个数据包，丢弃后从下一个关键帧继续\n", m_queue_packets.size());
+    m_queue_packets.clear();
+    // 已写入的数据收尾成完整的分段，之后的分段从新的关键帧开始
+    if (m_last_pts != AV_NOPTS_VALUE) {
+        const int64_t frame = av_rescale_q(m_frame_us, AVRational{1, 1000000}, m_enc_time_base);
+        if (finish_part(m_last_pts + frame) && finish_segment()) {
+            write_playlist(false);
+        }
+    }
+    m_wait_keyframe = true;
+    m_pipeline->request_keyframe(m_output_index);
+}
+
+void HlsWriter::run()
+{
+    m_is_running = true;
+    m_stop_flag = false;
+
+    if (!m_pipeline) {
+        fprintf(stderr, "[HLS输出] 错误: 未绑定编码链\n");
+        m_is_running = false;
+        return;
+    }
+
+    remove_stale_files(m_dir);
+    if (!initialize_muxer()) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+        cleanup_muxer();
+        m_is_running = false;
+        return;
+    }
+
+    const EncodeProfile& pipe_profile = m_pipeline->get_profile(m_output_index);
+    fprintf(stderr, "[HLS输出] 开始输出到 %s/%s (%dx%d, 部分分段 %.0f ms)\n", m_dir.c_str(), kPlaylistName,
+            pipe_profile.width, pipe_profile.height, m_part_target * 1000);
+
+    bool error = false;
+    AllocationProbe alloc_probe("HlsWriter");
+    while (true) {
+        AVPacketPtr pkt_ptr = m_queue_packets.wait_and_pop();
+        if (pkt_ptr == nullptr) {
+            break;
+        }
+        if (error) {
+            continue;
+        }
+        // 磁盘写入跟不上时不让队列无限增长
+        if (m_queue_packets.size() > static_cast<size_t>(HLS_MAX_QUEUED_PACKETS)) {
+            drop_backlog();
+            continue;
+        }
+        if (!write_packet(pkt_ptr.get())) {
+            error = true;
+            // 仅注销自己，不影响共享同一编码链的推流和录制
+            m_pipeline->unregister_consumer(&m_queue_packets);
+        }
+        alloc_probe.frame_done();
+    }
+
+    // 写完最后一个分段并标记直播结束
+    if (!error && m_last_pts != AV_NOPTS_VALUE && m_part_start_pts != AV_NOPTS_VALUE) {
+        const int64_t frame = av_rescale_q(m_frame_us, AVRational{1, 1000000}, m_enc_time_base);
+        if (finish_part(m_last_pts + frame) && finish_segment()) {
+            write_playlist(true);
+        }
+    }
+
+    cleanup_muxer();
+    fprintf(stderr, "[HLS输出] 输出结束。\n");
+    m_is_running = false;
+}
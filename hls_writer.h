@@ -0,0 +1,127 @@
+// --- START OF FILE hls_writer.h ---
+
+#ifndef HLS_WRITER_H
+#define HLS_WRITER_H
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <cstdio>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "app_config.h"
+#include "encode_pipeline.h"
+#include "threadsafe_queue.h"
+
+/**
+ * @class HlsWriter
+ * @brief 低延迟 HLS (LL-HLS) 输出：把编码数据包写成 CMAF fMP4 分段和部分分段，并维护滚动播放列表。
+ *
+ * - 目录中的文件可由任意静态 HTTP 服务器提供给浏览器 (hls.js / Safari)，不需要转码服务器：
+ *   index.m3u8 (播放列表)、init.mp4 (初始化分段)、segN.m4s (分段)、segN.P.m4s (部分分段)。
+ * - 和 RtspStreamer 一样只是编码链的一个数据包消费者，编码参数相同时与推流/内置服务器共享编码链。
+ * - 每个部分分段是一个 moof+mdat 片段，写完即出现在播放列表中 (EXT-X-PART)；分段从关键帧开始，
+ *   是其部分分段的拼接。静态服务器不支持阻塞式刷新，因此不输出 EXT-X-PRELOAD-HINT，
+ *   播放器按 PART-HOLD-BACK 轮询。
+ * - 资源上限：内存中最多一个部分分段；磁盘上保留 HLS_PLAYLIST_SEGMENTS 个分段 (外加一个，
+ *   留给正在下载的客户端)，部分分段只保留最近 HLS_PART_SEGMENTS 个分段的；
+ *   写入积压超过 HLS_MAX_QUEUED_PACKETS 时丢弃积压，从下一个关键帧继续。
+ * - 文件先写入临时文件再改名，HTTP 服务器不会读到写了一半的文件。
+ *
+ * 建议输出到 tmpfs (例如 /tmp)，避免存储卡磨损。
+ */
+class HlsWriter {
+public:
+    HlsWriter();
+    ~HlsWriter();
+
+    // dir: 输出目录 (不存在时创建)；part_ms: 部分分段时长，<=0 表示 HLS_PART_DURATION_MS
+    bool prepare(const std::string& dir, int part_ms, VideoCodec codec = VideoCodec::H264);
+
+    // prepare() 之后有效，用于向控制器申请 (或复用) 编码链
+    const EncodeProfile& get_encode_profile() const { return m_profile; }
+
+    // 绑定编码链并注册数据包队列，必须在 run() 之前在调用线程中完成
+    bool attach_pipeline(std::shared_ptr<EncodePipeline> pipeline);
+    std::shared_ptr<EncodePipeline> get_pipeline() const { return m_pipeline; }
+
+    // 是否把 OSD 烧录到画面中 (默认是)，必须在 prepare() 之前设置
+    void set_osd_burn_in(bool enabled) { m_burn_in_osd = enabled; }
+
+    void run();
+    void stop();
+    bool isRunning() const { return m_is_running; }
+
+private:
+    struct Part
+    {
+        double duration = 0;
+        bool independent = false;   // 以关键帧开始
+    };
+
+    struct Segment
+    {
+        unsigned sequence = 0;
+        double duration = 0;
+        bool complete = false;
+        bool parts_deleted = false;
+        std::vector<Part> parts;
+    };
+
+    bool initialize_muxer();
+    void cleanup_muxer();
+    bool write_packet(const AVPacket* pkt);
+    bool begin_fragment();
+    bool finish_part(int64_t end_pts);
+    bool finish_segment();
+    void trim_segments();
+    bool write_playlist(bool ended);
+    bool write_file(const std::string& name, const uint8_t* data, size_t size);
+    std::string path_of(const std::string& name) const;
+    std::string segment_name(unsigned sequence) const;
+    std::string part_name(unsigned sequence, size_t part_index) const;
+    void drop_backlog();
+
+    std::shared_ptr<EncodePipeline> m_pipeline;
+    EncodeProfile m_profile;
+    size_t m_output_index = 0;
+    bool m_burn_in_osd = true;
+
+    std::string m_dir;
+    int m_part_frames = 1;        // 每个部分分段的帧数
+    double m_part_target = 0;     // 部分分段目标时长 (秒)
+    int64_t m_frame_us = 0;       // 标称帧间隔
+    int m_target_duration = 1;    // EXT-X-TARGETDURATION (秒)，只增不减
+
+    AVFormatContext* m_ofmt_ctx = nullptr;
+    AVStream* m_out_stream = nullptr;
+    AVPacket* m_write_pkt = nullptr;
+    AVRational m_enc_time_base{1, 1000000};
+    bool m_header_written = false;
+
+    // 时间戳以第一个关键帧为零点
+    int64_t m_first_pts = AV_NOPTS_VALUE;
+    bool m_wait_keyframe = true;
+    int64_t m_part_start_pts = AV_NOPTS_VALUE;
+    int64_t m_segment_start_pts = AV_NOPTS_VALUE;
+    int64_t m_last_pts = AV_NOPTS_VALUE;
+    int m_part_frame_count = 0;
+    bool m_part_independent = false;
+
+    std::deque<Segment> m_segments;   // 最后一个可能是正在写的分段
+    unsigned m_next_sequence = 0;
+    FILE* m_segment_file = nullptr;   // 当前分段的临时文件，部分分段写完即追加
+
+    std::atomic<bool> m_stop_flag{false};
+    std::atomic<bool> m_is_running{false};
+
+    ThreadSafePacketQueue m_queue_packets;
+};
+
+#endif // HLS_WRITER_H
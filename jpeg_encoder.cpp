@@ -0,0 +1,99 @@
+// --- START OF FILE jpeg_encoder.cpp ---
+
+#include "jpeg_encoder.h"
+
+#include <cstdio>
+
+JpegEncoder::JpegEncoder(int width, int height, int qscale)
+    : m_width(width), m_height(height), m_qscale(qscale) {}
+
+JpegEncoder::~JpegEncoder()
+{
+    sws_freeContext(m_sws_ctx);
+    av_frame_free(&m_jpeg_frame);
+    avcodec_free_context(&m_ctx);
+}
+
+bool JpegEncoder::open()
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!codec) {
+        fprintf(stderr, "[JPEG编码] 错误: avcodec_find_encoder (MJPEG) 失败\n");
+        return false;
+    }
+
+    m_ctx = avcodec_alloc_context3(codec);
+    if (!m_ctx) {
+        return false;
+    }
+    m_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    m_ctx->width = m_width;
+    m_ctx->height = m_height;
+    m_ctx->time_base = {1, 25};
+    m_ctx->framerate = {25, 1};
+    if (m_qscale > 0) {
+        m_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        m_ctx->global_quality = FF_QP2LAMBDA * m_qscale;
+    }
+    if (avcodec_open2(m_ctx, codec, nullptr) < 0) {
+        fprintf(stderr, "[JPEG编码] 错误: avcodec_open2 (jpeg) 失败\n");
+        avcodec_free_context(&m_ctx);
+        return false;
+    }
+
+    m_jpeg_frame = av_frame_alloc();
+    if (!m_jpeg_frame) {
+        avcodec_free_context(&m_ctx);
+        return false;
+    }
+    m_jpeg_frame->format = m_ctx->pix_fmt;
+    m_jpeg_frame->width = m_width;
+    m_jpeg_frame->height = m_height;
+    if (av_frame_get_buffer(m_jpeg_frame, 0) < 0) {
+        fprintf(stderr, "[JPEG编码] 错误: av_frame_get_buffer (jpeg) 失败\n");
+        av_frame_free(&m_jpeg_frame);
+        avcodec_free_context(&m_ctx);
+        return false;
+    }
+
+    m_sws_ctx = sws_getContext(m_width, m_height, AV_PIX_FMT_NV12, m_width, m_height, m_ctx->pix_fmt,
+                               SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!m_sws_ctx) {
+        fprintf(stderr, "[JPEG编码] 错误: sws_getContext (to_jpeg) 失败\n");
+        av_frame_free(&m_jpeg_frame);
+        avcodec_free_context(&m_ctx);
+        return false;
+    }
+    return true;
+}
+
+bool JpegEncoder::encode(const AVFrame* nv12, AVPacket* out)
+{
+    if (!nv12 || !out || nv12->format != AV_PIX_FMT_NV12 || nv12->width != m_width || nv12->height != m_height) {
+        fprintf(stderr, "[JPEG编码] 错误: 输入帧须为 %dx%d NV12\n", m_width, m_height);
+        return false;
+    }
+    if (!m_ctx && !open()) {
+        return false;
+    }
+
+    // 编码器可能仍持有上一帧的引用，写入前确保转换帧可写
+    if (av_frame_make_writable(m_jpeg_frame) < 0) {
+        return false;
+    }
+    sws_scale(m_sws_ctx, nv12->data, nv12->linesize, 0, m_height, m_jpeg_frame->data, m_jpeg_frame->linesize);
+    m_jpeg_frame->pts = m_next_pts++;
+    if (m_qscale > 0) {
+        m_jpeg_frame->quality = m_ctx->global_quality;
+    }
+
+    if (avcodec_send_frame(m_ctx, m_jpeg_frame) < 0) {
+        fprintf(stderr, "[JPEG编码] 错误: avcodec_send_frame 失败\n");
+        return false;
+    }
+    if (avcodec_receive_packet(m_ctx, out) < 0) {
+        fprintf(stderr, "[JPEG编码] 错误: avcodec_receive_packet 失败\n");
+        return false;
+    }
+    return true;
+}
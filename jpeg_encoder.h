@@ -0,0 +1,53 @@
+// --- START OF FILE jpeg_encoder.h ---
+
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * @class JpegEncoder
+ * @brief NV12 帧 -> JPEG：转换为 YUVJ420P 后用 MJPEG 编码器编码。拍照和 MJPEG 预览共用。
+ *
+ * 编码器、转换上下文和转换帧在第一次编码时创建，之后重复使用，连续编码时每帧不再重新打开编码器。
+ * 非线程安全：每个实例只应由一个线程使用。
+ */
+class JpegEncoder
+{
+public:
+    /**
+     * @param width, height 输入帧与输出图片的尺寸。
+     * @param qscale 量化参数 (2~31，越小质量越高、图片越大)，<=0 表示使用编码器默认值。
+     */
+    JpegEncoder(int width, int height, int qscale = 0);
+    ~JpegEncoder();
+    JpegEncoder(const JpegEncoder&) = delete;
+    JpegEncoder& operator=(const JpegEncoder&) = delete;
+
+    /**
+     * @brief 编码一帧。
+     * @param nv12 NV12 软件帧，尺寸须与构造参数相同。
+     * @param out 接收 JPEG 数据的数据包 (由调用者 unref)。
+     * @return 成功返回 true。
+     */
+    bool encode(const AVFrame* nv12, AVPacket* out);
+
+private:
+    bool open();
+
+    int m_width;
+    int m_height;
+    int m_qscale;
+    int64_t m_next_pts = 0;
+
+    AVCodecContext* m_ctx = nullptr;
+    SwsContext* m_sws_ctx = nullptr;
+    AVFrame* m_jpeg_frame = nullptr;
+};
+
+#endif // JPEG_ENCODER_H
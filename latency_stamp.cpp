@@ -0,0 +1,43 @@
+// --- START OF FILE latency_stamp.cpp ---
+
+#include "latency_stamp.h"
+#include "h26x_sei.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+const uint8_t LATENCY_SEI_UUID[16] = {'Z', 'o', 'o', 'm', 'l', 'e', 'n', 'L',
+                                      'a', 't', 'e', 'n', 'c', 'y', 'T', 'S'};
+
+int64_t latency_clock_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool append_latency_sei(AVCodecID codec_id, const LatencyStamp& stamp, std::vector<uint8_t>& out)
+{
+    char text[80];
+    int n = snprintf(text, sizeof(text), "seq=%" PRIu32 ",cap=%" PRId64 ",send=%" PRId64,
+                     stamp.seq, stamp.capture_us, stamp.send_us);
+    if (n < 0 || static_cast<size_t>(n) >= sizeof(text)) {
+        return false;
+    }
+    return append_sei_user_data(codec_id, LATENCY_SEI_UUID, reinterpret_cast<const uint8_t*>(text),
+                                static_cast<size_t>(n), out);
+}
+
+bool find_latency_sei(AVCodecID codec_id, const uint8_t* data, size_t size, LatencyStamp& stamp,
+                      std::vector<uint8_t>& scratch)
+{
+    scratch.clear();
+    if (!find_sei_user_data(codec_id, LATENCY_SEI_UUID, data, size, scratch)) {
+        return false;
+    }
+    // 负载不以 '\0' 结尾
+    const std::string text(scratch.begin(), scratch.end());
+    return sscanf(text.c_str(), "seq=%" SCNu32 ",cap=%" SCNd64 ",send=%" SCNd64,
+                  &stamp.seq, &stamp.capture_us, &stamp.send_us) == 3;
+}
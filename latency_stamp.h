@@ -0,0 +1,52 @@
+// --- START OF FILE latency_stamp.h ---
+
+#ifndef LATENCY_STAMP_H
+#define LATENCY_STAMP_H
+
+#include <vector>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+/**
+ * @file latency_stamp.h
+ * @brief 端到端时延测量：发送端在每帧前插入一个 user data unregistered SEI (见 h26x_sei.h)，
+ *        记录该帧的采集时刻和发出时刻，接收端 (tools/latency_meter.cpp) 据此统计各阶段的时延。
+ *
+ * - 时间统一为 steady_clock (Linux 上即 CLOCK_MONOTONIC) 的微秒数，与 ZoomManager::now_us() 相同。
+ *   单调时钟只在同一台机器上可比，因此接收工具须与相机程序运行在同一设备上 (拉本机的流)。
+ * - 负载为文本，例如 "seq=120,cap=81234567890,send=81234601234"，便于用 ffmpeg 等工具直接查看。
+ * - 采集时刻为驱动交出该帧的时刻，不含曝光与传感器读出；显示端的时延也不在测量范围内。
+ */
+
+// 时延 SEI 的 UUID ("ZoomlenLatencyTS")
+extern const uint8_t LATENCY_SEI_UUID[16];
+
+struct LatencyStamp
+{
+    uint32_t seq = 0;         // 发送端的帧序号 (每个消费者从 0 开始)，接收端据此统计丢帧
+    int64_t capture_us = 0;   // 采集时刻
+    int64_t send_us = 0;      // 写入复用器 (推流/录像文件) 的时刻
+};
+
+// 时延测量使用的时钟 (微秒)
+int64_t latency_clock_us();
+
+/**
+ * @brief 生成时延 SEI NAL 并追加到 out (不清空 out，可与遥测 SEI 放在同一个数据包前)。
+ * @return 不支持的编码格式返回 false。
+ */
+bool append_latency_sei(AVCodecID codec_id, const LatencyStamp& stamp, std::vector<uint8_t>& out);
+
+/**
+ * @brief 在 Annex B 数据包中查找并解析时延 SEI。
+ * @param scratch 复用的负载缓冲区。
+ * @return 找到且格式正确时返回 true。
+ */
+bool find_latency_sei(AVCodecID codec_id, const uint8_t* data, size_t size, LatencyStamp& stamp,
+                      std::vector<uint8_t>& scratch);
+
+#endif // LATENCY_STAMP_H
@@ -0,0 +1,52 @@
+// --- START OF FILE media_pool.cpp ---
+
+#include "media_pool.h"
+
+#include <cstdio>
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+FramePool::FramePool(AVPixelFormat format, int width, int height)
+    : m_format(format),
+      m_width(width),
+      m_height(height),
+      m_align(format == AV_PIX_FMT_NV12 ? 1 : 32)
+{
+    int size = av_image_get_buffer_size(m_format, m_width, m_height, m_align);
+    if (size > 0) {
+        m_buffers = av_buffer_pool_init(static_cast<size_t>(size), av_buffer_alloc);
+    }
+    if (!m_buffers) {
+        fprintf(stderr, "[帧池] 错误: 无法创建 %dx%d 的缓冲池 (format %d)\n", m_width, m_height, m_format);
+    }
+}
+
+FramePool::~FramePool()
+{
+    // 已分发出去的帧仍持有缓冲区引用，池会在最后一个引用释放后真正销毁
+    av_buffer_pool_uninit(&m_buffers);
+}
+
+AVFramePtr FramePool::acquire()
+{
+    if (!m_buffers) return nullptr;
+
+    AVFramePtr frame = m_shells.acquire();
+    if (!frame) return nullptr;
+
+    AVFrame* f = frame.get();
+    f->buf[0] = av_buffer_pool_get(m_buffers);
+    if (!f->buf[0]) {
+        return nullptr;
+    }
+    if (av_image_fill_arrays(f->data, f->linesize, f->buf[0]->data, m_format, m_width, m_height, m_align) < 0) {
+        return nullptr;
+    }
+    f->format = m_format;
+    f->width = m_width;
+    f->height = m_height;
+    return frame;
+}
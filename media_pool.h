@@ -0,0 +1,238 @@
+// --- START OF FILE media_pool.h ---
+
+#ifndef MEDIA_POOL_H
+#define MEDIA_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/buffer.h>
+#include <libavutil/pixfmt.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "app_config.h"
+#include "threadsafe_queue.h"
+
+/**
+ * @file media_pool.h
+ * @brief 流水线热路径上的对象复用，稳态下每帧不再有 C++ 堆分配。
+ *
+ * - RecyclingAllocator：shared_ptr 控制块的回收分配器。
+ * - ShellPool：AVFrame/AVPacket 空壳池，配合 av_frame_move_ref/av_packet_move_ref 转移引用，代替克隆。
+ * - FramePool：带像素缓冲区的固定格式软件帧池。
+ */
+
+/**
+ * @class RecyclingAllocator
+ * @brief 用于 shared_ptr 控制块的分配器。
+ * 释放的块按类型挂在侵入式空闲链表上，下次分配直接取出；块不归还给系统，
+ * 数量以同时存在的智能指针的峰值为上限。
+ */
+template <typename T>
+class RecyclingAllocator
+{
+public:
+    using value_type = T;
+
+    RecyclingAllocator() = default;
+    template <typename U>
+    RecyclingAllocator(const RecyclingAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n == 1) {
+            FreeList& list = free_list();
+            std::lock_guard<std::mutex> lock(list.mutex);
+            if (list.head) {
+                Node* node = list.head;
+                list.head = node->next;
+                return reinterpret_cast<T*>(node);
+            }
+        }
+        return static_cast<T*>(::operator new(n == 1 ? kBlockSize : n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        FreeList& list = free_list();
+        Node* node = reinterpret_cast<Node*>(p);
+        std::lock_guard<std::mutex> lock(list.mutex);
+        node->next = list.head;
+        list.head = node;
+    }
+
+private:
+    struct Node
+    {
+        Node* next;
+    };
+    struct FreeList
+    {
+        std::mutex mutex;
+        Node* head = nullptr;
+    };
+    static const size_t kBlockSize = sizeof(T) > sizeof(Node) ? sizeof(T) : sizeof(Node);
+
+    static FreeList& free_list()
+    {
+        static FreeList list;
+        return list;
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const RecyclingAllocator<T>&, const RecyclingAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const RecyclingAllocator<T>&, const RecyclingAllocator<U>&) { return false; }
+
+template <typename T>
+struct MediaShellTraits;
+
+template <>
+struct MediaShellTraits<AVFrame>
+{
+    static AVFrame* alloc() { return av_frame_alloc(); }
+    static void free(AVFrame* f) { av_frame_free(&f); }
+    static void unref(AVFrame* f) { av_frame_unref(f); }
+    static void move_ref(AVFrame* dst, AVFrame* src) { av_frame_move_ref(dst, src); }
+};
+
+template <>
+struct MediaShellTraits<AVPacket>
+{
+    static AVPacket* alloc() { return av_packet_alloc(); }
+    static void free(AVPacket* p) { av_packet_free(&p); }
+    static void unref(AVPacket* p) { av_packet_unref(p); }
+    static void move_ref(AVPacket* dst, AVPacket* src) { av_packet_move_ref(dst, src); }
+};
+
+/**
+ * @class ShellPool
+ * @brief AVFrame/AVPacket 空壳池。
+ *
+ * acquire() 返回一个空的帧/数据包 (AVFramePtr/AVPacketPtr)。最后一个引用释放时，
+ * 在释放它的线程里 unref (缓冲区立即回到各自的缓冲池) 并放回空闲列表。
+ * 可在任意线程中获取和释放；池可以先于借出的对象销毁。
+ */
+template <typename T>
+class ShellPool
+{
+public:
+    explicit ShellPool(size_t max_free = MEDIA_POOL_MAX_FREE)
+        : m_state(std::make_shared<State>())
+    {
+        m_state->max_free = max_free;
+        m_state->free.reserve(max_free);
+    }
+    ShellPool(const ShellPool&) = delete;
+    ShellPool& operator=(const ShellPool&) = delete;
+
+    std::shared_ptr<T> acquire()
+    {
+        T* obj = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if (!m_state->free.empty()) {
+                obj = m_state->free.back();
+                m_state->free.pop_back();
+            }
+        }
+        if (!obj) {
+            obj = MediaShellTraits<T>::alloc();
+            if (!obj) return nullptr;
+        }
+        return std::shared_ptr<T>(obj, Recycler{m_state}, RecyclingAllocator<T>());
+    }
+
+    // 把 src 持有的引用移入一个空壳，src 被置空；失败时 src 保持不变
+    std::shared_ptr<T> adopt(T* src)
+    {
+        std::shared_ptr<T> obj = acquire();
+        if (obj) {
+            MediaShellTraits<T>::move_ref(obj.get(), src);
+        }
+        return obj;
+    }
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::vector<T*> free;
+        size_t max_free = 0;
+
+        ~State()
+        {
+            for (T* obj : free) MediaShellTraits<T>::free(obj);
+        }
+    };
+
+    struct Recycler
+    {
+        std::shared_ptr<State> state;
+
+        void operator()(T* obj) const
+        {
+            MediaShellTraits<T>::unref(obj);
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->free.size() < state->max_free) {
+                    state->free.push_back(obj);
+                    return;
+                }
+            }
+            MediaShellTraits<T>::free(obj);
+        }
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+using FrameShellPool = ShellPool<AVFrame>;
+using PacketShellPool = ShellPool<AVPacket>;
+
+/**
+ * @class FramePool
+ * @brief 固定格式和尺寸的软件帧池：空壳来自 ShellPool，像素缓冲区来自 AVBufferPool。
+ *
+ * 缓冲区只在所有引用 (包括编码器内部持有的) 都释放后才回到池中，因此取到的帧总是可写的。
+ * NV12 的 Y/UV 平面连续存放、行宽等于图像宽度，便于 RGA 以单个虚拟地址导入。
+ */
+class FramePool
+{
+public:
+    FramePool(AVPixelFormat format, int width, int height);
+    ~FramePool();
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // 取一帧 (已设置格式、尺寸和数据指针，pts 等属性由调用者设置)，失败时返回 nullptr
+    AVFramePtr acquire();
+
+    bool matches(AVPixelFormat format, int width, int height) const
+    {
+        return m_format == format && m_width == width && m_height == height;
+    }
+
+private:
+    AVPixelFormat m_format;
+    int m_width;
+    int m_height;
+    int m_align;
+    AVBufferPool* m_buffers = nullptr;
+    FrameShellPool m_shells;
+};
+
+#endif // MEDIA_POOL_H
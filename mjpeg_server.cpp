@@ -0,0 +1,414 @@
+// --- START OF FILE mjpeg_server.cpp ---
+
+#include "mjpeg_server.h"
+#include "app_config.h"
+#include "camera_capture.h"
+#include "osd_manager.h"
+#include "zoom_manager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MJPEG_BOUNDARY "zoomlenframe"
+
+static const size_t kMaxRequestSize = 4096;
+// 连接后这么久还没有发来完整请求的客户端被断开 (微秒)
+static const int64_t kRequestTimeoutUs = 10 * 1000000;
+
+static int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+MjpegServer::MjpegServer(CameraCapture* capture_module,
+                         std::shared_ptr<OsdManager> osd_manager,
+                         std::shared_ptr<ZoomManager> zoom_manager)
+    : m_capture_module(capture_module),
+      m_osd_manager(std::move(osd_manager)),
+      m_zoom_manager(std::move(zoom_manager)),
+      m_crop_stage(MJPEG_PREVIEW_WIDTH, MJPEG_PREVIEW_HEIGHT),
+      m_jpeg_encoder(MJPEG_PREVIEW_WIDTH, MJPEG_PREVIEW_HEIGHT, MJPEG_PREVIEW_QSCALE) {}
+
+MjpegServer::~MjpegServer()
+{
+    if (m_is_running) {
+        stop();
+    }
+    if (m_control_thread.joinable()) {
+        m_control_thread.join();
+    }
+    if (m_registered && m_capture_module) {
+        m_capture_module->unregister_consumer(&m_queue_frames);
+    }
+    close_socket();
+    av_packet_free(&m_jpeg_pkt);
+}
+
+bool MjpegServer::prepare(int port)
+{
+    if (!m_capture_module) {
+        fprintf(stderr, "[MJPEG预览] 错误: 采集模块无效\n");
+        return false;
+    }
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "[MJPEG预览] 错误: 无效的端口 %d\n", port);
+        return false;
+    }
+    m_port = port;
+    return true;
+}
+
+void MjpegServer::stop()
+{
+    fprintf(stderr, "[MJPEG预览] 收到停止信号...\n");
+    m_stop_flag = true;
+    m_queue_frames.stop();
+}
+
+size_t MjpegServer::get_client_count() const
+{
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    return m_clients.size();
+}
+
+bool MjpegServer::open_socket()
+{
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0) {
+        fprintf(stderr, "[MJPEG预览] 错误: 创建监听套接字失败: %s\n", strerror(errno));
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(m_port));
+    if (bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(m_listen_fd, MJPEG_PREVIEW_MAX_CLIENTS) < 0 || !set_nonblocking(m_listen_fd)) {
+        fprintf(stderr, "[MJPEG预览] 错误: 监听端口 %d 失败: %s\n", m_port, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void MjpegServer::close_socket()
+{
+    if (m_listen_fd >= 0) {
+        close(m_listen_fd);
+        m_listen_fd = -1;
+    }
+}
+
+void MjpegServer::control_thread_func()
+{
+    std::vector<pollfd> fds;
+    while (!m_stop_flag) {
+        fds.clear();
+        fds.push_back({m_listen_fd, POLLIN, 0});
+        {
+            // 客户端只在本线程中增删，poll 期间列表顺序不变
+            std::lock_guard<std::mutex> lock(m_clients_mutex);
+            for (const auto& c : m_clients) {
+                fds.push_back({c->fd, POLLIN, 0});
+            }
+        }
+
+        int n = poll(fds.data(), fds.size(), 200);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "[MJPEG预览] 错误: poll 失败: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) accept_client();
+
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        for (size_t i = 1; i < fds.size(); ++i) {
+            if (!fds[i].revents) continue;
+            Client& c = *m_clients[i - 1];
+            if (!read_client(c)) {
+                c.closing = true;
+            }
+        }
+        expire_clients();
+    }
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    for (auto& c : m_clients) {
+        close(c->fd);
+    }
+    m_clients.clear();
+    m_streaming_count = 0;
+    update_capture_registration();
+}
+
+void MjpegServer::accept_client()
+{
+    sockaddr_in peer{};
+    socklen_t len = sizeof(peer);
+    int fd = accept(m_listen_fd, reinterpret_cast<sockaddr*>(&peer), &len);
+    if (fd < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    if (m_clients.size() >= MJPEG_PREVIEW_MAX_CLIENTS) {
+        fprintf(stderr, "[MJPEG预览] 客户端数已达上限 (%d)，拒绝 %s\n", MJPEG_PREVIEW_MAX_CLIENTS,
+                inet_ntoa(peer.sin_addr));
+        close(fd);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    set_nonblocking(fd);
+
+    std::unique_ptr<Client> c(new Client());
+    c->fd = fd;
+    c->connected_us = now_us();
+    m_clients.push_back(std::move(c));
+    fprintf(stderr, "[MJPEG预览] 客户端 %s:%d 已连接\n", inet_ntoa(peer.sin_addr), ntohs(peer.sin_port));
+}
+
+bool MjpegServer::read_client(Client& c)
+{
+    char buf[1024];
+    for (;;) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        // 开始推送之后客户端不会再发请求，收到的数据直接丢弃
+        if (!c.streaming) {
+            c.recv_buf.append(buf, static_cast<size_t>(n));
+        }
+    }
+
+    if (c.streaming) {
+        return true;
+    }
+    const size_t end = c.recv_buf.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        return c.recv_buf.size() <= kMaxRequestSize;
+    }
+    handle_request(c, c.recv_buf.substr(0, end));
+    c.recv_buf.clear();
+    return true;
+}
+
+void MjpegServer::handle_request(Client& c, const std::string& request)
+{
+    // 请求行: GET <路径> HTTP/1.x，路径中的查询参数 (浏览器用来绕过缓存) 忽略
+    std::string path;
+    if (request.compare(0, 4, "GET ") == 0) {
+        const size_t end = request.find(' ', 4);
+        if (end != std::string::npos) {
+            path = request.substr(4, end - 4);
+            path = path.substr(0, path.find('?'));
+        }
+    }
+
+    if (path != "/" && path != "/preview.mjpg") {
+        static const Buffer not_found = std::make_shared<const std::string>(
+            "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        queue_to_client(c, not_found);
+        c.closing = true;
+        return;
+    }
+
+    static const Buffer header = std::make_shared<const std::string>(
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY "\r\n"
+        "Cache-Control: no-cache, no-store\r\n"
+        "Pragma: no-cache\r\n"
+        "Connection: close\r\n\r\n");
+    queue_to_client(c, header);
+    c.streaming = true;
+    m_streaming_count++;
+    update_capture_registration();
+}
+
+void MjpegServer::queue_to_client(Client& c, const Buffer& data)
+{
+    c.pending = data;
+    c.pending_offset = 0;
+    flush_pending(c);
+}
+
+bool MjpegServer::flush_pending(Client& c)
+{
+    while (c.pending) {
+        ssize_t n = send(c.fd, c.pending->data() + c.pending_offset, c.pending->size() - c.pending_offset,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) c.closing = true;
+            return false;
+        }
+        c.pending_offset += static_cast<size_t>(n);
+        if (c.pending_offset >= c.pending->size()) {
+            c.pending.reset();
+            c.pending_offset = 0;
+        }
+    }
+    return true;
+}
+
+void MjpegServer::update_capture_registration()
+{
+    // 有人观看才向采集器注册：采集线程按间隔抽帧，没有客户端时预览不消耗任何资源
+    const bool wanted = m_streaming_count > 0 && !m_stop_flag;
+    if (wanted == m_registered) {
+        return;
+    }
+    m_queue_frames.clear();
+    if (wanted) {
+        const int interval = std::max(1, V4L2_INPUT_FPS / std::max(1, MJPEG_PREVIEW_FPS));
+        m_capture_module->register_consumer(&m_queue_frames, interval);
+        fprintf(stderr, "[MJPEG预览] 开始编码预览帧 (%dx%d, 每 %d 帧取 1 帧)\n", MJPEG_PREVIEW_WIDTH,
+                MJPEG_PREVIEW_HEIGHT, interval);
+    } else {
+        m_capture_module->unregister_consumer(&m_queue_frames);
+        fprintf(stderr, "[MJPEG预览] 没有客户端观看，停止编码\n");
+    }
+    m_registered = wanted;
+}
+
+void MjpegServer::expire_clients()
+{
+    const int64_t now = now_us();
+    for (auto it = m_clients.begin(); it != m_clients.end();) {
+        Client& c = **it;
+        const bool timed_out = !c.streaming && (now - c.connected_us) > kRequestTimeoutUs;
+        if (!c.closing && !timed_out) {
+            ++it;
+            continue;
+        }
+        if (c.streaming) {
+            m_streaming_count--;
+        }
+        close(c.fd);
+        fprintf(stderr, "[MJPEG预览] 客户端断开%s，剩余 %zu 个\n", timed_out ? " (请求超时)" : "",
+                m_clients.size() - 1);
+        it = m_clients.erase(it);
+    }
+    update_capture_registration();
+}
+
+bool MjpegServer::encode_frame(const AVFrame* frame)
+{
+    // 与编码链相同：按帧的采集时刻取变焦区域，预览与录制/推流的画面一致
+    int cx = 0, cy = 0, cw = frame->width, ch = frame->height;
+    if (m_zoom_manager) {
+        const int64_t frame_time_us = m_capture_module->get_clock_origin_us() + frame->pts;
+        m_zoom_manager->get_crop_params_at(frame_time_us, cx, cy, cw, ch);
+    }
+
+    AVFramePtr preview = m_crop_stage.process(frame, cx, cy, cw, ch);
+    if (!preview) {
+        fprintf(stderr, "[MJPEG预览] 错误: 裁剪缩放失败\n");
+        return false;
+    }
+    if (m_burn_in_osd && m_osd_manager) {
+        m_osd_manager->blend_osd_on_frame(preview.get());
+    }
+    return m_jpeg_encoder.encode(preview.get(), m_jpeg_pkt);
+}
+
+void MjpegServer::send_frame(const Buffer& part)
+{
+    const int64_t now = now_us();
+    const int64_t stall_timeout_us = static_cast<int64_t>(MJPEG_PREVIEW_STALL_TIMEOUT_MS) * 1000;
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    for (auto& cp : m_clients) {
+        Client& c = *cp;
+        if (!c.streaming || c.closing) continue;
+        // 上一张图片还没发完：跳过这一帧 (只有一张图片的积压)，长时间发不出去则断开
+        if (!flush_pending(c)) {
+            if (c.stalled_since_us == 0) {
+                c.stalled_since_us = now;
+            } else if (now - c.stalled_since_us > stall_timeout_us) {
+                fprintf(stderr, "[MJPEG预览] 客户端 %.1f 秒未能接收数据，断开\n", stall_timeout_us / 1e6);
+                c.closing = true;
+            }
+            continue;
+        }
+        c.stalled_since_us = 0;
+        queue_to_client(c, part);
+    }
+}
+
+void MjpegServer::run()
+{
+    m_is_running = true;
+    m_stop_flag = false;
+
+    m_jpeg_pkt = av_packet_alloc();
+    if (!m_jpeg_pkt || !open_socket()) {
+        close_socket();
+        m_is_running = false;
+        return;
+    }
+    m_control_thread = std::thread(&MjpegServer::control_thread_func, this);
+    fprintf(stderr, "[MJPEG预览] 服务已启动: http://<设备IP>:%d/ (%dx%d @ %d fps)\n", m_port,
+            MJPEG_PREVIEW_WIDTH, MJPEG_PREVIEW_HEIGHT, MJPEG_PREVIEW_FPS);
+
+    char part_header[128];
+    while (true) {
+        AVFramePtr frame_ptr = m_queue_frames.wait_and_pop();
+        if (frame_ptr == nullptr) {
+            break;
+        }
+        // 编码跟不上时只编码最新的一帧，预览不追赶积压
+        if (m_queue_frames.size() > 0 || m_streaming_count == 0) {
+            continue;
+        }
+        if (!encode_frame(frame_ptr.get())) {
+            continue;
+        }
+        frame_ptr.reset();
+
+        const int n = snprintf(part_header, sizeof(part_header),
+                               "--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n",
+                               m_jpeg_pkt->size);
+        std::shared_ptr<std::string> part = std::make_shared<std::string>();
+        part->reserve(static_cast<size_t>(n) + m_jpeg_pkt->size + 2);
+        part->append(part_header, static_cast<size_t>(n));
+        part->append(reinterpret_cast<const char*>(m_jpeg_pkt->data), static_cast<size_t>(m_jpeg_pkt->size));
+        part->append("\r\n");
+        av_packet_unref(m_jpeg_pkt);
+
+        send_frame(part);
+    }
+
+    m_stop_flag = true;
+    if (m_control_thread.joinable()) {
+        m_control_thread.join();
+    }
+    close_socket();
+    m_is_running = false;
+    fprintf(stderr, "[MJPEG预览] 服务已停止。\n");
+}
@@ -0,0 +1,110 @@
+// --- START OF FILE mjpeg_server.h ---
+
+#ifndef MJPEG_SERVER_H
+#define MJPEG_SERVER_H
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#include "app_config.h"
+#include "threadsafe_queue.h"
+#include "crop_stage.h"
+#include "jpeg_encoder.h"
+
+class CameraCapture;
+class OsdManager;
+class ZoomManager;
+
+/**
+ * @class MjpegServer
+ * @brief 内置 MJPEG over HTTP 预览：浏览器或 <img> 标签直接打开 http://<设备IP>:端口/ 即可看到画面，
+ *        不需要 RTSP 客户端或视频解码器，适合取景和调试。
+ *
+ * - 不占用 H.264/HEVC 编码链：直接作为采集器的原始帧消费者，由采集线程按 MJPEG_PREVIEW_FPS 抽帧，
+ *   逐帧按当前变焦裁剪缩放到预览尺寸 (CropStage)、叠加 OSD，再用与拍照相同的 JpegEncoder 编码。
+ * - 只在至少有一个客户端观看时才向采集器注册并编码，没有客户端时不消耗任何 CPU。
+ * - 所有客户端共用同一份编码结果 (引用计数，不按客户端复制)；发送缓冲区满的客户端跳过当前帧，
+ *   不会拖慢其他客户端，长时间发不出数据的客户端被断开。
+ *
+ * 线程：控制线程处理连接和 HTTP 请求；run() 所在线程编码并发送预览帧。
+ */
+class MjpegServer {
+public:
+    MjpegServer(CameraCapture* capture_module,
+                std::shared_ptr<OsdManager> osd_manager,
+                std::shared_ptr<ZoomManager> zoom_manager);
+    ~MjpegServer();
+
+    // port: HTTP 监听端口
+    bool prepare(int port);
+
+    // 是否把 OSD 叠加到预览画面中 (默认是)
+    void set_osd_burn_in(bool enabled) { m_burn_in_osd = enabled; }
+
+    // 打开监听端口、启动控制线程，并在调用线程中编码和发送预览帧直到 stop()
+    void run();
+    void stop();
+    bool isRunning() const { return m_is_running; }
+
+    size_t get_client_count() const;
+
+private:
+    using Buffer = std::shared_ptr<const std::string>;
+
+    struct Client
+    {
+        int fd = -1;
+        std::string recv_buf;
+        bool streaming = false;     // 已收到请求并发出应答头，开始接收预览帧
+        bool closing = false;       // 发送失败或请求无效，由控制线程关闭
+        Buffer pending;             // 只发出一部分的应答头或图片
+        size_t pending_offset = 0;
+        int64_t stalled_since_us = 0;
+        int64_t connected_us = 0;
+    };
+
+    bool open_socket();
+    void close_socket();
+    void control_thread_func();
+    void accept_client();
+    bool read_client(Client& c);
+    void handle_request(Client& c, const std::string& request);
+    void queue_to_client(Client& c, const Buffer& data);
+    bool flush_pending(Client& c);
+    void update_capture_registration();
+    void expire_clients();
+
+    bool encode_frame(const AVFrame* frame);
+    void send_frame(const Buffer& part);
+
+    CameraCapture* m_capture_module;
+    std::shared_ptr<OsdManager> m_osd_manager;
+    std::shared_ptr<ZoomManager> m_zoom_manager;
+    bool m_burn_in_osd = true;
+    int m_port = 0;
+
+    int m_listen_fd = -1;
+
+    // 客户端列表及其套接字写入都在 m_clients_mutex 下进行
+    std::vector<std::unique_ptr<Client>> m_clients;
+    mutable std::mutex m_clients_mutex;
+    std::atomic<size_t> m_streaming_count{0};
+    bool m_registered = false;  // 是否已向采集器注册 (有客户端观看时)
+
+    // 编码状态只在 run() 所在线程中使用
+    CropStage m_crop_stage;
+    JpegEncoder m_jpeg_encoder;
+    AVPacket* m_jpeg_pkt = nullptr;
+
+    std::thread m_control_thread;
+    std::atomic<bool> m_stop_flag{false};
+    std::atomic<bool> m_is_running{false};
+
+    ThreadSafeFrameQueue m_queue_frames;
+};
+
+#endif // MJPEG_SERVER_H
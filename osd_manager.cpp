@@ -2,8 +2,7 @@
 #include "app_config.h"
 
 #include <iostream>
-#include <sstream>
-#include <iomanip>
+#include <cstdio>
 #include <chrono>
 #include <cstring> // For memset
 
@@ -12,6 +11,7 @@ extern "C"
 {
 #include <libavutil/frame.h>
 #include <libavutil/pixfmt.h> // [优化] 包含像素格式定义
+#include <libavutil/hwcontext_drm.h>
 }
 
 /**
@@ -61,6 +61,7 @@ void OsdManager::shutdown()
 void OsdManager::enable(bool state)
 {
     m_enabled = state;
+    m_osd_dirty = true;
     std::cout << "[OSD管理器] OSD 功能已 " << (state ? "开启" : "关闭") << std::endl;
 }
 
@@ -75,9 +76,21 @@ void OsdManager::set_pos_data(const PosData &data)
     if (!m_shutdown_flag)
     {
         m_pos_data = data;
+        m_has_pos_data = true;
+        m_osd_dirty = true;
     }
 }
 
+bool OsdManager::get_pos_data(PosData &data)
+{
+    std::lock_guard<std::mutex> lock(m_data_mutex);
+    if (m_has_pos_data)
+    {
+        data = m_pos_data;
+    }
+    return m_has_pos_data;
+}
+
 bool OsdManager::init_freetype()
 {
     if (FT_Init_FreeType(&ft_library))
@@ -187,13 +200,14 @@ void OsdManager::draw_background()
     }
 }
 
-void OsdManager::draw_text(const std::string &text, int x_start, int y_start)
+void OsdManager::draw_text(const char *text, int x_start, int y_start)
 {
     int pen_x = x_start;
     int pen_y = y_start;
 
-    for (const char &ch : text)
+    for (const char *p = text; *p; ++p)
     {
+        const char ch = *p;
         if (FT_Load_Char(ft_face, ch, FT_LOAD_RENDER))
             continue;
 
@@ -223,22 +237,14 @@ void OsdManager::draw_text(const std::string &text, int x_start, int y_start)
     }
 }
 
-void OsdManager::blend_osd_on_frame(AVFrame *frame)
+void OsdManager::render_osd_layer()
 {
-    if (!frame || !is_enabled())
-        return;
-    // [优化] 移除 !frame->data[0] 检查，因为硬件帧的 data[0] 可能是 FD
-
-    std::string line1, line2;
+    // 固定缓冲区格式化，定位数据每次更新都重绘，不在 T1 中分配内存
+    char line1[128], line2[128];
     {
         std::lock_guard<std::mutex> lock(m_data_mutex);
-        std::stringstream ss1, ss2;
-        ss1 << "Lat: " << std::fixed << std::setprecision(6) << m_pos_data.latitude
-            << " Lon: " << m_pos_data.longitude; // [修复] 修正了拼写错误，原为 m::pos_data.longitude
-        ss2 << "Speed: " << std::fixed << std::setprecision(1) << m_pos_data.speed_kmh
-            << " km/h | " << m_pos_data.timestamp;
-        line1 = ss1.str();
-        line2 = ss2.str();
+        snprintf(line1, sizeof(line1), "Lat: %.6f Lon: %.6f", m_pos_data.latitude, m_pos_data.longitude);
+        snprintf(line2, sizeof(line2), "Speed: %.1f km/h | %s", m_pos_data.speed_kmh, m_pos_data.timestamp.c_str());
     }
 
     const int osd_x = 50, osd_y = 50; // 左上角边距
@@ -248,19 +254,40 @@ void OsdManager::blend_osd_on_frame(AVFrame *frame)
     draw_background();                                            // 绘制半透明背景
     draw_text(line1, osd_x, osd_y + OSD_FONT_SIZE);               // 在背景上绘制第一行文字
     draw_text(line2, osd_x, osd_y + OSD_FONT_SIZE + line_height); // 绘制第二行
+}
+
+void OsdManager::blend_osd_on_frame(AVFrame *frame)
+{
+    if (!frame || !is_enabled())
+        return;
+    // [优化] 移除 !frame->data[0] 检查，因为硬件帧的 data[0] 可能是 FD
+
+    std::lock_guard<std::mutex> render_lock(m_render_mutex);
+    if (m_osd_dirty.exchange(false))
+    {
+        render_osd_layer();
+    }
 
     // --- [优化] 检查帧类型（硬件 vs 软件）并使用正确的RGA导入方法 ---
     rga_buffer_handle_t dst_handle = -1;
     // RK_FORMAT_YCbCr_420_SP 对应 NV12
     const int rga_format = RK_FORMAT_YCbCr_420_SP;
+    int wstride = frame->width;
+    int hstride = frame->height;
 
     if (frame->format == AV_PIX_FMT_DRM_PRIME)
     {
-        // 这是硬件 (DRM) 帧
-        // data[0] 存储的是文件描述符 (fd)
-        int frame_fd = (int)(intptr_t)frame->data[0];
-        // 使用文件描述符 (FD) 导入RGA缓冲区，实现零拷贝
-        dst_handle = importbuffer_fd(frame_fd, frame->width, frame->height, rga_format);
+        // 这是硬件 (DRM) 帧 (RGA 缩放后直通编码器的输出)
+        // data[0] 是 DRM 帧描述符，按 fd 和实际的行宽/行数导入，实现零拷贝
+        const AVDRMFrameDescriptor *desc = reinterpret_cast<const AVDRMFrameDescriptor *>(frame->data[0]);
+        if (!desc || desc->nb_objects < 1 || desc->nb_layers < 1 || desc->layers[0].nb_planes < 2)
+        {
+            fprintf(stderr, "[OSD管理器] 错误: 无效的 DRM 帧描述符\n");
+            return;
+        }
+        wstride = static_cast<int>(desc->layers[0].planes[0].pitch);
+        hstride = static_cast<int>(desc->layers[0].planes[1].offset / desc->layers[0].planes[0].pitch);
+        dst_handle = importbuffer_fd(desc->objects[0].fd, wstride, hstride, rga_format);
     }
     else if (frame->format == AV_PIX_FMT_NV12)
     {
@@ -282,7 +309,7 @@ void OsdManager::blend_osd_on_frame(AVFrame *frame)
         return;
     }
 
-    rga_buffer_t dst_camera_frame = wrapbuffer_handle(dst_handle, frame->width, frame->height, rga_format);
+    rga_buffer_t dst_camera_frame = wrapbuffer_handle(dst_handle, frame->width, frame->height, rga_format, wstride, hstride);
     if (dst_camera_frame.width > 0)
     {
         // 使用 RGA 将 OSD 缓冲区混合到视频帧上 (原地修改)
@@ -54,7 +54,11 @@ public:
     // 设置要显示的POS数据 (线程安全)
     void set_pos_data(const PosData& data);
 
+    // 获取最近一次设置的POS数据 (线程安全)，从未设置过时返回 false
+    bool get_pos_data(PosData& data);
+
     // 核心功能：将当前的 OSD 图层叠加到给定的视频帧上
+    // 文字图层只在数据变化后重绘一次，多路输出 (多分辨率录制、推流) 共用同一份图层
     void blend_osd_on_frame(AVFrame *frame);
 
 private:
@@ -65,9 +69,10 @@ private:
     void cleanup_rga();
 
     // OSD 文本和背景绘制辅助函数
-    void draw_text(const std::string& text, int x_start, int y_start);
+    void draw_text(const char* text, int x_start, int y_start);
     void clear_osd_buffer();
     void draw_background();
+    void render_osd_layer();
     
     // 成员变量
     std::atomic<bool> m_enabled{false};         // OSD 开关状态
@@ -75,6 +80,9 @@ private:
     std::mutex m_data_mutex;                    // 保护共享数据的互斥锁
 
     PosData m_pos_data;                         // 要显示的POS数据
+    bool m_has_pos_data = false;                // 是否设置过POS数据
+    std::atomic<bool> m_osd_dirty{true};        // POS 数据变化后置位，下一次叠加时重绘图层
+    std::mutex m_render_mutex;                  // 保护 OSD 图层的重绘与混合
 
     // FreeType 相关资源
     FT_Library ft_library = nullptr;
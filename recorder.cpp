@@ -2,9 +2,9 @@
 
 #include "recorder.h"
 #include "app_config.h"
-#include "osd_manager.h"
-#include "zoom_manager.h"
-#include "camera_capture.h"
+#include "alloc_counter.h"
+#include "h26x_sei.h"
+#include "latency_stamp.h"
 
 #include <iostream>
 #include <thread>
@@ -13,19 +13,17 @@
 #include <sstream>
 #include <mutex>
 #include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
 
 extern "C"
 {
 #include <libavutil/avutil.h>
 #include <libavutil/opt.h>
-#include <libavutil/channel_layout.h>
-#include <libavutil/hwcontext.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libavfilter/avfilter.h>
-#include <libavfilter/buffersrc.h>
-#include <libavfilter/buffersink.h>
-#include <libavutil/frame.h>
 }
 
 static void print_err(int ret, const char *context)
@@ -35,13 +33,19 @@ static void print_err(int ret, const char *context)
     fprintf(stderr, "[录制器] FFmpeg 错误 in %s: %s (ret=%d)\n", context, buf, ret);
 }
 
-static std::string generate_timestamp_filename()
+static std::string generate_timestamp_basename(std::chrono::system_clock::time_point tp)
 {
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
+    auto in_time_t = std::chrono::system_clock::to_time_t(tp);
     std::stringstream ss;
     ss << std::put_time(std::localtime(&in_time_t), "%Y%m%d%H%M%S");
-    return ss.str() + ".mp4";
+    return ss.str();
+}
+
+// 删除中断的分段及其索引，避免残留在临时目录 (通常是内存文件系统) 中
+static void remove_segment_files(const std::string& path)
+{
+    unlink(path.c_str());
+    unlink(recording_index_path(path).c_str());
 }
 
 const std::map<std::string, std::pair<int, int>> resolutions = {
@@ -49,18 +53,10 @@ const std::map<std::string, std::pair<int, int>> resolutions = {
     {"720p", {1280, 720}},
     {"360p", {640, 360}}};
 
-Recorder::Recorder(CameraCapture* capture_module,
-                   std::shared_ptr<OsdManager> osd_manager,
-                   std::shared_ptr<ZoomManager> zoom_manager,
-                   MediaCompleteCallback cb)
-    : m_capture_module(capture_module),
-      m_osd_manager(std::move(osd_manager)),
-      m_zoom_manager(std::move(zoom_manager)),
-      m_on_complete_cb(std::move(cb)),
-      m_use_hw(false),
+Recorder::Recorder(MediaCompleteCallback cb)
+    : m_on_complete_cb(std::move(cb)),
       m_stop_flag(false),
-      m_is_recording(false),
-      m_pipeline_error(false)
+      m_is_recording(false)
 {
 }
 
@@ -69,247 +65,420 @@ Recorder::~Recorder()
     if (m_is_recording) {
         stop();
     }
-    if (m_thread_filter.joinable()) m_thread_filter.join();
-    if (m_thread_encode.joinable()) m_thread_encode.join();
+    // 确保编码链不再持有本对象内队列的指针
+    if (m_pipeline) {
+        m_pipeline->unregister_consumers(packet_queues());
+    }
+    for (auto& r : m_renditions) {
+        if (r->thread_write.joinable()) r->thread_write.join();
+        cleanup_muxer(*r);
+    }
 }
 
-bool Recorder::prepare(const std::string &resolution_key)
+void Recorder::set_timelapse(int frame_interval, int blend_frames)
 {
-    auto it = resolutions.find(resolution_key);
-    if (it == resolutions.end())
-    {
-        std::cerr << "错误: 无效的分辨率 '" << resolution_key << "'." << std::endl;
+    m_frame_interval = std::max(frame_interval, 1);
+    m_blend_frames = std::max(1, std::min(blend_frames, m_frame_interval));
+    m_time_scale = static_cast<double>(m_frame_interval) * TIMELAPSE_OUTPUT_FPS / V4L2_INPUT_FPS;
+    if (m_frame_interval == 1) {
+        m_time_scale = 1.0;
+    }
+}
+
+bool Recorder::prepare(const std::string &resolution_keys, VideoCodec codec)
+{
+    m_renditions.clear();
+    m_start_time = std::chrono::system_clock::now();
+    if (mkdir(RECORDING_TEMP_PATH, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "[录制器] 错误: 无法创建临时目录 %s (%s)\n", RECORDING_TEMP_PATH, strerror(errno));
+        return false;
+    }
+
+    std::stringstream ss(resolution_keys);
+    std::string key;
+    while (std::getline(ss, key, ',')) {
+        if (key.empty()) continue;
+        auto it = resolutions.find(key);
+        if (it == resolutions.end())
+        {
+            std::cerr << "错误: 无效的分辨率 '" << key << "'." << std::endl;
+            m_renditions.clear();
+            return false;
+        }
+        for (const auto& r : m_renditions) {
+            if (r->profile.width == it->second.first && r->profile.height == it->second.second) {
+                std::cerr << "错误: 分辨率 '" << key << "' 重复." << std::endl;
+                m_renditions.clear();
+                return false;
+            }
+        }
+
+        std::unique_ptr<Rendition> r(new Rendition());
+        r->profile.width = it->second.first;
+        r->profile.height = it->second.second;
+        const bool high = (r->profile.width * r->profile.height > 1280 * 720);
+        if (codec == VideoCodec::HEVC) {
+            r->profile.rate_control.bit_rate = high ? RECORDER_HEVC_BITRATE_HIGH : RECORDER_HEVC_BITRATE_LOW;
+        } else {
+            r->profile.rate_control.bit_rate = high ? RECORDER_BITRATE_HIGH : RECORDER_BITRATE_LOW;
+        }
+        // 所有分辨率使用相同的 GOP，关键帧对齐，文件才能从同一帧开始
+        r->profile.rate_control.gop_size = RECORDER_GOP_SIZE;
+        r->profile.encoder_name = video_codec_encoder_candidates(codec);
+        r->profile.use_case = EncodeUseCase::Recording;
+        r->profile.frame_interval = m_frame_interval;
+        r->profile.blend_frames = m_blend_frames;
+        r->profile.burn_in_osd = m_burn_in_osd;
+        r->key = m_renditions.empty() ? std::string() : key;
+        r->filename = segment_filename(*r, 0);
+        m_renditions.push_back(std::move(r));
+    }
+
+    if (m_renditions.empty()) {
+        std::cerr << "错误: 未指定录制分辨率." << std::endl;
         return false;
     }
-    m_out_w = it->second.first;
-    m_out_h = it->second.second;
-    m_out_filename = std::string(TEMP_STORAGE_PATH) + generate_timestamp_filename();
+    return true;
+}
+
+std::vector<EncodeProfile> Recorder::get_encode_profiles() const
+{
+    std::vector<EncodeProfile> profiles;
+    for (const auto& r : m_renditions) {
+        profiles.push_back(r->profile);
+    }
+    return profiles;
+}
+
+std::vector<ThreadSafePacketQueue*> Recorder::packet_queues()
+{
+    std::vector<ThreadSafePacketQueue*> queues;
+    for (auto& r : m_renditions) {
+        queues.push_back(&r->queue_packets);
+    }
+    return queues;
+}
+
+bool Recorder::attach_pipeline(std::shared_ptr<EncodePipeline> pipeline)
+{
+    if (!pipeline || m_renditions.empty()) {
+        return false;
+    }
+
+    for (auto& r : m_renditions) {
+        int idx = pipeline->find_compatible_output(r->profile);
+        if (idx < 0 || !pipeline->register_consumer(&r->queue_packets, static_cast<size_t>(idx))) {
+            fprintf(stderr, "[录制器] 错误: 编码链没有 %dx%d 的输出\n", r->profile.width, r->profile.height);
+            pipeline->unregister_consumers(packet_queues());
+            return false;
+        }
+        r->output_index = static_cast<size_t>(idx);
+    }
+    m_pipeline = std::move(pipeline);
     return true;
 }
 
 bool Recorder::isRecording() const { return m_is_recording; }
 
-bool Recorder::initialize_ffmpeg()
+std::string Recorder::segment_filename(const Rendition& r, int64_t offset_sec) const
 {
-    fprintf(stderr, "[录制器] 开始录制 到 %s (%dx%d)\n", m_out_filename.c_str(), m_out_w, m_out_h);
-    int ret = 0;
+    std::string name = std::string(RECORDING_TEMP_PATH) + generate_timestamp_basename(m_start_time + std::chrono::seconds(offset_sec));
+    return r.key.empty() ? name + ".mp4" : name + "_" + r.key + ".mp4";
+}
 
-    AVBufferRef* hw_device_ctx = m_capture_module->get_hw_device_context();
-    if (hw_device_ctx != nullptr) {
-        fprintf(stderr, "[录制器] 从采集器获取 RKMPP 硬件设备成功。\n");
-        m_use_hw = true;
-    } else {
-        fprintf(stderr, "[录制器] 警告: 未获取到 RKMPP 硬件设备, 将回退到纯软件模式。\n");
-        m_use_hw = false;
+std::vector<std::string> Recorder::get_recent_segment_names() const
+{
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> lock(m_segment_mutex);
+    for (const auto& r : m_renditions) {
+        for (const std::string* path : {&r->prev_filename, &r->filename}) {
+            if (path->empty()) continue;
+            const char* slash = strrchr(path->c_str(), '/');
+            names.push_back(slash ? slash + 1 : *path);
+        }
     }
+    return names;
+}
 
-    const AVCodec *enc = avcodec_find_encoder_by_name(RECORDER_ENCODER_NAME);
-    if (!enc) {
-        fprintf(stderr, "[录制器] 找不到编码器: %s\n", RECORDER_ENCODER_NAME);
+bool Recorder::set_rate_control(const RateControl& rc)
+{
+    if (!m_pipeline || m_renditions.empty()) {
         return false;
     }
-    m_enc_ctx = avcodec_alloc_context3(enc);
-    if (!m_enc_ctx) {
-        fprintf(stderr, "[录制器] avcodec_alloc_context3 (enc) 失败\n");
-        return false;
+    const EncodeProfile& main_profile = m_renditions.front()->profile;
+    const double main_area = static_cast<double>(main_profile.width) * main_profile.height;
+
+    bool ok = true;
+    for (const auto& r : m_renditions) {
+        RateControl scaled = rc;
+        const double ratio = r->profile.width * r->profile.height / main_area;
+        scaled.bit_rate = static_cast<int64_t>(rc.bit_rate * ratio);
+        scaled.max_bit_rate = static_cast<int64_t>(rc.max_bit_rate * ratio);
+        ok = m_pipeline->set_rate_control(r->output_index, scaled) && ok;
     }
-    m_enc_ctx->width = m_out_w;
-    m_enc_ctx->height = m_out_h;
-    m_enc_ctx->pix_fmt = AV_PIX_FMT_NV12;
-    m_enc_ctx->time_base = AVRational{1, 1000000};
-    m_enc_ctx->framerate = AVRational{30, 1};
-    m_enc_ctx->bit_rate = (m_out_w * m_out_h > 1280 * 720) ? RECORDER_BITRATE_HIGH : RECORDER_BITRATE_LOW;
-    m_enc_ctx->gop_size = RECORDER_GOP_SIZE;
+    return ok;
+}
 
-    if (m_use_hw && hw_device_ctx) {
-        m_enc_ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-    }
-    if ((ret = avcodec_open2(m_enc_ctx, enc, nullptr)) < 0) {
-        print_err(ret, "avcodec_open2 (encoder)");
+bool Recorder::initialize_muxer(Rendition& r)
+{
+    const EncodeProfile& pipe_profile = m_pipeline->get_profile(r.output_index);
+    fprintf(stderr, "[录制器] 开始录制 到 %s (%dx%d)\n", r.filename.c_str(), pipe_profile.width, pipe_profile.height);
+    int ret = 0;
+
+    AVCodecParameters* enc_par = avcodec_parameters_alloc();
+    if (!enc_par || !m_pipeline->get_codec_parameters(r.output_index, enc_par, &r.enc_time_base)) {
+        fprintf(stderr, "[录制器] 错误: 编码链未就绪。\n");
+        avcodec_parameters_free(&enc_par);
         return false;
     }
 
-    avformat_alloc_output_context2(&m_ofmt_ctx, nullptr, nullptr, m_out_filename.c_str());
-    if (!m_ofmt_ctx) {
+    avformat_alloc_output_context2(&r.ofmt_ctx, nullptr, nullptr, r.filename.c_str());
+    if (!r.ofmt_ctx) {
         print_err(ret, "avformat_alloc_output_context2");
+        avcodec_parameters_free(&enc_par);
         return false;
     }
-    if (m_ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
-        m_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     
-    m_out_stream = avformat_new_stream(m_ofmt_ctx, nullptr);
-    if (!m_out_stream) {
+    r.out_stream = avformat_new_stream(r.ofmt_ctx, nullptr);
+    if (!r.out_stream) {
         fprintf(stderr, "[录制器] 创建输出流失败\n");
+        avcodec_parameters_free(&enc_par);
         return false;
     }
-    avcodec_parameters_from_context(m_out_stream->codecpar, m_enc_ctx);
-    m_out_stream->time_base = AVRational{1, 90000};
+    avcodec_parameters_copy(r.out_stream->codecpar, enc_par);
+    avcodec_parameters_free(&enc_par);
+    if (r.out_stream->codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        // 参数集放在 hvcC 中 (hvc1)，QuickTime/iOS 只能播放这种标记的 HEVC
+        r.out_stream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+    }
+    r.out_stream->time_base = AVRational{1, 90000};
+
+    // 遥测字幕轨：创建失败只影响元数据，不影响录像
+    r.telemetry_stream = nullptr;
+    r.next_telemetry_ms = 0;
+    if (m_position_source && (r.telemetry.is_open() || r.telemetry.open())) {
+        r.telemetry_stream = avformat_new_stream(r.ofmt_ctx, nullptr);
+        if (r.telemetry_stream && r.telemetry.fill_codec_parameters(r.telemetry_stream->codecpar)) {
+            r.telemetry_stream->time_base = AVRational{1, 1000};
+            av_dict_set(&r.telemetry_stream->metadata, "handler_name", "Telemetry", 0);
+        } else {
+            fprintf(stderr, "[录制器] 警告: 无法创建遥测字幕轨\n");
+        }
+    }
 
-    if (!(m_ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if ((ret = avio_open(&m_ofmt_ctx->pb, m_out_filename.c_str(), AVIO_FLAG_WRITE)) < 0) {
+    if (!(r.ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        if ((ret = avio_open(&r.ofmt_ctx->pb, r.filename.c_str(), AVIO_FLAG_WRITE)) < 0) {
             print_err(ret, "avio_open");
             return false;
         }
     }
-    if ((ret = avformat_write_header(m_ofmt_ctx, nullptr)) < 0) {
+    if ((ret = avformat_write_header(r.ofmt_ctx, nullptr)) < 0) {
         print_err(ret, "avformat_write_header");
         return false;
     }
+    r.header_written = true;
 
-    return true;
+    // 索引失败不影响录制，只是该分段无法被快速检索
+    const AVCodecParameters* par = r.out_stream->codecpar;
+    r.index.open(recording_index_path(r.filename), par->width, par->height, par->codec_id,
+                 par->extradata, par->extradata_size, m_time_scale);
+
+    r.write_pkt = av_packet_alloc();
+    return r.write_pkt != nullptr;
 }
 
-bool Recorder::reconfigure_filters()
+bool Recorder::write_packet(Rendition& r, const AVPacket* pkt)
 {
-    avfilter_graph_free(&m_filter_graph);
-    m_filter_graph = avfilter_graph_alloc();
-    if (!m_filter_graph) return false;
-
-    AVCodecContext* dec_ctx = m_capture_module->get_decoder_context();
-    AVBufferRef* hw_device_ctx = m_capture_module->get_hw_device_context();
-    if (!dec_ctx) {
-        fprintf(stderr, "[录制器] 错误: 无法从采集器获取解码器上下文。\n");
-        return false;
+    // 共享编码链上的数据包可能从 GOP 中间开始，必须从关键帧开始写；
+    // 多个分辨率的文件从同一个关键帧开始 (GOP 相同，关键帧时间戳对齐)
+    if (!r.started) {
+        if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(m_start_mutex);
+        if (m_start_pts == AV_NOPTS_VALUE) {
+            m_start_pts = pkt->pts;
+            m_start_wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch()).count();
+        } else if (pkt->pts < m_start_pts) {
+            return true;
+        }
+        r.started = true;
+        r.segment_start_pts = m_start_pts;
     }
 
-    const AVPixelFormat input_pix_fmt = dec_ctx->pix_fmt;
-    const bool is_input_hw = (input_pix_fmt == AV_PIX_FMT_DRM_PRIME);
-
-    int cx, cy, cw, ch;
-    m_zoom_manager->get_crop_params(cx, cy, cw, ch);
-
-    const AVFilter *buffersrc = avfilter_get_by_name("buffer");
-    const AVFilter *buffersink = avfilter_get_by_name("buffersink");
-    char args[512];
-    
-    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d",
-             dec_ctx->width, dec_ctx->height, input_pix_fmt, 1, 1000000);
-             
-    if (is_input_hw && dec_ctx->hw_frames_ctx) {
-        char hw_frames_ctx_arg[64];
-        snprintf(hw_frames_ctx_arg, sizeof(hw_frames_ctx_arg), ":hw_frames_ctx=%p", (void*)dec_ctx->hw_frames_ctx);
-        strcat(args, hw_frames_ctx_arg);
+    // 分段边界以 m_start_pts 为零点按固定间隔计算，各分辨率在同一个关键帧切换
+    if (RECORDER_SEGMENT_SECONDS > 0 && (pkt->flags & AV_PKT_FLAG_KEY)) {
+        const int64_t segment_len = av_rescale_q(RECORDER_SEGMENT_SECONDS, AVRational{1, 1}, r.enc_time_base);
+        if (pkt->pts - m_start_pts >= (r.segment_index + 1) * segment_len) {
+            if (!rotate_segment(r, pkt->pts)) {
+                return false;
+            }
+        }
     }
 
-    int ret = avfilter_graph_create_filter(&m_buffersrc_ctx, buffersrc, "in", args, nullptr, m_filter_graph);
-    if (ret < 0) {
-        print_err(ret, "avfilter_graph_create_filter (buffersrc)");
+    // 数据包由多个复用器共享，只能在自己的引用 (或带 SEI 的副本) 上修改时间戳
+    if (m_latency_stamping && build_latency_sei(r, pkt)) {
+        if (!packet_with_sei(r.write_pkt, pkt, r.sei_buf)) {
+            fprintf(stderr, "[录制器] 错误: 插入 SEI 失败\n");
+            return false;
+        }
+    } else if (av_packet_ref(r.write_pkt, pkt) < 0) {
+        fprintf(stderr, "[录制器] 错误: av_packet_ref 失败\n");
         return false;
     }
-
-    ret = avfilter_graph_create_filter(&m_buffersink_ctx, buffersink, "out", nullptr, nullptr, m_filter_graph);
+    const int64_t time_us = m_start_wall_us +
+        static_cast<int64_t>(av_rescale_q(pkt->pts - m_start_pts, r.enc_time_base, AVRational{1, 1000000}) * m_time_scale);
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        // av_write_frame 不经过交织缓冲直接写出数据，写入前的位置就是该关键帧的偏移
+        r.index.add_keyframe(time_us, avio_tell(r.ofmt_ctx->pb));
+        if (m_position_source && m_position_source->get_pos_data(r.pos)) {
+            r.index.add_position(r.pos.latitude, r.pos.longitude);
+        }
+    }
+    r.last_time_us = time_us;
+
+    r.write_pkt->pts -= r.segment_start_pts;
+    r.write_pkt->dts -= r.segment_start_pts;
+    const int64_t time_ms = av_rescale_q(r.write_pkt->pts, r.enc_time_base, AVRational{1, 1000});
+    av_packet_rescale_ts(r.write_pkt, r.enc_time_base, r.out_stream->time_base);
+    r.write_pkt->stream_index = r.out_stream->index;
+
+    // 各流的数据包按时间顺序到达，不需要复用器交织；交织缓冲会让稀疏的字幕轨拖住视频数据，
+    // 关键帧的文件偏移也就不准确了
+    int ret = av_write_frame(r.ofmt_ctx, r.write_pkt);
+    av_packet_unref(r.write_pkt);
     if (ret < 0) {
-        print_err(ret, "avfilter_graph_create_filter (buffersink)");
+        print_err(ret, "av_write_frame");
         return false;
     }
-    enum AVPixelFormat sink_fmts[] = {AV_PIX_FMT_NV12, AV_PIX_FMT_NONE};
-    av_opt_set_int_list(m_buffersink_ctx, "pix_fmts", sink_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-
-    char filt_descr[1024];
-    if (m_use_hw) {
-        char rga_part[256];
-        snprintf(rga_part, sizeof(rga_part), "vpp_rkrga=cx=%d:cy=%d:cw=%d:ch=%d:w=%d:h=%d",
-                 cx, cy, cw, ch, m_out_w, m_out_h);
-        
-        if (is_input_hw) {
-            fprintf(stderr, "[录制器] 检测到硬件帧输入(DRM_PRIME)，配置零拷贝滤镜路径。\n");
-            snprintf(filt_descr, sizeof(filt_descr), "%s,hwdownload,format=nv12", rga_part);
-        } else {
-            fprintf(stderr, "[录制器] 检测到软件帧输入，配置 'hwupload' 滤镜路径。\n");
-            snprintf(filt_descr, sizeof(filt_descr), "hwupload,%s,hwdownload,format=nv12", rga_part);
-        }
-    } else {
-        snprintf(filt_descr, sizeof(filt_descr), "crop=%d:%d:%d:%d,scale=%d:%d,format=nv12",
-                 cw, ch, cx, cy, m_out_w, m_out_h);
+
+    if (r.telemetry_stream && time_ms >= r.next_telemetry_ms) {
+        write_telemetry(r, time_ms);
     }
+    return true;
+}
 
-    AVFilterInOut *outputs = avfilter_inout_alloc();
-    AVFilterInOut *inputs = avfilter_inout_alloc();
-    outputs->name = av_strdup("in");
-    outputs->filter_ctx = m_buffersrc_ctx;
-    inputs->name = av_strdup("out");
-    inputs->filter_ctx = m_buffersink_ctx;
+bool Recorder::write_telemetry(Rendition& r, int64_t time_ms)
+{
+    if (!m_position_source->get_pos_data(r.pos)) {
+        return true; // 还没有定位数据，下一帧再检查
+    }
+    r.next_telemetry_ms = time_ms + TELEMETRY_INTERVAL_MS;
 
-    ret = avfilter_graph_parse_ptr(m_filter_graph, filt_descr, &inputs, &outputs, nullptr);
-    avfilter_inout_free(&inputs);
-    avfilter_inout_free(&outputs);
+    char text[128];
+    format_telemetry_text(r.pos, text, sizeof(text));
+    if (!r.telemetry.encode(text, TELEMETRY_INTERVAL_MS, r.write_pkt)) {
+        fprintf(stderr, "[录制器] 警告: 遥测样本编码失败\n");
+        return false;
+    }
+    r.write_pkt->pts = r.write_pkt->dts = time_ms;
+    av_packet_rescale_ts(r.write_pkt, AVRational{1, 1000}, r.telemetry_stream->time_base);
+    r.write_pkt->stream_index = r.telemetry_stream->index;
+
+    int ret = av_write_frame(r.ofmt_ctx, r.write_pkt);
+    av_packet_unref(r.write_pkt);
     if (ret < 0) {
-        print_err(ret, "avfilter_graph_parse_ptr");
+        // 元数据写入失败不中断录像
+        print_err(ret, "av_write_frame (telemetry)");
         return false;
     }
+    return true;
+}
 
-    if (m_use_hw && hw_device_ctx) {
-        for (unsigned i = 0; i < m_filter_graph->nb_filters; i++) {
-            AVFilterContext* fctx = m_filter_graph->filters[i];
-            const char* filter_name = fctx->filter->name;
-            if (strcmp(filter_name, "hwupload") == 0 || strcmp(filter_name, "vpp_rkrga") == 0) {
-                fctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-                fprintf(stderr, "[录制器] 已绑定 hw_device_ctx 到 %s 滤镜\n", filter_name);
-            }
+bool Recorder::build_latency_sei(Rendition& r, const AVPacket* pkt)
+{
+    LatencyStamp stamp;
+    stamp.capture_us = m_pipeline->get_capture_time_us(pkt->pts, r.enc_time_base);
+    if (stamp.capture_us == AV_NOPTS_VALUE) {
+        return false;
+    }
+    stamp.seq = r.latency_seq++;
+    stamp.send_us = latency_clock_us();
+    r.sei_buf.clear();
+    return append_latency_sei(r.out_stream->codecpar->codec_id, stamp, r.sei_buf);
+}
+
+void Recorder::thread_write(Rendition& r)
+{
+    AllocationProbe alloc_probe("Recorder");
+    while (true) {
+        AVPacketPtr pkt_ptr = r.queue_packets.wait_and_pop();
+        if (pkt_ptr == nullptr) {
+            break;
         }
+        if (r.error) {
+            continue; // 写入已失败，丢弃剩余数据包直到队列停止
+        }
+        if (!write_packet(r, pkt_ptr.get())) {
+            r.error = true;
+            // 仅注销这一路，不影响其他分辨率以及共享同一编码链的其他输出
+            m_pipeline->unregister_consumer(&r.queue_packets);
+        }
+        alloc_probe.frame_done();
     }
 
-    if ((ret = avfilter_graph_config(m_filter_graph, nullptr)) < 0) {
-        print_err(ret, "avfilter_graph_config");
-        return false;
+    if (m_pipeline->hasError()) {
+        r.error = true;
     }
-    fprintf(stderr, "[录制器] 滤镜图配置完成: \"%s\"\n", filt_descr);
-    return true;
+    cleanup_muxer(r);
 }
 
 void Recorder::run()
 {
     m_is_recording = true;
-    m_pipeline_error = false;
-    m_stop_flag = false;
-    
-    if (!initialize_ffmpeg()) {
-        fprintf(stderr, "[录制器] 错误: initialize_ffmpeg 失败\n");
-        cleanup_ffmpeg();
+
+    if (!m_pipeline) {
+        fprintf(stderr, "[录制器] 错误: 未绑定编码链\n");
         m_is_recording = false;
         return;
     }
 
-    // 首次配置滤镜图时加锁
-    {
-        std::lock_guard<std::mutex> lock(m_filter_mutex);
-        if (!reconfigure_filters()) {
-            fprintf(stderr, "[录制器] 错误: 首次配置滤镜图失败\n");
-            cleanup_ffmpeg();
-            m_is_recording = false;
-            return;
+    bool init_ok = true;
+    for (auto& r : m_renditions) {
+        if (!initialize_muxer(*r)) {
+            fprintf(stderr, "[录制器] 错误: initialize_muxer 失败 (%s)\n", r->filename.c_str());
+            init_ok = false;
+            break;
         }
     }
-    
-    m_capture_module->register_consumer(&m_queue_decoded_frames);
-
-    fprintf(stderr, "[录制器] 启动流水线线程...\n");
-    try {
-        m_thread_filter = std::thread(&Recorder::thread_filter_osd, this);
-        m_thread_encode = std::thread(&Recorder::thread_encode_write, this);
-    } catch (const std::exception& e) {
-        fprintf(stderr, "[录制器] 启动线程失败: %s\n", e.what());
-        m_pipeline_error = true;
-        stop();
+    if (!init_ok) {
+        m_pipeline->unregister_consumers(packet_queues());
+        for (auto& r : m_renditions) {
+            r->error = true;
+            cleanup_muxer(*r);
+            remove_segment_files(r->filename);
+        }
+        m_is_recording = false;
+        return;
     }
-    
-    if (m_thread_filter.joinable()) m_thread_filter.join();
-    if (m_thread_encode.joinable()) m_thread_encode.join();
 
-    fprintf(stderr, "[录制器] 流水线线程已全部退出。\n");
-    
-    m_capture_module->unregister_consumer(&m_queue_decoded_frames);
+    fprintf(stderr, "[录制器] 开始写入文件 (%zu 个分辨率)...\n", m_renditions.size());
+    for (auto& r : m_renditions) {
+        try {
+            r->thread_write = std::thread(&Recorder::thread_write, this, std::ref(*r));
+        } catch (const std::exception& e) {
+            fprintf(stderr, "[录制器] 启动写文件线程失败: %s\n", e.what());
+            r->error = true;
+            m_pipeline->unregister_consumer(&r->queue_packets);
+            cleanup_muxer(*r);
+        }
+    }
+    for (auto& r : m_renditions) {
+        if (r->thread_write.joinable()) r->thread_write.join();
+    }
 
-    cleanup_ffmpeg();
-    
-    if (!m_pipeline_error && m_stop_flag) {
-        fprintf(stderr, "[录制器] 录制结束 保存: %s\n", m_out_filename.c_str());
-        if (m_on_complete_cb) {
-            m_on_complete_cb(m_out_filename);
+    for (auto& r : m_renditions) {
+        if (!r->error && m_stop_flag) {
+            fprintf(stderr, "[录制器] 录制结束 保存: %s\n", r->filename.c_str());
+            if (m_on_complete_cb) {
+                m_on_complete_cb(r->filename);
+                m_on_complete_cb(recording_index_path(r->filename));
+            }
+        } else {
+            fprintf(stderr, "[录制器] 录制被中断 (错误或变焦)，删除临时文件及索引: %s\n", r->filename.c_str());
+            remove_segment_files(r->filename);
         }
-    } else {
-        fprintf(stderr, "[录制器] 录制被中断 (错误或变焦)，删除临时文件: %s\n", m_out_filename.c_str());
-        // unlink(m_out_filename.c_str());
     }
 
     m_is_recording = false;
@@ -319,180 +488,75 @@ void Recorder::stop()
 {
     fprintf(stderr, "[录制器] 收到停止信号...\n");
     m_stop_flag = true;
-    
-    m_queue_decoded_frames.stop();
-    m_queue_filtered_frames.stop();
-}
 
-void Recorder::cleanup_ffmpeg()
-{
-    fprintf(stderr, "[录制器] 正在清理 FFmpeg 资源...\n");
-
-    if (m_enc_ctx && m_ofmt_ctx && m_out_stream) {
-        AVPacket* outpkt = av_packet_alloc();
-        if (avcodec_send_frame(m_enc_ctx, nullptr) >= 0) {
-            while (avcodec_receive_packet(m_enc_ctx, outpkt) >= 0) {
-                av_packet_rescale_ts(outpkt, m_enc_ctx->time_base, m_out_stream->time_base);
-                outpkt->stream_index = m_out_stream->index;
-                av_interleaved_write_frame(m_ofmt_ctx, outpkt);
-                av_packet_unref(outpkt);
-            }
+    // 一次性注销所有分辨率：如果它们是编码链最后的消费者，编码链会先停止并把
+    // 剩余数据冲刷给每一路，保证各文件在同一帧结束。写文件线程取空队列后写 trailer 并退出。
+    if (m_pipeline) {
+        m_pipeline->unregister_consumers(packet_queues());
+    } else {
+        for (auto& r : m_renditions) {
+            r->queue_packets.stop();
         }
-        av_packet_free(&outpkt);
-        av_write_trailer(m_ofmt_ctx);
     }
+}
 
-    if (m_ofmt_ctx && !(m_ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-        avio_closep(&m_ofmt_ctx->pb);
-    if (m_ofmt_ctx) avformat_free_context(m_ofmt_ctx);
-    if (m_enc_ctx) avcodec_free_context(&m_enc_ctx);
-    
+bool Recorder::rotate_segment(Rendition& r, int64_t pts)
+{
+    const int64_t offset_tb = pts - m_start_pts;
+    const int64_t segment_len = av_rescale_q(RECORDER_SEGMENT_SECONDS, AVRational{1, 1}, r.enc_time_base);
+    // 文件名用采集时间：延时摄影的媒体时间比实际经过的时间短
+    const int64_t offset_sec = static_cast<int64_t>(
+        av_rescale_q(offset_tb, r.enc_time_base, AVRational{1, 1000000}) * m_time_scale / 1000000);
+
+    close_muxer(r);
+    const std::string finished = r.filename;
     {
-        std::lock_guard<std::mutex> lock(m_filter_mutex);
-        avfilter_graph_free(&m_filter_graph);
-        m_filter_graph = nullptr; // 防止悬空指针
+        std::lock_guard<std::mutex> lock(m_segment_mutex);
+        r.prev_filename = finished;
+        r.filename = segment_filename(r, offset_sec);
+    }
+    // 画面中断 (例如采集暂停) 时跳过空的分段序号，保持边界与时间对齐
+    r.segment_index = static_cast<int>(offset_tb / segment_len);
+    r.segment_start_pts = pts;
+
+    fprintf(stderr, "[录制器] 分段完成: %s\n", finished.c_str());
+    if (m_on_complete_cb) {
+        m_on_complete_cb(finished);
+        m_on_complete_cb(recording_index_path(finished));
     }
 
-    m_queue_decoded_frames.clear();
-    m_queue_filtered_frames.clear();
-
-    m_ofmt_ctx = nullptr;
-    m_enc_ctx = nullptr;
-    m_out_stream = nullptr;
+    // 重新获取编码参数：运行中修改码率控制后参数集可能已变化
+    if (!initialize_muxer(r)) {
+        fprintf(stderr, "[录制器] 错误: 无法创建新分段 %s\n", r.filename.c_str());
+        return false;
+    }
+    return true;
 }
 
-void Recorder::thread_filter_osd()
+void Recorder::close_muxer(Rendition& r)
 {
-    fprintf(stderr, "[T1:Filter] 滤镜OSD线程启动。\n");
-    AVFrame *filt_frame = av_frame_alloc();
+    r.index.close(r.last_time_us);
 
-    while (!m_stop_flag && !m_pipeline_error) {
-        AVFramePtr frame_ptr = m_queue_decoded_frames.wait_and_pop();
-        if (frame_ptr == nullptr) {
-            break;
-        }
-
-        // [修复] 时间戳归一化
-        AVFrame* frame = frame_ptr.get();
-        if (m_first_pts == AV_NOPTS_VALUE) {
-            m_first_pts = frame->pts;
-        }
-        frame->pts -= m_first_pts;
-
-        if (m_zoom_manager && m_zoom_manager->check_and_reset_change_flag()) {
-            fprintf(stderr, "[T1:Filter] 检测到变焦，正在动态重建滤镜图...\n");
-            
-            std::lock_guard<std::mutex> lock(m_filter_mutex);
-            if (!reconfigure_filters()) {
-                fprintf(stderr, "[T1:Filter] 错误: 动态重建滤镜失败，正在停止录制。\n");
-                m_pipeline_error = true;
-                break;
-            }
-            fprintf(stderr, "[T1:Filter] 滤镜图已成功更新。\n");
-        }
-        
-        {
-            std::lock_guard<std::mutex> lock(m_filter_mutex);
-            if (m_pipeline_error || !m_buffersrc_ctx) {
-                continue;
-            }
-            // 注意：我们将已经校正过 PTS 的 frame 送入滤镜
-            if (av_buffersrc_add_frame_flags(m_buffersrc_ctx, frame, 0) < 0) {
-                fprintf(stderr, "[T1:Filter] 错误: av_buffersrc_add_frame 失败\n");
-                m_pipeline_error = true;
-                break;
-            }
-        }
-
-        while (!m_stop_flag && !m_pipeline_error) {
-            int ret = 0;
-            {
-                std::lock_guard<std::mutex> lock(m_filter_mutex);
-                 if (m_pipeline_error || !m_buffersink_ctx) {
-                    ret = AVERROR_EOF;
-                } else {
-                    ret = av_buffersink_get_frame(m_buffersink_ctx, filt_frame);
-                }
-            }
-
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            }
-            if (ret < 0) {
-                print_err(ret, "av_buffersink_get_frame");
-                m_pipeline_error = true;
-                break;
-            }
-
-            if (m_osd_manager) {
-                m_osd_manager->blend_osd_on_frame(filt_frame);
-            }
-
-            AVFrame* filt_frame_copy = av_frame_clone(filt_frame);
-            if (!filt_frame_copy) {
-                 fprintf(stderr, "[T1:Filter] 错误: av_frame_clone (filt) 失败\n");
-                 m_pipeline_error = true;
-                 break;
-            }
-
-            m_queue_filtered_frames.push(make_avframe_ptr(filt_frame_copy));
-            av_frame_unref(filt_frame);
-        }
+    if (r.ofmt_ctx && r.header_written) {
+        av_write_trailer(r.ofmt_ctx);
     }
 
-    av_frame_free(&filt_frame);
-    m_queue_filtered_frames.stop();
-    fprintf(stderr, "[T1:Filter] 滤镜OSD线程退出。\n");
+    if (r.ofmt_ctx && !(r.ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&r.ofmt_ctx->pb);
+    if (r.ofmt_ctx) avformat_free_context(r.ofmt_ctx);
+    av_packet_free(&r.write_pkt);
+
+    r.ofmt_ctx = nullptr;
+    r.out_stream = nullptr;
+    r.telemetry_stream = nullptr;
+    r.header_written = false;
 }
 
-void Recorder::thread_encode_write()
+void Recorder::cleanup_muxer(Rendition& r)
 {
-    fprintf(stderr, "[T2:Encode] 编码写入线程启动。\n");
-    AVPacket* outpkt = av_packet_alloc();
-    
-    while (!m_stop_flag && !m_pipeline_error) {
-        AVFramePtr frame_ptr = m_queue_filtered_frames.wait_and_pop();
-        if (frame_ptr == nullptr) {
-            break;
-        }
-
-        AVFrame* frame = frame_ptr.get();
-        if (frame->pts != AV_NOPTS_VALUE) {
-            frame->pts = av_rescale_q(frame->pts, m_buffersink_ctx->inputs[0]->time_base, m_enc_ctx->time_base);
-        }
-
-        int ret = avcodec_send_frame(m_enc_ctx, frame);
-        if (ret < 0) {
-            print_err(ret, "avcodec_send_frame (encoder)");
-            m_pipeline_error = true;
-            break;
-        }
-
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(m_enc_ctx, outpkt);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            }
-            if (ret < 0) {
-                print_err(ret, "avcodec_receive_packet (encoder)");
-                m_pipeline_error = true;
-                break;
-            }
-
-            av_packet_rescale_ts(outpkt, m_enc_ctx->time_base, m_out_stream->time_base);
-            outpkt->stream_index = m_out_stream->index;
-            
-            ret = av_interleaved_write_frame(m_ofmt_ctx, outpkt);
-            av_packet_unref(outpkt);
-            if (ret < 0) {
-                print_err(ret, "av_interleaved_write_frame");
-                m_pipeline_error = true;
-                break;
-            }
-        }
+    if (r.ofmt_ctx) {
+        fprintf(stderr, "[录制器] 正在清理复用器资源 (%s)...\n", r.filename.c_str());
     }
-
-    av_packet_free(&outpkt);
-    m_queue_filtered_frames.stop();
-    fprintf(stderr, "[T2:Encode] 编码写入线程退出。\n");
+    close_muxer(r);
+    r.queue_packets.clear();
 }
\ No newline at end of file
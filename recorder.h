@@ -7,80 +7,166 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <vector>
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <chrono>
 
 extern "C"
 {
 #include <libavformat/avformat.h>
-#include <libavfilter/avfilter.h>
 #include <libavcodec/avcodec.h>
-#include <libavutil/hwcontext.h>
 }
 
-#include "osd_manager.h"
-#include "zoom_manager.h"
+#include "encode_pipeline.h"
 #include "threadsafe_queue.h"
-
-class CameraCapture;
+#include "recording_index.h"
+#include "osd_manager.h"
+#include "telemetry_track.h"
 
 using MediaCompleteCallback = std::function<void(const std::string &)>;
 
+/**
+ * @class Recorder
+ * @brief MP4 录制器。
+ *
+ * 只负责复用与写文件；裁剪、OSD 和编码由 EncodePipeline 完成，
+ * 因此可以与分辨率相同的 RtspStreamer 共享同一条编码链。
+ * 支持同时录制多种分辨率 (例如 1080p 主文件 + 360p 代理文件)：
+ * 所有分辨率来自同一条编码链的不同输出，只裁剪、叠加 OSD 一次，
+ * 每种分辨率一个复用器和写文件线程，各文件从同一个关键帧开始、在同一帧结束。
+ *
+ * 循环录制：每 RECORDER_SEGMENT_SECONDS 秒在下一个关键帧切换到新文件，
+ * 写完的分段立即通过完成回调交出 (移动到存储卡，由 StorageManager 淘汰最旧的分段)。
+ * 分段边界由时间戳决定，各分辨率在同一个关键帧切换。
+ *
+ * 每个分段边写边生成关键帧索引 (同名 .idx，见 recording_index.h)，
+ * 完成回调先交出媒体文件、再交出索引文件。
+ *
+ * 设置了位置来源时，每个文件带一条 mov_text 字幕轨记录 GPS/速度 (见 telemetry_track.h)，
+ * 数据可以被播放器渲染或原样提取；此时可以关闭 OSD 烧录以节省每帧的混合开销。
+ */
 class Recorder
 {
 public:
-    Recorder(CameraCapture* capture_module,
-             std::shared_ptr<OsdManager> osd_manager,
-             std::shared_ptr<ZoomManager> zoom_manager,
-             MediaCompleteCallback cb);
+    Recorder(MediaCompleteCallback cb);
     
     ~Recorder();
 
-    bool prepare(const std::string &resolution_key);
+    /**
+     * @param resolution_keys 逗号分隔的分辨率列表，例如 "1080p" 或 "1080p,360p"。
+     * 第一个为主文件，其余文件名追加分辨率后缀 (例如 xxx_360p.mp4)。
+     * @param codec 编码格式，所有分辨率相同；码率按编码格式取默认值。
+     */
+    bool prepare(const std::string &resolution_keys, VideoCodec codec = VideoCodec::H264);
+
+    /**
+     * @brief 延时摄影模式，必须在 prepare() 之前设置。
+     * @param frame_interval 每多少个采集帧保留一帧，1 表示普通录制。
+     * @param blend_frames 每个保留帧平均的采集帧数 (运动模糊)，1 表示不平均。
+     */
+    void set_timelapse(int frame_interval, int blend_frames);
+
+    // prepare() 之后有效，用于向控制器申请 (或复用) 编码链，顺序与 prepare() 的分辨率列表一致
+    std::vector<EncodeProfile> get_encode_profiles() const;
+
+    // 可选：在索引中记录 GPS 范围，并写入遥测字幕轨 (取自 OsdManager::PosData)，必须在 run() 之前设置
+    void set_position_source(std::shared_ptr<OsdManager> osd) { m_position_source = std::move(osd); }
+
+    // 是否把 OSD 烧录到画面中 (默认是)，必须在 prepare() 之前设置
+    void set_osd_burn_in(bool enabled) { m_burn_in_osd = enabled; }
+
+    // 每帧插入时延测量 SEI (采集时刻、写入时刻，见 latency_stamp.h)，必须在 run() 之前设置
+    void set_latency_stamping(bool enabled) { m_latency_stamping = enabled; }
+
+    /**
+     * @brief 绑定编码链并注册每种分辨率的数据包队列。
+     * 必须在 run() 之前、在调用线程中同步完成，避免与 stop() 竞争。
+     */
+    bool attach_pipeline(std::shared_ptr<EncodePipeline> pipeline);
+    std::shared_ptr<EncodePipeline> get_pipeline() const { return m_pipeline; }
+
+    /**
+     * @brief 运行中修改码率控制，在下一个关键帧生效。
+     * rc 针对主分辨率；其余分辨率的码率按面积比例缩放，GOP 保持一致以便关键帧对齐。
+     */
+    bool set_rate_control(const RateControl& rc);
+
+    // 当前正在写入的分段和上一个分段的文件名 (不含目录)，用于锁定事件片段 (线程安全)
+    std::vector<std::string> get_recent_segment_names() const;
     
     void run();
     void stop();
     bool isRecording() const;
 
 private:
-    void thread_filter_osd();
-    void thread_encode_write();
+    // 一种分辨率的输出文件
+    struct Rendition
+    {
+        EncodeProfile profile;
+        std::string key;              // 分辨率名称，用于非主文件的文件名后缀
+        std::string filename;         // 当前分段的完整路径 (修改时持有 m_segment_mutex)
+        std::string prev_filename;    // 上一个分段
+        size_t output_index = 0;
+        int segment_index = 0;
+        int64_t segment_start_pts = AV_NOPTS_VALUE;
+        RecordingIndexWriter index;
+        int64_t last_time_us = 0; // 最后写入的数据包的系统时间
+
+        AVFormatContext *ofmt_ctx = nullptr;
+        AVStream *out_stream = nullptr;
+        AVStream *telemetry_stream = nullptr;
+        TelemetryTextEncoder telemetry;
+        int64_t next_telemetry_ms = 0;   // 分段内下一个遥测样本的时间 (毫秒)
+        OsdManager::PosData pos;         // 复用，保留字符串容量，写文件线程中不再分配
+        AVPacket *write_pkt = nullptr;
+        AVRational enc_time_base{1, 1000000};
+        std::vector<uint8_t> sei_buf;    // 复用的时延 SEI 缓冲区
+        uint32_t latency_seq = 0;
+        bool header_written = false;
+        bool started = false;
+        std::atomic<bool> error{false};
+
+        ThreadSafePacketQueue queue_packets;
+        std::thread thread_write;
+    };
+
+    bool initialize_muxer(Rendition& r);
+    void close_muxer(Rendition& r);
+    void cleanup_muxer(Rendition& r);
+    bool rotate_segment(Rendition& r, int64_t pts);
+    std::string segment_filename(const Rendition& r, int64_t offset_sec) const;
+    bool write_packet(Rendition& r, const AVPacket* pkt);
+    bool write_telemetry(Rendition& r, int64_t time_ms);
+    bool build_latency_sei(Rendition& r, const AVPacket* pkt);
+    void thread_write(Rendition& r);
+    std::vector<ThreadSafePacketQueue*> packet_queues();
 
-    bool initialize_ffmpeg();
-    void cleanup_ffmpeg();
-    bool reconfigure_filters();
-
-    CameraCapture* m_capture_module;
-    std::shared_ptr<OsdManager> m_osd_manager;
-    std::shared_ptr<ZoomManager> m_zoom_manager;
     MediaCompleteCallback m_on_complete_cb;
+    std::shared_ptr<EncodePipeline> m_pipeline;
     
-    AVFormatContext *m_ofmt_ctx = nullptr;
-    AVCodecContext *m_enc_ctx = nullptr;
-    AVFilterGraph *m_filter_graph = nullptr;
-    AVFilterContext *m_buffersrc_ctx = nullptr;
-    AVFilterContext *m_buffersink_ctx = nullptr;
-    
-    std::string m_out_filename;
-    int m_out_w = 0, m_out_h = 0;
-    AVStream *m_out_stream = nullptr;
+    std::vector<std::unique_ptr<Rendition>> m_renditions;
+
+    // 所有文件共同的起始时间戳 (第一个被写入的关键帧)。
+    // 加入已在运行的编码链时，编码器时间戳并不从 0 开始，各文件都以它为零点。
+    int64_t m_start_pts = AV_NOPTS_VALUE;
+    std::mutex m_start_mutex;
+    // m_start_pts 对应的系统时间 (微秒)，索引中的时间 = 它 + 时间戳偏移
+    int64_t m_start_wall_us = 0;
+    int m_frame_interval = 1;
+    int m_blend_frames = 1;
+    bool m_burn_in_osd = true;
+    bool m_latency_stamping = false;
+    // 播放时间到实际时间的倍率 (延时摄影时大于 1)，用于索引中的系统时间
+    double m_time_scale = 1.0;
+    std::shared_ptr<OsdManager> m_position_source;
+    // 录制开始的系统时间，分段文件名 = 开始时间 + 分段起点的时间戳偏移
+    std::chrono::system_clock::time_point m_start_time;
+    mutable std::mutex m_segment_mutex;
 
-    // [新增] 用于消费者内部的时间戳归一化
-    int64_t m_first_pts = AV_NOPTS_VALUE;
-
-    bool m_use_hw = false;
     std::atomic<bool> m_stop_flag{false};
     std::atomic<bool> m_is_recording{false};
-    std::atomic<bool> m_pipeline_error{false};
-
-    std::thread m_thread_filter;
-    std::thread m_thread_encode;
-
-    std::mutex m_filter_mutex;
-
-    ThreadSafeFrameQueue m_queue_decoded_frames;
-    ThreadSafeFrameQueue m_queue_filtered_frames;
 };
 
 #endif // RECORDER_H
\ No newline at end of file
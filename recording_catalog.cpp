@@ -0,0 +1,132 @@
+// --- START OF FILE recording_catalog.cpp ---
+
+#include "recording_catalog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+
+static std::string media_path_for_index(const std::string& index_path)
+{
+    return index_path.substr(0, index_path.size() - strlen(RECORDING_INDEX_EXT)) + ".mp4";
+}
+
+static bool has_index_ext(const std::string& name)
+{
+    const size_t n = strlen(RECORDING_INDEX_EXT);
+    return name.size() > n && name.compare(name.size() - n, n, RECORDING_INDEX_EXT) == 0;
+}
+
+void RecordingCatalog::load(const std::string& dir)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<Item> items;
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        fprintf(stderr, "[录像目录] 警告: 无法打开目录 %s\n", dir.c_str());
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d)) != nullptr) {
+        std::string name = de->d_name;
+        if (!has_index_ext(name)) continue;
+
+        Item item;
+        item.index_path = dir + name;
+        item.media_path = media_path_for_index(item.index_path);
+        if (read_recording_index_header(item.index_path, item.header) && item.header.entry_count > 0) {
+            items.push_back(std::move(item));
+        }
+    }
+    closedir(d);
+
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.header.start_us < b.header.start_us; });
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.swap(items);
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    printf("[录像目录] 已加载 %zu 个录像索引 (%lld ms)\n", size(), (long long)ms);
+}
+
+void RecordingCatalog::insert_sorted(Item item)
+{
+    // 注意: 此函数应在已持有互斥锁的情况下被调用
+    auto it = std::upper_bound(m_items.begin(), m_items.end(), item.header.start_us,
+                               [](int64_t t, const Item& i) { return t < i.header.start_us; });
+    m_items.insert(it, std::move(item));
+}
+
+void RecordingCatalog::add(const std::string& index_path)
+{
+    Item item;
+    item.index_path = index_path;
+    item.media_path = media_path_for_index(index_path);
+    if (!read_recording_index_header(index_path, item.header) || item.header.entry_count == 0) {
+        fprintf(stderr, "[录像目录] 警告: 无效的索引文件 %s\n", index_path.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_items.erase(std::remove_if(m_items.begin(), m_items.end(),
+                                 [&](const Item& i) { return i.index_path == index_path; }),
+                  m_items.end());
+    insert_sorted(std::move(item));
+}
+
+void RecordingCatalog::remove(const std::string& media_filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_items.erase(std::remove_if(m_items.begin(), m_items.end(),
+                                 [&](const Item& i) {
+                                     const size_t n = media_filename.size();
+                                     return i.media_path.size() >= n &&
+                                            i.media_path.compare(i.media_path.size() - n, n, media_filename) == 0;
+                                 }),
+                  m_items.end());
+}
+
+std::vector<RecordingCatalogHit> RecordingCatalog::query(int64_t start_us, int64_t end_us) const
+{
+    std::vector<RecordingCatalogHit> hits;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // 开始时间晚于查询终点的条目之后都不会重叠
+        auto last = std::upper_bound(m_items.begin(), m_items.end(), end_us,
+                                     [](int64_t t, const Item& i) { return t < i.header.start_us; });
+        for (auto it = m_items.begin(); it != last; ++it) {
+            if (it->header.end_us < start_us) continue;
+            RecordingCatalogHit hit;
+            hit.media_path = it->media_path;
+            hit.index_path = it->index_path;
+            hit.header = it->header;
+            hits.push_back(std::move(hit));
+        }
+    }
+
+    // 读取命中文件的关键帧条目，定位起止偏移 (锁外进行)
+    std::vector<RecordingIndexEntry> entries;
+    for (auto& hit : hits) {
+        if (!read_recording_index_entries(hit.index_path, entries) || entries.empty()) continue;
+
+        auto after_start = std::upper_bound(entries.begin(), entries.end(), start_us,
+                                            [](int64_t t, const RecordingIndexEntry& e) { return t < e.time_us; });
+        const RecordingIndexEntry& first = (after_start == entries.begin()) ? entries.front() : *(after_start - 1);
+        hit.start_keyframe_us = first.time_us;
+        hit.start_offset = first.offset;
+
+        auto after_end = std::upper_bound(entries.begin(), entries.end(), end_us,
+                                          [](int64_t t, const RecordingIndexEntry& e) { return t < e.time_us; });
+        hit.end_offset = (after_end == entries.end()) ? -1 : after_end->offset;
+    }
+    return hits;
+}
+
+size_t RecordingCatalog::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_items.size();
+}
@@ -0,0 +1,67 @@
+// --- START OF FILE recording_catalog.h ---
+
+#ifndef RECORDING_CATALOG_H
+#define RECORDING_CATALOG_H
+
+#include "recording_index.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * @brief 时间范围查询的一条结果：一个覆盖该范围的录像文件及其读取位置。
+ */
+struct RecordingCatalogHit
+{
+    std::string media_path;
+    std::string index_path;
+    RecordingIndexHeader header;
+    int64_t start_keyframe_us = 0; // 不晚于查询起点的最近关键帧时间
+    int64_t start_offset = 0;      // 该关键帧在文件中的字节偏移
+    int64_t end_offset = -1;       // 查询终点之后第一个关键帧的偏移，-1 表示读到文件末尾
+};
+
+/**
+ * @class RecordingCatalog
+ * @brief 存储目录中全部录像的目录 (只保存索引文件头，常驻内存)。
+ *
+ * 由 FileManager 维护：启动时扫描一次 .idx 文件头，之后每移动一个索引文件登记一次，
+ * 录像被淘汰时移除。时间范围查询只读取命中文件的索引，不打开媒体文件。
+ * 所有方法线程安全。
+ */
+class RecordingCatalog
+{
+public:
+    // 扫描目录中的全部索引文件，替换当前内容
+    void load(const std::string& dir);
+
+    // 登记一个已移动到存储目录的索引文件
+    void add(const std::string& index_path);
+
+    // 移除媒体文件 (不含目录的文件名) 对应的条目
+    void remove(const std::string& media_filename);
+
+    /**
+     * @brief 查询与 [start_us, end_us] (系统时间, 微秒) 重叠的录像，按开始时间排序。
+     */
+    std::vector<RecordingCatalogHit> query(int64_t start_us, int64_t end_us) const;
+
+    size_t size() const;
+
+private:
+    struct Item
+    {
+        std::string index_path;
+        std::string media_path;
+        RecordingIndexHeader header;
+    };
+
+    void insert_sorted(Item item);
+
+    std::vector<Item> m_items; // 按 header.start_us 排序
+    mutable std::mutex m_mutex;
+};
+
+#endif // RECORDING_CATALOG_H
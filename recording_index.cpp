@@ -0,0 +1,176 @@
+// --- START OF FILE recording_index.cpp ---
+
+#include "recording_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+
+static size_t aligned_extradata_size(uint32_t size)
+{
+    return (static_cast<size_t>(size) + 7) & ~static_cast<size_t>(7);
+}
+
+// 第一个条目在文件中的偏移
+static size_t entries_offset(const RecordingIndexHeader& header)
+{
+    return sizeof(RecordingIndexHeader) + aligned_extradata_size(header.extradata_size);
+}
+
+// 读取并校验文件头
+static bool read_header_raw(FILE* f, RecordingIndexHeader& header)
+{
+    header = RecordingIndexHeader{};
+    return fread(&header, sizeof(header), 1, f) == 1 && header.magic == RECORDING_INDEX_MAGIC &&
+           header.version == RECORDING_INDEX_VERSION;
+}
+
+std::string recording_index_path(const std::string& media_path)
+{
+    size_t dot = media_path.rfind('.');
+    size_t slash = media_path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return media_path + RECORDING_INDEX_EXT;
+    }
+    return media_path.substr(0, dot) + RECORDING_INDEX_EXT;
+}
+
+bool RecordingIndexWriter::open(const std::string& path, int width, int height, int codec_id,
+                                const uint8_t* extradata, int extradata_size, double time_scale)
+{
+    close();
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        fprintf(stderr, "[录像索引] 错误: 无法创建 %s (%s)\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    m_header = RecordingIndexHeader{};
+    m_header.magic = RECORDING_INDEX_MAGIC;
+    m_header.version = RECORDING_INDEX_VERSION;
+    m_header.width = width;
+    m_header.height = height;
+    m_header.codec_id = codec_id;
+    m_header.extradata_size = (extradata && extradata_size > 0) ? static_cast<uint32_t>(extradata_size) : 0;
+    m_header.time_scale = static_cast<float>(time_scale);
+    m_has_position = false;
+
+    // 先写一个占位文件头，关闭时回写；extradata 在录制开始时就已确定，随文件头一起写出
+    static const uint8_t padding[8] = {0};
+    const size_t pad = aligned_extradata_size(m_header.extradata_size) - m_header.extradata_size;
+    bool ok = fwrite(&m_header, sizeof(m_header), 1, m_file) == 1 &&
+              (m_header.extradata_size == 0 ||
+               (fwrite(extradata, m_header.extradata_size, 1, m_file) == 1 && fwrite(padding, 1, pad, m_file) == pad));
+    if (ok) {
+        // 断电时至少文件头和 extradata 已经落盘，条目仍由 stdio 缓冲
+        ok = fflush(m_file) == 0;
+    }
+    if (!ok) {
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void RecordingIndexWriter::add_keyframe(int64_t time_us, int64_t offset)
+{
+    if (!m_file) return;
+    if (m_header.entry_count == 0) {
+        m_header.start_us = time_us;
+    }
+    RecordingIndexEntry entry{time_us, offset};
+    // 由 stdio 缓冲，不会每个关键帧都产生一次写入
+    if (fwrite(&entry, sizeof(entry), 1, m_file) == 1) {
+        m_header.entry_count++;
+    }
+}
+
+void RecordingIndexWriter::add_position(double latitude, double longitude)
+{
+    if (!m_file || (latitude == 0.0 && longitude == 0.0)) return;
+    if (!m_has_position) {
+        m_header.min_lat = m_header.max_lat = latitude;
+        m_header.min_lon = m_header.max_lon = longitude;
+        m_has_position = true;
+        return;
+    }
+    m_header.min_lat = std::min(m_header.min_lat, latitude);
+    m_header.max_lat = std::max(m_header.max_lat, latitude);
+    m_header.min_lon = std::min(m_header.min_lon, longitude);
+    m_header.max_lon = std::max(m_header.max_lon, longitude);
+}
+
+void RecordingIndexWriter::close(int64_t end_us)
+{
+    if (!m_file) return;
+    m_header.end_us = end_us;
+    if (fseek(m_file, 0, SEEK_SET) == 0) {
+        fwrite(&m_header, sizeof(m_header), 1, m_file);
+    }
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+bool read_recording_index_header(const std::string& path, RecordingIndexHeader& header)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    bool ok = read_header_raw(f, header);
+    const size_t offset = ok ? entries_offset(header) : 0;
+    struct stat st;
+    if (ok && fstat(fileno(f), &st) == 0) {
+        header.entry_count = st.st_size > static_cast<off_t>(offset)
+                                 ? static_cast<uint32_t>((st.st_size - offset) / sizeof(RecordingIndexEntry))
+                                 : 0;
+    }
+
+    // 未正常结束的索引：起止时间取首尾条目
+    if (ok && header.entry_count > 0 && (header.start_us == 0 || header.end_us == 0)) {
+        RecordingIndexEntry entry;
+        if (header.start_us == 0 && fseek(f, static_cast<long>(offset), SEEK_SET) == 0 &&
+            fread(&entry, sizeof(entry), 1, f) == 1) {
+            header.start_us = entry.time_us;
+        }
+        // 断电时最后一个条目可能只写了一半，取最后一个完整的条目
+        const long last = static_cast<long>(offset + (header.entry_count - 1) * sizeof(entry));
+        if (header.end_us == 0 && fseek(f, last, SEEK_SET) == 0 &&
+            fread(&entry, sizeof(entry), 1, f) == 1) {
+            header.end_us = entry.time_us;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool read_recording_index_entries(const std::string& path, std::vector<RecordingIndexEntry>& entries)
+{
+    RecordingIndexHeader header;
+    if (!read_recording_index_header(path, header)) return false;
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    entries.resize(header.entry_count);
+    bool ok = fseek(f, static_cast<long>(entries_offset(header)), SEEK_SET) == 0 &&
+              (entries.empty() || fread(entries.data(), sizeof(RecordingIndexEntry), entries.size(), f) == entries.size());
+    fclose(f);
+    return ok;
+}
+
+bool read_recording_index_extradata(const std::string& path, std::vector<uint8_t>& extradata)
+{
+    extradata.clear();
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    RecordingIndexHeader header;
+    bool ok = read_header_raw(f, header);
+    if (ok && header.extradata_size > 0) {
+        extradata.resize(header.extradata_size);
+        ok = fread(extradata.data(), extradata.size(), 1, f) == 1;
+    }
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,96 @@
+// --- START OF FILE recording_index.h ---
+
+#ifndef RECORDING_INDEX_H
+#define RECORDING_INDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * @file recording_index.h
+ * @brief 录像分段的关键帧索引 (".idx" 伴随文件)。
+ *
+ * 文件格式 (本机字节序)：固定长度的 RecordingIndexHeader，编码器的 extradata
+ * (SPS/PPS[/VPS]，按 8 字节对齐)，之后是按时间递增的 RecordingIndexEntry 数组。
+ * 录制时边写边追加条目，结束时回写文件头；中途断电时文件头的条目数为 0，读取时以文件长度为准。
+ * MP4 的 moov 只在录制结束时写出，断电后可以用索引中的 extradata 从 mdat 恢复录像
+ * (见 recording_recovery.h)。
+ *
+ * 条目和文件头中的时间都是系统时间；媒体文件内的时间戳乘以 time_scale 后加上 start_us
+ * 才是系统时间 (延时摄影的文件比实际时间短)。
+ */
+
+#define RECORDING_INDEX_MAGIC   0x5844495a // "ZIDX"
+#define RECORDING_INDEX_VERSION 1
+#define RECORDING_INDEX_EXT     ".idx"
+
+struct RecordingIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t start_us;      // 第一帧的系统时间 (微秒, UNIX 纪元)
+    int64_t end_us;        // 最后一帧的系统时间，录制未正常结束时为 0
+    int32_t width;
+    int32_t height;
+    int32_t codec_id;      // AVCodecID
+    uint32_t entry_count;
+    double min_lat, max_lat; // GPS 范围 (度)，没有定位数据时全部为 0
+    double min_lon, max_lon;
+    uint32_t extradata_size;
+    float time_scale;        // 媒体文件内 1 秒对应的系统时间秒数 (延时摄影时大于 1)
+};
+static_assert(sizeof(RecordingIndexHeader) == 80, "RecordingIndexHeader layout");
+
+struct RecordingIndexEntry
+{
+    int64_t time_us;       // 关键帧的系统时间 (微秒)
+    int64_t offset;        // 关键帧数据在 MP4 文件中的字节偏移
+};
+static_assert(sizeof(RecordingIndexEntry) == 16, "RecordingIndexEntry layout");
+
+// 媒体文件对应的索引文件路径 (xxx.mp4 -> xxx.idx)
+std::string recording_index_path(const std::string& media_path);
+
+/**
+ * @class RecordingIndexWriter
+ * @brief 在录制过程中写入索引文件。不是线程安全的，由写文件线程独占使用。
+ */
+class RecordingIndexWriter
+{
+public:
+    RecordingIndexWriter() = default;
+    ~RecordingIndexWriter() { close(); }
+
+    bool open(const std::string& path, int width, int height, int codec_id,
+              const uint8_t* extradata = nullptr, int extradata_size = 0, double time_scale = 1.0);
+    void add_keyframe(int64_t time_us, int64_t offset);
+    // 每帧记录定位，更新 GPS 范围
+    void add_position(double latitude, double longitude);
+    // 回写文件头并关闭
+    void close(int64_t end_us = 0);
+    bool is_open() const { return m_file != nullptr; }
+
+private:
+    FILE* m_file = nullptr;
+    RecordingIndexHeader m_header{};
+    bool m_has_position = false;
+};
+
+// 媒体文件内时间与系统时间的比例 (见 RecordingIndexHeader::time_scale)，无效值按 1 处理
+inline double recording_index_time_scale(const RecordingIndexHeader& header)
+{
+    return header.time_scale > 0 ? header.time_scale : 1.0;
+}
+
+// 只读取文件头 (用于建立目录)；entry_count 按文件长度修正
+bool read_recording_index_header(const std::string& path, RecordingIndexHeader& header);
+
+// 读取全部关键帧条目
+bool read_recording_index_entries(const std::string& path, std::vector<RecordingIndexEntry>& entries);
+
+// 读取编码器 extradata；录制时没有 extradata 的索引返回空
+bool read_recording_index_extradata(const std::string& path, std::vector<uint8_t>& extradata);
+
+#endif // RECORDING_INDEX_H
@@ -0,0 +1,436 @@
+// --- START OF FILE recording_recovery.cpp ---
+
+#include "recording_recovery.h"
+#include "recording_index.h"
+#include "telemetry_track.h"
+#include "file_utils.h"
+#include "app_config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/mem.h>
+}
+
+// 单个 NAL 的长度上限，超过即认为数据已损坏
+static const uint32_t kMaxNalSize = 32 * 1024 * 1024;
+static const int kIoBufferSize = 64 * 1024;
+static const char kRecoveringSuffix[] = ".recovering";
+
+static void print_err_recovery(int ret, const char* context) {
+    char buf[256];
+    av_strerror(ret, buf, sizeof(buf));
+    fprintf(stderr, "[录像恢复] FFmpeg 错误 in %s: %s (ret=%d)\n", context, buf, ret);
+}
+
+static bool has_suffix(const std::string& s, const char* suffix) {
+    const size_t n = strlen(suffix);
+    return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+enum class Mp4State { Complete, Truncated, Empty };
+
+/**
+ * @brief 扫描 MP4 的顶层 box。
+ * Recorder 写出的文件依次为 ftyp、free、mdat (未结束时大小为 0，即延伸到文件末尾)、moov。
+ */
+static Mp4State probe_mp4(const std::string& path, int64_t& mdat_start, int64_t& mdat_end)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return Mp4State::Empty;
+    struct stat st;
+    const int64_t file_size = (fstat(fileno(f), &st) == 0) ? st.st_size : 0;
+
+    bool has_moov = false;
+    mdat_start = mdat_end = -1;
+    int64_t pos = 0;
+    uint8_t head[16];
+    while (pos + 8 <= file_size && fseeko(f, pos, SEEK_SET) == 0 && fread(head, 8, 1, f) == 1) {
+        int64_t size = read_be32(head);
+        int64_t header_size = 8;
+        if (size == 1) {
+            if (fread(head + 8, 8, 1, f) != 1) break;
+            size = (int64_t(read_be32(head + 8)) << 32) | read_be32(head + 12);
+            header_size = 16;
+        } else if (size == 0) {
+            size = file_size - pos;
+        }
+        if (size < header_size) break;
+
+        const int64_t box_end = pos + size;
+        if (memcmp(head + 4, "mdat", 4) == 0) {
+            mdat_start = pos + header_size;
+            mdat_end = std::min(box_end, file_size);
+        } else if (memcmp(head + 4, "moov", 4) == 0 && box_end <= file_size) {
+            has_moov = true;
+        }
+        pos = box_end;
+    }
+    fclose(f);
+
+    if (has_moov && mdat_start >= 0) return Mp4State::Complete;
+    if (mdat_start >= 0 && mdat_end - mdat_start > 4) return Mp4State::Truncated;
+    return Mp4State::Empty;
+}
+
+/**
+ * @brief 把 mdat 中的样本转换为 Annex B 码流供 FFmpeg 的 h264/hevc 解复用器读取。
+ * 视频样本是 4 字节长度前缀的 NAL 单元；遥测字幕样本 (2 字节长度 + "lat=...") 直接跳过。
+ */
+struct MdatSource
+{
+    FILE* file = nullptr;
+    int64_t pos = 0;
+    int64_t end = 0;
+    std::vector<uint8_t> pending;
+    size_t pending_pos = 0;
+};
+
+static bool next_nal(MdatSource* src)
+{
+    const size_t prefix_len = strlen(TELEMETRY_TEXT_PREFIX);
+    uint8_t head[8];
+    while (src->pos + 5 <= src->end) {
+        const size_t want = static_cast<size_t>(std::min<int64_t>(2 + prefix_len, src->end - src->pos));
+        if (fseeko(src->file, src->pos, SEEK_SET) != 0 || fread(head, want, 1, src->file) != 1) {
+            return false;
+        }
+        if (want == 2 + prefix_len && memcmp(head + 2, TELEMETRY_TEXT_PREFIX, prefix_len) == 0) {
+            src->pos += 2 + ((head[0] << 8) | head[1]);
+            continue;
+        }
+
+        const uint32_t len = read_be32(head);
+        // 最后一个 NAL 可能只写了一半；forbidden_zero_bit 置位说明数据已错位
+        if (len == 0 || len > kMaxNalSize || src->pos + 4 + len > src->end || (head[4] & 0x80)) {
+            return false;
+        }
+        src->pending.resize(4 + len);
+        src->pending[0] = src->pending[1] = src->pending[2] = 0x00;
+        src->pending[3] = 0x01;
+        if (fseeko(src->file, src->pos + 4, SEEK_SET) != 0 || fread(&src->pending[4], len, 1, src->file) != 1) {
+            return false;
+        }
+        src->pending_pos = 0;
+        src->pos += 4 + len;
+        return true;
+    }
+    return false;
+}
+
+static int read_mdat_annexb(void* opaque, uint8_t* buf, int buf_size)
+{
+    MdatSource* src = static_cast<MdatSource*>(opaque);
+    int copied = 0;
+    while (copied < buf_size) {
+        if (src->pending_pos == src->pending.size() && !next_nal(src)) {
+            break;
+        }
+        const size_t n = std::min<size_t>(buf_size - copied, src->pending.size() - src->pending_pos);
+        memcpy(buf + copied, &src->pending[src->pending_pos], n);
+        src->pending_pos += n;
+        copied += static_cast<int>(n);
+    }
+    return copied > 0 ? copied : AVERROR_EOF;
+}
+
+RecordingRecovery::RecordingRecovery(std::function<void(const std::string&)> hand_off_cb)
+    : m_hand_off_cb(std::move(hand_off_cb)) {}
+
+RecordingRecovery::~RecordingRecovery() {
+    stop();
+}
+
+void RecordingRecovery::start() {
+    if (m_worker_thread.joinable()) {
+        return;
+    }
+    // 只扫描 Recorder 专用的临时目录，不会误处理 /tmp 中其他程序或导出的文件
+    DIR* dir = opendir(RECORDING_TEMP_PATH);
+    if (!dir) {
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(dir)) != nullptr) {
+        std::string name = de->d_name;
+        if (has_suffix(name, ".mp4") || has_suffix(name, RECORDING_INDEX_EXT)) {
+            m_pending.push_back(RECORDING_TEMP_PATH + name);
+        } else if (has_suffix(name, kRecoveringSuffix)) {
+            // 上次恢复到一半的输出
+            unlink((RECORDING_TEMP_PATH + name).c_str());
+        }
+    }
+    closedir(dir);
+
+    if (m_pending.empty()) {
+        return;
+    }
+    std::sort(m_pending.begin(), m_pending.end());
+    m_stop_flag = false;
+    m_worker_thread = std::thread(&RecordingRecovery::worker_thread_func, this);
+    printf("[录像恢复] 发现 %zu 个未移动的录像文件，后台处理中...\n", m_pending.size());
+}
+
+void RecordingRecovery::stop() {
+    m_stop_flag = true;
+    if (m_worker_thread.joinable()) {
+        m_worker_thread.join();
+    }
+}
+
+void RecordingRecovery::worker_thread_func() {
+    lower_thread_priority(CLIP_EXPORT_NICE);
+    for (const auto& path : m_pending) {
+        if (m_stop_flag) break;
+        if (has_suffix(path, RECORDING_INDEX_EXT)) {
+            process_orphan_index(path);
+        } else {
+            process_file(path);
+        }
+    }
+    printf("[录像恢复] 工作线程正在退出。\n");
+}
+
+void RecordingRecovery::hand_off(const std::string& media_path, const std::string& index_path) {
+    if (!m_hand_off_cb) return;
+    m_hand_off_cb(media_path);
+    if (access(index_path.c_str(), F_OK) == 0) {
+        m_hand_off_cb(index_path);
+    }
+}
+
+void RecordingRecovery::process_orphan_index(const std::string& index_path) {
+    const std::string media_path = index_path.substr(0, index_path.size() - strlen(RECORDING_INDEX_EXT)) + ".mp4";
+    if (std::binary_search(m_pending.begin(), m_pending.end(), media_path)) {
+        return; // 随媒体文件一起处理
+    }
+    const char* slash = strrchr(media_path.c_str(), '/');
+    const std::string moved_path = FINAL_STORAGE_PATH + std::string(slash ? slash + 1 : media_path.c_str());
+    if (access(moved_path.c_str(), F_OK) == 0) {
+        printf("[录像恢复] 补交索引: %s\n", index_path.c_str());
+        if (m_hand_off_cb) m_hand_off_cb(index_path);
+    } else {
+        unlink(index_path.c_str());
+    }
+}
+
+void RecordingRecovery::process_file(const std::string& path) {
+    const std::string index_path = recording_index_path(path);
+    int64_t mdat_start = 0, mdat_end = 0;
+
+    switch (probe_mp4(path, mdat_start, mdat_end)) {
+    case Mp4State::Complete:
+        // 录制已正常结束，只是没来得及移动
+        printf("[录像恢复] 完整的录像，直接移动: %s\n", path.c_str());
+        hand_off(path, index_path);
+        return;
+    case Mp4State::Empty:
+        printf("[录像恢复] 没有可恢复的数据，删除: %s\n", path.c_str());
+        unlink(path.c_str());
+        unlink(index_path.c_str());
+        return;
+    case Mp4State::Truncated:
+        break;
+    }
+
+    printf("[录像恢复] 正在恢复 %s (mdat %lld 字节)...\n", path.c_str(), (long long)(mdat_end - mdat_start));
+    if (rebuild_file(path, index_path, mdat_start, mdat_end)) {
+        hand_off(path, index_path);
+        return;
+    }
+    if (m_stop_flag) {
+        return; // 下次启动再处理
+    }
+    fprintf(stderr, "[录像恢复] 错误: 无法恢复 %s，保留为 %s%s\n", path.c_str(), path.c_str(), RECOVERY_DAMAGED_SUFFIX);
+    rename(path.c_str(), (path + RECOVERY_DAMAGED_SUFFIX).c_str());
+    unlink(index_path.c_str());
+}
+
+bool RecordingRecovery::rebuild_file(const std::string& path, const std::string& index_path,
+                                     int64_t mdat_start, int64_t mdat_end)
+{
+    // 索引提供参数集、编码格式以及各关键帧的系统时间；没有索引时只能依赖码流中的参数集
+    RecordingIndexHeader old_header{};
+    std::vector<RecordingIndexEntry> old_entries;
+    std::vector<uint8_t> extradata;
+    const bool has_index = read_recording_index_header(index_path, old_header);
+    if (has_index) {
+        read_recording_index_entries(index_path, old_entries);
+        read_recording_index_extradata(index_path, extradata);
+    }
+    // 只有 Annex B 格式的 extradata 可以直接拼接在码流前面
+    if (!extradata.empty() && extradata[0] != 0x00) {
+        extradata.clear();
+    }
+
+    MdatSource src;
+    src.file = fopen(path.c_str(), "rb");
+    if (!src.file) return false;
+    src.pos = mdat_start;
+    src.end = mdat_end;
+    src.pending = extradata;
+
+    const std::string tmp_path = path + kRecoveringSuffix;
+    const std::string tmp_index_path = index_path + kRecoveringSuffix;
+    const AVRational frame_tb = {1, V4L2_INPUT_FPS};
+    const AVRational out_tb = {1, 90000};
+
+    AVIOContext* avio = nullptr;
+    AVFormatContext* ifmt_ctx = nullptr;
+    AVFormatContext* ofmt_ctx = nullptr;
+    AVPacket* pkt = av_packet_alloc();
+    RecordingIndexWriter index;
+    bool ok = false;
+    int64_t frame_count = 0;
+    int64_t last_time_us = 0;
+    size_t keyframe_count = 0;
+    int ret = 0;
+
+    do {
+        uint8_t* io_buf = static_cast<uint8_t*>(av_malloc(kIoBufferSize));
+        if (!io_buf || !pkt) {
+            av_free(io_buf);
+            break;
+        }
+        avio = avio_alloc_context(io_buf, kIoBufferSize, 0, &src, read_mdat_annexb, nullptr, nullptr);
+        if (!avio) {
+            av_free(io_buf);
+            break;
+        }
+        ifmt_ctx = avformat_alloc_context();
+        if (!ifmt_ctx) break;
+        ifmt_ctx->pb = avio;
+
+        const AVInputFormat* fmt = nullptr;
+        if (has_index) {
+            fmt = av_find_input_format(old_header.codec_id == AV_CODEC_ID_HEVC ? "hevc" : "h264");
+        }
+        if ((ret = avformat_open_input(&ifmt_ctx, nullptr, fmt, nullptr)) < 0) {
+            print_err_recovery(ret, "avformat_open_input");
+            break; // 失败时 ifmt_ctx 已被释放
+        }
+        if ((ret = avformat_find_stream_info(ifmt_ctx, nullptr)) < 0 || ifmt_ctx->nb_streams == 0) {
+            print_err_recovery(ret, "avformat_find_stream_info");
+            break;
+        }
+        const AVStream* in_stream = ifmt_ctx->streams[0];
+
+        avformat_alloc_output_context2(&ofmt_ctx, nullptr, "mp4", tmp_path.c_str());
+        if (!ofmt_ctx) break;
+        AVStream* out_stream = avformat_new_stream(ofmt_ctx, nullptr);
+        if (!out_stream) break;
+        avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+        out_stream->codecpar->codec_tag = 0;
+        if (out_stream->codecpar->extradata_size == 0 && !extradata.empty()) {
+            out_stream->codecpar->extradata =
+                static_cast<uint8_t*>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (!out_stream->codecpar->extradata) break;
+            memcpy(out_stream->codecpar->extradata, extradata.data(), extradata.size());
+            out_stream->codecpar->extradata_size = static_cast<int>(extradata.size());
+        }
+        if (out_stream->codecpar->codec_id == AV_CODEC_ID_HEVC) {
+            out_stream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+        }
+        out_stream->time_base = out_tb;
+
+        if ((ret = avio_open(&ofmt_ctx->pb, tmp_path.c_str(), AVIO_FLAG_WRITE)) < 0) {
+            print_err_recovery(ret, "avio_open");
+            break;
+        }
+        if ((ret = avformat_write_header(ofmt_ctx, nullptr)) < 0) {
+            print_err_recovery(ret, "avformat_write_header");
+            break;
+        }
+        if (has_index) {
+            const AVCodecParameters* par = out_stream->codecpar;
+            index.open(tmp_index_path, par->width, par->height, par->codec_id, par->extradata, par->extradata_size,
+                       recording_index_time_scale(old_header));
+        }
+
+        // 原始码流没有时间戳：按帧率连续排列；关键帧的系统时间沿用原索引中的条目
+        const int64_t frame_us = static_cast<int64_t>(av_rescale_q(1, frame_tb, AVRational{1, 1000000}) *
+                                                      recording_index_time_scale(old_header));
+        int64_t key_time_us = old_header.start_us;
+        int64_t key_frame_index = 0;
+        ok = true;
+        while ((ret = av_read_frame(ifmt_ctx, pkt)) >= 0) {
+            if (m_stop_flag) {
+                ok = false;
+                av_packet_unref(pkt);
+                break;
+            }
+            const bool key = pkt->flags & AV_PKT_FLAG_KEY;
+            if (key) {
+                key_time_us = keyframe_count < old_entries.size()
+                                  ? old_entries[keyframe_count].time_us
+                                  : key_time_us + (frame_count - key_frame_index) * frame_us;
+                key_frame_index = frame_count;
+                keyframe_count++;
+            }
+            last_time_us = key_time_us + (frame_count - key_frame_index) * frame_us;
+
+            pkt->pts = pkt->dts = av_rescale_q(frame_count, frame_tb, out_tb);
+            pkt->duration = av_rescale_q(1, frame_tb, out_tb);
+            pkt->stream_index = out_stream->index;
+            pkt->pos = -1;
+            if (key) {
+                index.add_keyframe(key_time_us, avio_tell(ofmt_ctx->pb));
+            }
+            ret = av_write_frame(ofmt_ctx, pkt);
+            av_packet_unref(pkt);
+            if (ret < 0) {
+                print_err_recovery(ret, "av_write_frame");
+                ok = false;
+                break;
+            }
+            frame_count++;
+        }
+        if (ok && (ret = av_write_trailer(ofmt_ctx)) < 0) {
+            print_err_recovery(ret, "av_write_trailer");
+            ok = false;
+        }
+    } while (false);
+
+    // GPS 范围沿用原索引
+    if (old_header.min_lat != 0.0 || old_header.min_lon != 0.0) {
+        index.add_position(old_header.min_lat, old_header.min_lon);
+        index.add_position(old_header.max_lat, old_header.max_lon);
+    }
+    index.close(last_time_us);
+
+    if (ofmt_ctx) {
+        avio_closep(&ofmt_ctx->pb);
+        avformat_free_context(ofmt_ctx);
+    }
+    avformat_close_input(&ifmt_ctx);
+    if (avio) {
+        av_freep(&avio->buffer);
+        avio_context_free(&avio);
+    }
+    av_packet_free(&pkt);
+    fclose(src.file);
+
+    ok = ok && frame_count > 0;
+    if (ok && rename(tmp_path.c_str(), path.c_str()) == 0) {
+        if (has_index && rename(tmp_index_path.c_str(), index_path.c_str()) != 0) {
+            unlink(index_path.c_str());
+        }
+        printf("[录像恢复] 恢复完成: %s (%lld 帧, %zu 个关键帧)\n", path.c_str(), (long long)frame_count, keyframe_count);
+        return true;
+    }
+    unlink(tmp_path.c_str());
+    unlink(tmp_index_path.c_str());
+    return false;
+}
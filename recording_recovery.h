@@ -0,0 +1,54 @@
+// --- START OF FILE recording_recovery.h ---
+
+#ifndef RECORDING_RECOVERY_H
+#define RECORDING_RECOVERY_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+/**
+ * @class RecordingRecovery
+ * @brief 启动时恢复录像临时目录 (RECORDING_TEMP_PATH) 中因断电/崩溃而未正常结束的录像。
+ * 该目录在 tmpfs 上时 (默认配置) 重启后已为空，只有进程崩溃中断的录像能被恢复。
+ *
+ * MP4 的 moov (样本表) 只在录制结束时写出，中断的文件只有 ftyp 和 mdat，无法播放。
+ * mdat 中是按长度前缀排列的 H.264/HEVC NAL 单元，结合索引 (.idx) 中保存的
+ * 参数集 (SPS/PPS[/VPS]) 即可重建成 Annex B 码流，再按帧率重新复用成完整的 MP4，
+ * 同时重建关键帧索引。最后一个不完整的 NAL 被丢弃。
+ *
+ * - start() 只在调用线程中列出目录 (不读取文件内容)，恢复在后台线程中以最低 CPU/I/O
+ *   优先级进行，不拖慢相机启动；之后开始的新录制不在列表中。
+ * - 完整的文件 (例如移动前断电) 直接交出；恢复成功的文件与索引通过回调交给 FileManager 移动。
+ *   媒体文件已移走、只剩索引的 (两次移动之间断电)，索引也补交出去。
+ * - 无法恢复的文件改名为 xxx.mp4.damaged 保留，下次启动不再重试。
+ */
+class RecordingRecovery {
+public:
+    // 回调在后台线程中调用，参数为需要移动到存储目录的文件路径 (先媒体文件、后索引文件)
+    explicit RecordingRecovery(std::function<void(const std::string&)> hand_off_cb);
+    ~RecordingRecovery();
+
+    // 列出临时目录中的录像并启动后台恢复线程
+    void start();
+
+    // 请求停止并等待后台线程结束；正在恢复的文件保持原样，下次启动再处理
+    void stop();
+
+private:
+    void worker_thread_func();
+    void process_file(const std::string& path);
+    void process_orphan_index(const std::string& index_path);
+    bool rebuild_file(const std::string& path, const std::string& index_path, int64_t mdat_start, int64_t mdat_end);
+    void hand_off(const std::string& media_path, const std::string& index_path);
+
+    std::function<void(const std::string&)> m_hand_off_cb;
+    std::vector<std::string> m_pending;
+    std::thread m_worker_thread;
+    std::atomic<bool> m_stop_flag{false};
+};
+
+#endif // RECORDING_RECOVERY_H
@@ -0,0 +1,173 @@
+// --- START OF FILE rtp_packetizer.cpp ---
+
+#include "rtp_packetizer.h"
+#include "app_config.h"
+
+#include <atomic>
+#include <cstring>
+
+static const size_t kRtpHeaderSize = 12;
+
+bool next_annexb_nal(const uint8_t* data, size_t size, size_t& pos, const uint8_t*& nal, size_t& nal_size)
+{
+    // 跳到下一个起始码 00 00 01 (4 字节的起始码同样以它结尾)
+    while (pos + 3 <= size && !(data[pos] == 0x00 && data[pos + 1] == 0x00 && data[pos + 2] == 0x01)) {
+        pos++;
+    }
+    if (pos + 3 > size) {
+        pos = size;
+        return false;
+    }
+    const size_t start = pos + 3;
+    size_t end = start;
+    while (end + 3 <= size && !(data[end] == 0x00 && data[end + 1] == 0x00 &&
+                                (data[end + 2] == 0x01 || (data[end + 2] == 0x00 && end + 3 < size && data[end + 3] == 0x01)))) {
+        end++;
+    }
+    if (end + 3 > size) end = size;
+    pos = end;
+    nal = data + start;
+    nal_size = end - start;
+    return nal_size > 0;
+}
+
+RtpPacketizer::RtpPacketizer(AVCodecID codec_id, uint32_t ssrc, int payload_type)
+    : m_codec_id(codec_id),
+      m_ssrc(ssrc),
+      m_payload_type(payload_type),
+      m_seq(static_cast<uint16_t>(ssrc >> 16))
+{
+}
+
+void RtpPacketizer::set_parameter_sets(const uint8_t* extradata, int size)
+{
+    if (extradata && size > 0) {
+        m_parameter_sets.assign(extradata, extradata + size);
+    } else {
+        m_parameter_sets.clear();
+    }
+}
+
+std::shared_ptr<RtpFrame> RtpPacketizer::acquire_frame()
+{
+    for (auto& frame : m_frames) {
+        if (frame.use_count() == 1) {
+            // 最后一个客户端释放引用之前的读取对本线程可见
+            std::atomic_thread_fence(std::memory_order_acquire);
+            frame->data.clear();
+            frame->packets.clear();
+            return frame;
+        }
+    }
+    auto frame = std::make_shared<RtpFrame>();
+    if (m_frames.size() < RTP_FRAME_POOL_SIZE) {
+        m_frames.push_back(frame);
+    }
+    return frame;
+}
+
+bool RtpPacketizer::has_parameter_sets(const uint8_t* data, size_t size) const
+{
+    size_t pos = 0;
+    const uint8_t* nal = nullptr;
+    size_t nal_size = 0;
+    while (next_annexb_nal(data, size, pos, nal, nal_size)) {
+        const int type = (m_codec_id == AV_CODEC_ID_HEVC) ? ((nal[0] >> 1) & 0x3F) : (nal[0] & 0x1F);
+        if ((m_codec_id == AV_CODEC_ID_HEVC && type == 33) || (m_codec_id != AV_CODEC_ID_HEVC && type == 7)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+RtpFramePtr RtpPacketizer::packetize(const uint8_t* data, size_t size, uint32_t timestamp, bool keyframe,
+                                     const std::vector<uint8_t>* prefix)
+{
+    std::shared_ptr<RtpFrame> frame = acquire_frame();
+    frame->timestamp = timestamp;
+    frame->keyframe = keyframe;
+    m_timestamp = timestamp;
+
+    if (keyframe && !m_parameter_sets.empty() && !has_parameter_sets(data, size)) {
+        add_annexb(*frame, m_parameter_sets.data(), m_parameter_sets.size());
+    }
+    if (prefix && !prefix->empty()) {
+        add_annexb(*frame, prefix->data(), prefix->size());
+    }
+    add_annexb(*frame, data, size);
+
+    if (!frame->packets.empty()) {
+        // 一帧的最后一个包置 marker 位
+        frame->data[frame->packets.back().offset + 1] |= 0x80;
+    }
+    return frame;
+}
+
+void RtpPacketizer::add_annexb(RtpFrame& frame, const uint8_t* data, size_t size)
+{
+    size_t pos = 0;
+    const uint8_t* nal = nullptr;
+    size_t nal_size = 0;
+    while (next_annexb_nal(data, size, pos, nal, nal_size)) {
+        add_nal(frame, nal, nal_size);
+    }
+}
+
+uint8_t* RtpPacketizer::begin_packet(RtpFrame& frame, size_t payload_size)
+{
+    const size_t offset = frame.data.size();
+    frame.data.resize(offset + kRtpHeaderSize + payload_size);
+    frame.packets.push_back({static_cast<uint32_t>(offset), static_cast<uint16_t>(kRtpHeaderSize + payload_size)});
+
+    uint8_t* p = frame.data.data() + offset;
+    p[0] = 0x80; // V=2
+    p[1] = static_cast<uint8_t>(m_payload_type & 0x7F);
+    p[2] = static_cast<uint8_t>(m_seq >> 8);
+    p[3] = static_cast<uint8_t>(m_seq);
+    p[4] = static_cast<uint8_t>(m_timestamp >> 24);
+    p[5] = static_cast<uint8_t>(m_timestamp >> 16);
+    p[6] = static_cast<uint8_t>(m_timestamp >> 8);
+    p[7] = static_cast<uint8_t>(m_timestamp);
+    p[8] = static_cast<uint8_t>(m_ssrc >> 24);
+    p[9] = static_cast<uint8_t>(m_ssrc >> 16);
+    p[10] = static_cast<uint8_t>(m_ssrc >> 8);
+    p[11] = static_cast<uint8_t>(m_ssrc);
+    m_seq++;
+    return p + kRtpHeaderSize;
+}
+
+void RtpPacketizer::add_nal(RtpFrame& frame, const uint8_t* nal, size_t size)
+{
+    if (size <= RTP_MAX_PAYLOAD) {
+        memcpy(begin_packet(frame, size), nal, size);
+        return;
+    }
+
+    // 分片：H.264 FU-A (2 字节头)，HEVC FU (3 字节头)；原 NAL 头不发送，由分片头还原
+    const bool hevc = (m_codec_id == AV_CODEC_ID_HEVC);
+    const size_t nal_header_size = hevc ? 2 : 1;
+    const size_t fu_header_size = hevc ? 3 : 2;
+    const size_t max_chunk = RTP_MAX_PAYLOAD - fu_header_size;
+
+    const uint8_t* payload = nal + nal_header_size;
+    size_t remaining = size - nal_header_size;
+    bool first = true;
+    while (remaining > 0) {
+        const size_t chunk = remaining < max_chunk ? remaining : max_chunk;
+        const bool last = (chunk == remaining);
+        uint8_t* p = begin_packet(frame, fu_header_size + chunk);
+        const uint8_t se = (first ? 0x80 : 0x00) | (last ? 0x40 : 0x00);
+        if (hevc) {
+            p[0] = static_cast<uint8_t>((nal[0] & 0x81) | (49 << 1));
+            p[1] = nal[1];
+            p[2] = static_cast<uint8_t>(se | ((nal[0] >> 1) & 0x3F));
+        } else {
+            p[0] = static_cast<uint8_t>((nal[0] & 0xE0) | 28);
+            p[1] = static_cast<uint8_t>(se | (nal[0] & 0x1F));
+        }
+        memcpy(p + fu_header_size, payload, chunk);
+        payload += chunk;
+        remaining -= chunk;
+        first = false;
+    }
+}
@@ -0,0 +1,92 @@
+// --- START OF FILE rtp_packetizer.h ---
+
+#ifndef RTP_PACKETIZER_H
+#define RTP_PACKETIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+/**
+ * @brief 一个 RTP 包在 RtpFrame::data 中的位置。
+ */
+struct RtpSlice
+{
+    uint32_t offset;
+    uint16_t size;
+};
+
+/**
+ * @brief 一帧 (一个编码数据包) 打包成的全部 RTP 包，连续存放在同一块缓冲区中。
+ * 打包一次后以只读的 shared_ptr 分发给所有客户端，各客户端直接从这块缓冲区发送。
+ */
+struct RtpFrame
+{
+    std::vector<uint8_t> data;
+    std::vector<RtpSlice> packets;
+    uint32_t timestamp = 0;  // 90 kHz
+    bool keyframe = false;
+};
+
+using RtpFramePtr = std::shared_ptr<const RtpFrame>;
+
+/**
+ * @brief 在 Annex B 码流中查找下一个 NAL 单元 (不含起始码)。
+ * @param pos 输入为搜索起点，返回时指向该 NAL 之后。
+ * @return 没有更多 NAL 时返回 false。
+ */
+bool next_annexb_nal(const uint8_t* data, size_t size, size_t& pos, const uint8_t*& nal, size_t& nal_size);
+
+/**
+ * @class RtpPacketizer
+ * @brief 把 H.264 (RFC 6184) / HEVC (RFC 7798) 的 Annex B 数据包打包成 RTP 包。
+ *
+ * - 不超过 RTP_MAX_PAYLOAD 的 NAL 单独成包，更大的按 FU-A / FU 分片；一帧的最后一个包置 marker 位。
+ * - 关键帧本身不带参数集时，先发送 extradata 中的 SPS/PPS[/VPS]，中途加入的客户端无需依赖 SDP。
+ * - 所有客户端共享同一个 SSRC 和序号空间，打包结果可以原样发给每个客户端。
+ *
+ * 非线程安全：只在发送线程中使用。
+ */
+class RtpPacketizer
+{
+public:
+    RtpPacketizer(AVCodecID codec_id, uint32_t ssrc, int payload_type);
+
+    // 编码器的 extradata (Annex B 参数集)
+    void set_parameter_sets(const uint8_t* extradata, int size);
+
+    /**
+     * @brief 打包一帧。
+     * @param prefix 可选：放在帧数据之前的额外 NAL (Annex B，例如 SEI)。
+     * @return 打包结果；缓冲区在所有客户端发送完 (释放引用) 后复用。
+     */
+    RtpFramePtr packetize(const uint8_t* data, size_t size, uint32_t timestamp, bool keyframe,
+                          const std::vector<uint8_t>* prefix = nullptr);
+
+    uint16_t next_sequence() const { return m_seq; }
+    uint32_t ssrc() const { return m_ssrc; }
+
+private:
+    std::shared_ptr<RtpFrame> acquire_frame();
+    void add_annexb(RtpFrame& frame, const uint8_t* data, size_t size);
+    void add_nal(RtpFrame& frame, const uint8_t* nal, size_t size);
+    uint8_t* begin_packet(RtpFrame& frame, size_t payload_size);
+    bool has_parameter_sets(const uint8_t* data, size_t size) const;
+
+    AVCodecID m_codec_id;
+    uint32_t m_ssrc;
+    int m_payload_type;
+    uint16_t m_seq;
+    uint32_t m_timestamp = 0;
+    std::vector<uint8_t> m_parameter_sets;
+    // 复用的帧缓冲区：只有本对象持有 (客户端都已发送完) 的才会被取出复用
+    std::vector<std::shared_ptr<RtpFrame>> m_frames;
+};
+
+#endif // RTP_PACKETIZER_H
@@ -0,0 +1,147 @@
+// --- START OF FILE rtp_udp_sender.cpp ---
+
+#include "rtp_udp_sender.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <netinet/udp.h>
+#include <sys/uio.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// 单次 sendmmsg 的报文数上限 (内核限制为 UIO_MAXIOV)
+static const size_t kMaxBatch = 1024;
+// 一个 GSO 报文的负载上限 (IPv4 UDP 报文长度上限)
+static const size_t kMaxGsoBytes = 65507;
+
+RtpUdpSender::RtpUdpSender(UdpSendMode mode) : m_mode(mode) {}
+
+size_t RtpUdpSender::send_frame(int fd, const sockaddr_in& addr, const RtpFrame& frame)
+{
+    if (frame.packets.empty()) {
+        return 0;
+    }
+    if (m_mode == UdpSendMode::PerPacket) {
+        return send_per_packet(fd, addr, frame, 0);
+    }
+    return send_batched(fd, addr, frame, 0);
+}
+
+size_t RtpUdpSender::send_per_packet(int fd, const sockaddr_in& addr, const RtpFrame& frame, size_t first)
+{
+    size_t sent = 0;
+    for (size_t i = first; i < frame.packets.size(); ++i) {
+        const RtpSlice& s = frame.packets[i];
+        m_syscalls++;
+        ssize_t n = sendto(fd, frame.data.data() + s.offset, s.size, MSG_DONTWAIT,
+                           reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+        if (n < 0) {
+            break;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+size_t RtpUdpSender::build_messages(const sockaddr_in& addr, const RtpFrame& frame, size_t first)
+{
+    const std::vector<RtpSlice>& pk = frame.packets;
+    const bool gso = (m_mode == UdpSendMode::BatchedGso);
+    // 容量只增不减，之后的帧不再分配
+    const size_t max_msgs = pk.size() - first;
+    if (m_msgs.size() < max_msgs) {
+        m_msgs.resize(max_msgs);
+        m_iovs.resize(max_msgs);
+        m_controls.resize(max_msgs);
+        m_msg_packets.resize(max_msgs);
+    }
+
+    size_t count = 0;
+    size_t i = first;
+    while (i < pk.size()) {
+        // GSO 要求除最后一个外所有分段等长，且在缓冲区中连续
+        const uint16_t seg = pk[i].size;
+        size_t n = 1;
+        size_t bytes = seg;
+        while (gso && i + n < pk.size() && n < RTP_UDP_GSO_MAX_SEGMENTS) {
+            const RtpSlice& prev = pk[i + n - 1];
+            const RtpSlice& next = pk[i + n];
+            if (prev.size != seg || next.size > seg || next.offset != prev.offset + prev.size ||
+                bytes + next.size > kMaxGsoBytes) {
+                break;
+            }
+            bytes += next.size;
+            n++;
+        }
+
+        mmsghdr& m = m_msgs[count];
+        memset(&m, 0, sizeof(m));
+        m_iovs[count].iov_base = const_cast<uint8_t*>(frame.data.data() + pk[i].offset);
+        m_iovs[count].iov_len = bytes;
+        m.msg_hdr.msg_name = const_cast<sockaddr_in*>(&addr);
+        m.msg_hdr.msg_namelen = sizeof(addr);
+        m.msg_hdr.msg_iov = &m_iovs[count];
+        m.msg_hdr.msg_iovlen = 1;
+        if (n > 1) {
+            GsoControl& ctl = m_controls[count];
+            memset(&ctl, 0, sizeof(ctl));
+            m.msg_hdr.msg_control = ctl.buf;
+            m.msg_hdr.msg_controllen = sizeof(ctl.buf);
+            cmsghdr* cm = CMSG_FIRSTHDR(&m.msg_hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cm), &seg, sizeof(seg));
+        }
+        m_msg_packets[count] = n;
+        count++;
+        i += n;
+    }
+    return count;
+}
+
+size_t RtpUdpSender::send_batched(int fd, const sockaddr_in& addr, const RtpFrame& frame, size_t first)
+{
+    const size_t msg_count = build_messages(addr, frame, first);
+    size_t sent_msgs = 0;
+    size_t sent_packets = 0;
+    while (sent_msgs < msg_count) {
+        const size_t batch = std::min(msg_count - sent_msgs, kMaxBatch);
+        m_syscalls++;
+        int r = sendmmsg(fd, &m_msgs[sent_msgs], static_cast<unsigned>(batch), MSG_DONTWAIT);
+        if (r > 0) {
+            for (int k = 0; k < r; ++k) {
+                sent_packets += m_msg_packets[sent_msgs + k];
+            }
+            sent_msgs += static_cast<size_t>(r);
+            continue;
+        }
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        const int err = (r < 0) ? errno : EAGAIN;
+        if (err == ENOSYS) {
+            fprintf(stderr, "[RTP发送] sendmmsg 不可用，改为逐包发送。\n");
+            m_mode = UdpSendMode::PerPacket;
+            return sent_packets + send_per_packet(fd, addr, frame, first + sent_packets);
+        }
+        // 内核不支持 UDP_SEGMENT (EINVAL/ENOPROTOOPT)，或出口网卡不支持校验和卸载 (EIO)
+        if (m_mode == UdpSendMode::BatchedGso && m_msg_packets[sent_msgs] > 1 &&
+            (err == EIO || err == EINVAL || err == ENOPROTOOPT || err == EOPNOTSUPP)) {
+            fprintf(stderr, "[RTP发送] UDP GSO 不可用 (%s)，改为只用 sendmmsg。\n", strerror(err));
+            m_mode = UdpSendMode::Batched;
+            return sent_packets + send_batched(fd, addr, frame, first + sent_packets);
+        }
+        // 发送缓冲区满：这一帧剩余的包丢弃
+        break;
+    }
+    return sent_packets;
+}
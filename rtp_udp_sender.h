@@ -0,0 +1,74 @@
+// --- START OF FILE rtp_udp_sender.h ---
+
+#ifndef RTP_UDP_SENDER_H
+#define RTP_UDP_SENDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "app_config.h"
+#include "rtp_packetizer.h"
+
+// RTP over UDP 的发送方式 (取值与 RTP_UDP_SEND_MODE 相同)
+enum class UdpSendMode
+{
+    PerPacket = 0,    // 每个 RTP 包一次 sendto
+    Batched = 1,      // 每帧一次 sendmmsg
+    BatchedGso = 2,   // sendmmsg，且连续等长的包合并为一个 UDP GSO 报文
+};
+
+/**
+ * @class RtpUdpSender
+ * @brief 按帧批量发送 RTP over UDP，减少高码率下的系统调用次数。
+ *
+ * - 一帧的全部 RTP 包在一次 sendmmsg 中发出 (打包结果在同一块缓冲区中，直接引用，不复制)。
+ * - GSO 方式下，FU 分片产生的连续等长包合并成一个带 UDP_SEGMENT 的报文，由内核 (或网卡) 切分，
+ *   协议栈对整组只走一遍。每组最多 RTP_UDP_GSO_MAX_SEGMENTS 个包。
+ * - 内核或出口网卡不支持 GSO 时退回只用 sendmmsg；sendmmsg 不可用时退回逐包 sendto。
+ *   退回只发生一次，之后一直使用较低的方式。
+ *
+ * 非线程安全：每个发送线程使用自己的实例；内部数组重复使用，稳态下发送不分配内存。
+ */
+class RtpUdpSender
+{
+public:
+    explicit RtpUdpSender(UdpSendMode mode = static_cast<UdpSendMode>(RTP_UDP_SEND_MODE));
+
+    /**
+     * @brief 把一帧的全部 RTP 包发到 addr (非阻塞)。
+     * @return 完整发出的包个数；发送缓冲区满或出错时小于 frame.packets.size()，其余的包被丢弃。
+     */
+    size_t send_frame(int fd, const sockaddr_in& addr, const RtpFrame& frame);
+
+    UdpSendMode mode() const { return m_mode; }
+
+    // 累计的发送系统调用次数 (用于性能对比)
+    uint64_t get_syscall_count() const { return m_syscalls; }
+
+private:
+    size_t send_per_packet(int fd, const sockaddr_in& addr, const RtpFrame& frame, size_t first);
+    size_t send_batched(int fd, const sockaddr_in& addr, const RtpFrame& frame, size_t first);
+    size_t build_messages(const sockaddr_in& addr, const RtpFrame& frame, size_t first);
+
+    struct GsoControl
+    {
+        union {
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            cmsghdr align;
+        };
+    };
+
+    UdpSendMode m_mode;
+    uint64_t m_syscalls = 0;
+
+    std::vector<mmsghdr> m_msgs;
+    std::vector<iovec> m_iovs;
+    std::vector<GsoControl> m_controls;
+    std::vector<size_t> m_msg_packets;   // 每个报文包含的 RTP 包个数
+};
+
+#endif // RTP_UDP_SENDER_H
@@ -0,0 +1,779 @@
+// --- START OF FILE rtsp_server.cpp ---
+
+#include "rtsp_server.h"
+#include "app_config.h"
+#include "h26x_sei.h"
+#include "telemetry_track.h"
+#include "latency_stamp.h"
+#include "alloc_counter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <strings.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavutil/base64.h>
+#include <libavutil/mathematics.h>
+}
+
+static const int kRtpPayloadType = 96;
+static const size_t kMaxRequestSize = 8192;
+// 发送缓冲区中积压的字节上限 (RTP 包剩余部分加上未发出的应答)，超过时断开客户端
+static const size_t kMaxPendingBytes = 128 * 1024;
+
+static int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 取请求头中某一字段的值 (字段名不区分大小写)，不存在时返回空串
+static std::string header_value(const std::string& request, const char* name)
+{
+    const size_t name_len = strlen(name);
+    size_t pos = request.find("\r\n");
+    while (pos != std::string::npos) {
+        pos += 2;
+        const size_t end = request.find("\r\n", pos);
+        if (end == std::string::npos || end == pos) break;
+        if (end - pos > name_len && request[pos + name_len] == ':' &&
+            strncasecmp(request.c_str() + pos, name, name_len) == 0) {
+            size_t v = pos + name_len + 1;
+            while (v < end && request[v] == ' ') v++;
+            return request.substr(v, end - v);
+        }
+        pos = end;
+    }
+    return std::string();
+}
+
+// 解析 Content-Length：没有该头时为 0；只接受十进制数字 (负数、溢出、尾随字符都视为无效)
+static bool parse_content_length(const std::string& value, size_t* len)
+{
+    *len = 0;
+    if (value.empty()) return true;
+    if (value[0] < '0' || value[0] > '9') return false;
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long v = strtoul(value.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') return false;
+    *len = static_cast<size_t>(v);
+    return true;
+}
+
+static std::string base64(const uint8_t* data, size_t size)
+{
+    std::string out(AV_BASE64_SIZE(size), '\0');
+    if (!av_base64_encode(&out[0], static_cast<int>(out.size()), data, static_cast<int>(size))) {
+        return std::string();
+    }
+    out.resize(strlen(out.c_str()));
+    return out;
+}
+
+RtspServer::RtspServer() {}
+
+RtspServer::~RtspServer()
+{
+    if (m_is_running) {
+        stop();
+    }
+    if (m_pipeline) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+    }
+    if (m_control_thread.joinable()) {
+        m_control_thread.join();
+    }
+    close_sockets();
+}
+
+bool RtspServer::prepare(int port, VideoCodec codec)
+{
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "[RTSP服务器] 错误: 无效的端口 %d\n", port);
+        return false;
+    }
+    m_port = port;
+    // 与 RtspStreamer 使用相同的编码参数，同时推流和提供服务时共享一条编码链
+    m_profile.width = RTSP_OUTPUT_WIDTH;
+    m_profile.height = RTSP_OUTPUT_HEIGHT;
+    m_profile.rate_control.bit_rate = (codec == VideoCodec::HEVC) ? RTSP_HEVC_BITRATE : RTSP_BITRATE;
+    m_profile.rate_control.gop_size = RTSP_GOP_SIZE;
+    m_profile.encoder_name = video_codec_encoder_candidates(codec);
+    m_profile.use_case = EncodeUseCase::LowLatency;
+    m_profile.burn_in_osd = m_burn_in_osd;
+    m_profile.intra_refresh = m_intra_refresh;
+    return true;
+}
+
+bool RtspServer::attach_pipeline(std::shared_ptr<EncodePipeline> pipeline)
+{
+    if (!pipeline) {
+        return false;
+    }
+    int idx = pipeline->find_compatible_output(m_profile);
+    if (idx < 0 || !pipeline->register_consumer(&m_queue_packets, static_cast<size_t>(idx))) {
+        return false;
+    }
+    m_output_index = static_cast<size_t>(idx);
+    m_pipeline = std::move(pipeline);
+    return true;
+}
+
+bool RtspServer::request_keyframe()
+{
+    if (!m_pipeline) {
+        return false;
+    }
+    m_pipeline->request_keyframe(m_output_index);
+    return true;
+}
+
+void RtspServer::handle_keyframe_request()
+{
+    if (!m_keyframe_wanted) {
+        return;
+    }
+    // 限频：多个客户端同时加入或持续丢帧时，不让 IDR 连续出现把码率推高
+    const int64_t now = now_us();
+    if (m_last_keyframe_request_us != 0 &&
+        now - m_last_keyframe_request_us < static_cast<int64_t>(RTSP_KEYFRAME_REQUEST_MIN_MS) * 1000) {
+        return;
+    }
+    m_keyframe_wanted = false;
+    m_last_keyframe_request_us = now;
+    m_pipeline->request_keyframe(m_output_index);
+}
+
+bool RtspServer::set_rate_control(const RateControl& rc)
+{
+    if (!m_pipeline) {
+        return false;
+    }
+    return m_pipeline->set_rate_control(m_output_index, rc);
+}
+
+void RtspServer::stop()
+{
+    fprintf(stderr, "[RTSP服务器] 收到停止信号...\n");
+    m_stop_flag = true;
+    if (m_pipeline) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+    } else {
+        m_queue_packets.stop();
+    }
+}
+
+size_t RtspServer::get_client_count() const
+{
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    return m_clients.size();
+}
+
+bool RtspServer::open_sockets()
+{
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0) {
+        fprintf(stderr, "[RTSP服务器] 错误: 创建监听套接字失败: %s\n", strerror(errno));
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(m_port));
+    if (bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(m_listen_fd, RTSP_SERVER_MAX_CLIENTS) < 0 || !set_nonblocking(m_listen_fd)) {
+        fprintf(stderr, "[RTSP服务器] 错误: 监听端口 %d 失败: %s\n", m_port, strerror(errno));
+        return false;
+    }
+
+    // RTP/RTCP over UDP：所有客户端共用一对套接字，端口由系统分配
+    int* udp_fds[2] = {&m_rtp_fd, &m_rtcp_fd};
+    uint16_t* udp_ports[2] = {&m_rtp_port, &m_rtcp_port};
+    for (int i = 0; i < 2; ++i) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        *udp_fds[i] = fd;
+        sockaddr_in udp_addr{};
+        udp_addr.sin_family = AF_INET;
+        udp_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        socklen_t len = sizeof(udp_addr);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&udp_addr), sizeof(udp_addr)) < 0 ||
+            getsockname(fd, reinterpret_cast<sockaddr*>(&udp_addr), &len) < 0 || !set_nonblocking(fd)) {
+            fprintf(stderr, "[RTSP服务器] 错误: 创建 UDP 套接字失败: %s\n", strerror(errno));
+            return false;
+        }
+        *udp_ports[i] = ntohs(udp_addr.sin_port);
+    }
+    int sndbuf = RTSP_SERVER_UDP_SNDBUF;
+    setsockopt(m_rtp_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    return true;
+}
+
+void RtspServer::close_sockets()
+{
+    int* fds[3] = {&m_listen_fd, &m_rtp_fd, &m_rtcp_fd};
+    for (int* fd : fds) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void RtspServer::control_thread_func()
+{
+    std::vector<pollfd> fds;
+    while (!m_stop_flag) {
+        fds.clear();
+        fds.push_back({m_listen_fd, POLLIN, 0});
+        fds.push_back({m_rtp_fd, POLLIN, 0});
+        fds.push_back({m_rtcp_fd, POLLIN, 0});
+        {
+            // 客户端只在本线程中增删，poll 期间列表顺序不变
+            std::lock_guard<std::mutex> lock(m_clients_mutex);
+            for (const auto& c : m_clients) {
+                // 有积压的字节时同时等待可写，应答不依赖 RTP 帧推动发送
+                fds.push_back({c->fd, static_cast<short>(POLLIN | (c->pending.empty() ? 0 : POLLOUT)), 0});
+            }
+        }
+
+        int n = poll(fds.data(), fds.size(), 200);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "[RTSP服务器] 错误: poll 失败: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) accept_client();
+        if (fds[1].revents & POLLIN) drain_rtcp(m_rtp_fd);
+        if (fds[2].revents & POLLIN) drain_rtcp(m_rtcp_fd);
+
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        for (size_t i = 3; i < fds.size(); ++i) {
+            if (!fds[i].revents) continue;
+            Client& c = *m_clients[i - 3];
+            if (fds[i].revents & POLLOUT) {
+                flush_pending(c);
+            }
+            if ((fds[i].revents & ~POLLOUT) && !read_client(c)) {
+                c.closing = true;
+            }
+        }
+        expire_clients();
+    }
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    for (auto& c : m_clients) {
+        close(c->fd);
+    }
+    m_clients.clear();
+    m_playing_count = 0;
+}
+
+void RtspServer::accept_client()
+{
+    sockaddr_in peer{};
+    socklen_t len = sizeof(peer);
+    int fd = accept(m_listen_fd, reinterpret_cast<sockaddr*>(&peer), &len);
+    if (fd < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    if (m_clients.size() >= RTSP_SERVER_MAX_CLIENTS) {
+        fprintf(stderr, "[RTSP服务器] 客户端数已达上限 (%d)，拒绝 %s\n", RTSP_SERVER_MAX_CLIENTS,
+                inet_ntoa(peer.sin_addr));
+        close(fd);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    set_nonblocking(fd);
+
+    std::unique_ptr<Client> c(new Client());
+    c->fd = fd;
+    c->last_activity_us = now_us();
+    m_clients.push_back(std::move(c));
+    fprintf(stderr, "[RTSP服务器] 客户端 %s:%d 已连接\n", inet_ntoa(peer.sin_addr), ntohs(peer.sin_port));
+}
+
+bool RtspServer::read_client(Client& c)
+{
+    char buf[2048];
+    for (;;) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        c.recv_buf.append(buf, static_cast<size_t>(n));
+        c.last_activity_us = now_us();
+    }
+
+    while (!c.recv_buf.empty()) {
+        // TCP 方式下客户端发来的 RTCP 包 ($ 通道 长度 数据)，只用于保活
+        if (c.recv_buf[0] == '$') {
+            if (c.recv_buf.size() < 4) break;
+            const size_t len = (static_cast<uint8_t>(c.recv_buf[2]) << 8) | static_cast<uint8_t>(c.recv_buf[3]);
+            if (c.recv_buf.size() < 4 + len) break;
+            c.recv_buf.erase(0, 4 + len);
+            continue;
+        }
+
+        const size_t end = c.recv_buf.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (c.recv_buf.size() > kMaxRequestSize) return false;
+            break;
+        }
+        const size_t header_len = end + 4;
+        const std::string request = c.recv_buf.substr(0, header_len);
+        // 正文长度由对端给出，先校验再等待正文，否则一个很大的长度就能让接收缓冲区无限增长
+        size_t content_len = 0;
+        if (!parse_content_length(header_value(request, "Content-Length"), &content_len)) {
+            send_response(c, atoi(header_value(request, "CSeq").c_str()), 400, "Bad Request");
+            return false;
+        }
+        if (header_len > kMaxRequestSize || content_len > kMaxRequestSize - header_len) {
+            send_response(c, atoi(header_value(request, "CSeq").c_str()), 413, "Request Entity Too Large");
+            return false;
+        }
+        if (c.recv_buf.size() < header_len + content_len) break;
+        c.recv_buf.erase(0, header_len + content_len);
+        if (!handle_request(c, request)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RtspServer::handle_request(Client& c, const std::string& request)
+{
+    char method[32] = {0};
+    char url[512] = {0};
+    if (sscanf(request.c_str(), "%31s %511s", method, url) != 2) {
+        send_response(c, 0, 400, "Bad Request");
+        return false;
+    }
+    const int cseq = atoi(header_value(request, "CSeq").c_str());
+    const std::string session_header = c.session.empty() ? std::string() :
+        "Session: " + c.session + ";timeout=" + std::to_string(RTSP_SERVER_SESSION_TIMEOUT) + "\r\n";
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        send_response(c, cseq, 200, "OK",
+                      "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER\r\n");
+    } else if (strcmp(method, "DESCRIBE") == 0) {
+        std::string base = url;
+        if (base.empty() || base.back() != '/') base += '/';
+        send_response(c, cseq, 200, "OK",
+                      "Content-Base: " + base + "\r\nContent-Type: application/sdp\r\n", build_sdp(c));
+    } else if (strcmp(method, "SETUP") == 0) {
+        const std::string transport = header_value(request, "Transport");
+        char reply[256];
+        if (transport.find("RTP/AVP/TCP") != std::string::npos) {
+            int a = 0, b = 1;
+            size_t p = transport.find("interleaved=");
+            if (p != std::string::npos) {
+                sscanf(transport.c_str() + p, "interleaved=%d-%d", &a, &b);
+            }
+            c.tcp = true;
+            c.rtp_channel = a;
+            c.rtcp_channel = b;
+            snprintf(reply, sizeof(reply), "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08X\r\n",
+                     a, b, m_packetizer->ssrc());
+        } else {
+            int a = 0, b = 0;
+            size_t p = transport.find("client_port=");
+            if (p == std::string::npos || sscanf(transport.c_str() + p, "client_port=%d-%d", &a, &b) < 1) {
+                send_response(c, cseq, 461, "Unsupported Transport");
+                return true;
+            }
+            if (b == 0) b = a + 1;
+            sockaddr_in peer{};
+            socklen_t len = sizeof(peer);
+            getpeername(c.fd, reinterpret_cast<sockaddr*>(&peer), &len);
+            c.tcp = false;
+            c.rtp_addr = peer;
+            c.rtp_addr.sin_port = htons(static_cast<uint16_t>(a));
+            c.rtcp_addr = peer;
+            c.rtcp_addr.sin_port = htons(static_cast<uint16_t>(b));
+            snprintf(reply, sizeof(reply),
+                     "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%u-%u;ssrc=%08X\r\n",
+                     a, b, m_rtp_port, m_rtcp_port, m_packetizer->ssrc());
+        }
+        if (c.session.empty()) {
+            static std::mt19937 rng(std::random_device{}());
+            char id[17];
+            snprintf(id, sizeof(id), "%08X%08X", static_cast<unsigned>(rng()), static_cast<unsigned>(rng()));
+            c.session = id;
+        }
+        c.setup = true;
+        send_response(c, cseq, 200, "OK", std::string(reply) + "Session: " + c.session + ";timeout=" +
+                      std::to_string(RTSP_SERVER_SESSION_TIMEOUT) + "\r\n");
+    } else if (strcmp(method, "PLAY") == 0) {
+        if (!c.setup) {
+            send_response(c, cseq, 455, "Method Not Valid in This State");
+            return true;
+        }
+        if (!c.playing) {
+            c.playing = true;
+            c.wait_keyframe = true;
+            m_keyframe_wanted = true;
+            m_playing_count++;
+            fprintf(stderr, "[RTSP服务器] 客户端开始播放 (%s)，当前 %zu 个播放中\n",
+                    c.tcp ? "TCP" : "UDP", m_playing_count.load());
+        }
+        send_response(c, cseq, 200, "OK", session_header + "Range: npt=0.000-\r\n");
+    } else if (strcmp(method, "PAUSE") == 0) {
+        if (c.playing) {
+            c.playing = false;
+            m_playing_count--;
+        }
+        send_response(c, cseq, 200, "OK", session_header);
+    } else if (strcmp(method, "TEARDOWN") == 0) {
+        send_response(c, cseq, 200, "OK", session_header);
+        return false;
+    } else if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0) {
+        send_response(c, cseq, 200, "OK", session_header);
+    } else {
+        send_response(c, cseq, 501, "Not Implemented");
+    }
+    return true;
+}
+
+void RtspServer::send_response(Client& c, int cseq, int code, const char* reason,
+                               const std::string& headers, const std::string& body)
+{
+    char status[128];
+    snprintf(status, sizeof(status), "RTSP/1.0 %d %s\r\nCSeq: %d\r\nServer: camera_sdk\r\n", code, reason, cseq);
+    std::string response = status;
+    response += headers;
+    if (!body.empty()) {
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    response += "\r\n";
+    response += body;
+    // 在持有 m_clients_mutex 时不能阻塞等待对端：应答追加到积压字节之后 (不会插在半个 RTP 包中间)，
+    // 能发多少发多少，剩余的由控制线程在可写时继续发送
+    if (c.pending.size() + response.size() > kMaxPendingBytes) {
+        fprintf(stderr, "[RTSP服务器] 客户端积压 %zu 字节未读取，断开\n", c.pending.size());
+        c.closing = true;
+        return;
+    }
+    c.pending.insert(c.pending.end(), response.begin(), response.end());
+    flush_pending(c);
+}
+
+bool RtspServer::flush_pending(Client& c)
+{
+    if (c.pending.empty()) {
+        return true;
+    }
+    ssize_t n = send(c.fd, c.pending.data(), c.pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) c.closing = true;
+        return false;
+    }
+    c.pending.erase(c.pending.begin(), c.pending.begin() + n);
+    return c.pending.empty();
+}
+
+std::string RtspServer::build_sdp(const Client& c) const
+{
+    sockaddr_in local{};
+    socklen_t len = sizeof(local);
+    getsockname(c.fd, reinterpret_cast<sockaddr*>(&local), &len);
+
+    std::string sdp;
+    sdp += "v=0\r\n";
+    sdp += "o=- 0 0 IN IP4 " + std::string(inet_ntoa(local.sin_addr)) + "\r\n";
+    sdp += "s=camera_sdk\r\n";
+    sdp += "c=IN IP4 0.0.0.0\r\n";
+    sdp += "t=0 0\r\n";
+    sdp += "a=control:*\r\n";
+    sdp += "m=video 0 RTP/AVP " + std::to_string(kRtpPayloadType) + "\r\n";
+
+    // 参数集从 extradata 中取出，作为带外参数告知客户端
+    std::string sps, pps, vps;
+    char profile_level_id[8] = "42e01f";
+    size_t pos = 0;
+    const uint8_t* nal = nullptr;
+    size_t nal_size = 0;
+    while (next_annexb_nal(m_extradata.data(), m_extradata.size(), pos, nal, nal_size)) {
+        if (m_codec_id == AV_CODEC_ID_HEVC) {
+            const int type = (nal[0] >> 1) & 0x3F;
+            if (type == 32) vps = base64(nal, nal_size);
+            else if (type == 33) sps = base64(nal, nal_size);
+            else if (type == 34) pps = base64(nal, nal_size);
+        } else {
+            const int type = nal[0] & 0x1F;
+            if (type == 7) {
+                sps = base64(nal, nal_size);
+                if (nal_size >= 4) {
+                    snprintf(profile_level_id, sizeof(profile_level_id), "%02x%02x%02x", nal[1], nal[2], nal[3]);
+                }
+            } else if (type == 8) {
+                pps = base64(nal, nal_size);
+            }
+        }
+    }
+
+    const std::string pt = std::to_string(kRtpPayloadType);
+    if (m_codec_id == AV_CODEC_ID_HEVC) {
+        sdp += "a=rtpmap:" + pt + " H265/90000\r\n";
+        if (!vps.empty() && !sps.empty() && !pps.empty()) {
+            sdp += "a=fmtp:" + pt + " sprop-vps=" + vps + "; sprop-sps=" + sps + "; sprop-pps=" + pps + "\r\n";
+        }
+    } else {
+        sdp += "a=rtpmap:" + pt + " H264/90000\r\n";
+        sdp += "a=fmtp:" + pt + " packetization-mode=1; profile-level-id=" + profile_level_id;
+        if (!sps.empty() && !pps.empty()) {
+            sdp += "; sprop-parameter-sets=" + sps + "," + pps;
+        }
+        sdp += "\r\n";
+    }
+    sdp += "a=control:track0\r\n";
+    return sdp;
+}
+
+void RtspServer::drain_rtcp(int fd)
+{
+    uint8_t buf[1500];
+    for (;;) {
+        sockaddr_in from{};
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr*>(&from), &len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        // 客户端的 RTCP 接收报告只用于会话保活
+        std::lock_guard<std::mutex> lock(m_clients_mutex);
+        for (auto& c : m_clients) {
+            if (!c->tcp && c->setup && c->rtcp_addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+                (c->rtcp_addr.sin_port == from.sin_port || c->rtp_addr.sin_port == from.sin_port)) {
+                c->last_activity_us = now_us();
+            }
+        }
+    }
+}
+
+void RtspServer::expire_clients()
+{
+    const int64_t now = now_us();
+    const int64_t timeout_us = static_cast<int64_t>(RTSP_SERVER_SESSION_TIMEOUT) * 1000000;
+    for (auto it = m_clients.begin(); it != m_clients.end();) {
+        Client& c = **it;
+        const bool timed_out = (now - c.last_activity_us) > timeout_us;
+        if (!c.closing && !timed_out) {
+            ++it;
+            continue;
+        }
+        if (c.playing) {
+            m_playing_count--;
+        }
+        close(c.fd);
+        fprintf(stderr, "[RTSP服务器] 客户端断开%s，剩余 %zu 个\n", timed_out ? " (会话超时)" : "",
+                m_clients.size() - 1);
+        it = m_clients.erase(it);
+    }
+}
+
+void RtspServer::send_frame(const RtpFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    for (auto& cp : m_clients) {
+        Client& c = *cp;
+        if (!c.playing || c.closing) continue;
+        if (c.wait_keyframe) {
+            if (!frame.keyframe) continue;
+            c.wait_keyframe = false;
+        }
+        if (c.tcp) {
+            send_frame_tcp(c, frame);
+        } else {
+            send_frame_udp(c, frame);
+        }
+        // 这一帧丢了：从下一个关键帧恢复，不等完整的 GOP
+        if (c.wait_keyframe && !c.closing) {
+            m_keyframe_wanted = true;
+        }
+    }
+}
+
+void RtspServer::send_frame_udp(Client& c, const RtpFrame& frame)
+{
+    // 一帧的包批量发出 (见 RtpUdpSender)；发送缓冲区满时剩余的包被丢弃，从下一个关键帧恢复
+    if (m_udp_sender.send_frame(m_rtp_fd, c.rtp_addr, frame) < frame.packets.size()) {
+        c.wait_keyframe = true;
+    }
+}
+
+void RtspServer::send_frame_tcp(Client& c, const RtpFrame& frame)
+{
+    if (!flush_pending(c)) {
+        c.wait_keyframe = true;
+        return;
+    }
+    for (const RtpSlice& s : frame.packets) {
+        uint8_t hdr[4] = {'$', static_cast<uint8_t>(c.rtp_channel),
+                          static_cast<uint8_t>(s.size >> 8), static_cast<uint8_t>(s.size)};
+        iovec iov[2];
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = sizeof(hdr);
+        iov[1].iov_base = const_cast<uint8_t*>(frame.data.data() + s.offset);
+        iov[1].iov_len = s.size;
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        ssize_t n = sendmsg(c.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n == static_cast<ssize_t>(sizeof(hdr) + s.size)) {
+            continue;
+        }
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                c.closing = true;
+            }
+            c.wait_keyframe = true;
+            return;
+        }
+        // 只发出一部分：剩余字节必须先发完，否则 interleaved 帧边界会错乱
+        const size_t sent = static_cast<size_t>(n);
+        if (sent < sizeof(hdr)) {
+            c.pending.insert(c.pending.end(), hdr + sent, hdr + sizeof(hdr));
+            c.pending.insert(c.pending.end(), frame.data.begin() + s.offset, frame.data.begin() + s.offset + s.size);
+        } else {
+            const size_t off = s.offset + (sent - sizeof(hdr));
+            c.pending.insert(c.pending.end(), frame.data.begin() + off, frame.data.begin() + s.offset + s.size);
+        }
+        c.wait_keyframe = true;
+        return;
+    }
+}
+
+bool RtspServer::build_telemetry_sei(int64_t time_ms)
+{
+    if (!m_position_source->get_pos_data(m_pos)) {
+        return false;
+    }
+    m_next_telemetry_ms = time_ms + TELEMETRY_INTERVAL_MS;
+
+    char text[128];
+    const size_t len = format_telemetry_text(m_pos, text, sizeof(text));
+    return append_sei_user_data(m_codec_id, TELEMETRY_SEI_UUID,
+                                reinterpret_cast<const uint8_t*>(text), len, m_sei_buf);
+}
+
+bool RtspServer::build_latency_sei(const AVPacket* pkt)
+{
+    LatencyStamp stamp;
+    stamp.capture_us = m_pipeline->get_capture_time_us(pkt->pts, m_enc_time_base);
+    if (stamp.capture_us == AV_NOPTS_VALUE) {
+        return false;
+    }
+    stamp.seq = m_latency_seq++;
+    // 打包后立即发给各客户端
+    stamp.send_us = latency_clock_us();
+    return append_latency_sei(m_codec_id, stamp, m_sei_buf);
+}
+
+void RtspServer::run()
+{
+    m_is_running = true;
+    m_stop_flag = false;
+
+    if (!m_pipeline) {
+        fprintf(stderr, "[RTSP服务器] 错误: 未绑定编码链\n");
+        m_is_running = false;
+        return;
+    }
+
+    AVCodecParameters* enc_par = avcodec_parameters_alloc();
+    if (!enc_par || !m_pipeline->get_codec_parameters(m_output_index, enc_par, &m_enc_time_base)) {
+        fprintf(stderr, "[RTSP服务器] 错误: 编码链未就绪。\n");
+        avcodec_parameters_free(&enc_par);
+        m_pipeline->unregister_consumer(&m_queue_packets);
+        m_is_running = false;
+        return;
+    }
+    m_codec_id = enc_par->codec_id;
+    m_extradata.assign(enc_par->extradata, enc_par->extradata + enc_par->extradata_size);
+    avcodec_parameters_free(&enc_par);
+
+    if (!open_sockets()) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+        close_sockets();
+        m_is_running = false;
+        return;
+    }
+
+    std::random_device rd;
+    const uint32_t ssrc = rd();
+    const uint32_t ts_base = rd();
+    m_packetizer.reset(new RtpPacketizer(m_codec_id, ssrc, kRtpPayloadType));
+    m_packetizer->set_parameter_sets(m_extradata.data(), static_cast<int>(m_extradata.size()));
+    m_control_thread = std::thread(&RtspServer::control_thread_func, this);
+
+    const EncodeProfile& pipe_profile = m_pipeline->get_profile(m_output_index);
+    fprintf(stderr, "[RTSP服务器] 服务已启动: rtsp://<设备IP>:%d/live (%dx%d, %s)\n", m_port,
+            pipe_profile.width, pipe_profile.height, m_codec_id == AV_CODEC_ID_HEVC ? "HEVC" : "H.264");
+
+    AllocationProbe alloc_probe("RtspServer");
+    while (true) {
+        AVPacketPtr pkt_ptr = m_queue_packets.wait_and_pop();
+        if (pkt_ptr == nullptr) {
+            break;
+        }
+        const AVPacket* pkt = pkt_ptr.get();
+        if (m_first_pts == AV_NOPTS_VALUE) {
+            m_first_pts = pkt->pts;
+        }
+        // 没有客户端在播放时不打包；RTP 时间戳仍由 pts 推算，保持连续
+        if (m_playing_count > 0) {
+            const int64_t rel = pkt->pts - m_first_pts;
+            const uint32_t ts = ts_base + static_cast<uint32_t>(av_rescale_q(rel, m_enc_time_base, AVRational{1, 90000}));
+            const int64_t time_ms = av_rescale_q(rel, m_enc_time_base, AVRational{1, 1000});
+            m_sei_buf.clear();
+            bool with_sei = m_position_source && time_ms >= m_next_telemetry_ms && build_telemetry_sei(time_ms);
+            with_sei = (m_latency_stamping && build_latency_sei(pkt)) || with_sei;
+            RtpFramePtr frame = m_packetizer->packetize(pkt->data, static_cast<size_t>(pkt->size), ts,
+                                                        (pkt->flags & AV_PKT_FLAG_KEY) != 0,
+                                                        with_sei ? &m_sei_buf : nullptr);
+            send_frame(*frame);
+        }
+        handle_keyframe_request();
+        alloc_probe.frame_done();
+    }
+
+    m_stop_flag = true;
+    if (m_control_thread.joinable()) {
+        m_control_thread.join();
+    }
+    close_sockets();
+    m_queue_packets.clear();
+    fprintf(stderr, "[RTSP服务器] 服务已停止。\n");
+    m_is_running = false;
+}
@@ -0,0 +1,165 @@
+// --- START OF FILE rtsp_server.h ---
+
+#ifndef RTSP_SERVER_H
+#define RTSP_SERVER_H
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#include <netinet/in.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "app_config.h"
+#include "encode_pipeline.h"
+#include "threadsafe_queue.h"
+#include "osd_manager.h"
+#include "rtp_packetizer.h"
+#include "rtp_udp_sender.h"
+
+/**
+ * @class RtspServer
+ * @brief 内置 RTSP 服务器：客户端直接从相机拉流，不需要外部媒体服务器转发。
+ *
+ * - 支持 OPTIONS/DESCRIBE/SETUP/PLAY/PAUSE/TEARDOWN/GET_PARAMETER，
+ *   传输方式为 RTP over UDP 或 RTP over RTSP (TCP interleaved)。
+ * - 和 RtspStreamer 一样只是编码链的一个数据包消费者：所有客户端共用一路编码输出，
+ *   每帧只打包一次 (RtpPacketizer)，打包结果以引用计数的方式发给每个客户端，不按客户端复制。
+ * - 新客户端从下一个关键帧开始接收；发送缓冲区满的客户端丢弃当前帧，等下一个关键帧再继续，
+ *   不会拖慢其他客户端。
+ *
+ * UDP 方式下每帧的 RTP 包用 sendmmsg (及 UDP GSO) 批量发出，见 RtpUdpSender。
+ *
+ * 线程：控制线程处理连接和 RTSP 请求；run() 所在线程打包并发送媒体数据。
+ * 本机测试：ffplay rtsp://127.0.0.1:8554/live (加 -rtsp_transport tcp 测试 TCP 方式)。
+ */
+class RtspServer {
+public:
+    RtspServer();
+    ~RtspServer();
+
+    // port: RTSP 监听端口；codec: 编码格式，码率按编码格式取默认值 (与 RtspStreamer 相同，可共享编码链)
+    bool prepare(int port, VideoCodec codec = VideoCodec::H264);
+
+    // prepare() 之后有效，用于向控制器申请 (或复用) 编码链
+    const EncodeProfile& get_encode_profile() const { return m_profile; }
+
+    // 绑定编码链并注册数据包队列，必须在 run() 之前在调用线程中完成
+    bool attach_pipeline(std::shared_ptr<EncodePipeline> pipeline);
+    std::shared_ptr<EncodePipeline> get_pipeline() const { return m_pipeline; }
+
+    // 运行中修改码率控制，在下一个关键帧生效
+    bool set_rate_control(const RateControl& rc);
+
+    // 可选：以 SEI 发送遥测数据，必须在 run() 之前设置
+    void set_position_source(std::shared_ptr<OsdManager> osd) { m_position_source = std::move(osd); }
+
+    // 是否把 OSD 烧录到画面中 (默认是)，必须在 prepare() 之前设置
+    void set_osd_burn_in(bool enabled) { m_burn_in_osd = enabled; }
+
+    // 是否使用帧内刷新代替周期 IDR (默认 RTSP_INTRA_REFRESH)，必须在 prepare() 之前设置。
+    // 帧内刷新时新客户端只能等刷新周期完成，因此客户端开始播放时会请求一次 IDR。
+    void set_intra_refresh(bool enabled) { m_intra_refresh = enabled; }
+
+    // 请求编码链在下一帧输出 IDR
+    bool request_keyframe();
+
+    // 每帧插入时延测量 SEI (见 latency_stamp.h)，必须在 run() 之前设置
+    void set_latency_stamping(bool enabled) { m_latency_stamping = enabled; }
+
+    // 打开监听端口、启动控制线程，并在调用线程中分发数据包直到 stop()
+    void run();
+    void stop();
+    bool isRunning() const { return m_is_running; }
+
+    size_t get_client_count() const;
+
+private:
+    struct Client
+    {
+        int fd = -1;
+        std::string session;
+        std::string recv_buf;
+        bool setup = false;
+        bool tcp = false;
+        int rtp_channel = 0;            // TCP interleaved 通道号
+        int rtcp_channel = 1;
+        sockaddr_in rtp_addr{};         // UDP 目的地址
+        sockaddr_in rtcp_addr{};
+        bool playing = false;
+        bool wait_keyframe = true;      // 加入或丢帧后等待下一个关键帧
+        bool closing = false;           // 发送失败或 TEARDOWN，由控制线程关闭
+        std::vector<uint8_t> pending;   // 未发出的字节：只发出一部分的 RTP 包剩余部分和 RTSP 应答
+        int64_t last_activity_us = 0;
+    };
+
+    bool open_sockets();
+    void close_sockets();
+    void control_thread_func();
+    void accept_client();
+    bool read_client(Client& c);
+    bool handle_request(Client& c, const std::string& request);
+    void send_response(Client& c, int cseq, int code, const char* reason,
+                       const std::string& headers = std::string(), const std::string& body = std::string());
+    bool flush_pending(Client& c);
+    std::string build_sdp(const Client& c) const;
+    void drain_rtcp(int fd);
+    void expire_clients();
+
+    void send_frame(const RtpFrame& frame);
+    void send_frame_udp(Client& c, const RtpFrame& frame);
+    void send_frame_tcp(Client& c, const RtpFrame& frame);
+    bool build_telemetry_sei(int64_t time_ms);
+    bool build_latency_sei(const AVPacket* pkt);
+    void handle_keyframe_request();
+
+    std::shared_ptr<EncodePipeline> m_pipeline;
+    EncodeProfile m_profile;
+    size_t m_output_index = 0;
+    int m_port = 0;
+
+    AVCodecID m_codec_id = AV_CODEC_ID_H264;
+    std::vector<uint8_t> m_extradata;
+    AVRational m_enc_time_base{1, 1000000};
+    std::unique_ptr<RtpPacketizer> m_packetizer;
+    RtpUdpSender m_udp_sender;   // 只在 m_clients_mutex 下使用
+    int64_t m_first_pts = AV_NOPTS_VALUE;
+
+    int m_listen_fd = -1;
+    int m_rtp_fd = -1;
+    int m_rtcp_fd = -1;
+    uint16_t m_rtp_port = 0;
+    uint16_t m_rtcp_port = 0;
+
+    // 客户端列表及其套接字写入 (RTSP 应答与 RTP 数据) 都在 m_clients_mutex 下进行
+    std::vector<std::unique_ptr<Client>> m_clients;
+    mutable std::mutex m_clients_mutex;
+    std::atomic<size_t> m_playing_count{0};
+
+    // 有客户端在等待关键帧 (开始播放或丢帧)，由 run() 所在线程限频后向编码链请求 IDR
+    std::atomic<bool> m_keyframe_wanted{false};
+    int64_t m_last_keyframe_request_us = 0;
+
+    std::shared_ptr<OsdManager> m_position_source;
+    bool m_burn_in_osd = true;
+    bool m_intra_refresh = RTSP_INTRA_REFRESH;
+    int64_t m_next_telemetry_ms = 0;
+    std::vector<uint8_t> m_sei_buf;
+    OsdManager::PosData m_pos;
+    bool m_latency_stamping = false;
+    uint32_t m_latency_seq = 0;
+
+    std::thread m_control_thread;
+    std::atomic<bool> m_stop_flag{false};
+    std::atomic<bool> m_is_running{false};
+
+    ThreadSafePacketQueue m_queue_packets;
+};
+
+#endif // RTSP_SERVER_H
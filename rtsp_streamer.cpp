@@ -2,27 +2,24 @@
 
 #include "rtsp_streamer.h"
 #include "app_config.h"
-#include "osd_manager.h"
-#include "zoom_manager.h"
-#include "camera_capture.h"
+#include "h26x_sei.h"
+#include "telemetry_track.h"
+#include "latency_stamp.h"
+#include "alloc_counter.h"
 
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <mutex> 
 #include <cstring>
+#include <algorithm>
 
 extern "C" {
 #include <libavutil/avutil.h>
 #include <libavutil/opt.h>
-#include <libavutil/channel_layout.h> 
-#include <libavutil/hwcontext.h>
+#include <libavutil/time.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libavfilter/avfilter.h>
-#include <libavfilter/buffersrc.h>
-#include <libavfilter/buffersink.h>
-#include <libavutil/frame.h> 
 }
 
 static void print_err_rtsp(int ret, const char* context) {
@@ -31,14 +28,14 @@ static void print_err_rtsp(int ret, const char* context) {
     fprintf(stderr, "[RTSP推流器] FFmpeg 错误 in %s: %s (ret=%d)\n", context, buf, ret);
 }
 
-RtspStreamer::RtspStreamer(CameraCapture* capture_module,
-                           std::shared_ptr<OsdManager> osd_manager,
-                           std::shared_ptr<ZoomManager> zoom_manager)
-    : m_capture_module(capture_module),
-      m_osd_manager(std::move(osd_manager)),
-      m_zoom_manager(std::move(zoom_manager)),
-      m_use_hw(false),
-      m_stop_flag(false),
+// rtmp:// 地址使用 FLV 封装推送，其余按 RTSP 推送
+static bool is_rtmp_url(const std::string& url)
+{
+    return url.compare(0, 7, "rtmp://") == 0 || url.compare(0, 8, "rtmps://") == 0;
+}
+
+RtspStreamer::RtspStreamer()
+    : m_stop_flag(false),
       m_is_streaming(false),
       m_pipeline_error(false)
       {}
@@ -48,400 +45,495 @@ RtspStreamer::~RtspStreamer()
     if (m_is_streaming) {
         stop();
     }
-    if (m_thread_filter.joinable()) m_thread_filter.join();
-    if (m_thread_encode.joinable()) m_thread_encode.join();
+    // 确保编码链不再持有本对象内队列的指针
+    if (m_pipeline) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+    }
+    for (auto& d : m_destinations) {
+        d->queue.stop();
+        if (d->thread.joinable()) {
+            d->thread.join();
+        }
+        cleanup_muxer(*d);
+    }
+}
+
+bool RtspStreamer::prepare(const std::string& rtsp_url, VideoCodec codec) {
+    RtspStreamConfig config;
+    config.url = rtsp_url;
+    return prepare(config, codec);
+}
+
+bool RtspStreamer::prepare(const std::vector<std::string>& urls, VideoCodec codec) {
+    if (urls.empty()) {
+        std::cerr << "错误: RTSP URL 不能为空。" << std::endl;
+        return false;
+    }
+    RtspStreamConfig config;
+    config.url = urls[0];
+    config.mirror_urls.assign(urls.begin() + 1, urls.end());
+    return prepare(config, codec);
 }
 
-bool RtspStreamer::prepare(const std::string& rtsp_url) {
-    if (rtsp_url.empty()) {
+bool RtspStreamer::prepare(const RtspStreamConfig& config, VideoCodec codec) {
+    if (config.url.empty() ||
+        std::any_of(config.mirror_urls.begin(), config.mirror_urls.end(), [](const std::string& u) { return u.empty(); })) {
         std::cerr << "错误: RTSP URL 不能为空。" << std::endl;
         return false;
     }
-    m_rtsp_url = rtsp_url;
+    if (config.width <= 0 || config.height <= 0 || (config.width % 2) || (config.height % 2) || config.fps < 0) {
+        fprintf(stderr, "[RTSP推流器] 错误: 无效的推流参数 %dx%d@%d\n", config.width, config.height, config.fps);
+        return false;
+    }
+    m_urls.assign(1, config.url);
+    m_urls.insert(m_urls.end(), config.mirror_urls.begin(), config.mirror_urls.end());
+    m_profile.width = config.width;
+    m_profile.height = config.height;
+    m_profile.fps = (config.fps > 0 && config.fps < V4L2_INPUT_FPS) ? config.fps : 0;
+
+    int64_t bit_rate = config.bit_rate;
+    if (bit_rate <= 0) {
+        // 默认码率按面积相对主码流缩放
+        const int64_t main_rate = (codec == VideoCodec::HEVC) ? RTSP_HEVC_BITRATE : RTSP_BITRATE;
+        bit_rate = main_rate * config.width * config.height / (RTSP_OUTPUT_WIDTH * RTSP_OUTPUT_HEIGHT);
+        if (m_profile.fps > 0) {
+            bit_rate = bit_rate * m_profile.fps / V4L2_INPUT_FPS;
+        }
+        bit_rate = std::max<int64_t>(bit_rate, RTSP_MIN_BITRATE);
+    }
+    m_profile.rate_control.bit_rate = bit_rate;
+    if (config.gop_size > 0) {
+        m_profile.rate_control.gop_size = config.gop_size;
+    } else {
+        m_profile.rate_control.gop_size = m_profile.fps > 0
+            ? std::max(1, RTSP_GOP_SIZE * m_profile.fps / V4L2_INPUT_FPS) : RTSP_GOP_SIZE;
+    }
+    m_profile.encoder_name = video_codec_encoder_candidates(codec);
+    m_profile.use_case = EncodeUseCase::LowLatency;
+    m_profile.burn_in_osd = m_burn_in_osd;
+    m_profile.intra_refresh = m_intra_refresh;
     return true;
 }
 
+bool RtspStreamer::attach_pipeline(std::shared_ptr<EncodePipeline> pipeline)
+{
+    if (!pipeline) {
+        return false;
+    }
+    int idx = pipeline->find_compatible_output(m_profile);
+    if (idx < 0 || !pipeline->register_consumer(&m_queue_packets, static_cast<size_t>(idx))) {
+        return false;
+    }
+    m_output_index = static_cast<size_t>(idx);
+    m_pipeline = std::move(pipeline);
+    return true;
+}
+
+bool RtspStreamer::request_keyframe()
+{
+    if (!m_pipeline) {
+        return false;
+    }
+    m_pipeline->request_keyframe(m_output_index);
+    return true;
+}
+
+bool RtspStreamer::set_rate_control(const RateControl& rc)
+{
+    if (!m_pipeline) {
+        return false;
+    }
+    return m_pipeline->set_rate_control(m_output_index, rc);
+}
+
 void RtspStreamer::stop() { 
     fprintf(stderr, "[RTSP推流器] 收到停止信号...\n");
     m_stop_flag = true;
-    m_queue_decoded_frames.stop();
-    m_queue_filtered_frames.stop();
+    if (m_pipeline) {
+        m_pipeline->unregister_consumer(&m_queue_packets);
+    } else {
+        m_queue_packets.stop();
+    }
 }
 bool RtspStreamer::isStreaming() const { return m_is_streaming; }
 
-bool RtspStreamer::initialize_ffmpeg()
+bool RtspStreamer::initialize_muxer(Destination& d)
 {
-    fprintf(stderr, "[RTSP推流器] 正在连接到 %s (%dx%d)\n", m_rtsp_url.c_str(), RTSP_OUTPUT_WIDTH, RTSP_OUTPUT_HEIGHT);
+    const EncodeProfile& pipe_profile = m_pipeline->get_profile(m_output_index);
+    fprintf(stderr, "[RTSP推流器] 正在连接到 %s (%dx%d)\n", d.url.c_str(), pipe_profile.width, pipe_profile.height);
     int ret = 0;
 
-    AVBufferRef* hw_device_ctx = m_capture_module->get_hw_device_context();
-    if (hw_device_ctx != nullptr) {
-        fprintf(stderr, "[RTSP推流器] 从采集器获取 RKMPP 硬件设备成功。\n");
-        m_use_hw = true;
-    } else {
-        fprintf(stderr, "[RTSP推流器] 警告: 未获取到 RKMPP 硬件设备, 将回退到纯软件模式。\n");
-        m_use_hw = false;
-    }
-
-    const AVCodec* enc = avcodec_find_encoder_by_name(RTSP_ENCODER_NAME);
-    m_enc_ctx = avcodec_alloc_context3(enc);
-    m_enc_ctx->width = RTSP_OUTPUT_WIDTH;
-    m_enc_ctx->height = RTSP_OUTPUT_HEIGHT;
-    m_enc_ctx->pix_fmt = AV_PIX_FMT_NV12;
-    m_enc_ctx->time_base = {1, 1000000};
-    m_enc_ctx->framerate = {30, 1};
-    m_enc_ctx->bit_rate = RTSP_BITRATE;
-    m_enc_ctx->gop_size = RTSP_GOP_SIZE;
-    m_enc_ctx->max_b_frames = 0;
-
-    if (m_use_hw && hw_device_ctx) {
-         m_enc_ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-    }
-    if ((ret = avcodec_open2(m_enc_ctx, enc, nullptr)) < 0) {
-        print_err_rtsp(ret, "avcodec_open2 for encoder");
+    AVCodecParameters* enc_par = avcodec_parameters_alloc();
+    if (!enc_par || !m_pipeline->get_codec_parameters(m_output_index, enc_par, &d.enc_time_base)) {
+        fprintf(stderr, "[RTSP推流器] 错误: 编码链未就绪。\n");
+        avcodec_parameters_free(&enc_par);
         return false;
     }
 
-    avformat_alloc_output_context2(&m_ofmt_ctx, nullptr, "rtsp", m_rtsp_url.c_str());
-    if (!m_ofmt_ctx) {
-        print_err_rtsp(-1, "avformat_alloc_output_context2 (rtsp)");
+    const bool rtmp = is_rtmp_url(d.url);
+    avformat_alloc_output_context2(&d.ofmt_ctx, nullptr, rtmp ? "flv" : "rtsp", d.url.c_str());
+    if (!d.ofmt_ctx) {
+        print_err_rtsp(-1, rtmp ? "avformat_alloc_output_context2 (flv)" : "avformat_alloc_output_context2 (rtsp)");
+        avcodec_parameters_free(&enc_par);
         return false;
     }
-    if (m_ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
-        m_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-    m_out_stream = avformat_new_stream(m_ofmt_ctx, nullptr);
-    if (!m_out_stream) {
+    d.out_stream = avformat_new_stream(d.ofmt_ctx, nullptr);
+    if (!d.out_stream) {
         fprintf(stderr, "[RTSP推流器] 创建输出流失败\n");
+        avcodec_parameters_free(&enc_par);
         return false;
     }
-    avcodec_parameters_from_context(m_out_stream->codecpar, m_enc_ctx);
-    m_out_stream->time_base = {1, 90000};
+    avcodec_parameters_copy(d.out_stream->codecpar, enc_par);
+    avcodec_parameters_free(&enc_par);
+    // RTP 打包由编码格式决定 (H.264: RFC 6184, HEVC: RFC 7798)，不使用容器标记；FLV 由复用器填写
+    d.out_stream->codecpar->codec_tag = 0;
+    d.out_stream->time_base = rtmp ? AVRational{1, 1000} : AVRational{1, 90000};
 
     AVDictionary* rtsp_opts = nullptr;
-    av_dict_set(&rtsp_opts, "rtsp_transport", RTSP_TRANSPORT, 0);
-    av_dict_set(&rtsp_opts, "muxdelay", "0.1", 0);
+    if (!rtmp) {
+        av_dict_set(&rtsp_opts, "rtsp_transport", RTSP_TRANSPORT, 0);
+        // 套接字读写超时，链路失效时写入报错而不是无限阻塞，从而触发重连
+        av_dict_set_int(&rtsp_opts, "timeout", RTSP_SOCKET_TIMEOUT_US, 0);
+        av_dict_set(&rtsp_opts, "muxdelay", "0.1", 0);
+    }
 
-    if (!(m_ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if ((ret = avio_open(&m_ofmt_ctx->pb, m_rtsp_url.c_str(), AVIO_FLAG_WRITE)) < 0) {
-            print_err_rtsp(ret, "avio_open (rtsp)");
+    if (!(d.ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        AVDictionary* io_opts = nullptr;
+        av_dict_set_int(&io_opts, "rw_timeout", RTSP_SOCKET_TIMEOUT_US, 0);
+        ret = avio_open2(&d.ofmt_ctx->pb, d.url.c_str(), AVIO_FLAG_WRITE, nullptr, &io_opts);
+        av_dict_free(&io_opts);
+        if (ret < 0) {
+            print_err_rtsp(ret, "avio_open2");
             av_dict_free(&rtsp_opts);
             return false;
         }
     }
 
-    if ((ret = avformat_write_header(m_ofmt_ctx, &rtsp_opts)) < 0) {
-        print_err_rtsp(ret, "avformat_write_header (rtsp)");
+    if ((ret = avformat_write_header(d.ofmt_ctx, &rtsp_opts)) < 0) {
+        print_err_rtsp(ret, "avformat_write_header");
         av_dict_free(&rtsp_opts);
         return false;
     }
     av_dict_free(&rtsp_opts);
-    printf("[RTSP推流器] RTSP头已写入，推流开始。\n");
-    return true;
-}
-
-bool RtspStreamer::reconfigure_filters() {
-    avfilter_graph_free(&m_filter_graph);
-    m_filter_graph = avfilter_graph_alloc();
-    if (!m_filter_graph) return false;
+    d.header_written = true;
 
-    AVCodecContext* dec_ctx = m_capture_module->get_decoder_context();
-    AVBufferRef* hw_device_ctx = m_capture_module->get_hw_device_context();
-    if (!dec_ctx) {
-        fprintf(stderr, "[RTSP推流器] 错误: 无法从采集器获取解码器上下文。\n");
+    d.write_pkt = av_packet_alloc();
+    if (!d.write_pkt) {
         return false;
     }
+    printf("[RTSP推流器] %s 头已写入，推流开始。\n", d.url.c_str());
+    return true;
+}
 
-    const AVPixelFormat input_pix_fmt = dec_ctx->pix_fmt;
-    const bool is_input_hw = (input_pix_fmt == AV_PIX_FMT_DRM_PRIME);
-
-    int cx, cy, cw, ch;
-    m_zoom_manager->get_crop_params(cx, cy, cw, ch);
-
-    const AVFilter* buffersrc = avfilter_get_by_name("buffer");
-    const AVFilter* buffersink = avfilter_get_by_name("buffersink");
-    
-    char args[512];
-    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d", 
-             dec_ctx->width, dec_ctx->height, input_pix_fmt, 1, 1000000);
-
-    if (is_input_hw && dec_ctx->hw_frames_ctx) {
-        char hw_frames_ctx_arg[64];
-        snprintf(hw_frames_ctx_arg, sizeof(hw_frames_ctx_arg), ":hw_frames_ctx=%p", (void*)dec_ctx->hw_frames_ctx);
-        strcat(args, hw_frames_ctx_arg);
-    }
-    
-    avfilter_graph_create_filter(&m_buffersrc_ctx, buffersrc, "in", args, nullptr, m_filter_graph);
-    avfilter_graph_create_filter(&m_buffersink_ctx, buffersink, "out", nullptr, nullptr, m_filter_graph);
-    
-    enum AVPixelFormat pix_fmts[] = {AV_PIX_FMT_NV12, AV_PIX_FMT_NONE};
-    av_opt_set_int_list(m_buffersink_ctx, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-
-    char filt_descr[1024];
-    if (m_use_hw) {
-        char rga_part[256];
-        snprintf(rga_part, sizeof(rga_part), "vpp_rkrga=cx=%d:cy=%d:cw=%d:ch=%d:w=%d:h=%d",
-                 cx, cy, cw, ch, RTSP_OUTPUT_WIDTH, RTSP_OUTPUT_HEIGHT);
-        
-        if (is_input_hw) {
-            fprintf(stderr, "[RTSP推流器] 检测到硬件帧输入(DRM_PRIME)，配置零拷贝滤镜路径。\n");
-            snprintf(filt_descr, sizeof(filt_descr), "%s,hwdownload,format=nv12", rga_part);
-        } else {
-            fprintf(stderr, "[RTSP推流器] 检测到软件帧输入，配置 'hwupload' 滤镜路径。\n");
-            snprintf(filt_descr, sizeof(filt_descr), "hwupload,%s,hwdownload,format=nv12", rga_part);
+bool RtspStreamer::write_packet(Destination& d, const AVPacket* pkt)
+{
+    // 加入已在运行的编码链 (或丢弃积压) 时，必须等到关键帧才能开始推流
+    if (d.first_pts == AV_NOPTS_VALUE) {
+        if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+            return true;
         }
-    } else {
-         snprintf(filt_descr, sizeof(filt_descr), "crop=%d:%d:%d:%d,scale=%d:%d,format=nv12",
-                 cw, ch, cx, cy, RTSP_OUTPUT_WIDTH, RTSP_OUTPUT_HEIGHT);
-    }
-
-    AVFilterInOut *outputs = avfilter_inout_alloc();
-    AVFilterInOut *inputs = avfilter_inout_alloc();
-    outputs->name = av_strdup("in");
-    outputs->filter_ctx = m_buffersrc_ctx;
-    inputs->name = av_strdup("out");
-    inputs->filter_ctx = m_buffersink_ctx;
-    int ret = avfilter_graph_parse_ptr(m_filter_graph, filt_descr, &inputs, &outputs, nullptr);
-    avfilter_inout_free(&inputs);
-    avfilter_inout_free(&outputs);
-    if (ret < 0) {
-        print_err_rtsp(ret, "avfilter_graph_parse_ptr");
-        return false;
+        d.first_pts = pkt->pts;
     }
 
-    if (m_use_hw && hw_device_ctx) {
-        for (unsigned i = 0; i < m_filter_graph->nb_filters; ++i) {
-            AVFilterContext* fctx = m_filter_graph->filters[i];
-            const char* filter_name = fctx->filter->name;
-            if (strcmp(filter_name, "hwupload") == 0 || strcmp(filter_name, "vpp_rkrga") == 0) {
-                fctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-                fprintf(stderr, "[RTSP推流器] 已绑定 hw_device_ctx 到 %s 滤镜\n", filter_name);
-            }
+    // 数据包被各目的地址及录制器共享，SEI 只能加在自己的副本上
+    const int64_t time_ms = av_rescale_q(pkt->pts - d.first_pts, d.enc_time_base, AVRational{1, 1000});
+    d.sei_buf.clear();
+    bool with_sei = m_position_source && time_ms >= d.next_telemetry_ms && build_telemetry_sei(d, time_ms);
+    with_sei = (m_latency_stamping && build_latency_sei(d, pkt)) || with_sei;
+    if (with_sei) {
+        if (!packet_with_sei(d.write_pkt, pkt, d.sei_buf)) {
+            fprintf(stderr, "[RTSP推流器] 错误: 插入 SEI 失败\n");
+            return false;
         }
+    } else if (av_packet_ref(d.write_pkt, pkt) < 0) {
+        fprintf(stderr, "[RTSP推流器] 错误: av_packet_ref 失败\n");
+        return false;
+    }
+    d.write_pkt->pts -= d.first_pts;
+    d.write_pkt->dts -= d.first_pts;
+    av_packet_rescale_ts(d.write_pkt, d.enc_time_base, d.out_stream->time_base);
+    d.write_pkt->stream_index = d.out_stream->index;
+
+    // 写入耗时即链路阻塞的时间 (TCP 发送缓冲区满时 av_interleaved_write_frame 会阻塞)
+    const int64_t send_start_us = av_gettime_relative();
+    int ret = av_interleaved_write_frame(d.ofmt_ctx, d.write_pkt);
+    av_packet_unref(d.write_pkt);
+    if (m_congestion && d.index == 0) {
+        m_congestion->on_packet_sent(av_gettime_relative() - send_start_us, d.queue.size());
+    }
+    if (ret < 0) {
+        print_err_rtsp(ret, "av_interleaved_write_frame");
+        return false;
     }
+    return true;
+}
 
-    if ((ret = avfilter_graph_config(m_filter_graph, nullptr)) < 0) {
-        print_err_rtsp(ret, "avfilter_graph_config");
+bool RtspStreamer::build_telemetry_sei(Destination& d, int64_t time_ms)
+{
+    if (!m_position_source->get_pos_data(d.pos)) {
         return false;
     }
+    d.next_telemetry_ms = time_ms + TELEMETRY_INTERVAL_MS;
 
-    fprintf(stderr, "[RTSP推流器] 滤镜图配置完成: \"%s\"\n", filt_descr);
-    return true;
+    char text[128];
+    const size_t len = format_telemetry_text(d.pos, text, sizeof(text));
+    return append_sei_user_data(d.out_stream->codecpar->codec_id, TELEMETRY_SEI_UUID,
+                                reinterpret_cast<const uint8_t*>(text), len, d.sei_buf);
 }
 
-void RtspStreamer::run() {
-    m_is_streaming = true;
-    m_pipeline_error = false;
-    m_stop_flag = false;
+bool RtspStreamer::build_latency_sei(Destination& d, const AVPacket* pkt)
+{
+    LatencyStamp stamp;
+    stamp.capture_us = m_pipeline->get_capture_time_us(pkt->pts, d.enc_time_base);
+    if (stamp.capture_us == AV_NOPTS_VALUE) {
+        return false;
+    }
+    stamp.seq = d.latency_seq++;
+    // 紧接着写入复用器，RTP 打包和发送在 av_interleaved_write_frame 中同步完成
+    stamp.send_us = latency_clock_us();
+    return append_latency_sei(d.out_stream->codecpar->codec_id, stamp, d.sei_buf);
+}
 
-    if (!initialize_ffmpeg()) {
-        fprintf(stderr, "[RTSP推流器] 错误: initialize_ffmpeg 失败\n");
-        cleanup_ffmpeg();
-        m_is_streaming = false;
+void RtspStreamer::update_congestion()
+{
+    const int64_t now_us = av_gettime_relative();
+    if (!m_congestion->update(now_us)) {
         return;
     }
-
-    {
-        std::lock_guard<std::mutex> lock(m_filter_mutex);
-        if (!reconfigure_filters()) {
-            fprintf(stderr, "[RTSP推流器] 错误: 首次配置滤镜图失败\n");
-            cleanup_ffmpeg();
-            m_is_streaming = false;
-            return;
+    // 与录制等共享同一输出时，降级会连带影响对方：回到原参数，不做调整
+    if (m_pipeline->get_consumer_count(m_output_index) > 1) {
+        if (!m_shared_output_logged) {
+            fprintf(stderr, "[RTSP推流器] 编码输出与其他消费者共享，拥塞控制不调整编码参数。\n");
+            m_shared_output_logged = true;
         }
+        m_congestion->reset(now_us);
+    }
+    if (m_congestion->level_index() == m_applied_level) {
+        return;
     }
 
-    m_capture_module->register_consumer(&m_queue_decoded_frames);
-
-    fprintf(stderr, "[RTSP推流器] 启动流水线线程...\n");
-    try {
-        m_thread_filter = std::thread(&RtspStreamer::thread_filter_osd, this);
-        m_thread_encode = std::thread(&RtspStreamer::thread_encode_stream, this);
-    } catch (const std::exception& e) {
-        fprintf(stderr, "[RTSP推流器] 启动线程失败: %s\n", e.what());
-        m_pipeline_error = true;
-        stop();
+    const CongestionController::Level& level = m_congestion->current();
+    RateControl rc = m_pipeline->get_rate_control(m_output_index);
+    if (rc.mode != RateControlMode::CQP && rc.bit_rate > 0 && rc.bit_rate != level.bit_rate) {
+        rc.max_bit_rate = rc.max_bit_rate * level.bit_rate / rc.bit_rate;
+        rc.bit_rate = level.bit_rate;
+        m_pipeline->set_rate_control(m_output_index, rc);
     }
+    m_pipeline->set_output_adaptation(m_output_index, level.width, level.height, level.fps);
+    m_applied_level = m_congestion->level_index();
+}
 
-    if (m_thread_filter.joinable()) m_thread_filter.join();
-    if (m_thread_encode.joinable()) m_thread_encode.join();
+void RtspStreamer::handle_disconnect(Destination& d)
+{
+    fprintf(stderr, "[RTSP推流器] %s 连接中断，%d ms 后重连 (编码链保持运行)。\n", d.url.c_str(), d.reconnect_delay_ms);
+    d.connected = false;
+    d.disconnect_time_us = av_gettime_relative();
+    d.next_reconnect_us = d.disconnect_time_us + static_cast<int64_t>(d.reconnect_delay_ms) * 1000;
+    // 连接已断开，不再发送 TEARDOWN (av_write_trailer)，直接释放复用器
+    d.header_written = false;
+    cleanup_muxer(d);
+}
 
-    fprintf(stderr, "[RTSP推流器] 流水线线程已全部退出。\n");
+bool RtspStreamer::try_reconnect(Destination& d)
+{
+    const int64_t now_us = av_gettime_relative();
+    if (now_us < d.next_reconnect_us) {
+        return false;
+    }
 
-    m_capture_module->unregister_consumer(&m_queue_decoded_frames);
+    if (!initialize_muxer(d)) {
+        d.header_written = false;
+        cleanup_muxer(d);
+        // 指数退避，避免服务器不可用时频繁重连
+        d.reconnect_delay_ms = std::min(d.reconnect_delay_ms * 2, RTSP_RECONNECT_MAX_MS);
+        d.next_reconnect_us = av_gettime_relative() + static_cast<int64_t>(d.reconnect_delay_ms) * 1000;
+        fprintf(stderr, "[RTSP推流器] %s 重连失败，%d ms 后重试。\n", d.url.c_str(), d.reconnect_delay_ms);
+        return false;
+    }
 
-    cleanup_ffmpeg();
-    fprintf(stderr, "[RTSP推流器] 推流结束。\n");
-    m_is_streaming = false;
+    fprintf(stderr, "[RTSP推流器] %s 重连成功 (中断 %.1f 秒)。\n", d.url.c_str(),
+            (av_gettime_relative() - d.disconnect_time_us) / 1e6);
+    d.connected = true;
+    d.reconnect_delay_ms = RTSP_RECONNECT_INITIAL_MS;
+    // 重连期间积压的数据包已经过时，连同当前包一起丢弃；新会话的时间戳从强制的 IDR 开始
+    d.queue.clear();
+    d.first_pts = AV_NOPTS_VALUE;
+    d.next_telemetry_ms = 0;
+    m_pipeline->request_keyframe(m_output_index);
+    return false;
 }
 
-void RtspStreamer::cleanup_ffmpeg() {
-    fprintf(stderr, "[RTSP推流器] 正在清理 FFmpeg 资源...\n");
-
-    if (m_enc_ctx && m_ofmt_ctx && m_out_stream) {
-        AVPacket* outpkt = av_packet_alloc();
-        if (avcodec_send_frame(m_enc_ctx, nullptr) >= 0) {
-            while (avcodec_receive_packet(m_enc_ctx, outpkt) >= 0) {
-                av_packet_rescale_ts(outpkt, m_enc_ctx->time_base, m_out_stream->time_base);
-                outpkt->stream_index = m_out_stream->index;
-                av_interleaved_write_frame(m_ofmt_ctx, outpkt);
-                av_packet_unref(outpkt);
-            }
-        }
-        av_packet_free(&outpkt);
-        av_write_trailer(m_ofmt_ctx);
-    }
-    
-    if (m_ofmt_ctx && !(m_ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-        avio_closep(&m_ofmt_ctx->pb);
-    if (m_ofmt_ctx) avformat_free_context(m_ofmt_ctx);
-    if (m_enc_ctx) avcodec_free_context(&m_enc_ctx);
-    
-    {
-        std::lock_guard<std::mutex> lock(m_filter_mutex);
-        avfilter_graph_free(&m_filter_graph);
-        m_filter_graph = nullptr;
+void RtspStreamer::destination_failed(Destination& d)
+{
+    d.failed = true;
+    d.queue.stop();
+    if (++m_failed_destinations == m_destinations.size()) {
+        m_pipeline_error = true;
+        // 所有目的地址都不可用：仅注销自己，不影响共享同一编码链的录制
+        m_pipeline->unregister_consumer(&m_queue_packets);
     }
-
-    m_queue_decoded_frames.clear();
-    m_queue_filtered_frames.clear();
-    
-    m_ofmt_ctx = nullptr;
-    m_enc_ctx = nullptr;
-    m_out_stream = nullptr;
 }
 
-void RtspStreamer::thread_filter_osd()
+void RtspStreamer::destination_thread_func(Destination& d)
 {
-    fprintf(stderr, "[T1:Filter-RTSP] 滤镜OSD线程启动。\n");
-    AVFrame *filt_frame = av_frame_alloc();
-
-    while (!m_stop_flag && !m_pipeline_error) {
-        AVFramePtr frame_ptr = m_queue_decoded_frames.wait_and_pop();
-        if (frame_ptr == nullptr) {
-            break;
+    d.connected = initialize_muxer(d);
+    if (!d.connected) {
+        d.header_written = false;
+        cleanup_muxer(d);
+        // 多个目的地址时，其中一个暂时连不上不影响其他的启动，按重连流程重试
+        if (!RTSP_RECONNECT_ENABLED || m_destinations.size() == 1) {
+            fprintf(stderr, "[RTSP推流器] 错误: 连接 %s 失败\n", d.url.c_str());
+            destination_failed(d);
+            return;
         }
+        d.disconnect_time_us = av_gettime_relative();
+        d.next_reconnect_us = d.disconnect_time_us + static_cast<int64_t>(d.reconnect_delay_ms) * 1000;
+        fprintf(stderr, "[RTSP推流器] 连接 %s 失败，%d ms 后重试。\n", d.url.c_str(), d.reconnect_delay_ms);
+    }
 
-        // [修复] 时间戳归一化
-        AVFrame* frame = frame_ptr.get();
-        if (m_first_pts == AV_NOPTS_VALUE) {
-            m_first_pts = frame->pts;
+    AllocationProbe alloc_probe("RtspStreamer");
+    while (!m_stop_flag) {
+        AVPacketPtr pkt_ptr = d.queue.wait_and_pop();
+        if (pkt_ptr == nullptr) {
+            break;
         }
-        frame->pts -= m_first_pts;
-
-        if (m_zoom_manager && m_zoom_manager->check_and_reset_change_flag()) {
-            fprintf(stderr, "[T1:Filter-RTSP] 检测到变焦，正在动态重建滤镜图...\n");
-            
-            std::lock_guard<std::mutex> lock(m_filter_mutex);
-            if (!reconfigure_filters()) {
-                fprintf(stderr, "[T1:Filter-RTSP] 错误: 动态重建滤镜失败，正在停止推流。\n");
-                m_pipeline_error = true;
-                break;
-            }
-            fprintf(stderr, "[T1:Filter-RTSP] 滤镜图已成功更新。\n");
+#if RTSP_RECONNECT_ENABLED
+        // 断线期间编码链照常运行，数据包直接丢弃，到重连时间再尝试
+        if (!d.connected && !try_reconnect(d)) {
+            continue;
         }
-        
-        {
-            std::lock_guard<std::mutex> lock(m_filter_mutex);
-            if (m_pipeline_error || !m_buffersrc_ctx) {
-                continue;
-            }
-            if (av_buffersrc_add_frame_flags(m_buffersrc_ctx, frame, 0) < 0) {
-                fprintf(stderr, "[T1:Filter-RTSP] 错误: av_buffersrc_add_frame 失败\n");
-                m_pipeline_error = true;
-                break;
-            }
+#endif
+        if (!write_packet(d, pkt_ptr.get())) {
+#if RTSP_RECONNECT_ENABLED
+            handle_disconnect(d);
+#else
+            destination_failed(d);
+            break;
+#endif
+        } else if (m_congestion && d.index == 0) {
+            update_congestion();
         }
+        alloc_probe.frame_done();
+    }
 
-        while (!m_stop_flag && !m_pipeline_error) {
-            int ret = 0;
-            {
-                std::lock_guard<std::mutex> lock(m_filter_mutex);
-                 if (m_pipeline_error || !m_buffersink_ctx) {
-                    ret = AVERROR_EOF;
-                } else {
-                    ret = av_buffersink_get_frame(m_buffersink_ctx, filt_frame);
-                }
-            }
-
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            }
-            if (ret < 0) {
-                print_err_rtsp(ret, "av_buffersink_get_frame");
-                m_pipeline_error = true;
-                break;
-            }
+    cleanup_muxer(d);
+}
 
-            if (m_osd_manager) {
-                m_osd_manager->blend_osd_on_frame(filt_frame);
+void RtspStreamer::dispatch_packet(const AVPacketPtr& pkt)
+{
+    const bool keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+    for (auto& dp : m_destinations) {
+        Destination& d = *dp;
+        if (d.failed) {
+            continue;
+        }
+        if (d.skip_to_keyframe) {
+            if (!keyframe) {
+                d.dropped_packets++;
+                continue;
             }
+            fprintf(stderr, "[RTSP推流器] %s 从关键帧恢复发送 (丢弃 %llu 个数据包)。\n", d.url.c_str(),
+                    static_cast<unsigned long long>(d.dropped_packets));
+            d.skip_to_keyframe = false;
+            d.dropped_packets = 0;
+        }
+        // 该目的地址跟不上 (链路阻塞)：丢弃它的积压，从下一个关键帧继续，不影响其他目的地址
+        const size_t backlog = d.queue.size();
+        if (backlog >= RTSP_DESTINATION_MAX_QUEUED) {
+            d.queue.clear();
+            d.skip_to_keyframe = true;
+            d.dropped_packets = backlog + 1;
+            fprintf(stderr, "[RTSP推流器] %s 发送积压 %zu 个数据包，丢弃积压并等待关键帧。\n", d.url.c_str(), backlog);
+            continue;
+        }
+        d.queue.push(pkt);
+    }
+}
 
-            AVFrame* filt_frame_copy = av_frame_clone(filt_frame);
-            if (!filt_frame_copy) {
-                 fprintf(stderr, "[T1:Filter-RTSP] 错误: av_frame_clone (filt) 失败\n");
-                 m_pipeline_error = true;
-                 break;
-            }
+void RtspStreamer::run() {
+    m_is_streaming = true;
+    m_pipeline_error = false;
 
-            m_queue_filtered_frames.push(make_avframe_ptr(filt_frame_copy));
-            av_frame_unref(filt_frame);
-        }
+    if (!m_pipeline) {
+        fprintf(stderr, "[RTSP推流器] 错误: 未绑定编码链\n");
+        m_is_streaming = false;
+        return;
     }
 
-    av_frame_free(&filt_frame);
-    m_queue_filtered_frames.stop();
-    fprintf(stderr, "[T1:Filter-RTSP] 滤镜OSD线程退出。\n");
-}
+#if RTSP_ADAPTIVE_ENABLED
+    {
+        const EncodeProfile& profile = m_pipeline->get_profile(m_output_index);
+        RateControl rc = m_pipeline->get_rate_control(m_output_index);
+        CongestionController::Level base{rc.bit_rate > 0 ? rc.bit_rate : profile.rate_control.bit_rate,
+                                         profile.fps, profile.width, profile.height};
+        m_congestion.reset(new CongestionController(base, m_pipeline->can_resize_output(m_output_index)));
+        m_applied_level = 0;
+    }
+#endif
+
+    // 每个目的地址在自己的线程中连接和写入，本线程只负责分发
+    m_failed_destinations = 0;
+    m_destinations.clear();
+    for (size_t i = 0; i < m_urls.size(); ++i) {
+        std::unique_ptr<Destination> d(new Destination());
+        d->url = m_urls[i];
+        d->index = i;
+        m_destinations.push_back(std::move(d));
+    }
+    for (auto& d : m_destinations) {
+        Destination* dest = d.get();
+        dest->thread = std::thread([this, dest]() { destination_thread_func(*dest); });
+    }
+    if (m_destinations.size() > 1) {
+        fprintf(stderr, "[RTSP推流器] 同一路编码推送到 %zu 个目的地址。\n", m_destinations.size());
+    }
 
-void RtspStreamer::thread_encode_stream()
-{
-    fprintf(stderr, "[T2:Encode-RTSP] 编码推流线程启动。\n");
-    AVPacket* outpkt = av_packet_alloc();
-    
-    while (!m_stop_flag && !m_pipeline_error) {
-        AVFramePtr frame_ptr = m_queue_filtered_frames.wait_and_pop();
-        if (frame_ptr == nullptr) {
+    while (true) {
+        AVPacketPtr pkt_ptr = m_queue_packets.wait_and_pop();
+        if (pkt_ptr == nullptr) {
             break;
         }
-
-        AVFrame* frame = frame_ptr.get();
-        if (frame->pts != AV_NOPTS_VALUE) {
-            frame->pts = av_rescale_q(frame->pts, m_buffersink_ctx->inputs[0]->time_base, m_enc_ctx->time_base);
+        if (m_pipeline_error) {
+            continue;
         }
+        dispatch_packet(pkt_ptr);
+    }
 
-        int ret = avcodec_send_frame(m_enc_ctx, frame);
-        if (ret < 0) {
-            print_err_rtsp(ret, "avcodec_send_frame (encoder)");
-            m_pipeline_error = true;
-            break;
+    for (auto& d : m_destinations) {
+        d->queue.stop();
+    }
+    for (auto& d : m_destinations) {
+        if (d->thread.joinable()) {
+            d->thread.join();
         }
+    }
 
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(m_enc_ctx, outpkt);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            }
-            if (ret < 0) {
-                print_err_rtsp(ret, "avcodec_receive_packet (encoder)");
-                m_pipeline_error = true;
-                break;
-            }
+    if (m_pipeline->hasError()) {
+        m_pipeline_error = true;
+    }
 
-            av_packet_rescale_ts(outpkt, m_enc_ctx->time_base, m_out_stream->time_base);
-            outpkt->stream_index = m_out_stream->index;
-            
-            ret = av_interleaved_write_frame(m_ofmt_ctx, outpkt);
-            av_packet_unref(outpkt);
-            if (ret < 0) {
-                print_err_rtsp(ret, "av_interleaved_write_frame (rtsp)");
-                m_pipeline_error = true;
-                break;
-            }
-        }
+    fprintf(stderr, "[RTSP推流器] 推流结束。\n");
+    m_is_streaming = false;
+}
+
+void RtspStreamer::cleanup_muxer(Destination& d) {
+    if (d.ofmt_ctx) {
+        fprintf(stderr, "[RTSP推流器] 正在清理 %s 的复用器资源...\n", d.url.c_str());
     }
 
-    av_packet_free(&outpkt);
-    m_queue_filtered_frames.stop();
-    fprintf(stderr, "[T2:Encode-RTSP] 编码推流线程退出。\n");
+    if (d.ofmt_ctx && d.header_written) {
+        av_write_trailer(d.ofmt_ctx);
+    }
+
+    if (d.ofmt_ctx && !(d.ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&d.ofmt_ctx->pb);
+    if (d.ofmt_ctx) avformat_free_context(d.ofmt_ctx);
+    av_packet_free(&d.write_pkt);
+
+    d.queue.clear();
+
+    d.ofmt_ctx = nullptr;
+    d.out_stream = nullptr;
+    d.header_written = false;
 }
\ No newline at end of file
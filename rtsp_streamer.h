@@ -9,71 +9,173 @@
 #include <memory>
 #include <thread>
 #include <mutex> // [新增] 包含 mutex
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libavfilter/avfilter.h>
-#include <libavutil/hwcontext.h>
 }
 
-#include "osd_manager.h"
-#include "zoom_manager.h"
+#include "encode_pipeline.h"
 #include "threadsafe_queue.h"
+#include "osd_manager.h"
+#include "app_config.h"
+#include "congestion_controller.h"
+
+/**
+ * @brief 一路 RTSP 推流的参数 (主码流 / 子码流)。
+ * 同时启动的多路推流共用一条编码链：采集和裁剪只做一次，每路只多一次缩放和编码。
+ */
+struct RtspStreamConfig
+{
+    std::string url;
+    // 同一编码输出额外推送的目的地址 (例如备份服务器)，每个地址有独立的发送队列和线程
+    std::vector<std::string> mirror_urls;
+    int width = RTSP_OUTPUT_WIDTH;
+    int height = RTSP_OUTPUT_HEIGHT;
+    int fps = 0;            // 0 表示采集帧率
+    int64_t bit_rate = 0;   // 0 表示按编码格式取默认码率 (按面积相对主码流缩放)
+    int gop_size = 0;       // 0 表示 RTSP_GOP_SIZE (按帧率换算，保持相同的关键帧时间间隔)
+};
 
-class CameraCapture;
-
+/**
+ * @class RtspStreamer
+ * @brief RTSP 推流器。
+ *
+ * 只负责 RTSP 复用与发送；裁剪、OSD 和编码由 EncodePipeline 完成，
+ * 因此可以与分辨率相同的 Recorder 共享同一条编码链。
+ *
+ * 设置了位置来源时，每 TELEMETRY_INTERVAL_MS 在一帧的数据前插入一个遥测 SEI
+ * (见 telemetry_track.h)，接收端可以从码流中取出 GPS/速度自行渲染。
+ *
+ * 开启 RTSP_RECONNECT_ENABLED 时，连接中断不会结束推流：编码链继续运行 (断线期间的数据包丢弃)，
+ * 按指数退避重新连接，连上后请求编码器立即输出 IDR，重连耗时只取决于网络。
+ *
+ * 开启 RTSP_ADAPTIVE_ENABLED 时按写入耗时和队列积压做拥塞控制 (见 CongestionController)，
+ * 在不重启推流的情况下逐级降低/恢复码率、帧率和分辨率。编码输出与录制等共享时不做调整。
+ *
+ * 可以把同一路编码推送到多个目的地址 (主/备服务器，rtsp:// 或 rtmp://)：只编码一次，
+ * run() 所在线程把数据包分发到各目的地址自己的有界队列，每个目的地址由独立的线程连接、写入和重连。
+ * 某个目的地址阻塞或断开只会让它自己的队列积压 (超过 RTSP_DESTINATION_MAX_QUEUED 时丢弃积压，
+ * 从下一个关键帧继续)，不会阻塞其他目的地址或让其丢帧。拥塞控制只跟随第一个 (主) 目的地址。
+ */
 class RtspStreamer {
 public:
-    RtspStreamer(CameraCapture* capture_module,
-                 std::shared_ptr<OsdManager> osd_manager,
-                 std::shared_ptr<ZoomManager> zoom_manager);
+    RtspStreamer();
 
     ~RtspStreamer();
 
-    bool prepare(const std::string& rtsp_url);
-    
+    // codec: 编码格式 (H.264 / HEVC)，码率按编码格式取默认值
+    bool prepare(const std::string& rtsp_url, VideoCodec codec = VideoCodec::H264);
+    // 同一路码流推送到多个目的地址，第一个为主目的地址
+    bool prepare(const std::vector<std::string>& urls, VideoCodec codec = VideoCodec::H264);
+    // 指定分辨率/帧率/码率，用于子码流
+    bool prepare(const RtspStreamConfig& config, VideoCodec codec = VideoCodec::H264);
+
+    // prepare() 之后有效，用于向控制器申请 (或复用) 编码链
+    const EncodeProfile& get_encode_profile() const { return m_profile; }
+
+    /**
+     * @brief 绑定编码链并注册数据包队列。
+     * 必须在 run() 之前、在调用线程中同步完成，避免与 stop() 竞争。
+     */
+    bool attach_pipeline(std::shared_ptr<EncodePipeline> pipeline);
+    std::shared_ptr<EncodePipeline> get_pipeline() const { return m_pipeline; }
+
+    // 运行中修改码率控制，在下一个关键帧生效
+    bool set_rate_control(const RateControl& rc);
+
+    // 可选：以 SEI 发送遥测数据 (取自 OsdManager::PosData)，必须在 run() 之前设置
+    void set_position_source(std::shared_ptr<OsdManager> osd) { m_position_source = std::move(osd); }
+
+    // 是否把 OSD 烧录到画面中 (默认是)，必须在 prepare() 之前设置
+    void set_osd_burn_in(bool enabled) { m_burn_in_osd = enabled; }
+
+    // 是否使用帧内刷新代替周期 IDR (默认 RTSP_INTRA_REFRESH)，必须在 prepare() 之前设置
+    void set_intra_refresh(bool enabled) { m_intra_refresh = enabled; }
+
+    // 请求编码链在下一帧输出 IDR (共享编码链时其他消费者也会收到)
+    bool request_keyframe();
+
+    // 每帧插入时延测量 SEI (采集时刻、发送时刻，见 latency_stamp.h)，必须在 run() 之前设置
+    void set_latency_stamping(bool enabled) { m_latency_stamping = enabled; }
+
     void run();
     void stop();
     bool isStreaming() const;
 
 private:
-    void thread_filter_osd();
-    void thread_encode_stream();
-
-    bool initialize_ffmpeg();
-    void cleanup_ffmpeg();
-    bool reconfigure_filters();
-
-    CameraCapture* m_capture_module;
-    std::shared_ptr<OsdManager> m_osd_manager;
-    std::shared_ptr<ZoomManager> m_zoom_manager;
-
-    AVFormatContext *m_ofmt_ctx = nullptr;
-    AVCodecContext *m_enc_ctx = nullptr;
-    AVFilterGraph *m_filter_graph = nullptr;
-    AVFilterContext *m_buffersrc_ctx = nullptr;
-    AVFilterContext *m_buffersink_ctx = nullptr;
-    
-    std::string m_rtsp_url;
-    AVStream *m_out_stream = nullptr;
-    
-    // [新增] 用于消费者内部的时间戳归一化
-    int64_t m_first_pts = AV_NOPTS_VALUE;
-
-    bool m_use_hw = false;
+    // 一个推送目的地址：独立的复用器、发送队列、写入线程和重连状态
+    struct Destination
+    {
+        std::string url;
+        size_t index = 0;
+
+        AVFormatContext* ofmt_ctx = nullptr;
+        AVStream* out_stream = nullptr;
+        AVPacket* write_pkt = nullptr;
+        AVRational enc_time_base{1, 1000000};
+        bool header_written = false;
+
+        // 时间戳从该目的地址收到的第一个关键帧开始归零
+        int64_t first_pts = AV_NOPTS_VALUE;
+        int64_t next_telemetry_ms = 0;
+        std::vector<uint8_t> sei_buf;  // 复用的 SEI 缓冲区
+        OsdManager::PosData pos;       // 复用，保留字符串容量
+        uint32_t latency_seq = 0;
+
+        // 断线重连状态 (仅在写入线程中访问)
+        bool connected = false;
+        int reconnect_delay_ms = RTSP_RECONNECT_INITIAL_MS;
+        int64_t next_reconnect_us = 0;
+        int64_t disconnect_time_us = 0;
+        std::atomic<bool> failed{false};   // 不再重连，分发线程跳过
+
+        // 队列溢出后等待关键帧 (仅在分发线程中访问)
+        bool skip_to_keyframe = false;
+        uint64_t dropped_packets = 0;
+
+        ThreadSafePacketQueue queue;
+        std::thread thread;
+    };
+
+    bool initialize_muxer(Destination& d);
+    void cleanup_muxer(Destination& d);
+    bool write_packet(Destination& d, const AVPacket* pkt);
+    bool build_telemetry_sei(Destination& d, int64_t time_ms);
+    bool build_latency_sei(Destination& d, const AVPacket* pkt);
+    void update_congestion();
+    void handle_disconnect(Destination& d);
+    // 到了重连时间则尝试重连；返回 false 表示当前数据包应丢弃
+    bool try_reconnect(Destination& d);
+    void destination_thread_func(Destination& d);
+    void dispatch_packet(const AVPacketPtr& pkt);
+    void destination_failed(Destination& d);
+
+    std::shared_ptr<EncodePipeline> m_pipeline;
+    EncodeProfile m_profile;
+    // 本路推流在编码链中对应的输出序号
+    size_t m_output_index = 0;
+
+    std::vector<std::string> m_urls;
+    std::vector<std::unique_ptr<Destination>> m_destinations;
+    std::atomic<size_t> m_failed_destinations{0};
+
+    std::shared_ptr<OsdManager> m_position_source;
+    bool m_burn_in_osd = true;
+    bool m_intra_refresh = RTSP_INTRA_REFRESH;
+    bool m_latency_stamping = false;
+
+    // 拥塞控制只在主目的地址的写入线程中访问
+    std::unique_ptr<CongestionController> m_congestion;
+    size_t m_applied_level = 0;
+    bool m_shared_output_logged = false;
+
     std::atomic<bool> m_stop_flag{false};
     std::atomic<bool> m_is_streaming{false};
     std::atomic<bool> m_pipeline_error{false};
 
-    std::thread m_thread_filter;
-    std::thread m_thread_encode;
-
-    // [新增] 用于保护滤镜图重建过程的互斥锁
-    std::mutex m_filter_mutex;
-
-    ThreadSafeFrameQueue m_queue_decoded_frames;
-    ThreadSafeFrameQueue m_queue_filtered_frames;
+    ThreadSafePacketQueue m_queue_packets;
 };
 
-#endif // RTSP_STREAMER_H```
\ No newline at end of file
+#endif // RTSP_STREAMER_H
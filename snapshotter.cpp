@@ -5,6 +5,7 @@
 #include "osd_manager.h"
 #include "zoom_manager.h"
 #include "camera_capture.h"
+#include "jpeg_encoder.h"
 
 #include <thread>
 #include <chrono>
@@ -21,7 +22,6 @@ extern "C"
 #include <libavutil/imgutils.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libswscale/swscale.h>
 #include <libavfilter/buffersrc.h>
 #include <libavfilter/buffersink.h>
 }
@@ -140,10 +140,6 @@ void Snapshotter::run()
 {
     AVFramePtr raw_frame_ptr = nullptr;
     AVFrame *processed_frame = nullptr;
-    AVFrame *final_jpeg_frame = nullptr;
-    const AVCodec *jpeg_codec = nullptr;
-    AVCodecContext *jpeg_ctx = nullptr;
-    SwsContext *sws_ctx_to_jpeg = nullptr;
     AVPacket *out_pkt = nullptr;
     
     std::string temp_filename = TEMP_STORAGE_PATH + generate_jpg_timestamp_filename();
@@ -171,6 +167,13 @@ void Snapshotter::run()
             break;
         }
         fprintf(stderr, "[拍照器] 成功获取一帧。\n");
+
+        // 采集帧与流水线共享，在自己的引用上修改时间戳并交给滤镜图
+        raw_frame_ptr = make_avframe_ptr(av_frame_clone(raw_frame_ptr.get()));
+        if (raw_frame_ptr == nullptr) {
+            fprintf(stderr, "[拍照器] 错误: av_frame_clone 失败。\n");
+            break;
+        }
         
         AVFrame* frame = raw_frame_ptr.get();
         frame->pts = 0;
@@ -221,69 +224,28 @@ void Snapshotter::run()
             m_osd_manager->blend_osd_on_frame(processed_frame);
         }
 
-        jpeg_codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
-        if (!jpeg_codec) {
-             std::cerr << "[拍照器] 错误: avcodec_find_encoder (MJPEG) 失败" << std::endl;
-            break;
-        }
-            
-        jpeg_ctx = avcodec_alloc_context3(jpeg_codec);
-        jpeg_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
-        jpeg_ctx->width = JPEG_OUTPUT_WIDTH;
-        jpeg_ctx->height = JPEG_OUTPUT_HEIGHT;
-        jpeg_ctx->time_base = {1, 25};
-        jpeg_ctx->framerate = {25, 1};
-        if (avcodec_open2(jpeg_ctx, jpeg_codec, nullptr) < 0) {
-             std::cerr << "[拍照器] 错误: avcodec_open2 (jpeg) 失败" << std::endl;
-            break;
-        }
-            
-        final_jpeg_frame = av_frame_alloc();
-        final_jpeg_frame->format = jpeg_ctx->pix_fmt;
-        final_jpeg_frame->width = jpeg_ctx->width;
-        final_jpeg_frame->height = jpeg_ctx->height;
-        if (av_frame_get_buffer(final_jpeg_frame, 0) < 0) {
-             std::cerr << "[拍照器] 错误: av_frame_get_buffer (jpeg) 失败" << std::endl;
-            break;
-        }
-            
-        sws_ctx_to_jpeg = sws_getContext(JPEG_OUTPUT_WIDTH, JPEG_OUTPUT_HEIGHT, AV_PIX_FMT_NV12,
-                                         jpeg_ctx->width, jpeg_ctx->height, jpeg_ctx->pix_fmt,
-                                         SWS_BILINEAR, nullptr, nullptr, nullptr);
-        if (!sws_ctx_to_jpeg) {
-             std::cerr << "[拍照器] 错误: sws_getContext (to_jpeg) 失败" << std::endl;
+        out_pkt = av_packet_alloc();
+        if (!out_pkt) break;
+        JpegEncoder jpeg_encoder(JPEG_OUTPUT_WIDTH, JPEG_OUTPUT_HEIGHT);
+        if (!jpeg_encoder.encode(processed_frame, out_pkt)) {
             break;
         }
-            
-        sws_scale(sws_ctx_to_jpeg, processed_frame->data, processed_frame->linesize, 0, JPEG_OUTPUT_HEIGHT, final_jpeg_frame->data, final_jpeg_frame->linesize);
 
-        out_pkt = av_packet_alloc();
-        if (avcodec_send_frame(jpeg_ctx, final_jpeg_frame) == 0) {
-            if (avcodec_receive_packet(jpeg_ctx, out_pkt) == 0) {
-                FILE *f = fopen(temp_filename.c_str(), "wb");
-                if (f) {
-                    fwrite(out_pkt->data, 1, out_pkt->size, f);
-                    fclose(f);
-                    printf("[拍照器] 成功保存快照至: %s\n", temp_filename.c_str());
-                    if (m_on_complete_cb) m_on_complete_cb(temp_filename);
-                    success = true;
-                } else {
-                    std::cerr << "[拍照器] 错误: fopen 失败: " << strerror(errno) << std::endl;
-                }
-            } else {
-                 std::cerr << "[拍照器] 错误: avcodec_receive_packet 失败" << std::endl;
-            }
+        FILE *f = fopen(temp_filename.c_str(), "wb");
+        if (f) {
+            fwrite(out_pkt->data, 1, out_pkt->size, f);
+            fclose(f);
+            printf("[拍照器] 成功保存快照至: %s\n", temp_filename.c_str());
+            if (m_on_complete_cb) m_on_complete_cb(temp_filename);
+            success = true;
         } else {
-            std::cerr << "[拍照器] 错误: avcodec_send_frame 失败" << std::endl;
+            std::cerr << "[拍照器] 错误: fopen 失败: " << strerror(errno) << std::endl;
         }
     } while (false);
 
     cleanup_filter_graph();
     av_packet_free(&out_pkt);
-    sws_freeContext(sws_ctx_to_jpeg);
-    av_frame_free(&final_jpeg_frame);
     av_frame_free(&processed_frame);
-    avcodec_free_context(&jpeg_ctx);
     
     if (!success) {
         fprintf(stderr, "[拍照器] 拍照任务失败，未保存文件。\n");
@@ -0,0 +1,242 @@
+// --- START OF FILE storage_manager.cpp ---
+
+#include "storage_manager.h"
+#include "app_config.h"
+#include "recording_index.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+StorageManager::StorageManager() {}
+
+StorageManager::~StorageManager() {
+    stop();
+}
+
+void StorageManager::start() {
+    if (m_worker_thread.joinable()) {
+        return;
+    }
+    // 扫描在调用线程中完成，之后的 add_file 都是增量的
+    scan_directory();
+    update_quota();
+    m_stop_flag = false;
+    m_worker_thread = std::thread(&StorageManager::worker_thread_func, this);
+    printf("[存储管理器] 后台线程已启动: %zu 个录像, 已用 %llu MB, 配额 %llu MB\n", m_entries.size(),
+           (unsigned long long)(m_used_bytes / (1024 * 1024)), (unsigned long long)(m_quota_bytes / (1024 * 1024)));
+}
+
+void StorageManager::stop() {
+    if (m_stop_flag.exchange(true)) {
+        return;
+    }
+    m_cv.notify_one();
+    if (m_worker_thread.joinable()) {
+        m_worker_thread.join();
+    }
+    printf("[存储管理器] 后台线程已停止。\n");
+}
+
+bool StorageManager::is_managed_file(const std::string& filename) {
+    // 只淘汰录像分段；照片等其他文件通过 statvfs 的剩余空间间接计入
+    static const std::string ext = ".mp4";
+    return filename.size() > ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+std::string StorageManager::lock_path(const std::string& filename) {
+    return FINAL_STORAGE_PATH + filename + STORAGE_LOCK_SUFFIX;
+}
+
+void StorageManager::scan_directory() {
+    DIR* dir = opendir(FINAL_STORAGE_PATH);
+    if (!dir) {
+        fprintf(stderr, "[存储管理器] 警告: 无法打开存储目录 %s (%s)\n", FINAL_STORAGE_PATH, strerror(errno));
+        return;
+    }
+
+    std::deque<Entry> entries;
+    uint64_t used = 0;
+    struct dirent* de;
+    while ((de = readdir(dir)) != nullptr) {
+        std::string name = de->d_name;
+        if (!is_managed_file(name)) continue;
+
+        struct stat st;
+        if (stat((FINAL_STORAGE_PATH + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        bool locked = access(lock_path(name).c_str(), F_OK) == 0;
+        entries.push_back({name, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime), locked});
+        used += st.st_size;
+    }
+    closedir(dir);
+
+    // 文件名以时间戳开头，修改时间相同时按名称排序
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.mtime != b.mtime ? a.mtime < b.mtime : a.filename < b.filename;
+    });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.swap(entries);
+    m_used_bytes = used;
+}
+
+void StorageManager::update_quota() {
+    struct statvfs vfs;
+    if (statvfs(FINAL_STORAGE_PATH, &vfs) != 0) {
+        return;
+    }
+    // 可用于录像的空间 = 录像已用 + 剩余 - 预留 (其他文件占用的空间自然被排除在外)
+    const uint64_t avail = static_cast<uint64_t>(vfs.f_bavail) * vfs.f_frsize;
+    const uint64_t used = m_used_bytes;
+    uint64_t capacity = used + avail > STORAGE_RESERVED_BYTES ? used + avail - STORAGE_RESERVED_BYTES : 0;
+    if (STORAGE_QUOTA_BYTES > 0) {
+        capacity = std::min<uint64_t>(capacity, STORAGE_QUOTA_BYTES);
+    }
+    m_quota_bytes = capacity;
+}
+
+void StorageManager::evict_if_needed() {
+    // 提前腾出 STORAGE_EVICTION_HEADROOM_BYTES，新分段写入时无需等待淘汰
+    const uint64_t quota = m_quota_bytes;
+    const uint64_t target = quota > STORAGE_EVICTION_HEADROOM_BYTES ? quota - STORAGE_EVICTION_HEADROOM_BYTES : 0;
+
+    while (m_used_bytes > target && !m_stop_flag) {
+        Entry victim;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = std::find_if(m_entries.begin(), m_entries.end(), [this](const Entry& e) {
+                return !e.locked && m_pinned.find(e.filename) == m_pinned.end();
+            });
+            if (it == m_entries.end()) {
+                fprintf(stderr, "[存储管理器] 警告: 空间不足，但剩余录像均已锁定或正在读取，无法淘汰。\n");
+                return;
+            }
+            victim = *it;
+            m_entries.erase(it);
+            m_used_bytes -= victim.size;
+        }
+
+        // 删除文件在锁外进行，不阻塞 add_file/lock_file
+        std::string path = FINAL_STORAGE_PATH + victim.filename;
+        if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+            fprintf(stderr, "[存储管理器] 错误: 删除 %s 失败 (%s)\n", path.c_str(), strerror(errno));
+        } else {
+            printf("[存储管理器] 已淘汰最旧的录像: %s (%llu MB)\n", victim.filename.c_str(),
+                   (unsigned long long)(victim.size / (1024 * 1024)));
+        }
+        // 伴随的关键帧索引一起删除
+        unlink(recording_index_path(path).c_str());
+        if (m_on_evict_cb) {
+            m_on_evict_cb(victim.filename);
+        }
+    }
+}
+
+void StorageManager::add_file(const std::string& path) {
+    const char* slash = strrchr(path.c_str(), '/');
+    std::string name = slash ? slash + 1 : path;
+    if (!is_managed_file(name)) return;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        fprintf(stderr, "[存储管理器] 警告: 无法获取文件大小: %s\n", path.c_str());
+        return;
+    }
+    bool locked = access(lock_path(name).c_str(), F_OK) == 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_entries.begin(), m_entries.end(), [&](const Entry& e) { return e.filename == name; });
+        if (it != m_entries.end()) {
+            m_used_bytes -= it->size;
+            m_entries.erase(it);
+        }
+        m_entries.push_back({name, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime), locked});
+        m_used_bytes += st.st_size;
+        m_check_requested = true;
+    }
+    m_cv.notify_one();
+}
+
+bool StorageManager::lock_file(const std::string& filename) {
+    if (filename.empty() || filename.find('/') != std::string::npos) return false;
+
+    int fd = open(lock_path(filename).c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[存储管理器] 错误: 无法创建锁文件 %s (%s)\n", lock_path(filename).c_str(), strerror(errno));
+        return false;
+    }
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& e : m_entries) {
+        if (e.filename == filename) e.locked = true;
+    }
+    printf("[存储管理器] 已锁定: %s\n", filename.c_str());
+    return true;
+}
+
+void StorageManager::pin_files(const std::vector<std::string>& filenames) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& name : filenames) {
+        m_pinned[name]++;
+    }
+}
+
+void StorageManager::unpin_files(const std::vector<std::string>& filenames) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& name : filenames) {
+            auto it = m_pinned.find(name);
+            if (it != m_pinned.end() && --it->second <= 0) {
+                m_pinned.erase(it);
+            }
+        }
+        // 读取期间可能积压了需要淘汰的空间
+        m_check_requested = true;
+    }
+    m_cv.notify_one();
+}
+
+bool StorageManager::unlock_file(const std::string& filename) {
+    if (filename.empty() || filename.find('/') != std::string::npos) return false;
+
+    if (unlink(lock_path(filename).c_str()) != 0 && errno != ENOENT) {
+        fprintf(stderr, "[存储管理器] 错误: 无法删除锁文件 %s (%s)\n", lock_path(filename).c_str(), strerror(errno));
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& e : m_entries) {
+            if (e.filename == filename) e.locked = false;
+        }
+        m_check_requested = true;
+    }
+    m_cv.notify_one();
+    printf("[存储管理器] 已解锁: %s\n", filename.c_str());
+    return true;
+}
+
+void StorageManager::worker_thread_func() {
+    while (!m_stop_flag) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // 新文件登记或解锁时立即检查，否则定期检查 (其他程序也可能占用存储空间)
+            m_cv.wait_for(lock, std::chrono::milliseconds(STORAGE_CHECK_INTERVAL_MS),
+                          [this] { return m_check_requested || m_stop_flag; });
+            m_check_requested = false;
+        }
+        if (m_stop_flag) break;
+
+        update_quota();
+        evict_if_needed();
+    }
+    printf("[存储管理器] 工作线程正在退出循环。\n");
+}
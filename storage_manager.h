@@ -0,0 +1,98 @@
+// --- START OF FILE storage_manager.h ---
+
+#ifndef STORAGE_MANAGER_H
+#define STORAGE_MANAGER_H
+
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @class StorageManager
+ * @brief 管理最终存储目录 (FINAL_STORAGE_PATH) 的空间，实现循环录制。
+ *
+ * - 启动时扫描一次目录，之后由 FileManager 在每次移动完成后通知新增文件，增量统计已用空间。
+ * - 后台线程提前淘汰最旧的未锁定录像，使已用空间保持在 (配额 - 预留余量) 以下，
+ *   淘汰从不发生在写文件的路径上。
+ * - 锁定的文件 (事件片段) 不会被淘汰。锁定以同名的 ".lock" 文件持久化，重启后仍然有效。
+ * - 正在被读取的文件 (片段导出的源分段) 用 pin_files 标记，读取结束前同样不会被淘汰。
+ */
+class StorageManager {
+public:
+    StorageManager();
+    ~StorageManager();
+
+    // 扫描存储目录并启动后台淘汰线程
+    void start();
+
+    // 请求停止后台线程并等待其结束
+    void stop();
+
+    /**
+     * @brief 登记一个已经移动到存储目录的文件 (线程安全)。
+     * @param path 文件的完整路径。
+     */
+    void add_file(const std::string& path);
+
+    /**
+     * @brief 锁定/解锁一个文件，防止其被淘汰 (线程安全)。
+     * 文件尚未移动到存储目录时也可以锁定 (例如正在录制的分段)。
+     * @param filename 文件名 (不含目录)。
+     */
+    bool lock_file(const std::string& filename);
+    bool unlock_file(const std::string& filename);
+
+    /**
+     * @brief 标记/取消标记正在被读取的文件，标记期间不会被淘汰 (线程安全)。
+     * 只在内存中计数，不持久化，也不影响 lock_file 的锁定；同一文件可被多个读取者标记，需成对调用。
+     * @param filenames 文件名 (不含目录)。
+     */
+    void pin_files(const std::vector<std::string>& filenames);
+    void unpin_files(const std::vector<std::string>& filenames);
+
+    // 设置录像被淘汰后的回调 (在后台线程中调用)，参数为文件名。必须在 start() 之前设置。
+    void set_evict_callback(std::function<void(const std::string&)> cb) { m_on_evict_cb = std::move(cb); }
+
+    // 已登记文件占用的空间与生效的配额 (字节)
+    uint64_t get_used_bytes() const { return m_used_bytes; }
+    uint64_t get_quota_bytes() const { return m_quota_bytes; }
+
+private:
+    struct Entry {
+        std::string filename;
+        uint64_t size;
+        int64_t mtime;
+        bool locked;
+    };
+
+    void scan_directory();
+    void update_quota();
+    void evict_if_needed();
+    void worker_thread_func();
+    static bool is_managed_file(const std::string& filename);
+    static std::string lock_path(const std::string& filename);
+
+    // 按时间从旧到新排列；新文件总是追加到末尾
+    std::deque<Entry> m_entries;
+    // 正在被读取的文件及读取者个数，受 m_mutex 保护
+    std::map<std::string, int> m_pinned;
+    mutable std::mutex m_mutex;
+
+    std::atomic<uint64_t> m_used_bytes{0};
+    std::atomic<uint64_t> m_quota_bytes{0};
+
+    std::thread m_worker_thread;
+    std::condition_variable m_cv;
+    bool m_check_requested = false;
+    std::atomic<bool> m_stop_flag{false};
+    std::function<void(const std::string&)> m_on_evict_cb;
+};
+
+#endif // STORAGE_MANAGER_H
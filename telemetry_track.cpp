@@ -0,0 +1,123 @@
+// --- START OF FILE telemetry_track.cpp ---
+
+#include "telemetry_track.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+
+const uint8_t TELEMETRY_SEI_UUID[16] = {'Z', 'o', 'o', 'm', 'l', 'e', 'n', 'T',
+                                        'e', 'l', 'e', 'm', 'e', 't', 'r', 'y'};
+
+const char TELEMETRY_TEXT_PREFIX[] = "lat=";
+
+// mov_text 编码器需要一个 ASS 头来生成 tx3g 样本描述 (字体、位置)，文字显示在画面底部
+static const char kAssHeader[] =
+    "[Script Info]\r\n"
+    "ScriptType: v4.00+\r\n"
+    "PlayResX: 384\r\n"
+    "PlayResY: 288\r\n"
+    "\r\n"
+    "[V4+ Styles]\r\n"
+    "Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, BackColour, "
+    "Bold, Italic, Underline, StrikeOut, ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, "
+    "Shadow, Alignment, MarginL, MarginR, MarginV, Encoding\r\n"
+    "Style: Default,Arial,12,&Hffffff,&Hffffff,&H0,&H80000000,0,0,0,0,100,100,0,0,3,1,0,1,10,10,10,0\r\n"
+    "\r\n"
+    "[Events]\r\n"
+    "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\r\n";
+
+size_t format_telemetry_text(const OsdManager::PosData& data, char* buf, size_t size)
+{
+    if (size == 0) return 0;
+    int n = snprintf(buf, size, "%s%.6f,lon=%.6f,speed=%.1f,time=%s", TELEMETRY_TEXT_PREFIX, data.latitude,
+                     data.longitude, data.speed_kmh, data.timestamp.c_str());
+    if (n < 0) {
+        buf[0] = '\0';
+        return 0;
+    }
+    return std::min(static_cast<size_t>(n), size - 1);
+}
+
+TelemetryTextEncoder::~TelemetryTextEncoder()
+{
+    close();
+}
+
+bool TelemetryTextEncoder::open()
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MOV_TEXT);
+    if (!codec) {
+        fprintf(stderr, "[遥测轨道] 错误: FFmpeg 未启用 mov_text 编码器\n");
+        return false;
+    }
+    m_ctx = avcodec_alloc_context3(codec);
+    if (!m_ctx) {
+        return false;
+    }
+    m_ctx->time_base = AVRational{1, 1000};
+    // 由编码器在 avcodec_free_context 时释放
+    m_ctx->subtitle_header = static_cast<uint8_t*>(av_mallocz(sizeof(kAssHeader)));
+    if (!m_ctx->subtitle_header) {
+        close();
+        return false;
+    }
+    memcpy(m_ctx->subtitle_header, kAssHeader, sizeof(kAssHeader));
+    m_ctx->subtitle_header_size = static_cast<int>(sizeof(kAssHeader)) - 1;
+
+    int ret = avcodec_open2(m_ctx, codec, nullptr);
+    if (ret < 0) {
+        char buf[256];
+        av_strerror(ret, buf, sizeof(buf));
+        fprintf(stderr, "[遥测轨道] 错误: 无法打开 mov_text 编码器: %s\n", buf);
+        close();
+        return false;
+    }
+    m_buf.resize(1024);
+    m_ass.resize(256);
+    return true;
+}
+
+void TelemetryTextEncoder::close()
+{
+    avcodec_free_context(&m_ctx);
+}
+
+bool TelemetryTextEncoder::fill_codec_parameters(AVCodecParameters* par) const
+{
+    return m_ctx && avcodec_parameters_from_context(par, m_ctx) >= 0;
+}
+
+bool TelemetryTextEncoder::encode(const char* text, int64_t duration_ms, AVPacket* pkt)
+{
+    if (!m_ctx) {
+        return false;
+    }
+    // ASS 事件行: ReadOrder,Layer,Style,Name,MarginL,MarginR,MarginV,Effect,Text
+    snprintf(m_ass.data(), m_ass.size(), "0,0,Default,,0,0,0,,%s", text);
+
+    AVSubtitleRect rect;
+    memset(&rect, 0, sizeof(rect));
+    rect.type = SUBTITLE_ASS;
+    rect.ass = m_ass.data();
+    AVSubtitleRect* rects[] = {&rect};
+
+    AVSubtitle sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.num_rects = 1;
+    sub.rects = rects;
+    sub.end_display_time = static_cast<uint32_t>(duration_ms);
+
+    int size = avcodec_encode_subtitle(m_ctx, m_buf.data(), static_cast<int>(m_buf.size()), &sub);
+    if (size <= 0 || av_new_packet(pkt, size) < 0) {
+        return false;
+    }
+    memcpy(pkt->data, m_buf.data(), size);
+    pkt->duration = duration_ms;
+    return true;
+}
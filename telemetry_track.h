@@ -0,0 +1,72 @@
+// --- START OF FILE telemetry_track.h ---
+
+#ifndef TELEMETRY_TRACK_H
+#define TELEMETRY_TRACK_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include "osd_manager.h"
+
+/**
+ * @file telemetry_track.h
+ * @brief 把 OsdManager::PosData 作为元数据随视频保存/传输，而不是 (只) 烧录到像素中。
+ *
+ * - MP4：一条 mov_text (tx3g) 字幕轨，每 TELEMETRY_INTERVAL_MS 一个样本，
+ *   播放器可以自行渲染叠加，也可以用 ffprobe/ffmpeg 把数据原样提取出来。
+ * - RTSP：只承载视频，遥测数据以 user data unregistered SEI 插入码流 (见 h26x_sei.h)，
+ *   UUID 为 TELEMETRY_SEI_UUID，负载与字幕文本相同。
+ */
+
+// 遥测 SEI 的 UUID ("ZoomlenTelemetry")
+extern const uint8_t TELEMETRY_SEI_UUID[16];
+
+/**
+ * @brief 一条遥测记录的文本形式，例如 "lat=39.904200,lon=116.407400,speed=35.5,time=2024/01/01 12:00:00"。
+ * 写入调用者提供的缓冲区 (不分配内存)，超长时截断。
+ * @return 文本长度 (不含结尾的 '\0')。
+ */
+size_t format_telemetry_text(const OsdManager::PosData& data, char* buf, size_t size);
+
+// 遥测文本的固定开头；mov_text 样本为 2 字节长度 + 文本，恢复录像时据此从 mdat 中识别字幕样本
+extern const char TELEMETRY_TEXT_PREFIX[];
+
+/**
+ * @class TelemetryTextEncoder
+ * @brief 把遥测文本编码成 mov_text 字幕样本。
+ * 每个复用器一个实例 (只在写文件线程中使用)。
+ */
+class TelemetryTextEncoder
+{
+public:
+    TelemetryTextEncoder() = default;
+    ~TelemetryTextEncoder();
+    TelemetryTextEncoder(const TelemetryTextEncoder&) = delete;
+    TelemetryTextEncoder& operator=(const TelemetryTextEncoder&) = delete;
+
+    bool open();
+    void close();
+    bool is_open() const { return m_ctx != nullptr; }
+
+    // 填充字幕流的编码参数 (含 tx3g 样本描述)
+    bool fill_codec_parameters(AVCodecParameters* par) const;
+
+    /**
+     * @brief 编码一个字幕样本到 pkt (必须是空的数据包)。
+     * pkt->duration 设为 duration_ms (时间基 1/1000)，时间戳由调用者设置。
+     */
+    bool encode(const char* text, int64_t duration_ms, AVPacket* pkt);
+
+private:
+    AVCodecContext* m_ctx = nullptr;
+    std::vector<uint8_t> m_buf;
+    std::vector<char> m_ass;  // 复用的 ASS 事件行缓冲区
+};
+
+#endif // TELEMETRY_TRACK_H
@@ -3,7 +3,7 @@
 #ifndef THREADSAFE_QUEUE_H
 #define THREADSAFE_QUEUE_H
 
-#include <queue>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -13,6 +13,7 @@
 extern "C"
 {
 #include <libavutil/frame.h>
+#include <libavcodec/avcodec.h>
 }
 
 // [重构] 定义一个 AVFrame 的智能指针类型，并附带自定义删除器。
@@ -25,54 +26,78 @@ inline AVFramePtr make_avframe_ptr(AVFrame* frame) {
     return AVFramePtr(frame, [](AVFrame* f){ av_frame_free(&f); });
 }
 
+// [新增] 编码后数据包的智能指针，用于将同一份编码结果分发给多个复用器 (录制/推流)。
+// 多个消费者共享同一个包，消费者不得修改其内容，需要改时间戳时应先 av_packet_ref 一份。
+using AVPacketPtr = std::shared_ptr<AVPacket>;
+
+inline AVPacketPtr make_avpacket_ptr(AVPacket* pkt) {
+    if (!pkt) return nullptr;
+    return AVPacketPtr(pkt, [](AVPacket* p){ av_packet_free(&p); });
+}
+
 
 /**
- * @class ThreadSafeFrameQueue
- * @brief 一个专门为 AVFramePtr (AVFrame的智能指针) 优化的线程安全阻塞队列。
+ * @class ThreadSafeQueue
+ * @brief 一个线程安全的阻塞队列，元素为智能指针 (AVFramePtr / AVPacketPtr)。
+ *
+ * 存储为只增不减的环形缓冲区：容量满时翻倍，之后一直保留，
+ * 稳态下 push/pop 不再分配内存 (std::queue 的 deque 会不断申请/释放分块)。
  */
-class ThreadSafeFrameQueue
+template <typename T>
+class ThreadSafeQueue
 {
 public:
-    ThreadSafeFrameQueue() : m_stop(false) {}
+    ThreadSafeQueue() : m_slots(kInitialCapacity), m_stop(false) {}
 
     /**
-     * @brief 生产者调用：将一个帧推入队列。
-     * @param frame_ptr 指向帧的智能指针。
+     * @brief 生产者调用：将一个元素推入队列。
+     * @param item 指向帧或数据包的智能指针。
      */
-    void push(AVFramePtr frame_ptr)
+    void push(T item)
     {
-        if (!frame_ptr) return;
+        if (!item) return;
         std::lock_guard<std::mutex> lock(m_mutex);
         if (m_stop)
         {
             return;
         }
-        m_queue.push(std::move(frame_ptr)); // [优化] 使用 std::move 提升效率
+        if (m_count == m_slots.size())
+        {
+            grow();
+        }
+        m_slots[(m_head + m_count) % m_slots.size()] = std::move(item);
+        m_count++;
         m_cv.notify_one();
     }
 
     /**
-     * @brief 消费者调用：等待并弹出一个帧。
-     * @return 包含帧的智能指针，或在队列停止时返回 nullptr。
+     * @brief 消费者调用：等待并弹出一个元素。
+     * @return 队首元素，或在队列停止且已取空时返回 nullptr。
      */
-    AVFramePtr wait_and_pop()
+    T wait_and_pop()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         m_cv.wait(lock, [this]
-                  { return !m_queue.empty() || m_stop; });
+                  { return m_count > 0 || m_stop; });
 
-        if (m_stop && m_queue.empty())
-        {
-            return nullptr;
-        }
-        if (m_queue.empty())
+        if (m_count == 0)
         {
             return nullptr;
         }
 
-        AVFramePtr frame_ptr = std::move(m_queue.front()); // [优化] 使用 std::move
-        m_queue.pop();
-        return frame_ptr;
+        T item = std::move(m_slots[m_head]); // 移出后槽位为空，不再持有引用
+        m_head = (m_head + 1) % m_slots.size();
+        m_count--;
+        return item;
+    }
+
+    /**
+     * @brief 当前排队的元素个数 (用于积压统计)。
+     */
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
     }
 
     /**
@@ -86,21 +111,51 @@ public:
     }
 
     /**
-     * @brief 清空队列中的所有帧。
+     * @brief 清空队列中的所有元素。
      */
     inline void clear()
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        // [重构] 无需手动释放，智能指针会自动处理。只需清空队列即可。
-        std::queue<AVFramePtr> empty_queue;
-        m_queue.swap(empty_queue);
+        // [重构] 无需手动释放，智能指针会自动处理。只需清空队列即可 (保留容量)。
+        for (auto& slot : m_slots)
+        {
+            slot = nullptr;
+        }
+        m_head = 0;
+        m_count = 0;
     }
 
 private:
-    std::queue<AVFramePtr> m_queue; // [重构] 存储 AVFramePtr 而不是 AVFrame*
+    static const size_t kInitialCapacity = 16;
+
+    // 容量翻倍，按出队顺序搬到新缓冲区的开头
+    void grow()
+    {
+        std::vector<T> slots(m_slots.size() * 2);
+        for (size_t i = 0; i < m_count; i++)
+        {
+            slots[i] = std::move(m_slots[(m_head + i) % m_slots.size()]);
+        }
+        m_slots.swap(slots);
+        m_head = 0;
+    }
+
+    std::vector<T> m_slots;
+    size_t m_head = 0;
+    size_t m_count = 0;
     mutable std::mutex m_mutex;
     std::condition_variable m_cv;
     std::atomic<bool> m_stop;
 };
 
+/**
+ * @brief 专门存放 AVFramePtr 的队列 (采集 -> 滤镜 -> 编码)。
+ */
+using ThreadSafeFrameQueue = ThreadSafeQueue<AVFramePtr>;
+
+/**
+ * @brief 专门存放 AVPacketPtr 的队列 (编码 -> 复用器)。
+ */
+using ThreadSafePacketQueue = ThreadSafeQueue<AVPacketPtr>;
+
 #endif // THREADSAFE_QUEUE_H
\ No newline at end of file
@@ -0,0 +1,246 @@
+// --- START OF FILE tools/latency_meter.cpp ---
+//
+// 端到端时延测量工具：拉流 (或读取录像文件)，解码并根据时延 SEI (见 latency_stamp.h) 统计各阶段时延。
+//
+// 用法: latency_meter <rtsp_url|文件> [帧数] [udp|tcp]
+//   相机端先执行 "latency on" 再开始推流/服务，例如:
+//     latency_meter rtsp://127.0.0.1:8554/live 600 tcp
+//   时间戳来自单调时钟，必须与相机程序运行在同一设备上。
+//
+// 输出各阶段的 p50/p90/p99/最大值 (毫秒):
+//   采集->发送   裁剪、OSD、编码和发送队列等待 (录像文件中为 采集->写入)
+//   发送->接收   网络传输和接收端的缓冲
+//   接收->解码   解码耗时 (含解码器内部的帧缓冲)
+//   端到端       采集->解码完成，不含曝光和显示
+
+#include "latency_stamp.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+#include <libavutil/avutil.h>
+}
+
+namespace {
+
+struct PendingFrame
+{
+    LatencyStamp stamp;
+    int64_t recv_us = 0;
+};
+
+struct Stage
+{
+    const char* name;
+    std::vector<int64_t> samples;
+};
+
+void print_err(int err, const char* msg)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(err, buf, sizeof(buf));
+    fprintf(stderr, "[时延测量] 错误: %s: %s\n", msg, buf);
+}
+
+void print_stage(Stage& stage)
+{
+    if (stage.samples.empty()) {
+        return;
+    }
+    std::vector<int64_t>& v = stage.samples;
+    std::sort(v.begin(), v.end());
+    auto pct = [&v](double p) {
+        size_t idx = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+        return v[std::min(idx, v.size() - 1)] / 1000.0;
+    };
+    printf("  %-12s p50 %7.1f  p90 %7.1f  p99 %7.1f  最大 %7.1f ms\n", stage.name, pct(0.5), pct(0.9), pct(0.99),
+           v.back() / 1000.0);
+}
+
+// MP4 中的数据包是长度前缀格式，转换为 Annex B 后才能查找 SEI
+AVBSFContext* open_annexb_filter(const AVStream* st)
+{
+    const AVCodecParameters* par = st->codecpar;
+    if (par->extradata_size <= 0 || par->extradata[0] != 1) {
+        return nullptr;
+    }
+    const AVBitStreamFilter* filter =
+        av_bsf_get_by_name(par->codec_id == AV_CODEC_ID_HEVC ? "hevc_mp4toannexb" : "h264_mp4toannexb");
+    AVBSFContext* bsf = nullptr;
+    if (!filter || av_bsf_alloc(filter, &bsf) < 0) {
+        return nullptr;
+    }
+    avcodec_parameters_copy(bsf->par_in, par);
+    bsf->time_base_in = st->time_base;
+    if (av_bsf_init(bsf) < 0) {
+        av_bsf_free(&bsf);
+        return nullptr;
+    }
+    return bsf;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "用法: %s <rtsp_url|文件> [帧数, 默认 600] [udp|tcp]\n", argv[0]);
+        return 1;
+    }
+    const std::string input = argv[1];
+    const long max_frames = (argc > 2) ? std::max(1L, strtol(argv[2], nullptr, 10)) : 600;
+    const char* transport = (argc > 3) ? argv[3] : "tcp";
+
+    avformat_network_init();
+
+    AVFormatContext* ifmt_ctx = nullptr;
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "rtsp_transport", transport, 0);
+    // 不在解复用器中缓冲，数据包到达即交给解码器
+    av_dict_set(&opts, "fflags", "nobuffer", 0);
+    av_dict_set(&opts, "reorder_queue_size", "0", 0);
+    int ret = avformat_open_input(&ifmt_ctx, input.c_str(), nullptr, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        print_err(ret, "avformat_open_input");
+        return 1;
+    }
+
+    // 实时流的参数集已在 SDP 中，不探测码流，否则探测期间缓冲的帧会被计入接收时延
+    const bool live = (ifmt_ctx->iformat->flags & AVFMT_NOFILE) != 0;
+    if (!live && (ret = avformat_find_stream_info(ifmt_ctx, nullptr)) < 0) {
+        print_err(ret, "avformat_find_stream_info");
+        avformat_close_input(&ifmt_ctx);
+        return 1;
+    }
+
+    const int stream_index = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0) {
+        fprintf(stderr, "[时延测量] 错误: 没有视频流\n");
+        avformat_close_input(&ifmt_ctx);
+        return 1;
+    }
+    AVStream* st = ifmt_ctx->streams[stream_index];
+    const AVCodecID codec_id = st->codecpar->codec_id;
+    if (codec_id != AV_CODEC_ID_H264 && codec_id != AV_CODEC_ID_HEVC) {
+        fprintf(stderr, "[时延测量] 错误: 只支持 H.264/HEVC\n");
+        avformat_close_input(&ifmt_ctx);
+        return 1;
+    }
+
+    const AVCodec* decoder = avcodec_find_decoder(codec_id);
+    AVCodecContext* dec_ctx = decoder ? avcodec_alloc_context3(decoder) : nullptr;
+    if (!dec_ctx) {
+        fprintf(stderr, "[时延测量] 错误: 找不到解码器\n");
+        avformat_close_input(&ifmt_ctx);
+        return 1;
+    }
+    avcodec_parameters_to_context(dec_ctx, st->codecpar);
+    // 单线程 + 低延迟：帧级多线程会让每帧多等若干帧才输出
+    dec_ctx->thread_count = 1;
+    dec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    if ((ret = avcodec_open2(dec_ctx, decoder, nullptr)) < 0) {
+        print_err(ret, "avcodec_open2");
+        avcodec_free_context(&dec_ctx);
+        avformat_close_input(&ifmt_ctx);
+        return 1;
+    }
+
+    AVBSFContext* bsf = live ? nullptr : open_annexb_filter(st);
+    AVPacket* pkt = av_packet_alloc();
+    AVPacket* annexb_pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+
+    Stage send_stage{live ? "采集->发送" : "采集->写入", {}};
+    Stage net_stage{"发送->接收", {}};
+    Stage decode_stage{"接收->解码", {}};
+    Stage total_stage{"端到端", {}};
+
+    // 按时间戳把解码输出的帧和数据包中的 SEI 对应起来
+    std::map<int64_t, PendingFrame> pending;
+    std::vector<uint8_t> scratch;
+    long frames = 0;
+    long unstamped = 0;
+    long lost = 0;
+    bool have_seq = false;
+    uint32_t last_seq = 0;
+
+    fprintf(stderr, "[时延测量] 开始统计 %s (%ld 帧)...\n", input.c_str(), max_frames);
+    while (frames < max_frames && av_read_frame(ifmt_ctx, pkt) >= 0) {
+        const int64_t recv_us = latency_clock_us();
+        if (pkt->stream_index != stream_index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        const AVPacket* scan = pkt;
+        if (bsf && av_bsf_send_packet(bsf, pkt) >= 0 && av_bsf_receive_packet(bsf, annexb_pkt) >= 0) {
+            scan = annexb_pkt;
+        }
+        LatencyStamp stamp;
+        if (find_latency_sei(codec_id, scan->data, static_cast<size_t>(scan->size), stamp, scratch)) {
+            if (have_seq && stamp.seq > last_seq + 1) {
+                lost += stamp.seq - last_seq - 1;
+            }
+            have_seq = true;
+            last_seq = stamp.seq;
+            send_stage.samples.push_back(stamp.send_us - stamp.capture_us);
+            if (live) {
+                net_stage.samples.push_back(recv_us - stamp.send_us);
+                pending[scan->pts] = PendingFrame{stamp, recv_us};
+                // 解码器丢弃的帧 (例如起播前的非关键帧) 没有输出，不让记录无限增长
+                if (pending.size() > 64) {
+                    pending.erase(pending.begin());
+                }
+            }
+        } else {
+            unstamped++;
+        }
+
+        if (live) {
+            ret = avcodec_send_packet(dec_ctx, scan);
+            while (ret >= 0 && avcodec_receive_frame(dec_ctx, frame) >= 0) {
+                const int64_t decoded_us = latency_clock_us();
+                auto it = pending.find(frame->best_effort_timestamp);
+                if (it != pending.end()) {
+                    decode_stage.samples.push_back(decoded_us - it->second.recv_us);
+                    total_stage.samples.push_back(decoded_us - it->second.stamp.capture_us);
+                    // 解码输出按时间戳递增，更早的记录不会再用到
+                    pending.erase(pending.begin(), std::next(it));
+                }
+                av_frame_unref(frame);
+            }
+        }
+        av_packet_unref(annexb_pkt);
+        av_packet_unref(pkt);
+        frames++;
+    }
+
+    printf("[时延测量] %ld 帧, 无时延 SEI %ld 帧, 发送端序号缺失 %ld 帧\n", frames, unstamped, lost);
+    print_stage(send_stage);
+    print_stage(net_stage);
+    print_stage(decode_stage);
+    print_stage(total_stage);
+    if (send_stage.samples.empty()) {
+        printf("  没有找到时延 SEI：请先在相机端执行 latency on (camera_sdk_set_latency_sei)，再开始推流/录制。\n");
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&annexb_pkt);
+    av_packet_free(&pkt);
+    av_bsf_free(&bsf);
+    avcodec_free_context(&dec_ctx);
+    avformat_close_input(&ifmt_ctx);
+    avformat_network_deinit();
+    return 0;
+}
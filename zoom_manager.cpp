@@ -2,6 +2,8 @@
 #include "app_config.h"
 
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 /**
  * @file zoom_manager.cpp
@@ -9,61 +11,149 @@
  */
 
 ZoomManager::ZoomManager() {
-    // 使用配置中的传感器分辨率初始化裁剪参数
-    update_crop_params();
+    Motion motion = {m_min_level, m_min_level, 0.0f, now_us(), 0, 0};
+    publish_motion(motion);
+}
+
+int64_t ZoomManager::now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 void ZoomManager::zoom_in() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_level < m_max_level) {
-        m_level += m_step;
-        update_crop_params();
-        m_changed = true; // 设置状态已改变标志
-        printf("[变焦管理器] 变焦级别: %.1fx\n", m_level);
+    if (step_base_level() < m_max_level) {
+        start_motion(std::min(step_base_level() + m_step, m_max_level), ZOOM_STEP_DURATION_MS);
+        printf("[变焦管理器] 变焦级别: %.1fx\n", m_target_level);
     }
 }
 
 void ZoomManager::zoom_out() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_level > m_min_level) {
-        m_level -= m_step;
-        if (m_level < m_min_level) m_level = m_min_level;
-        update_crop_params();
-        m_changed = true; // 设置状态已改变标志
-        printf("[变焦管理器] 变焦级别: %.1fx\n", m_level);
+    if (step_base_level() > m_min_level) {
+        start_motion(std::max(step_base_level() - m_step, m_min_level), ZOOM_STEP_DURATION_MS);
+        printf("[变焦管理器] 变焦级别: %.1fx\n", m_target_level);
     }
 }
 
-void ZoomManager::get_crop_params(int& cx, int& cy, int& cw, int& ch) {
+void ZoomManager::zoom_to(float level, int duration_ms) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    cx = m_crop_x;
-    cy = m_crop_y;
-    cw = m_crop_w;
-    ch = m_crop_h;
+    start_motion(std::max(m_min_level, std::min(level, m_max_level)), duration_ms);
+    printf("[变焦管理器] 变焦到 %.2fx, 时长 %d ms\n", m_target_level, duration_ms);
 }
 
-bool ZoomManager::check_and_reset_change_flag() {
-    // exchange 是一个原子操作, 它会返回 m_changed 的旧值, 并立即将其设为新值 (false)。
-    // 这确保了即使多线程访问，"检查并重置" 这个动作也不会被打断。
-    return m_changed.exchange(false);
+float ZoomManager::step_base_level() const {
+    // 注意: 此函数应在已持有互斥锁的情况下被调用
+    // 连续变焦中没有固定目标，以当前级别为基准；否则从上一次的目标继续累加
+    Motion motion = load_motion();
+    return (motion.velocity != 0.0f) ? level_at(motion, now_us()) : m_target_level;
 }
 
-void ZoomManager::update_crop_params() {
+void ZoomManager::start_motion(float target, int duration_ms) {
     // 注意: 此函数应在已持有互斥锁的情况下被调用
+    // 从当前插值位置出发，动画被打断时画面不会跳变
+    int64_t now = now_us();
+    Motion motion = {level_at(load_motion(), now), target, 0.0f, now, std::max(duration_ms, 0) * 1000LL, 0};
+    m_target_level = target;
+    publish_motion(motion);
+}
+
+void ZoomManager::set_zoom_velocity(float levels_per_sec) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int64_t now = now_us();
+    float current = level_at(load_motion(), now);
+    Motion motion = {current, current, levels_per_sec, now, 0, 0};
+    m_target_level = current;
+    publish_motion(motion);
+    printf("[变焦管理器] 连续变焦速度: %.2fx/s\n", levels_per_sec);
+}
+
+float ZoomManager::get_level() const {
+    return level_at(load_motion(), now_us());
+}
+
+void ZoomManager::get_crop_params(int& cx, int& cy, int& cw, int& ch) const {
+    compute_crop(get_level(), cx, cy, cw, ch);
+}
+
+void ZoomManager::get_crop_params_at(int64_t time_us, int& cx, int& cy, int& cw, int& ch, uint32_t* generation) const {
+    Motion motion = load_motion();
+    compute_crop(level_at(motion, time_us), cx, cy, cw, ch);
+    if (generation) {
+        *generation = motion.generation;
+    }
+}
+
+std::chrono::steady_clock::time_point ZoomManager::get_last_change_time() const {
+    return std::chrono::steady_clock::time_point(std::chrono::microseconds(load_motion().start_us));
+}
+
+ZoomManager::Motion ZoomManager::load_motion() const {
+    Motion motion;
+    uint32_t seq_begin, seq_end;
+    do {
+        seq_begin = m_seq.load(std::memory_order_acquire);
+        motion.from_level = m_from_level.load(std::memory_order_relaxed);
+        motion.to_level = m_to_level.load(std::memory_order_relaxed);
+        motion.velocity = m_velocity.load(std::memory_order_relaxed);
+        motion.start_us = m_start_us.load(std::memory_order_relaxed);
+        motion.duration_us = m_duration_us.load(std::memory_order_relaxed);
+        motion.generation = m_generation.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq_end = m_seq.load(std::memory_order_relaxed);
+    } while ((seq_begin & 1) || seq_begin != seq_end);
+    return motion;
+}
+
+void ZoomManager::publish_motion(const Motion& motion) {
+    // 注意: 此函数应在已持有 m_mutex 的情况下被调用 (构造函数除外)
+    uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_from_level.store(motion.from_level, std::memory_order_relaxed);
+    m_to_level.store(motion.to_level, std::memory_order_relaxed);
+    m_velocity.store(motion.velocity, std::memory_order_relaxed);
+    m_start_us.store(motion.start_us, std::memory_order_relaxed);
+    m_duration_us.store(motion.duration_us, std::memory_order_relaxed);
+    m_generation.store(m_generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    m_seq.store(seq + 2, std::memory_order_release);
+}
+
+float ZoomManager::level_at(const Motion& motion, int64_t time_us) const {
+    // 运动开始前的帧 (采集早于请求) 保持起始级别
+    double elapsed = std::max<int64_t>(time_us - motion.start_us, 0) / 1e6;
+
+    float level;
+    if (motion.velocity != 0.0f) {
+        level = motion.from_level + motion.velocity * static_cast<float>(elapsed);
+    } else if (motion.duration_us <= 0 || elapsed * 1e6 >= motion.duration_us) {
+        level = motion.to_level;
+    } else {
+        // 在对数空间插值 (视觉上匀速的缩放)，并用 smoothstep 缓入缓出
+        double s = elapsed * 1e6 / motion.duration_us;
+        s = s * s * (3.0 - 2.0 * s);
+        level = static_cast<float>(motion.from_level * std::pow(motion.to_level / motion.from_level, s));
+    }
+    return std::max(m_min_level, std::min(level, m_max_level));
+}
+
+void ZoomManager::compute_crop(float level, int& cx, int& cy, int& cw, int& ch) const {
     int src_w = V4L2_INPUT_WIDTH;
     int src_h = V4L2_INPUT_HEIGHT;
 
     // 根据变焦级别计算需要从源图像中裁剪的区域大小
-    m_crop_w = static_cast<int>(src_w / m_level);
-    m_crop_h = static_cast<int>(src_h / m_level);
+    cw = static_cast<int>(src_w / level);
+    ch = static_cast<int>(src_h / level);
     // 计算裁剪区域的左上角坐标，使其居中
-    m_crop_x = (src_w - m_crop_w) / 2;
-    m_crop_y = (src_h - m_crop_h) / 2;
+    cx = (src_w - cw) / 2;
+    cy = (src_h - ch) / 2;
 
     // 确保裁剪参数是偶数，这对于视频处理（特别是YUV格式）很重要
-    m_crop_x &= ~1;
-    m_crop_y &= ~1;
-    m_crop_w &= ~1;
-    m_crop_h &= ~1;
+    cx &= ~1;
+    cy &= ~1;
+    cw &= ~1;
+    ch &= ~1;
 }
 
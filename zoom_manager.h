@@ -5,53 +5,103 @@
 
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 
 /**
  * @class ZoomManager
  * @brief 线程安全地管理数字变焦状态。
  *
- * - 存储当前的变焦级别。
- * - 根据变焦级别计算 RGA 硬件滤镜所需的裁剪参数 (crop parameters)。
- * - 标记变焦状态是否已改变，以通知其他模块（如录制器）更新其配置。
+ * - 变焦以“运动”描述：从某个级别出发，在给定时长内平滑过渡到目标级别，或以恒定速度连续变焦。
+ * - 根据任意时刻 (帧时间戳) 插值出变焦级别，并计算裁剪参数 (crop parameters)。
+ * - 运动参数通过序列锁 (seqlock) 发布，各条流水线每帧读取时无需加锁。
+ *
+ * 时间统一使用 steady_clock 的微秒数 (见 now_us())。
  */
 class ZoomManager {
 public:
     ZoomManager();
 
-    // 增加变焦级别 (放大)
+    // 增加变焦级别 (放大)，在 ZOOM_STEP_DURATION_MS 内平滑过渡一个步长
     void zoom_in();
 
-    // 减小变焦级别 (缩小)
+    // 减小变焦级别 (缩小)，在 ZOOM_STEP_DURATION_MS 内平滑过渡一个步长
     void zoom_out();
-    
+
+    /**
+     * @brief 在 duration_ms 内平滑变焦到目标级别。
+     * @param level 目标级别，会被限制在 [最小级别, 最大级别] 内。
+     * @param duration_ms 过渡时长，<= 0 表示立即跳到目标级别。
+     */
+    void zoom_to(float level, int duration_ms);
+
+    /**
+     * @brief 以恒定速度连续变焦，直到达到边界或再次设置。
+     * @param levels_per_sec 每秒变化的级别数，正数放大、负数缩小，0 表示停在当前级别。
+     */
+    void set_zoom_velocity(float levels_per_sec);
+
+    // 获取当前时刻的变焦级别
+    float get_level() const;
+
     /**
-     * @brief 获取当前的裁剪参数 (线程安全)。
+     * @brief 获取当前时刻的裁剪参数 (线程安全，无锁)。
      * @param cx, cy, cw, ch 用于接收裁剪坐标和尺寸的输出参数。
      */
-    void get_crop_params(int& cx, int& cy, int& cw, int& ch);
+    void get_crop_params(int& cx, int& cy, int& cw, int& ch) const;
 
     /**
-     * @brief 检查变焦级别是否已改变，并原子地重置标志位。
-     * @return 如果自上次检查以来变焦级别已改变，则返回 true。
+     * @brief 获取指定时刻 (帧时间戳) 的插值裁剪参数 (线程安全，无锁)。
+     * @param time_us steady_clock 微秒时间。
+     * @param generation 可选，接收该运动的序号；每次发起新的变焦运动序号加一。
      */
-    bool check_and_reset_change_flag();
+    void get_crop_params_at(int64_t time_us, int& cx, int& cy, int& cw, int& ch, uint32_t* generation = nullptr) const;
+
+    /**
+     * @brief 获取最近一次发起变焦运动的时间 (线程安全)。
+     * 用于统计从变焦请求到新裁剪区域应用到视频帧的延迟。
+     */
+    std::chrono::steady_clock::time_point get_last_change_time() const;
+
+    // 与 get_crop_params_at() 使用同一时钟的当前时间 (微秒)
+    static int64_t now_us();
 
 private:
-    // 根据当前变焦级别更新内部的裁剪参数
-    void update_crop_params();
+    // 一段变焦运动：zoom_to 为 (from -> to, 时长)，连续变焦为 (from, 速度)
+    struct Motion {
+        float from_level;
+        float to_level;
+        float velocity;      // 非 0 时为连续变焦，忽略 to_level/duration_us
+        int64_t start_us;
+        int64_t duration_us;
+        uint32_t generation;
+    };
+
+    float step_base_level() const;
+    void start_motion(float target, int duration_ms);
+    Motion load_motion() const;
+    void publish_motion(const Motion& motion);
+    float level_at(const Motion& motion, int64_t time_us) const;
+    void compute_crop(float level, int& cx, int& cy, int& cw, int& ch) const;
 
     // 成员变量
-    float m_level = 1.0f;              // 当前变焦级别 (1.0x, 1.1x, ...)
     const float m_min_level = 1.0f;    // 最小变焦级别
     const float m_max_level = 8.0f;    // 最大变焦级别
     const float m_step = 0.1f;         // 每次变焦的步长
 
-    // 裁剪参数
-    int m_crop_x, m_crop_y, m_crop_w, m_crop_h;
+    // 写端 (各变焦 API) 之间的互斥；读端不加锁
+    std::mutex m_mutex;
+    // 步进变焦的累计目标，连续点击时从上一次目标继续而不是从插值中途开始
+    float m_target_level = 1.0f;
 
-    // 线程安全相关
-    std::mutex m_mutex;                // 保护所有成员变量的读写
-    std::atomic<bool> m_changed{false};// 变焦状态改变标志
+    // 序列锁：奇数表示写入中，读端在前后序号一致且为偶数时才接受读到的值
+    std::atomic<uint32_t> m_seq{0};
+    std::atomic<float> m_from_level{1.0f};
+    std::atomic<float> m_to_level{1.0f};
+    std::atomic<float> m_velocity{0.0f};
+    std::atomic<int64_t> m_start_us{0};
+    std::atomic<int64_t> m_duration_us{0};
+    std::atomic<uint32_t> m_generation{0};
 };
 
 #endif // ZOOM_MANAGER_H
\ No newline at end of file